@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# run-bench.sh
+# Throughput/latency benchmark for udp-monitor: microbenchmarks, then a
+# load-generator run against a chaos-free (or CHAOS-profiled) server. Every result is one JSON
+# object per line in $LOGDIR/bench-<timestamp>.jsonl.
+#
+# Knobs (environment): CLIENTS, RATE, DURATION, THREADS, WORKERS, SEED,
+# IO_URING=1 (run the server's io_uring backend), CHAOS=FILE (run the
+# server with these chaos profiles instead of none; see README)
+
+set -euo pipefail
+
+SCRIPTDIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+BINDIR="$SCRIPTDIR/../build"
+LOGDIR="$SCRIPTDIR/logs"
+
+CLIENTS="${CLIENTS:-2000}"
+RATE="${RATE:-20000}"
+DURATION="${DURATION:-10}"
+THREADS="${THREADS:-1}"
+WORKERS="${WORKERS:-1}"
+SEED="${SEED:-1}"
+BACKEND=()
+[ "${IO_URING:-0}" = 1 ] && BACKEND=(--io-uring)
+CHAOS_ARGS=(--no-chaos)
+[ -n "${CHAOS:-}" ] && CHAOS_ARGS=(--chaos "$CHAOS")
+
+mkdir -p "$LOGDIR"
+OUT="$LOGDIR/bench-$(date +%Y%m%d-%H%M%S).jsonl"
+
+echo "=== UDP Monitor Benchmark ==="
+pkill udp-monitor-server udp-monitor-client 2>/dev/null || true
+sleep 1
+
+echo "1) Round-trip checks, then microbenchmarks…"
+"$BINDIR/udp-monitor-microbench" --check | tee -a "$OUT"
+"$BINDIR/udp-monitor-microbench" | tee -a "$OUT"
+
+echo "2) Starting server ($WORKERS worker(s), chaos ${CHAOS:-off}, no child clients)…"
+"$BINDIR/udp-monitor-server" --json "${CHAOS_ARGS[@]}" --seed "$SEED" --clients 0 \
+    --workers "$WORKERS" --stats-interval 1 ${BACKEND[@]+"${BACKEND[@]}"} \
+    > "$LOGDIR/bench-server.log" 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+echo "3) Load: $CLIENTS clients, $RATE pings/s for $DURATION s…"
+"$BINDIR/udp-monitor-loadgen" --clients "$CLIENTS" --rate "$RATE" \
+    --duration "$DURATION" --threads "$THREADS" | tee -a "$OUT"
+sleep 1.5
+
+echo "4) Shutting down server…"
+kill -INT $SERVER_PID 2>/dev/null || true
+wait $SERVER_PID 2>/dev/null || true
+
+# the server's last stats line carries its recvmmsg/sendmmsg batch counts
+# (or io_uring_enter calls as uring_enters)
+grep '"event":"stats"' "$LOGDIR/bench-server.log" | tail -n 1 \
+    | sed 's/^{/{"bench":"server_stats",/' | tee -a "$OUT"
+
+echo
+echo "=== Benchmark Complete ==="
+echo "Results: $OUT"
@@ -0,0 +1,417 @@
+// loadgen.c
+// Load generator: thousands of virtual clients doing REGISTER/PING/METRIC
+// against a running udp-monitor-server, spread over a few threads and a
+// few sockets per thread (the server keys clients by pid and address, so
+// many virtual clients can share one socket).
+//
+// Pings use the binary framing; the server echoes the header untouched, so
+// the RTT of every PONG comes from the send timestamp it carries and no
+// per-probe state is kept here. With the server running --no-chaos the RTT
+// percentiles are the latency the server (plus loopback) adds.
+//
+// Virtual clients follow CONTROLs like the real client: each one talks to
+// the port of the lane it is on, so the sockets stay unconnected and every
+// datagram carries its destination.
+//
+// Prints one JSON object with throughput, syscall counts and RTT
+// percentiles, so runs can be diffed or fed to a dashboard.
+
+#define _GNU_SOURCE  // recvmmsg/sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common/histogram.h"
+#include "common/wire.h"
+
+#define BATCH     64
+#define MAX_SOCKS 64
+#define PID_BASE  0x40000000u   // keeps virtual pids clear of real ones
+
+static const char *ADDRESS      = "127.0.0.1";
+static int         PORT         = 5000;
+static int         NUM_CLIENTS  = 1000;
+static int         NUM_THREADS  = 1;
+static int         NUM_SOCKS    = 8;
+static double      RATE         = 10000.0;   // pings per second, all threads
+static double      DURATION_S   = 10.0;
+static int         METRIC_EVERY = 10;        // METRIC after every N PONGs per client
+
+static uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct {
+    uint32_t pongs_since_metric;
+    uint32_t last_rtt_us;
+    int      registered;
+    uint16_t port;           // of the lane it is on, 0 = the door
+    uint32_t ctl_seq;        // newest CONTROL acted on
+} vclient_t;
+
+typedef struct {
+    int id;
+    int nsocks;
+    int fds[MAX_SOCKS];
+    uint32_t first_client, nclients;
+    vclient_t *clients;
+    struct sockaddr_in srv;   // the door; lanes differ only in port
+    pthread_t thread;
+
+    // results
+    uint64_t registered, tx_pings, rx_pongs, tx_metrics, controls, switches, other;
+    uint64_t sendmmsg_calls, recvmmsg_calls, poll_calls;
+    hist_t rtt_us;
+
+    // outgoing batch for one socket
+    int      tx_fd;
+    unsigned tx_count;
+    _Alignas(8) char tx_bufs[BATCH][sizeof(wire_metric_t)];
+    struct iovec   tx_iov[BATCH];
+    struct mmsghdr tx_msgs[BATCH];
+    struct sockaddr_in tx_addr[BATCH];
+
+    _Alignas(8) char rx_bufs[BATCH][256];
+    struct iovec   rx_iov[BATCH];
+    struct mmsghdr rx_msgs[BATCH];
+} lg_thread_t;
+
+// ——— Sending ———
+
+static void tx_flush(lg_thread_t *t) {
+    unsigned done = 0;
+    while (done < t->tx_count) {
+        int m = sendmmsg(t->tx_fd, t->tx_msgs + done, t->tx_count - done, 0);
+        t->sendmmsg_calls++;
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            // EAGAIN: drop the rest, they count as lost
+            break;
+        }
+        done += (unsigned)m;
+    }
+    t->tx_count = 0;
+}
+
+// Clients are split into contiguous blocks per socket, so a round-robin
+// sweep produces long runs on one socket and full sendmmsg() batches.
+static int client_fd(lg_thread_t *t, uint32_t k) {
+    return t->fds[(uint64_t)k * (uint64_t)t->nsocks / t->nclients];
+}
+
+// A buffer for a datagram from client k to port (0 = its lane's).
+static void *tx_slot(lg_thread_t *t, uint32_t k, uint16_t port) {
+    int fd = client_fd(t, k);
+    if (t->tx_count && (t->tx_fd != fd || t->tx_count == BATCH)) tx_flush(t);
+    t->tx_fd = fd;
+    struct sockaddr_in *to = &t->tx_addr[t->tx_count];
+    *to = t->srv;
+    if (!port) port = t->clients[k].port;
+    if (port) to->sin_port = htons(port);
+    return t->tx_bufs[t->tx_count];
+}
+
+static void tx_commit(lg_thread_t *t, size_t len) {
+    unsigned i = t->tx_count++;
+    t->tx_iov[i]  = (struct iovec){ .iov_base = t->tx_bufs[i], .iov_len = len };
+    t->tx_msgs[i] = (struct mmsghdr){ .msg_hdr = {
+        .msg_name = &t->tx_addr[i], .msg_namelen = sizeof(t->tx_addr[i]),
+        .msg_iov = &t->tx_iov[i], .msg_iovlen = 1 } };
+}
+
+static void send_register(lg_thread_t *t, uint32_t k) {
+    wire_ping_t *m = tx_slot(t, k, (uint16_t)PORT);   // always at the door
+    wire_hdr_init(&m->h, WIRE_REGISTER, PID_BASE + t->first_client + k, 0, get_now_ns());
+    tx_commit(t, sizeof(*m));
+}
+
+static void send_ping(lg_thread_t *t, uint32_t k, uint32_t seq) {
+    wire_ping_t *m = tx_slot(t, k, 0);
+    wire_hdr_init(&m->h, WIRE_PING, PID_BASE + t->first_client + k, seq, get_now_ns());
+    tx_commit(t, sizeof(*m));
+    t->tx_pings++;
+}
+
+static void send_metric(lg_thread_t *t, uint32_t k, vclient_t *vc) {
+    wire_metric_t *m = tx_slot(t, k, 0);
+    wire_hdr_init(&m->h, WIRE_METRIC, PID_BASE + t->first_client + k, 0, get_now_ns());
+    m->rtt_us    = htole32(vc->last_rtt_us);
+    m->jitter_us = 0;
+    m->loss      = 0;
+    m->reserved  = 0;
+    tx_commit(t, sizeof(*m));
+    t->tx_metrics++;
+}
+
+// ——— Receiving ———
+
+static void handle_reply(lg_thread_t *t, const char *buf, size_t n, uint64_t now) {
+    const wire_hdr_t *h = wire_view(buf, n);
+    if (!h) {
+        t->other++;
+        return;
+    }
+    uint32_t k = le32toh(h->pid) - PID_BASE - t->first_client;
+    switch (h->type) {
+        case WIRE_PONG: {
+            uint64_t rtt_ns = now - le64toh(h->ts_ns);
+            hist_record(&t->rtt_us, rtt_ns / 1000);
+            t->rx_pongs++;
+            if (k < t->nclients && METRIC_EVERY > 0) {
+                vclient_t *vc = &t->clients[k];
+                vc->last_rtt_us = (uint32_t)(rtt_ns / 1000);
+                if (++vc->pongs_since_metric >= (uint32_t)METRIC_EVERY) {
+                    vc->pongs_since_metric = 0;
+                    send_metric(t, k, vc);
+                }
+            }
+            break;
+        }
+        case WIRE_REGISTER_ACK:
+            if (k < t->nclients && !t->clients[k].registered) {
+                t->clients[k].registered = 1;
+                t->registered++;
+            }
+            break;
+        case WIRE_CONTROL: {
+            // each seq is acted on once; every copy is acknowledged from
+            // the lane the client ends up on
+            t->controls++;
+            if (k >= t->nclients || n < sizeof(wire_control_t)) break;
+            const wire_control_t *ctl = (const wire_control_t *)h;
+            vclient_t *vc = &t->clients[k];
+            uint32_t seq  = le32toh(h->seq);
+            uint16_t port = le16toh(ctl->port);
+            int fresh = seq == 0 || (int32_t)(seq - vc->ctl_seq) > 0;
+            if (fresh && seq) vc->ctl_seq = seq;
+            if (fresh && port && port != (vc->port ? vc->port : PORT)) {
+                vc->port = port;
+                t->switches++;
+            }
+            if (seq) {
+                wire_control_t *ack = tx_slot(t, k, 0);
+                *ack = *ctl;
+                wire_hdr_init(&ack->h, WIRE_CONTROL_ACK, le32toh(h->pid), seq, now);
+                tx_commit(t, sizeof(*ack));
+            }
+            break;
+        }
+        default:
+            t->other++;
+            break;
+    }
+}
+
+// Drain every socket once, waiting up to wait_ms for the first datagram.
+static void rx_poll(lg_thread_t *t, int wait_ms) {
+    struct pollfd pfds[MAX_SOCKS];
+    for (int i = 0; i < t->nsocks; i++)
+        pfds[i] = (struct pollfd){ .fd = t->fds[i], .events = POLLIN };
+    t->poll_calls++;
+    if (poll(pfds, (nfds_t)t->nsocks, wait_ms) <= 0) return;
+
+    for (int i = 0; i < t->nsocks; i++) {
+        if (!(pfds[i].revents & POLLIN)) continue;
+        for (;;) {
+            for (int j = 0; j < BATCH; j++) {
+                t->rx_iov[j] = (struct iovec){ .iov_base = t->rx_bufs[j], .iov_len = sizeof(t->rx_bufs[j]) };
+                t->rx_msgs[j].msg_hdr = (struct msghdr){ .msg_iov = &t->rx_iov[j], .msg_iovlen = 1 };
+            }
+            int got = recvmmsg(t->fds[i], t->rx_msgs, BATCH, MSG_DONTWAIT, NULL);
+            t->recvmmsg_calls++;
+            if (got <= 0) break;
+            uint64_t now = get_now_ns();
+            for (int j = 0; j < got; j++)
+                handle_reply(t, t->rx_bufs[j], t->rx_msgs[j].msg_len, now);
+            if (got < BATCH) break;
+        }
+    }
+    if (t->tx_count) tx_flush(t);   // METRICs queued by the replies
+}
+
+// ——— Thread body ———
+
+static void *lg_main(void *arg) {
+    lg_thread_t *t = arg;
+
+    // 1) register every virtual client a batch at a time so the server's
+    //    receive queue is not flooded; resend the unacked ones until 2 s pass
+    uint64_t give_up = get_now_ns() + 2000000000ull;
+    while (t->registered < t->nclients && get_now_ns() < give_up) {
+        for (uint32_t k = 0; k < t->nclients; k++) {
+            if (t->clients[k].registered) continue;
+            send_register(t, k);
+            if (t->tx_count == BATCH) {
+                tx_flush(t);
+                rx_poll(t, 0);
+            }
+        }
+        if (t->tx_count) tx_flush(t);
+        uint64_t settle = get_now_ns() + 200000000ull;
+        while (t->registered < t->nclients && get_now_ns() < settle) rx_poll(t, 10);
+    }
+
+    // 2) paced pings, round-robin over the virtual clients
+    double   rate  = RATE / NUM_THREADS;
+    uint64_t start = get_now_ns();
+    uint64_t end   = start + (uint64_t)(DURATION_S * 1e9);
+    uint32_t next_client = 0, seq = 1;
+    for (uint64_t now = start; now < end; now = get_now_ns()) {
+        uint64_t due = (uint64_t)((double)(now - start) / 1e9 * rate);
+        while (t->tx_pings < due) {
+            send_ping(t, next_client, seq++);
+            if (++next_client == t->nclients) next_client = 0;
+        }
+        if (t->tx_count) tx_flush(t);
+        rx_poll(t, 1);
+    }
+
+    // 3) collect stragglers
+    uint64_t drain = get_now_ns() + 200000000ull;
+    while (get_now_ns() < drain) rx_poll(t, 10);
+    return NULL;
+}
+
+static int open_socket(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int buf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    static struct option long_opts[] = {
+        {"address",      required_argument, 0, 'a'},
+        {"door",         required_argument, 0, 'p'},
+        {"clients",      required_argument, 0, 'c'},
+        {"threads",      required_argument, 0, 'T'},
+        {"sockets",      required_argument, 0, 's'},
+        {"rate",         required_argument, 0, 'r'},
+        {"duration",     required_argument, 0, 'd'},
+        {"metric-every", required_argument, 0, 'm'},
+        {"help",         no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "a:p:c:T:s:r:d:m:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'a': ADDRESS      = optarg;       break;
+            case 'p': PORT         = atoi(optarg); break;
+            case 'c': NUM_CLIENTS  = atoi(optarg); break;
+            case 'T': NUM_THREADS  = atoi(optarg); break;
+            case 's': NUM_SOCKS    = atoi(optarg); break;
+            case 'r': RATE         = atof(optarg); break;
+            case 'd': DURATION_S   = atof(optarg); break;
+            case 'm': METRIC_EVERY = atoi(optarg); break;
+            case 'h':
+            default:
+                printf("Usage: %s [--address IP] [--door PORT] [--clients N] [--threads N] "
+                       "[--sockets N] [--rate PPS] [--duration SEC] [--metric-every N]\n", argv[0]);
+                return (opt=='h') ? 0 : 2;
+        }
+    }
+    if (NUM_THREADS < 1) NUM_THREADS = 1;
+    if (NUM_CLIENTS < NUM_THREADS) NUM_CLIENTS = NUM_THREADS;
+    if (NUM_SOCKS < 1) NUM_SOCKS = 1;
+    if (NUM_SOCKS > MAX_SOCKS) NUM_SOCKS = MAX_SOCKS;
+
+    struct sockaddr_in srv = { .sin_family = AF_INET, .sin_port = htons(PORT) };
+    if (inet_pton(AF_INET, ADDRESS, &srv.sin_addr) != 1) {
+        fprintf(stderr, "bad --address '%s'\n", ADDRESS);
+        return 2;
+    }
+
+    lg_thread_t **threads = calloc((size_t)NUM_THREADS, sizeof(*threads));
+    if (!threads) {
+        perror("calloc");
+        return 1;
+    }
+    uint32_t per = (uint32_t)NUM_CLIENTS / (uint32_t)NUM_THREADS;
+    for (int i = 0; i < NUM_THREADS; i++) {
+        lg_thread_t *t = calloc(1, sizeof(*t));
+        if (!t) {
+            perror("calloc");
+            return 1;
+        }
+        t->id           = i;
+        t->first_client = per * (uint32_t)i;
+        t->srv          = srv;
+        t->nclients     = i == NUM_THREADS - 1 ? (uint32_t)NUM_CLIENTS - t->first_client : per;
+        t->clients      = calloc(t->nclients, sizeof(*t->clients));
+        t->nsocks       = NUM_SOCKS < (int)t->nclients ? NUM_SOCKS : (int)t->nclients;
+        if (!t->clients) {
+            perror("calloc");
+            return 1;
+        }
+        hist_reset(&t->rtt_us);
+        for (int s = 0; s < t->nsocks; s++) {
+            t->fds[s] = open_socket();
+            if (t->fds[s] < 0) return 1;
+        }
+        threads[i] = t;
+    }
+
+    uint64_t t0 = get_now_ns();
+    for (int i = 0; i < NUM_THREADS; i++) {
+        int err = pthread_create(&threads[i]->thread, NULL, lg_main, threads[i]);
+        if (err) {
+            errno = err;
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    uint64_t registered = 0, tx = 0, rx = 0, metrics = 0, controls = 0, switches = 0, other = 0;
+    uint64_t n_send = 0, n_recv = 0, n_poll = 0;
+    hist_t rtt;
+    hist_reset(&rtt);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        lg_thread_t *t = threads[i];
+        pthread_join(t->thread, NULL);
+        registered += t->registered;
+        tx         += t->tx_pings;
+        rx         += t->rx_pongs;
+        metrics    += t->tx_metrics;
+        controls   += t->controls;
+        switches   += t->switches;
+        other      += t->other;
+        n_send     += t->sendmmsg_calls;
+        n_recv     += t->recvmmsg_calls;
+        n_poll     += t->poll_calls;
+        hist_merge(&rtt, &t->rtt_us);
+    }
+    double elapsed = (double)(get_now_ns() - t0) / 1e9;
+
+    static const double pct[3] = { 50.0, 99.0, 99.9 };
+    uint64_t p[3];
+    const hist_t *hs = &rtt;
+    hist_percentiles(&hs, 1, pct, p, 3);
+
+    printf("{\"bench\":\"loadgen\",\"clients\":%d,\"threads\":%d,\"sockets_per_thread\":%d,\"target_pps\":%.0f,\"duration_s\":%.1f,\"elapsed_s\":%.3f,"
+           "\"registered\":%" PRIu64 ",\"tx_pings\":%" PRIu64 ",\"rx_pongs\":%" PRIu64 ",\"lost\":%" PRIu64 ",\"tx_metrics\":%" PRIu64 ",\"controls\":%" PRIu64 ",\"lane_switches\":%" PRIu64 ",\"other\":%" PRIu64 ","
+           "\"pps_tx\":%.0f,\"pps_rx\":%.0f,"
+           "\"syscalls\":{\"sendmmsg\":%" PRIu64 ",\"recvmmsg\":%" PRIu64 ",\"poll\":%" PRIu64 "},"
+           "\"rtt_us\":{\"p50\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}}\n",
+           NUM_CLIENTS, NUM_THREADS, NUM_SOCKS, RATE, DURATION_S, elapsed,
+           registered, tx, rx, tx > rx ? tx - rx : 0, metrics, controls, switches, other,
+           tx / DURATION_S, rx / DURATION_S,
+           n_send, n_recv, n_poll,
+           p[0], p[1], p[2], rtt.max);
+    return 0;
+}
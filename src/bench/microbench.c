@@ -0,0 +1,730 @@
+// microbench.c
+// Microbenchmarks for the server's per-packet work: message parsing, the
+// lane decision, the statistics it maintains, and the logging pipeline.
+//
+// Each benchmark prints one JSON line (name, iterations, ns/op, ops/s), so
+// results can be collected by scripts/run-bench.sh and compared over time.
+//
+// --check instead runs the round-trip checks: encode known input, decode it
+// back and compare, damaged input included. Each prints one JSON line
+// (name, ok) and the details of any failure go to stderr; the exit status
+// is 1 if one failed.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/histogram.h"
+#include "common/log.h"
+#include "common/metrics_file.h"
+#include "common/winstats.h"
+#include "common/wire.h"
+#include "server/chaos.h"
+#include "server/client_table.h"
+#include "server/lane_policy.h"
+#include "server/parse.h"
+#include "server/relay.h"
+
+static uint64_t ITERS = 2000000;
+static const char *FILTER = NULL;
+
+// results land here so the compiler cannot drop the benchmarked work
+static volatile uint64_t sink;
+
+static uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64: cheap, deterministic inputs
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// extra is either "" or further JSON members starting with a comma
+static void report_extra(const char *name, uint64_t iters, uint64_t elapsed_ns, const char *extra) {
+    double ns_per_op = (double)elapsed_ns / (double)iters;
+    printf("{\"bench\":\"%s\",\"iters\":%" PRIu64 ",\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f%s}\n",
+           name, iters, ns_per_op, ns_per_op > 0 ? 1e9 / ns_per_op : 0.0, extra);
+    fflush(stdout);
+}
+
+static void report(const char *name, uint64_t iters, uint64_t elapsed_ns) {
+    report_extra(name, iters, elapsed_ns, "");
+}
+
+static int selected(const char *name) {
+    return !FILTER || strstr(name, FILTER);
+}
+
+// ——— Checks ———
+
+static int check_failures;   // of the check running now
+
+#define CHECK(cond) check_that((cond), #cond, __LINE__)
+
+static int check_that(int ok, const char *what, int line) {
+    if (!ok) {
+        fprintf(stderr, "microbench.c:%d: check failed: %s\n", line, what);
+        check_failures++;
+    }
+    return ok;
+}
+
+// ——— Parsing ———
+
+static void bench_parse_text_metric(void) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "METRIC pid=%d rtt=%.1f loss=%d jitter=%.1f", 12345, 42.7, 1, 13.2);
+    msg_t m;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        msg_parse(buf, strlen(buf), &m);
+        sink += (uint64_t)m.pid;
+    }
+    report("parse_text_metric", ITERS, get_now_ns() - t0);
+}
+
+static void bench_parse_binary_metric(void) {
+    wire_metric_t buf;
+    wire_hdr_init(&buf.h, WIRE_METRIC, 12345, 7, 1);
+    buf.rtt_us    = htole32(42700);
+    buf.jitter_us = htole32(13200);
+    buf.loss      = htole32(1);
+    buf.reserved  = 0;
+    msg_t m;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        msg_parse((const char *)&buf, sizeof(buf), &m);
+        sink += (uint64_t)m.loss;
+    }
+    report("parse_binary_metric", ITERS, get_now_ns() - t0);
+}
+
+static void bench_parse_text_ping(void) {
+    char buf[] = "PING seq=123456";
+    msg_t m;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        msg_parse(buf, sizeof(buf) - 1, &m);
+        sink += m.kind;
+    }
+    report("parse_text_ping", ITERS, get_now_ns() - t0);
+}
+
+// ——— Lane decision and statistics ———
+
+static void run_lane_observe(const char *name, const lane_engine_t *engine) {
+    client_table_t t;
+    if (client_table_init(&t, 0, 10) < 0) {
+        perror("client_table_init");
+        return;
+    }
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(40000) };
+    int created;
+    client_t *c = client_table_insert(&t, 1, &addr, &created);
+    uint64_t now = get_now_ns();
+    hist_window_init(&c->rtt_hist, 10000000000ull, now);
+
+    lane_policy_t p;
+    lane_policy_defaults(&p);
+    p.engine = engine;
+    lane_verdict_t v;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        double rtt = (double)(rng() % 150000) / 1000.0;
+        now += 1000000;   // one METRIC per simulated millisecond
+        lane_observe(&p, c, rtt, (int)(rng() % 5 == 0), now, &v);
+        sink += (uint64_t)v.desired;
+    }
+    report(name, ITERS, get_now_ns() - t0);
+    client_table_free(&t);
+}
+
+static void bench_lane_observe(void)        { run_lane_observe("lane_observe", &LANE_ENGINE_STREAK); }
+static void bench_lane_observe_ewma(void)   { run_lane_observe("lane_observe_ewma", &LANE_ENGINE_EWMA); }
+
+static void bench_hist_record(void) {
+    static hist_t h;
+    hist_reset(&h);
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) hist_record(&h, rng() % 200000);
+    report("hist_record", ITERS, get_now_ns() - t0);
+    sink += h.total;
+}
+
+static void bench_winstats_push(void) {
+    const uint32_t cap = 1000;
+    winstats_t w;
+    void *store = malloc(winstats_storage_size(cap));
+    if (!store) {
+        perror("malloc");
+        return;
+    }
+    winstats_init(&w, cap, store);
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) winstats_push(&w, (double)(rng() % 150000) / 1000.0);
+    report("winstats_push_w1000", ITERS, get_now_ns() - t0);
+    sink += (uint64_t)winstats_max(&w);
+    free(store);
+}
+
+// ——— Chaos ———
+// One echo's fate under a busy profile: Gilbert-Elliott loss, a Pareto
+// delay tail, reordering, duplication and a rate limit.
+
+static void bench_chaos_decide(void) {
+    chaos_profile_t p = {
+        .loss_model = CHAOS_LOSS_GILBERT, .ge_p = 0.05, .ge_r = 0.3, .ge_loss_bad = 0.8,
+        .delay_model = CHAOS_DELAY_PARETO, .delay_a = 20.0, .delay_b = 10.0,
+        .reorder = 0.05, .reorder_ms = 30.0, .duplicate = 0.01,
+        .rate_pps = 500000.0, .burst = 1000.0
+    };
+    chaos_rng_t r;
+    chaos_rng_seed(&r, 1);
+    uint64_t now = get_now_ns();
+    chaos_lane_state_t st;
+    chaos_state_init(&st, &p, now);
+    chaos_verdict_t v;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        now += 1000;   // one echo per simulated microsecond
+        chaos_decide(&p, &st, &r, now, &v);
+        sink += v.delay_ns + (uint64_t)v.drop;
+    }
+    report("chaos_decide", ITERS, get_now_ns() - t0);
+}
+
+// ——— Recording ———
+// METRICs from 1000 clients about 20 µs apart, appended to a segment in a
+// scratch directory (block encoding included), then scanned back.
+
+static void record_fill(mf_writer_t *w, uint64_t n) {
+    uint64_t ts = 1700000000000000000ull;
+    for (uint64_t i = 0; i < n; i++) {
+        ts += 10000 + rng() % 20000;
+        mf_sample_t m = {
+            .ts_ns = ts, .pid = 40000 + (uint32_t)(rng() % 1000), .lane = (uint8_t)(rng() % 3),
+            .rtt_us = 20000 + (uint32_t)(rng() % 130000), .loss = rng() % 8 == 0,
+            .jitter_us = (uint32_t)(rng() % 30000)
+        };
+        mf_append(w, &m);
+    }
+}
+
+static int record_open(mf_writer_t *w, char *dir) {
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return -1;
+    }
+    if (mf_writer_open(w, dir, 0, (size_t)MF_DEFAULT_SEGMENT_MB << 20) < 0) {
+        perror(dir);
+        rmdir(dir);
+        return -1;
+    }
+    return 0;
+}
+
+static void record_remove(mf_writer_t *w, char *dir) {
+    unlink(w->path);
+    rmdir(dir);
+    free(w);
+}
+
+static void bench_record_append(void) {
+    char dir[] = "/tmp/udpmon-bench-XXXXXX";
+    mf_writer_t *w = malloc(sizeof(*w));
+    if (!w || record_open(w, dir) < 0) {
+        free(w);
+        return;
+    }
+    // one segment's worth at most, so the timing never includes a rollover
+    uint64_t n = ITERS < 4000000 ? ITERS : 4000000;
+    uint64_t t0 = get_now_ns();
+    record_fill(w, n);
+    mf_flush(w);
+    uint64_t elapsed = get_now_ns() - t0;
+    size_t bytes = w->off;
+    mf_writer_close(w);
+    char extra[64];
+    snprintf(extra, sizeof(extra), ",\"bytes_per_sample\":%.2f", (double)bytes / (double)n);
+    report_extra("record_append", n, elapsed, extra);
+    record_remove(w, dir);
+}
+
+static int count_sample(const mf_sample_t *m, void *arg) {
+    *(uint64_t *)arg += m->rtt_us;
+    return 0;
+}
+
+static void bench_record_scan(void) {
+    char dir[] = "/tmp/udpmon-bench-XXXXXX";
+    mf_writer_t *w = malloc(sizeof(*w));
+    if (!w || record_open(w, dir) < 0) {
+        free(w);
+        return;
+    }
+    uint64_t n = ITERS < 4000000 ? ITERS : 4000000;
+    record_fill(w, n);
+    mf_writer_close(w);
+    mf_reader_t r;
+    if (mf_open(&r, w->path) < 0) {
+        perror(w->path);
+        record_remove(w, dir);
+        return;
+    }
+    mf_query_t all = { .pid = -1 };
+    uint64_t sum = 0;
+    uint64_t t0 = get_now_ns();
+    mf_scan(&r, &all, count_sample, &sum, NULL);
+    uint64_t elapsed = get_now_ns() - t0;
+    sink += sum;
+    mf_close(&r);
+    report("record_scan", n, elapsed);
+    record_remove(w, dir);
+}
+
+// Round trip: samples written as blocks, scanned back from the live segment,
+// then from the closed one, then with its last block cut short.
+
+#define CHECK_SAMPLES  (2 * MF_BLOCK_SAMPLES + 452)   // two full blocks and a partial one
+#define CHECK_PENDING  100                            // appended but not flushed
+
+typedef struct {
+    const mf_sample_t *want;
+    uint64_t n, bad;
+} sample_cmp_t;
+
+static int compare_sample(const mf_sample_t *m, void *arg) {
+    sample_cmp_t *c = arg;
+    const mf_sample_t *x = &c->want[c->n++];
+    if (m->ts_ns != x->ts_ns || m->pid != x->pid || m->lane != x->lane || m->probe != x->probe
+        || m->rtt_us != x->rtt_us || m->loss != x->loss || m->jitter_us != x->jitter_us)
+        c->bad++;
+    return 0;
+}
+
+static int record_rescan(mf_reader_t *r, const char *path, const mf_sample_t *want,
+                         sample_cmp_t *c, mf_scan_stats_t *st) {
+    mf_close(r);
+    if (mf_open(r, path) < 0) return -1;
+    mf_query_t all = { .pid = -1, .probes = 1 };
+    *c = (sample_cmp_t){ .want = want };
+    *st = (mf_scan_stats_t){0};
+    return mf_scan(r, &all, compare_sample, c, st);
+}
+
+static void check_record_roundtrip(void) {
+    enum { N = CHECK_SAMPLES + CHECK_PENDING };
+    char dir[] = "/tmp/udpmon-check-XXXXXX";
+    static mf_sample_t want[N];
+    mf_writer_t *w = malloc(sizeof(*w));
+    if (!CHECK(w && record_open(w, dir) == 0)) {
+        free(w);
+        return;
+    }
+
+    // the extremes of each column: the wall clock stepping back, pids
+    // falling, 32-bit maxima, probes on every lane
+    uint64_t ts = 1700000000000000000ull;
+    for (int i = 0; i < N; i++) {
+        ts = i % 97 == 0 ? ts - 5000000 : ts + rng() % 50000000;
+        want[i] = (mf_sample_t){
+            .ts_ns = ts, .pid = i % 11 == 0 ? UINT32_MAX : (uint32_t)(rng() % 4000000),
+            .lane = (uint8_t)(i % 3), .probe = i % 7 == 0,
+            .rtt_us = i % 13 == 0 ? UINT32_MAX : (uint32_t)(rng() % 200000),
+            .loss = (uint32_t)(rng() % 3), .jitter_us = (uint32_t)(rng() % 30000)
+        };
+    }
+    // each append reports the block it completed, and the flush the rest
+    for (int i = 0; i < CHECK_SAMPLES; i++) {
+        int rc = mf_append(w, &want[i]);
+        CHECK(rc == ((i + 1) % MF_BLOCK_SAMPLES ? 0 : MF_BLOCK_SAMPLES));
+    }
+    CHECK(mf_flush(w) == CHECK_SAMPLES - 2 * MF_BLOCK_SAMPLES);
+    CHECK(mf_flush(w) == 0);
+    for (int i = CHECK_SAMPLES; i < N; i++) CHECK(mf_append(w, &want[i]) == 0);
+
+    // a live segment: only what was flushed, through no index block yet
+    mf_reader_t r = {0};
+    sample_cmp_t c;
+    mf_scan_stats_t st;
+    CHECK(record_rescan(&r, w->path, want, &c, &st) == 0);
+    CHECK(c.n == CHECK_SAMPLES && c.bad == 0);
+    CHECK(st.blocks == 3 && st.samples == CHECK_SAMPLES);
+
+    // closed: the pending samples as a fourth block, found through the index
+    CHECK(mf_writer_close(w) == CHECK_PENDING);
+    CHECK(record_rescan(&r, w->path, want, &c, &st) == 0);
+    CHECK(c.n == N && c.bad == 0);
+    CHECK(st.blocks == 4 && st.blocks_read == 4);
+
+    // the last block's jitter column one byte short: the scan visits the
+    // blocks before it and then fails
+    int fd = open(w->path, O_RDWR);
+    struct stat fs;
+    uint8_t *base = fd < 0 || fstat(fd, &fs) < 0 ? MAP_FAILED
+                  : mmap(NULL, (size_t)fs.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (CHECK(base != MAP_FAILED)) {
+        const mf_header_t *h = (const mf_header_t *)base;
+        uint64_t off = (h->header_size + 7) & ~7ull, last = 0;
+        while (off < h->end) {
+            const mf_block_t *b = (const mf_block_t *)(base + off);
+            if (b->magic == MF_BLOCK_DATA) last = off;
+            off += b->len;
+        }
+        uint32_t *col_len = (uint32_t *)((mf_block_t *)(base + last) + 1);
+        col_len[MF_COL_JITTER]--;
+        munmap(base, (size_t)fs.st_size);
+        errno = 0;
+        CHECK(record_rescan(&r, w->path, want, &c, &st) < 0 && errno == EPROTO);
+        CHECK(c.n == CHECK_SAMPLES && c.bad == 0);
+
+        // and a file cut off inside that block is refused, not read past
+        CHECK(ftruncate(fd, (off_t)last + 16) == 0);
+        errno = 0;
+        CHECK(record_rescan(&r, w->path, want, &c, &st) < 0 && errno == EPROTO);
+        CHECK(c.n == 0);
+    }
+    if (fd >= 0) close(fd);
+    mf_close(&r);
+    record_remove(w, dir);
+}
+
+// ——— Relay summaries ———
+// Encoding one client record of a relay summary, pids consecutive as the
+// relay sends them, and decoding it again at the server above.
+
+static _Alignas(8) uint8_t relay_store[1 << 20];   // datagrams of the last summary, back to back
+static size_t   relay_used;
+static uint32_t relay_dgrams;
+
+static void relay_keep(const void *dgram, size_t len, void *arg) {
+    (void)arg;
+    if (relay_used + RELAY_MTU > sizeof(relay_store)) relay_used = 0;
+    memcpy(relay_store + relay_used, dgram, len);
+    relay_used += (len + 7) & ~(size_t)7;   // keeps the next one aligned
+    relay_dgrams++;
+}
+
+static void count_client(void *arg, const relay_client_t *c) {
+    *(uint64_t *)arg += c->p50_us;
+}
+
+static void bench_relay_encode(void) {
+    static relay_enc_t e;
+    relay_enc_init(&e, 1, 0, relay_keep, NULL);
+    // summaries of 10000 clients, so the store always holds a whole one
+    uint64_t n = ITERS / 10000 * 10000;
+    if (!n) n = 10000;
+    uint64_t t0 = get_now_ns(), bytes = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (i % 10000 == 0) {
+            if (i) relay_enc_end(&e);
+            relay_used = 0;
+            relay_enc_begin(&e, (uint32_t)(i / 10000 + 1), t0);
+        }
+        relay_client_t c = { .pid = 100000 + (uint32_t)(i % 10000), .lane = (uint8_t)(i % 3),
+                             .metrics = 10, .losses = (uint32_t)(rng() % 2),
+                             .p50_us = 200 + (uint32_t)(rng() % 50), .p99_us = 900 + (uint32_t)(rng() % 500) };
+        relay_enc_client(&e, &c);
+    }
+    relay_enc_end(&e);
+    uint64_t elapsed = get_now_ns() - t0;
+    bytes = relay_used;
+    char extra[64];
+    snprintf(extra, sizeof(extra), ",\"bytes_per_client\":%.2f", (double)bytes / 10000.0);
+    report_extra("relay_encode", n, elapsed, extra);
+}
+
+static void bench_relay_decode(void) {
+    static const relay_visitor_t v = { NULL, NULL, count_client };
+    // the last summary bench_relay_encode left behind, or a fresh one
+    if (!relay_used) bench_relay_encode();
+    uint64_t rounds = ITERS / 10000 ? ITERS / 10000 : 1, sum = 0;
+    uint64_t t0 = get_now_ns();
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (size_t off = 0; off < relay_used; ) {
+            const wire_summary_t *d = (const wire_summary_t *)(relay_store + off);
+            size_t len = sizeof(*d) + le32toh(d->body_len);
+            relay_decode(d, len, &v, &sum);
+            off += (len + 7) & ~(size_t)7;
+        }
+    }
+    uint64_t elapsed = get_now_ns() - t0;
+    sink += sum;
+    report("relay_decode", rounds * 10000, elapsed);
+}
+
+// Round trip: a summary whose histograms and client list span several
+// datagrams, decoded datagram by datagram and put back together; then
+// damaged datagrams, and the source table's view of lost ones.
+
+#define CHECK_CLIENTS 600
+
+typedef struct {
+    relay_lane_t   lanes[WIRE_LANES];
+    int            lane_seen[WIRE_LANES];
+    uint32_t       hist_parts[WIRE_LANES][2];
+    relay_client_t clients[CHECK_CLIENTS];
+    uint32_t       nclients;
+} relay_got_t;
+
+static void got_lane(void *arg, int lane, const relay_lane_t *l) {
+    relay_got_t *g = arg;
+    g->lanes[lane].clients  = l->clients;
+    g->lanes[lane].metrics  = l->metrics;
+    g->lanes[lane].losses   = l->losses;
+    g->lanes[lane].switches = l->switches;
+    g->lane_seen[lane]++;
+}
+
+static void got_hist(void *arg, int lane, int jitter, const hist_t *h) {
+    relay_got_t *g = arg;
+    hist_merge(jitter ? &g->lanes[lane].jitter : &g->lanes[lane].rtt, h);
+    g->hist_parts[lane][jitter]++;
+}
+
+static void got_client(void *arg, const relay_client_t *c) {
+    relay_got_t *g = arg;
+    if (g->nclients < CHECK_CLIENTS) g->clients[g->nclients] = *c;
+    g->nclients++;
+}
+
+static int hist_equal(const hist_t *a, const hist_t *b) {
+    return a->total == b->total && a->max == b->max
+        && memcmp(a->counts, b->counts, sizeof(a->counts)) == 0;
+}
+
+static void check_relay_roundtrip(void) {
+    static const relay_visitor_t v = { got_lane, got_hist, got_client };
+    static relay_lane_t lanes[WIRE_LANES];
+    static relay_client_t clients[CHECK_CLIENTS];
+    static relay_got_t got;
+    static relay_enc_t e;
+
+    // lane 0: every bucket of both histograms, far more than one datagram
+    // holds; lane 1: a few buckets; lane 2: nothing but its counters
+    memset(lanes, 0, sizeof(lanes));
+    for (int l = 0; l < WIRE_LANES; l++) {
+        lanes[l] = (relay_lane_t){ .clients = 1000u * (uint32_t)l, .metrics = UINT64_MAX >> l,
+                                   .losses = 7, .switches = (uint64_t)l };
+        hist_reset(&lanes[l].rtt);
+        hist_reset(&lanes[l].jitter);
+    }
+    for (uint32_t b = 0; b < HIST_BUCKETS; b++) {
+        lanes[0].rtt.counts[b]    = b % 5 ? 1 + (uint32_t)(rng() % 100000) : UINT32_MAX;
+        lanes[0].jitter.counts[b] = 1 + (uint32_t)(rng() % 100);
+        lanes[0].rtt.total    += lanes[0].rtt.counts[b];
+        lanes[0].jitter.total += lanes[0].jitter.counts[b];
+    }
+    lanes[0].rtt.max = lanes[0].jitter.max = 1ull << 30;
+    for (uint64_t x = 1; x < 1000000; x *= 10) hist_record(&lanes[1].rtt, x);
+    for (uint32_t i = 0; i < CHECK_CLIENTS; i++)
+        clients[i] = (relay_client_t){
+            .pid = i % 50 == 0 ? UINT32_MAX - i : 1000 + (uint32_t)(rng() % 100000),
+            .lane = (uint8_t)(i % WIRE_LANES), .metrics = (uint32_t)rng(),
+            .losses = i % 3 ? 0 : UINT32_MAX, .switches = i % 2,
+            .p50_us = (uint32_t)(rng() % 200000), .p99_us = (uint32_t)rng()
+        };
+
+    relay_used   = 0;
+    relay_dgrams = 0;
+    relay_enc_init(&e, 42, 3, relay_keep, NULL);
+    relay_enc_begin(&e, 7, 123456789);
+    for (int l = 0; l < WIRE_LANES; l++) relay_enc_lane(&e, l, &lanes[l]);
+    for (uint32_t i = 0; i < CHECK_CLIENTS; i++) relay_enc_client(&e, &clients[i]);
+    uint16_t parts = relay_enc_end(&e);
+    CHECK(parts == relay_dgrams && parts > 3);
+
+    // each datagram fits, is numbered in order, only the last is marked
+    // last, and decodes on its own
+    memset(&got, 0, sizeof(got));
+    uint16_t part = 0;
+    const wire_summary_t *first_client = NULL;
+    for (size_t off = 0; off < relay_used; part++) {
+        const wire_summary_t *d = (const wire_summary_t *)(relay_store + off);
+        size_t len = sizeof(*d) + le32toh(d->body_len);
+        CHECK(len <= RELAY_MTU);
+        CHECK(le16toh(d->part) == part && d->last == (part + 1 == parts));
+        CHECK(d->source == 3 && le32toh(d->h.seq) == 7);
+        uint32_t before = got.nclients;
+        CHECK(relay_decode(d, len, &v, &got) == 0);
+        if (!first_client && got.nclients > before + 1) first_client = d;
+        off += (len + 7) & ~(size_t)7;
+    }
+    CHECK(part == parts);
+
+    for (int l = 0; l < WIRE_LANES; l++) {
+        CHECK(got.lane_seen[l] == 1);
+        CHECK(got.lanes[l].clients == lanes[l].clients && got.lanes[l].metrics == lanes[l].metrics
+              && got.lanes[l].losses == lanes[l].losses && got.lanes[l].switches == lanes[l].switches);
+        CHECK(hist_equal(&got.lanes[l].rtt, &lanes[l].rtt));
+        CHECK(hist_equal(&got.lanes[l].jitter, &lanes[l].jitter));
+    }
+    CHECK(got.hist_parts[0][0] > 1);      // split over datagrams
+    CHECK(got.hist_parts[1][0] == 1 && got.hist_parts[1][1] == 0);
+    CHECK(got.hist_parts[2][0] == 0 && got.hist_parts[2][1] == 0);
+    CHECK(got.nclients == CHECK_CLIENTS);
+    if (got.nclients == CHECK_CLIENTS)
+        for (uint32_t i = 0; i < CHECK_CLIENTS; i++) {
+            const relay_client_t *a = &got.clients[i], *b = &clients[i];
+            if (!CHECK(a->pid == b->pid && a->lane == b->lane && a->metrics == b->metrics
+                       && a->losses == b->losses && a->switches == b->switches
+                       && a->p50_us == b->p50_us && a->p99_us == b->p99_us))
+                break;
+        }
+
+    // a datagram cut short, and one whose last record is: both refused, the
+    // latter after the records before it
+    if (CHECK(first_client != NULL)) {
+        static _Alignas(8) uint8_t cut[RELAY_MTU];
+        size_t len = sizeof(wire_summary_t) + le32toh(first_client->body_len);
+        memcpy(cut, first_client, len);
+        memset(&got, 0, sizeof(got));
+        errno = 0;
+        CHECK(relay_decode(cut, len - 1, &v, &got) < 0 && errno == EPROTO);
+        ((wire_summary_t *)cut)->body_len = htole32(le32toh(first_client->body_len) - 1);
+        memset(&got, 0, sizeof(got));
+        errno = 0;
+        CHECK(relay_decode(cut, len - 1, &v, &got) < 0 && errno == EPROTO);
+        CHECK(got.nclients > 0);
+    }
+
+    // the source table: gaps within a summary, across summaries, a
+    // summary's missing tail, duplicates, stale datagrams and a restart
+    static relay_sources_t t;
+    memset(&t, 0, sizeof(t));
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    relay_source_t *s = relay_source_get(&t, 42, 3, &addr, 0);
+    if (!CHECK(s != NULL)) return;
+    CHECK(relay_source_get(&t, 42, 3, &addr, 0) == s);
+    CHECK(relay_source_get(&t, 42, 4, &addr, 0) != s);
+    CHECK(relay_source_part(s, 1, 0, 0, 1) == 0);
+    CHECK(relay_source_part(s, 1, 2, 1, 2) == 1);      // part 1 lost
+    CHECK(relay_source_part(s, 1, 2, 1, 3) == -1);     // seen
+    CHECK(relay_source_part(s, 2, 0, 0, 4) == 0);
+    CHECK(relay_source_part(s, 5, 1, 0, 5) == 4);      // 2's tail, 3, 4, 5's part 0
+    CHECK(relay_source_part(s, 5, 0, 0, 6) == -1);     // late
+    CHECK(relay_source_part(s, 4, 0, 1, 7) == -1);     // stale
+    CHECK(relay_source_part(s, 5, 2, 1, 8) == 0);
+    CHECK(relay_source_part(s, 1, 1, 1, 9) == 1);      // restarted, part 0 lost
+    CHECK(s->lost_parts == 6 && s->summaries == 3);
+    CHECK(s->seq == 1 && s->complete && s->last_seen_ns == 9);
+
+    // a full table turns new relays away until one of its own goes quiet
+    memset(&t, 0, sizeof(t));
+    for (uint32_t id = 1; id <= RELAY_MAX_SOURCES; id++) {
+        relay_source_t *r = relay_source_get(&t, id, 0, &addr, 0);
+        if (!CHECK(r != NULL)) return;
+        relay_source_part(r, 1, 0, 1, 1000 + id);
+    }
+    CHECK(relay_source_get(&t, 1000, 0, &addr, 1000) == NULL);
+    s = relay_source_get(&t, 1000, 0, &addr, 1002);
+    CHECK(s != NULL && s == &t.s[0] && s->relay_id == 1000 && !s->started);
+}
+
+// ——— Logging ———
+// Producer-side cost of one client_metrics line; the writer thread drains
+// to /dev/null. Lines the ring could not take are reported as dropped.
+
+static void bench_log_printf(void) {
+    log_config_t cfg = { .path = "/dev/null", .json = 1, .component = "bench" };
+    if (log_init(&cfg) < 0) {
+        perror("log_init");
+        return;
+    }
+    uint64_t t0 = get_now_ns();
+    for (uint64_t i = 0; i < ITERS; i++) {
+        log_printf(LOG_CAT_METRICS, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_metrics\",\"pid\":%d,\"rtt\":%.2f,\"loss\":%d,\"jitter\":%.2f}\n",
+                   (long)i, 12345, 42.7, 0, 13.2);
+    }
+    uint64_t elapsed = get_now_ns() - t0;
+    uint64_t dropped = log_dropped_total();
+    log_shutdown();
+    char extra[64];
+    snprintf(extra, sizeof(extra), ",\"dropped\":%" PRIu64, dropped);
+    report_extra("log_printf", ITERS, elapsed, extra);
+}
+
+static const struct {
+    const char *name;
+    void (*fn)(void);
+} BENCHES[] = {
+    { "parse_text_metric",   bench_parse_text_metric },
+    { "parse_binary_metric", bench_parse_binary_metric },
+    { "parse_text_ping",     bench_parse_text_ping },
+    { "lane_observe",        bench_lane_observe },
+    { "lane_observe_ewma",   bench_lane_observe_ewma },
+    { "hist_record",         bench_hist_record },
+    { "winstats_push_w1000", bench_winstats_push },
+    { "chaos_decide",        bench_chaos_decide },
+    { "record_append",       bench_record_append },
+    { "record_scan",         bench_record_scan },
+    { "relay_encode",        bench_relay_encode },
+    { "relay_decode",        bench_relay_decode },
+    { "log_printf",          bench_log_printf },
+};
+
+static const struct {
+    const char *name;
+    void (*fn)(void);
+} CHECKS[] = {
+    { "record_roundtrip", check_record_roundtrip },
+    { "relay_roundtrip",  check_relay_roundtrip },
+};
+
+int main(int argc, char *argv[]) {
+    static struct option long_opts[] = {
+        {"iters",  required_argument, 0, 'n'},
+        {"filter", required_argument, 0, 'f'},
+        {"check",  no_argument,       0, 'c'},
+        {"help",   no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+    int opt, checks = 0;
+    while ((opt = getopt_long(argc, argv, "n:f:ch", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'n': ITERS  = strtoull(optarg, NULL, 10); break;
+            case 'f': FILTER = optarg; break;
+            case 'c': checks = 1; break;
+            case 'h':
+            default:
+                printf("Usage: %s [--iters N] [--filter SUBSTRING] [--check]\n", argv[0]);
+                return (opt=='h') ? 0 : 2;
+        }
+    }
+    if (ITERS == 0) ITERS = 1;
+
+    if (checks) {
+        int failed = 0;
+        for (size_t i = 0; i < sizeof(CHECKS) / sizeof(CHECKS[0]); i++) {
+            if (!selected(CHECKS[i].name)) continue;
+            check_failures = 0;
+            CHECKS[i].fn();
+            printf("{\"check\":\"%s\",\"ok\":%s}\n", CHECKS[i].name,
+                   check_failures ? "false" : "true");
+            fflush(stdout);
+            if (check_failures) failed = 1;
+        }
+        return failed;
+    }
+
+    for (size_t i = 0; i < sizeof(BENCHES) / sizeof(BENCHES[0]); i++)
+        if (selected(BENCHES[i].name)) BENCHES[i].fn();
+    return 0;
+}
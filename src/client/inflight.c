@@ -0,0 +1,131 @@
+// inflight.c
+// Sequence-tracked probe table (see inflight.h).
+
+#include <stdlib.h>
+
+#include "inflight.h"
+
+// seq comparison that survives 32-bit wraparound
+static int seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+uint32_t inflight_capacity(uint32_t capacity) {
+    uint32_t cap = 16;
+    while (cap < capacity && cap < (1u << 24)) cap <<= 1;
+    return cap;
+}
+
+void inflight_init_with(inflight_t *t, uint32_t capacity, uint64_t timeout_ns,
+                        inflight_slot_t *storage) {
+    uint32_t cap = inflight_capacity(capacity);
+    *t = (inflight_t){0};
+    t->slots      = storage;
+    t->mask       = cap - 1;
+    t->timeout_ns = timeout_ns;
+    t->next_seq   = 1;
+    t->oldest     = 1;
+    for (uint32_t i = 0; i < cap; i++) t->slots[i] = (inflight_slot_t){0};
+}
+
+int inflight_init(inflight_t *t, uint32_t capacity, uint64_t timeout_ns) {
+    inflight_slot_t *slots = calloc(inflight_capacity(capacity), sizeof(*slots));
+    if (!slots) return -1;
+    inflight_init_with(t, capacity, timeout_ns, slots);
+    return 0;
+}
+
+void inflight_free(inflight_t *t) {
+    free(t->slots);
+    t->slots = NULL;
+}
+
+int inflight_full(const inflight_t *t) {
+    return t->next_seq - t->oldest > t->mask;
+}
+
+uint32_t inflight_send(inflight_t *t, uint64_t now_ns) {
+    uint32_t seq = t->next_seq++;
+    t->slots[seq & t->mask] = (inflight_slot_t){
+        .sent_ns = now_ns,
+        .seq     = seq,
+        .state   = SLOT_PENDING
+    };
+    t->outstanding++;
+    t->sent++;
+    return seq;
+}
+
+// Move oldest past every probe that can no longer time out.
+static void advance_oldest(inflight_t *t) {
+    while (t->oldest != t->next_seq
+           && t->slots[t->oldest & t->mask].state != SLOT_PENDING)
+        t->oldest++;
+}
+
+reply_kind_t inflight_reply(inflight_t *t, uint32_t seq, uint64_t now_ns,
+                            double *rtt_ms, int *reordered) {
+    *reordered = 0;
+    if (!seq_before(seq, t->next_seq)) return REPLY_UNKNOWN;
+
+    inflight_slot_t *s = &t->slots[seq & t->mask];
+    if (s->seq != seq || s->state == SLOT_FREE) return REPLY_UNKNOWN;
+
+    if (s->state == SLOT_ANSWERED) {
+        t->duplicates++;
+        return REPLY_DUPLICATE;
+    }
+    if (t->highest_acked && seq_before(seq, t->highest_acked)) {
+        *reordered = 1;
+        t->reordered++;
+    }
+    if (s->state == SLOT_LOST) {
+        // counted as lost already; a second late copy is then a duplicate
+        s->state = SLOT_ANSWERED;
+        t->late++;
+        return REPLY_LATE;
+    }
+
+    s->state = SLOT_ANSWERED;
+    *rtt_ms  = (double)(now_ns - s->sent_ns) / 1e6;
+    t->outstanding--;
+    t->received++;
+    if (!t->highest_acked || seq_before(t->highest_acked, seq))
+        t->highest_acked = seq;
+    advance_oldest(t);
+    return REPLY_OK;
+}
+
+inflight_slot_t *inflight_find(inflight_t *t, uint32_t seq) {
+    inflight_slot_t *s = &t->slots[seq & t->mask];
+    return s->seq == seq && s->state != SLOT_FREE ? s : NULL;
+}
+
+size_t inflight_expire(inflight_t *t, uint64_t now_ns,
+                       void (*on_lost)(uint32_t seq, void *arg), void *arg) {
+    size_t n = 0;
+    advance_oldest(t);
+    // pending probes were sent in seq order, so the oldest expires first
+    while (t->oldest != t->next_seq) {
+        inflight_slot_t *s = &t->slots[t->oldest & t->mask];
+        if (s->state == SLOT_PENDING) {
+            if (now_ns - s->sent_ns < t->timeout_ns) break;
+            s->state = SLOT_LOST;
+            t->outstanding--;
+            t->lost++;
+            n++;
+            if (on_lost) on_lost(s->seq, arg);
+        }
+        t->oldest++;
+    }
+    return n;
+}
+
+uint64_t inflight_next_deadline(const inflight_t *t) {
+    if (t->outstanding == 0) return 0;
+    for (uint32_t seq = t->oldest; seq != t->next_seq; seq++) {
+        const inflight_slot_t *s = &t->slots[seq & t->mask];
+        if (s->state == SLOT_PENDING) return s->sent_ns + t->timeout_ns;
+    }
+    return 0;
+}
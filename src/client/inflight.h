@@ -0,0 +1,92 @@
+// inflight.h
+// Sequence-tracked probe table for the pipelined pinger.
+//
+// Probes are numbered from 1 and stored in a power-of-two ring indexed by
+// seq & mask, each with its own send timestamp. A reply is matched to its
+// probe by seq, so RTTs are attributed correctly however many probes are
+// outstanding. A probe that is still unanswered after the timeout is
+// declared lost; its slot keeps the seq until it is reused, so a reply that
+// shows up later is recognised as late instead of being credited to a newer
+// probe. Replies that arrive twice are duplicates, and replies older than
+// the newest answered seq are counted as reordered.
+
+#ifndef UDPMON_INFLIGHT_H
+#define UDPMON_INFLIGHT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    SLOT_FREE = 0,
+    SLOT_PENDING,
+    SLOT_ANSWERED,
+    SLOT_LOST
+};
+
+typedef struct {
+    uint64_t sent_ns;
+    uint32_t seq;
+    uint32_t state;
+    // CLOCK_REALTIME send time for --timestamps: taken in user space at send,
+    // then replaced by the kernel's TX stamp if that arrives
+    uint64_t tx_wall_ns;
+    int      tx_kernel;
+} inflight_slot_t;
+
+typedef struct {
+    inflight_slot_t *slots;
+    uint32_t mask;
+    uint64_t timeout_ns;
+
+    uint32_t next_seq;       // seq the next probe will carry
+    uint32_t oldest;         // oldest seq that may still be pending
+    uint32_t outstanding;    // probes sent and neither answered nor lost
+    uint32_t highest_acked;  // 0 until the first reply
+
+    uint64_t sent, received, lost, late, duplicates, reordered;
+} inflight_t;
+
+typedef enum {
+    REPLY_OK,         // first reply for a pending probe; *rtt_ms is set
+    REPLY_LATE,       // reply for a probe already declared lost
+    REPLY_DUPLICATE,  // second reply for an answered probe
+    REPLY_UNKNOWN     // never sent, or its slot was reused long ago
+} reply_kind_t;
+
+// capacity is rounded up to a power of two; it bounds how many probes can
+// be tracked at once (outstanding plus recently completed).
+int          inflight_init(inflight_t *t, uint32_t capacity, uint64_t timeout_ns);
+void         inflight_free(inflight_t *t);
+
+// The slot count capacity rounds up to. inflight_init_with() runs the table
+// over caller storage of that many slots (not to be passed to inflight_free),
+// so many tables can share one allocation.
+uint32_t     inflight_capacity(uint32_t capacity);
+void         inflight_init_with(inflight_t *t, uint32_t capacity, uint64_t timeout_ns,
+                                inflight_slot_t *storage);
+
+// True when the ring has no free slot left for a new probe.
+int          inflight_full(const inflight_t *t);
+
+// Record a probe sent at now_ns and return its seq.
+uint32_t     inflight_send(inflight_t *t, uint64_t now_ns);
+
+// Classify a reply. *reordered is set when seq is older than a seq that
+// was already answered.
+reply_kind_t inflight_reply(inflight_t *t, uint32_t seq, uint64_t now_ns,
+                            double *rtt_ms, int *reordered);
+
+// The slot still holding seq (pending, answered or lost), or NULL once it
+// has been reused.
+inflight_slot_t *inflight_find(inflight_t *t, uint32_t seq);
+
+// Declare every probe older than the timeout lost, calling on_lost for each.
+// Returns how many were lost.
+size_t       inflight_expire(inflight_t *t, uint64_t now_ns,
+                             void (*on_lost)(uint32_t seq, void *arg), void *arg);
+
+// CLOCK_MONOTONIC time at which the oldest pending probe times out, or 0 if
+// nothing is outstanding.
+uint64_t     inflight_next_deadline(const inflight_t *t);
+
+#endif
@@ -0,0 +1,139 @@
+// lane_probe.c
+// Background lane probing (see lane_probe.h).
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common/log.h"
+#include "lane_probe.h"
+
+// Defined in main.c.
+extern int JSON_LOGGING;
+
+static int lane_of_port(const lane_prober_t *lp, int port) {
+    for (int l = 0; l < WIRE_LANES; l++)
+        if (lp->ports[l] == port) return l;
+    return -1;
+}
+
+int lane_prober_init(lane_prober_t *lp, const wire_register_ack_t *ack, size_t ack_len,
+                     const struct sockaddr_in *srv, int active_port, uint32_t pid,
+                     uint64_t interval_ns, uint64_t timeout_ns, uint64_t now_ns) {
+    memset(lp, 0, sizeof(*lp));
+    if (ack_len < sizeof(*ack)) return -1;
+    for (int l = 0; l < WIRE_LANES; l++) lp->ports[l] = le16toh(ack->lane_ports[l]);
+    lp->active = lane_of_port(lp, active_port);
+    if (lp->active < 0) return -1;
+
+    lp->pid         = pid;
+    lp->interval_ns = interval_ns;
+    lp->next_ns     = now_ns + interval_ns;
+    lp->srv         = *srv;
+    // every probe of a lane within one timeout, plus slack for late replies
+    uint32_t cap = (uint32_t)(timeout_ns / interval_ns) * 2 + 8;
+    for (int l = 0; l < WIRE_LANES; l++) {
+        lp->lanes[l].last_rtt = -1.0;
+        if (inflight_init(&lp->lanes[l].probes, cap, timeout_ns) < 0) {
+            lane_prober_free(lp);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void lane_prober_free(lane_prober_t *lp) {
+    for (int l = 0; l < WIRE_LANES; l++)
+        if (lp->lanes[l].probes.slots) inflight_free(&lp->lanes[l].probes);
+    lp->active = -1;
+}
+
+void lane_prober_set_port(lane_prober_t *lp, int port) {
+    int l = lane_of_port(lp, port);
+    if (l >= 0) lp->active = l;
+}
+
+uint64_t lane_prober_deadline(const lane_prober_t *lp) {
+    uint64_t due = lp->next_ns;
+    for (int l = 0; l < WIRE_LANES; l++) {
+        uint64_t d = inflight_next_deadline(&lp->lanes[l].probes);
+        if (d && d < due) due = d;
+    }
+    return due;
+}
+
+static void count_lost(uint32_t seq, void *arg) {
+    (void)seq;
+    ((lane_probe_lane_t *)arg)->loss_since_report++;
+}
+
+static int send_to_lane(lane_prober_t *lp, int sock, int lane, const void *buf, size_t len,
+                        const char *what) {
+    struct sockaddr_in to = lp->srv;
+    to.sin_port = htons(lp->ports[lane]);
+    if (sendto(sock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) < 0) {
+        perror(what);
+        return 0;
+    }
+    return 1;
+}
+
+int lane_prober_tick(lane_prober_t *lp, int sock, uint64_t now_ns) {
+    for (int l = 0; l < WIRE_LANES; l++)
+        inflight_expire(&lp->lanes[l].probes, now_ns, count_lost, &lp->lanes[l]);
+    if (now_ns < lp->next_ns) return 0;
+    lp->next_ns += lp->interval_ns;
+    if (lp->next_ns <= now_ns) lp->next_ns = now_ns + lp->interval_ns;
+
+    int sent = 0;
+    for (int l = 0; l < WIRE_LANES; l++) {
+        inflight_t *t = &lp->lanes[l].probes;
+        if (l == lp->active || inflight_full(t)) continue;
+        wire_lane_probe_t m;
+        wire_hdr_init(&m.h, WIRE_LANE_PROBE, lp->pid, inflight_send(t, now_ns), now_ns);
+        m.lane      = htole16((uint16_t)l);
+        m.reserved  = 0;
+        m.reserved2 = 0;
+        sent += send_to_lane(lp, sock, l, &m, sizeof(m), "sendto LANE_PROBE");
+    }
+    return sent;
+}
+
+int lane_prober_reply(lane_prober_t *lp, int sock, const wire_hdr_t *h, size_t n,
+                      uint64_t now_ns) {
+    if (h->type != WIRE_LANE_PROBE || n < sizeof(wire_lane_probe_t)) return 0;
+    if (le32toh(h->pid) != lp->pid) return 1;
+    int l = le16toh(((const wire_lane_probe_t *)h)->lane);
+    if (l >= WIRE_LANES) return 1;
+
+    lane_probe_lane_t *ln = &lp->lanes[l];
+    double rtt;
+    int reordered;
+    if (inflight_reply(&ln->probes, le32toh(h->seq), now_ns, &rtt, &reordered) != REPLY_OK)
+        return 1;
+    double jitter = ln->last_rtt < 0 ? 0.0 : rtt > ln->last_rtt ? rtt - ln->last_rtt : ln->last_rtt - rtt;
+    ln->last_rtt = rtt;
+
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"lane_probe\",\"pid\":%u,\"lane\":%d,\"port\":%u,\"seq\":%u,\"rtt\":%.2f,\"lost\":%lu}\n",
+               time(NULL), lp->pid, l, lp->ports[l], le32toh(h->seq), rtt,
+               (unsigned long)ln->probes.lost);
+    } else {
+        log_printf(LOG_CAT_PROBE, "lane%d seq=%u rtt_ms=%.1f loss=%lu\n",
+               l, le32toh(h->seq), rtt, (unsigned long)ln->probes.lost);
+    }
+
+    // reported on the active lane, like a METRIC
+    if (lp->active < 0) return 1;
+    wire_lane_metric_t m;
+    wire_hdr_init(&m.h, WIRE_LANE_METRIC, lp->pid, le32toh(h->seq), now_ns);
+    m.rtt_us    = htole32((uint32_t)(rtt * 1000.0));
+    m.jitter_us = htole32((uint32_t)(jitter * 1000.0));
+    m.loss      = htole32((uint32_t)ln->loss_since_report);
+    m.lane      = htole16((uint16_t)l);
+    m.reserved  = 0;
+    ln->loss_since_report = 0;
+    return 1 + send_to_lane(lp, sock, lp->active, &m, sizeof(m), "sendto LANE_METRIC");
+}
@@ -0,0 +1,57 @@
+// lane_probe.h
+// Background probing of the lanes a client is not on. Every interval one
+// LANE_PROBE goes to each other lane's port; each answered probe is
+// reported to the server as a LANE_METRIC on the active lane, so the
+// server can compare lanes before moving the client (see wire.h).
+// Probes of each lane have their own seq space and in-flight table, so a
+// late or lost probe is attributed to the right lane.
+
+#ifndef UDPMON_LANE_PROBE_H
+#define UDPMON_LANE_PROBE_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "common/wire.h"
+#include "inflight.h"
+
+typedef struct {
+    inflight_t probes;
+    int        loss_since_report;
+    double     last_rtt;          // < 0 until the first reply
+} lane_probe_lane_t;
+
+typedef struct {
+    int      active;              // lane the client is on, -1 when unknown
+    uint16_t ports[WIRE_LANES];
+    uint32_t pid;
+    uint64_t interval_ns;
+    uint64_t next_ns;             // next round of probes
+    struct sockaddr_in srv;       // server address; the port is set per send
+    lane_probe_lane_t lanes[WIRE_LANES];
+} lane_prober_t;
+
+// ack is the server's REGISTER_ACK; returns -1 if it carries no lane table
+// or active_port is not one of its lanes.
+int  lane_prober_init(lane_prober_t *lp, const wire_register_ack_t *ack, size_t ack_len,
+                      const struct sockaddr_in *srv, int active_port, uint32_t pid,
+                      uint64_t interval_ns, uint64_t timeout_ns, uint64_t now_ns);
+void lane_prober_free(lane_prober_t *lp);
+
+// The client moved to port (after a CONTROL).
+void lane_prober_set_port(lane_prober_t *lp, int port);
+
+// CLOCK_MONOTONIC time the prober next needs to run: its next round or the
+// oldest outstanding probe's timeout, whichever is first.
+uint64_t lane_prober_deadline(const lane_prober_t *lp);
+
+// Expire timed-out probes and send the next round if it is due. Returns
+// how many datagrams were sent.
+int  lane_prober_tick(lane_prober_t *lp, int sock, uint64_t now_ns);
+
+// Handle a datagram that may be an echoed LANE_PROBE: returns 0 if it is
+// not one, else 1 plus the number of datagrams sent in reply (the report).
+int  lane_prober_reply(lane_prober_t *lp, int sock, const wire_hdr_t *h, size_t n,
+                       uint64_t now_ns);
+
+#endif
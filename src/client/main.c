@@ -1,6 +1,17 @@
 // udp-monitor-client.c
-// Sends PING → waits for PONG, reports RTT/loss/jitter
+// Sends sequence-numbered PINGs on a fixed clock, matches PONGs by seq,
+// reports RTT/loss/jitter. With --pipeline N up to N probes are in flight at
+// once; the default of 1 behaves like the old stop-and-wait pinger.
 // Listens for CONTROL pid=<pid> port=<newPort> and switches lanes in place.
+// With --binary it negotiates the wire.h framing at REGISTER time and falls
+// back to text if the server does not acknowledge it. In binary mode it also
+// probes the lanes it is not on every --lane-probe-ms (lane_probe.c).
+// With --target/--targets it probes many servers or lanes from one process
+// instead (multi.c).
+// With --adaptive the PING interval follows the path: it backs off while the
+// RTT window is calm and drops on loss or a swing jump, within
+// --probe-min-ms/--probe-max-ms, and follows the server's rate hints
+// (rate_ctl.c). --host-budget caps the PINGs of every client on the host.
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,53 +21,225 @@
 #include <time.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+
+#include "common/log.h"
+#include "common/tstamp.h"
+#include "common/winstats.h"
+#include "common/wire.h"
+#include "inflight.h"
+#include "lane_probe.h"
+#include "multi.h"
+#include "rate_ctl.h"
 
 // Add JSON logging flag
 int JSON_LOGGING = 0;
 
+volatile sig_atomic_t STOP = 0;
+
+void on_stop_signal(int sig) {
+    (void)sig;
+    STOP = 1;
+}
+
+#define BUFSZ 2048
+
+// An adaptive client never calls a window swing above this calm; it matches
+// the server's default --jitter-ms.
+#define ADAPT_SWING_MS 20.0
+
+uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct {
+    inflight_t probes;
+    int loss_since_metric;   // probes lost since the last METRIC was sent
+} probe_stats_t;
+
+void log_probe_lost(uint32_t seq, void *arg) {
+    probe_stats_t *ps = arg;
+    ps->loss_since_metric++;
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_timeout\",\"seq\":%u,\"lost\":%lu}\n",
+               time(NULL), seq, (unsigned long)ps->probes.lost);
+    } else {
+        log_printf(LOG_CAT_PROBE, "seq=%u rtt_ms=NA loss=%lu window_swing_ms=unchanged\n",
+               seq, (unsigned long)ps->probes.lost);
+    }
+}
+
+void log_probe_rate(int pid, uint64_t from_ns, uint64_t to_ns, int hinted) {
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"probe_rate\",\"pid\":%d,\"from_us\":%lu,\"to_us\":%lu,\"hinted\":%s}\n",
+               time(NULL), pid, (unsigned long)(from_ns / 1000), (unsigned long)(to_ns / 1000),
+               hinted ? "true" : "false");
+    } else {
+        log_printf(LOG_CAT_PROBE, "CLIENT: probe interval %.1f ms -> %.1f ms%s\n",
+               (double)from_ns / 1e6, (double)to_ns / 1e6, hinted ? " (server hint)" : "");
+    }
+}
+
+// At most once a second while the host budget is skipping this client's ticks.
+void log_throttled(int pid, uint64_t skipped, uint64_t pps) {
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"client\",\"event\":\"budget_throttled\",\"pid\":%d,\"skipped\":%lu,\"budget_pps\":%lu}\n",
+               time(NULL), pid, (unsigned long)skipped, (unsigned long)pps);
+    } else {
+        log_printf(LOG_CAT_GENERAL, "CLIENT: host budget of %lu pps reached, %lu PINGs skipped\n",
+               (unsigned long)pps, (unsigned long)skipped);
+    }
+}
+
+// Extract the seq a PONG answers. Returns 0 for anything that is not a PONG.
+int parse_pong(const char *buf, size_t n, int use_binary, uint32_t *seq) {
+    const wire_hdr_t *h = use_binary ? wire_view(buf, n) : NULL;
+    if (h) {
+        if (h->type != WIRE_PONG) return 0;
+        *seq = le32toh(h->seq);
+        return 1;
+    }
+    if (strncmp(buf, "PING", 4) != 0) return 0;
+    const char *p = strstr(buf, "seq=");
+    if (!p) return 0;
+    *seq = (uint32_t)strtoul(p + 4, NULL, 10);
+    return 1;
+}
+
 int main(int argc, char *argv[]) {
     char *ADDR       = "127.0.0.1";
     int   PORT       = 5000;
     int   RATE_MS    = 1000;
+    int   RATE_US    = 0;      // overrides RATE_MS for sub-millisecond probing
     int   TIMEOUT_MS = 2000;
     int   WINDOW     = 10;
-    const size_t BUFSZ = 2048;
+    int   BINARY     = 0;
+    int   PIPELINE   = 1;      // max probes in flight
+    int   TIMESTAMPS = 0;      // kernel RX/TX stamps and server-side timestamps
+    int   LANE_PROBE_MS = 1000;   // background probes of the other lanes, 0 disables
+    int   ADAPTIVE      = 0;
+    int   PROBE_MIN_MS  = 0;      // adaptive bounds, 0 = a tenth / ten times the rate
+    int   PROBE_MAX_MS  = 0;
+    long  HOST_BUDGET   = 0;      // PINGs per second for the whole host, 0 = no budget
+    log_config_t log_cfg = { .component = "client" };
+    multi_config_t mcfg  = { .sockets = 4, .report_s = 10 };
 
     static struct option long_opts[] = {
         {"address",    required_argument, 0, 'a'},
         {"door",       required_argument, 0, 'p'},
         {"rate-ms",    required_argument, 0, 'r'},
+        {"rate-us",    required_argument, 0, 'u'},
         {"timeout-ms", required_argument, 0, 't'},
         {"window",     required_argument, 0, 'w'},
+        {"pipeline",   required_argument, 0, 'P'},
         {"json",       no_argument,       0, 'j'},
+        {"binary",     no_argument,       0, 'b'},
+        {"log-file",   required_argument, 0, 1000},
+        {"log-sample", required_argument, 0, 1001},
+        {"log-rate",   required_argument, 0, 1002},
+        {"timestamps", no_argument,       0, 1003},
+        {"target",     required_argument, 0, 1004},
+        {"targets",    required_argument, 0, 1005},
+        {"sockets",    required_argument, 0, 1006},
+        {"report-s",   required_argument, 0, 1007},
+        {"lane-probe-ms", required_argument, 0, 1008},
+        {"adaptive",   no_argument,       0, 1009},
+        {"probe-min-ms", required_argument, 0, 1010},
+        {"probe-max-ms", required_argument, 0, 1011},
+        {"host-budget", required_argument, 0, 1012},
         {"help",       no_argument,       0, 'h'},
         {0,0,0,0}
     };
 
     int opt, opt_index = 0;
-    while ((opt = getopt_long(argc, argv, "a:p:r:t:w:jh", long_opts, &opt_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "a:p:r:u:t:w:P:jbh", long_opts, &opt_index)) != -1) {
         switch (opt) {
             case 'a': ADDR       = optarg;       break;
             case 'p': PORT       = atoi(optarg); break;
             case 'r': RATE_MS    = atoi(optarg); break;
+            case 'u': RATE_US    = atoi(optarg); break;
             case 't': TIMEOUT_MS = atoi(optarg); break;
             case 'w': WINDOW     = atoi(optarg); break;
+            case 'P': PIPELINE   = atoi(optarg); break;
             case 'j': JSON_LOGGING = 1; break;
+            case 'b': BINARY       = 1; break;
+            case 1000: log_cfg.path = optarg; break;
+            case 1001:
+                if (log_set_sample(optarg) < 0)
+                    fprintf(stderr, "ignoring bad --log-sample '%s'\n", optarg);
+                break;
+            case 1002:
+                if (log_set_rate(optarg) < 0)
+                    fprintf(stderr, "ignoring bad --log-rate '%s'\n", optarg);
+                break;
+            case 1003: TIMESTAMPS = BINARY = 1; break;   // needs binary framing
+            case 1004: {
+                const char **grown = realloc(mcfg.targets, (size_t)(mcfg.ntargets + 1) * sizeof(*grown));
+                if (!grown) { perror("realloc"); return 1; }
+                mcfg.targets = grown;
+                mcfg.targets[mcfg.ntargets++] = optarg;
+                break;
+            }
+            case 1005: mcfg.targets_file = optarg;       break;
+            case 1006: mcfg.sockets      = atoi(optarg); break;
+            case 1007: mcfg.report_s     = atoi(optarg); break;
+            case 1008: LANE_PROBE_MS     = atoi(optarg); break;
+            case 1009: ADAPTIVE          = 1;            break;
+            case 1010: PROBE_MIN_MS      = atoi(optarg); break;
+            case 1011: PROBE_MAX_MS      = atoi(optarg); break;
+            case 1012: HOST_BUDGET       = atol(optarg); break;
             case 'h':
             default:
-                printf("Usage: %s [--address IP] [--door PORT] [--rate-ms MS] "
-                       "[--timeout-ms MS] [--window N] [--json]\n", argv[0]);
+                printf("Usage: %s [--address IP] [--door PORT] [--rate-ms MS] [--rate-us US] "
+                       "[--timeout-ms MS] [--window N] [--pipeline N] [--json] [--binary] "
+                       "[--log-file PATH] [--log-sample CAT=N] [--log-rate CAT=N] [--timestamps] "
+                       "[--lane-probe-ms MS] [--adaptive] [--probe-min-ms MS] [--probe-max-ms MS] "
+                       "[--host-budget PPS] [--target ADDR:PORT]... [--targets FILE] [--sockets N] [--report-s N]\n", argv[0]);
                 return (opt=='h') ? 0 : 2;
         }
     }
 
+    log_cfg.json = JSON_LOGGING;
+    if (log_init(&log_cfg) < 0) {
+        perror("log_init");
+        return 1;
+    }
+    // flush queued log lines on the way out
+    signal(SIGINT,  on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+
+    if (WINDOW < 1) WINDOW = 1;
+    if (PIPELINE < 1) PIPELINE = 1;
+    uint64_t interval_ns = RATE_US > 0 ? (uint64_t)RATE_US * 1000ull
+                                       : (uint64_t)(RATE_MS > 0 ? RATE_MS : 1) * 1000000ull;
+
+    // Multi-target mode: binary only, and it owns its own sockets
+    if (mcfg.ntargets > 0 || mcfg.targets_file) {
+        if (TIMESTAMPS) log_printf(LOG_CAT_GENERAL, "CLIENT: --timestamps is not supported with --target, ignored\n");
+        if (ADAPTIVE || HOST_BUDGET > 0)
+            log_printf(LOG_CAT_GENERAL, "CLIENT: --adaptive and --host-budget are not supported with --target, ignored\n");
+        mcfg.interval_ns = interval_ns;
+        mcfg.timeout_ms  = TIMEOUT_MS;
+        mcfg.window      = WINDOW;
+        mcfg.pipeline    = PIPELINE;
+        int rc = multi_main(&mcfg);
+        free(mcfg.targets);
+        log_shutdown();
+        return rc;
+    }
+
     // 1) Create UDP socket
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) { perror("socket"); return 1; }
 
-    // 2) Set receive timeout
+    // 2) Set receive timeout (only used while waiting for the REGISTER ack)
     struct timeval tv = {
         .tv_sec  = TIMEOUT_MS / 1000,
         .tv_usec = (TIMEOUT_MS % 1000) * 1000
@@ -80,7 +263,9 @@ int main(int argc, char *argv[]) {
     // 4) REGISTER with server
     pid_t my_pid = getpid();
     char regbuf[64];
-    int  rlen   = snprintf(regbuf, sizeof(regbuf), "REGISTER pid=%d", my_pid);
+    int  rlen   = BINARY
+        ? snprintf(regbuf, sizeof(regbuf), "REGISTER pid=%d proto=%d", my_pid, WIRE_VERSION)
+        : snprintf(regbuf, sizeof(regbuf), "REGISTER pid=%d", my_pid);
     if (sendto(sock, regbuf, rlen, 0,
                (struct sockaddr *)&srv, sizeof(srv)) < 0) {
         perror("sendto REGISTER");
@@ -88,127 +273,467 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     if (JSON_LOGGING) {
-        printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"registration\",\"pid\":%d,\"port\":%d}\n",
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"registration\",\"pid\":%d,\"port\":%d}\n",
                time(NULL), my_pid, PORT);
-        fflush(stdout);
     } else {
-        printf("CLIENT: sent registration → %.*s\n", rlen, regbuf);
+        log_printf(LOG_CAT_GENERAL, "CLIENT: sent registration → %.*s\n", rlen, regbuf);
+    }
+
+    // Binary views need 8-byte aligned buffers; one spare byte keeps text
+    // replies NUL-terminated.
+    _Alignas(8) char sendbuf[BUFSZ], recvbuf[BUFSZ];
+
+    // 4b) Binary framing is used only once the server acknowledges it
+    //     and, when the ack lists the lane ports, lane probing with it
+    int use_binary = 0, lane_probing = 0;
+    lane_prober_t lp = { .active = -1 };
+    if (BINARY) {
+        ssize_t n = recvfrom(sock, recvbuf, BUFSZ - 1, 0, NULL, NULL);
+        const wire_hdr_t *h = n > 0 ? wire_view(recvbuf, (size_t)n) : NULL;
+        use_binary = h && h->type == WIRE_REGISTER_ACK
+                       && (pid_t)le32toh(h->pid) == my_pid;
+        lane_probing = use_binary && LANE_PROBE_MS > 0
+            && lane_prober_init(&lp, (const wire_register_ack_t *)recvbuf, (size_t)n, &srv, PORT,
+                                (uint32_t)my_pid, (uint64_t)LANE_PROBE_MS * 1000000ull,
+                                (uint64_t)TIMEOUT_MS * 1000000ull, get_now_ns()) == 0;
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"protocol\",\"pid\":%d,\"binary\":%s,\"lane_probing\":%s}\n",
+                   time(NULL), my_pid, use_binary ? "true" : "false", lane_probing ? "true" : "false");
+        } else {
+            log_printf(LOG_CAT_GENERAL, "CLIENT: %s%s\n", use_binary ? "using binary protocol"
+                                              : "no binary ack, falling back to text",
+                       lane_probing ? ", probing the other lanes" : "");
+        }
+    }
+
+    // 4c) Timestamping: kernel RX stamps on replies, kernel TX stamps on the
+    //     error queue (tagged with a per-socket send counter), and PINGs
+    //     with room for the server's own receive/send times.
+    int      ts_rx = 0, ts_tx = 0;
+    uint32_t tx_count = 0;          // datagrams sent since TX stamping was enabled
+    uint32_t txid_seq[256] = {0};   // send counter & 255 -> PING seq (0: not a PING)
+    uint32_t last_ctl_seq = 0;      // newest CONTROL seq acted on
+    if (TIMESTAMPS && use_binary) {
+        ts_rx = tstamp_enable_rx(sock) == 0;
+        ts_tx = tstamp_enable_tx(sock) == 0;
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"timestamping\",\"pid\":%d,\"kernel_rx\":%s,\"kernel_tx\":%s}\n",
+                   time(NULL), my_pid, ts_rx ? "true" : "false", ts_tx ? "true" : "false");
+        } else {
+            log_printf(LOG_CAT_GENERAL, "CLIENT: timestamping kernel_rx=%s kernel_tx=%s\n",
+                   ts_rx ? "on" : "off", ts_tx ? "on" : "off");
+        }
+    } else if (TIMESTAMPS) {
+        log_printf(LOG_CAT_GENERAL, "CLIENT: --timestamps needs the binary protocol, disabled\n");
+        TIMESTAMPS = 0;
+    }
+
+    // 5) Switch to the event loop: the socket is drained non-blocking and a
+    //    timerfd paces sends, so replies, CONTROL and timeouts are handled
+    //    as they happen instead of inside one blocking recvfrom().
+    int flags = 1;
+    if (ioctl(sock, FIONBIO, &flags) < 0) {
+        perror("ioctl FIONBIO");
+        close(sock);
+        return 1;
+    }
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (tfd < 0) { perror("timerfd_create"); close(sock); return 1; }
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = (time_t)(interval_ns / 1000000000ull),
+                         .tv_nsec = (long)(interval_ns % 1000000000ull) },
+        .it_value    = { .tv_sec = 0, .tv_nsec = 1 }   // first probe right away
+    };
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+        perror("timerfd_settime");
+        close(sock);
+        return 1;
+    }
+
+    // 5b) Adaptive pacing starts at the configured interval; the timer is
+    //     re-armed whenever the wanted interval changes
+    rate_ctl_t rc;
+    uint64_t min_ns = PROBE_MIN_MS > 0 ? (uint64_t)PROBE_MIN_MS * 1000000ull : interval_ns / 10;
+    uint64_t max_ns = PROBE_MAX_MS > 0 ? (uint64_t)PROBE_MAX_MS * 1000000ull : interval_ns * 10;
+    if (min_ns == 0) min_ns = 1;
+    if (!ADAPTIVE) min_ns = max_ns = interval_ns;
+    rate_ctl_init(&rc, interval_ns, min_ns, max_ns, (uint32_t)WINDOW, ADAPT_SWING_MS);
+    uint64_t armed_ns = interval_ns;
+
+    host_budget_t budget = {0};
+    uint64_t skipped = 0, skipped_logged_ns = 0;   // ticks the budget had no room for
+    if (HOST_BUDGET > 0 && host_budget_open(&budget, HOST_BUDGET_NAME, (uint64_t)HOST_BUDGET) < 0) {
+        perror("host_budget_open");
+        close(sock);
+        return 1;
+    }
+    if (budget.shm && budget.shm->pps != (uint64_t)HOST_BUDGET)
+        log_printf(LOG_CAT_GENERAL, "CLIENT: host budget already set to %lu pps, using that\n",
+                   (unsigned long)budget.shm->pps);
+
+    // Track every probe sent within one timeout, plus the pipeline depth,
+    // so late replies can still be recognised. An adaptive client may go
+    // as fast as min_ns.
+    uint64_t timeout_ns = (uint64_t)TIMEOUT_MS * 1000000ull;
+    probe_stats_t ps = {0};
+    if (inflight_init(&ps.probes, (uint32_t)(timeout_ns / min_ns) * 2 + (uint32_t)PIPELINE + 16,
+                      timeout_ns) < 0) {
+        perror("inflight_init");
+        close(sock);
+        return 1;
+    }
+
+    // 6) Prepare stats: min/max/mean/variance over the last WINDOW RTTs
+    winstats_t rtt_win;
+    void *rtt_store = malloc(winstats_storage_size((uint32_t)WINDOW));
+    if (!rtt_store) {
+        perror("malloc");
+        close(sock);
+        return 1;
     }
+    winstats_init(&rtt_win, (uint32_t)WINDOW, rtt_store);
 
-    // 5) Prepare stats
-    int    seq = 0, sent = 0, received = 0, lost = 0;
-    double rtts[WINDOW];
-    int    rtt_count  = 0;
+    struct pollfd pfds[2] = {
+        { .fd = sock, .events = POLLIN },
+        { .fd = tfd,  .events = POLLIN },
+    };
 
-    char sendbuf[BUFSZ], recvbuf[BUFSZ];
+    while (!STOP) {
+        // sleep until a reply, the next send tick, or the oldest probe's timeout
+        int wait_ms = -1;
+        uint64_t deadline = inflight_next_deadline(&ps.probes);
+        if (lane_probing) {
+            uint64_t lane_due = lane_prober_deadline(&lp);
+            if (!deadline || lane_due < deadline) deadline = lane_due;
+        }
+        if (deadline) {
+            uint64_t now = get_now_ns();
+            wait_ms = deadline <= now ? 0 : (int)((deadline - now + 999999) / 1000000);
+        }
+        if (poll(pfds, 2, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
 
-    while (1) {
-        // ——— Ping round ———
-        seq++; sent++;
-        struct timespec t0, t1;
-        clock_gettime(CLOCK_MONOTONIC, &t0);
+        // ——— Timeouts ———
+        // expire first so a timed-out probe frees its pipeline slot
+        uint64_t lost_before = ps.probes.lost;
+        inflight_expire(&ps.probes, get_now_ns(), log_probe_lost, &ps);
+        if (ps.probes.lost != lost_before) rate_ctl_loss(&rc);
 
-        int len = snprintf(sendbuf, BUFSZ, "PING seq=%d", seq);
-        if (sendto(sock, sendbuf, len, 0,
-                   (struct sockaddr *)&srv, sizeof(srv)) < 0) {
-            perror("sendto PING");
-            // we still attempt to recv CONTROL below
+        // ——— Lane probes ———
+        if (lane_probing) {
+            int sent = lane_prober_tick(&lp, sock, get_now_ns());
+            if (ts_tx)
+                while (sent-- > 0) txid_seq[tx_count++ & 255] = 0;
         }
 
-        ssize_t n = recvfrom(sock, recvbuf, BUFSZ, 0, NULL, NULL);
-        double rtt = -1;
-        if (n < 0) {
-            // timeout or error
-            lost++;
-            if (JSON_LOGGING) {
-                printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_timeout\",\"seq\":%d,\"lost\":%d}\n",
-                       time(NULL), seq, lost);
-                fflush(stdout);
-            } else {
-                printf("seq=%d rtt_ms=NA loss=%d window_swing_ms=unchanged\n",
-                       seq, lost);
+        // ——— Send tick ———
+        if (pfds[1].revents & POLLIN) {
+            uint64_t ticks;
+            if (read(tfd, &ticks, sizeof(ticks)) < 0 && errno != EAGAIN)
+                perror("read timerfd");
+            // skip the tick while the pipeline is full; missed ticks are not
+            // made up, so the probe rate never exceeds the configured one.
+            // A tick the host budget has no room for is skipped the same way.
+            int room = ps.probes.outstanding < (uint32_t)PIPELINE && !inflight_full(&ps.probes);
+            if (room && budget.shm) {
+                uint64_t now = get_now_ns();
+                room = host_budget_take(&budget, now);
+                if (!room) skipped++;
+                if (skipped && now - skipped_logged_ns >= 1000000000ull) {
+                    log_throttled(my_pid, skipped, budget.shm->pps);
+                    skipped = 0;
+                    skipped_logged_ns = now;
+                }
             }
-        } else {
-            // Check if this is a CONTROL message first
-            if (strncmp(recvbuf, "CONTROL", 7) == 0) {
-                int recv_pid = 0, new_port = 0;
+            if (room) {
+                uint64_t t0 = get_now_ns();
+                uint32_t seq = inflight_send(&ps.probes, t0);
+                int len;
+                if (TIMESTAMPS) {
+                    wire_ping_ts_t *ping = (wire_ping_ts_t *)sendbuf;
+                    wire_hdr_init(&ping->h, WIRE_PING, (uint32_t)my_pid, seq, t0);
+                    ping->srv_rx_ns = ping->srv_tx_ns = 0;
+                    len = sizeof(*ping);
+                    inflight_find(&ps.probes, seq)->tx_wall_ns = tstamp_wall_ns();
+                } else if (use_binary) {
+                    wire_ping_t *ping = (wire_ping_t *)sendbuf;
+                    wire_hdr_init(&ping->h, WIRE_PING, (uint32_t)my_pid, seq, t0);
+                    len = sizeof(*ping);
+                } else {
+                    len = snprintf(sendbuf, BUFSZ, "PING seq=%u", seq);
+                }
+                if (sendto(sock, sendbuf, len, 0,
+                           (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+                    perror("sendto PING");
+                    // the probe stays pending and will time out as a loss
+                } else if (ts_tx) {
+                    txid_seq[tx_count++ & 255] = seq;
+                }
+            }
+        }
+
+        // ——— Kernel TX timestamps ———
+        if (pfds[0].revents & POLLERR) {
+            uint32_t id;
+            uint64_t stamp;
+            while (tstamp_read_tx(sock, &id, &stamp)) {
+                uint32_t seq = txid_seq[id & 255];
+                inflight_slot_t *slot = seq ? inflight_find(&ps.probes, seq) : NULL;
+                if (slot) {
+                    slot->tx_wall_ns = stamp;
+                    slot->tx_kernel  = 1;
+                }
+            }
+        }
+
+        // ——— Replies ———
+        while (pfds[0].revents & POLLIN) {
+            char ctrl[TSTAMP_CMSG_SPACE];
+            struct iovec iov = { .iov_base = recvbuf, .iov_len = BUFSZ - 1 };
+            struct msghdr msg = {
+                .msg_iov        = &iov,
+                .msg_iovlen     = 1,
+                .msg_control    = ts_rx ? ctrl : NULL,
+                .msg_controllen = ts_rx ? sizeof(ctrl) : 0
+            };
+            ssize_t n = recvmsg(sock, &msg, 0);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    perror("recvmsg");
+                break;
+            }
+            uint64_t t1 = get_now_ns();
+            uint64_t rx_wall = TIMESTAMPS ? tstamp_rx(&msg) : 0;
+            if (TIMESTAMPS && !rx_wall) rx_wall = tstamp_wall_ns();
+            recvbuf[n] = '\0';
+
+            int is_control = 0, recv_pid = 0, new_port = 0;
+            uint32_t ctl_seq = 0;
+            const wire_hdr_t *h = use_binary ? wire_view(recvbuf, (size_t)n) : NULL;
+            if (h && lane_probing) {
+                int handled = lane_prober_reply(&lp, sock, h, (size_t)n, t1);
+                if (handled) {
+                    if (ts_tx)
+                        while (--handled > 0) txid_seq[tx_count++ & 255] = 0;
+                    continue;
+                }
+            }
+            if (h && h->type == WIRE_RATE_HINT) {
+                const wire_rate_hint_t *hint = (const wire_rate_hint_t *)h;
+                if ((pid_t)le32toh(h->pid) == my_pid && ADAPTIVE)
+                    rate_ctl_hint(&rc, (uint64_t)le32toh(hint->interval_us) * 1000ull,
+                                  (uint64_t)le32toh(hint->ttl_ms) * 1000000ull, t1);
+                continue;
+            }
+            if (!h && strncmp(recvbuf, "RATE ", 5) == 0) {
                 char *p;
+                int hint_pid = 0;
+                unsigned long interval_us = 0, ttl_ms = 0;
+                if ((p = strstr(recvbuf, "pid=")))         hint_pid    = atoi(p+4);
+                if ((p = strstr(recvbuf, "interval_us="))) interval_us = strtoul(p+12, NULL, 10);
+                if ((p = strstr(recvbuf, "ttl_ms=")))      ttl_ms      = strtoul(p+7, NULL, 10);
+                if (hint_pid == my_pid && ADAPTIVE && interval_us)
+                    rate_ctl_hint(&rc, (uint64_t)interval_us * 1000ull,
+                                  (uint64_t)ttl_ms * 1000000ull, t1);
+                continue;
+            }
+            // the server lost track of us (evicted as idle, or restarted):
+            // register again, where we are now
+            int rereg_pid = -1;
+            if (h && h->type == WIRE_REREGISTER) rereg_pid = (int)le32toh(h->pid);
+            else if (!h && strncmp(recvbuf, "REREGISTER", 10) == 0 && strstr(recvbuf, "pid="))
+                rereg_pid = atoi(strstr(recvbuf, "pid=") + 4);
+            if (rereg_pid >= 0) {
+                if (rereg_pid != my_pid) continue;
+                if (sendto(sock, regbuf, rlen, 0, (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+                    perror("sendto REGISTER");   // the next METRIC asks again
+                } else if (ts_tx) {
+                    txid_seq[tx_count++ & 255] = 0;
+                }
+                if (JSON_LOGGING) {
+                    log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"reregistration\",\"pid\":%d,\"port\":%d}\n",
+                           time(NULL), my_pid, PORT);
+                } else {
+                    log_printf(LOG_CAT_GENERAL, "CLIENT: server asked to register again → %.*s\n", rlen, regbuf);
+                }
+                continue;
+            }
+
+            if (h) {
+                if (h->type == WIRE_CONTROL) {
+                    const wire_control_t *ctl = (const wire_control_t *)h;
+                    is_control = 1;
+                    recv_pid   = (int)le32toh(h->pid);
+                    new_port   = le16toh(ctl->port);
+                    ctl_seq    = le32toh(h->seq);
+                }
+            } else if (strncmp(recvbuf, "CONTROL", 7) == 0) {
+                char *p;
+                is_control = 1;
                 if ((p = strstr(recvbuf, "pid=")))  recv_pid  = atoi(p+4);
                 if ((p = strstr(recvbuf, "port="))) new_port  = atoi(p+5);
+                if ((p = strstr(recvbuf, "seq=")))  ctl_seq   = (uint32_t)strtoul(p+4, NULL, 10);
+            }
 
-                if (recv_pid == my_pid && new_port > 0 && new_port != PORT) {
+            // CONTROL is not a probe reply and never counts as a loss. Each
+            // seq is acted on once (resends repeat it) and every copy is
+            // acknowledged from the lane the client ends up on.
+            if (is_control) {
+                if (recv_pid != my_pid) continue;
+                int fresh = ctl_seq == 0 || (int32_t)(ctl_seq - last_ctl_seq) > 0;
+                if (fresh && ctl_seq) last_ctl_seq = ctl_seq;
+                if (fresh && new_port > 0 && new_port != PORT) {
                     if (JSON_LOGGING) {
-                        printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"lane_switch\",\"pid\":%d,\"old_port\":%d,\"new_port\":%d}\n",
+                        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"lane_switch\",\"pid\":%d,\"old_port\":%d,\"new_port\":%d}\n",
                                time(NULL), my_pid, PORT, new_port);
-                        fflush(stdout);
                     } else {
-                        printf("CLIENT: switching from port %d to %d\n",
+                        log_printf(LOG_CAT_GENERAL, "CLIENT: switching from port %d to %d\n",
                                PORT, new_port);
-                        fflush(stdout);
                     }
                     PORT           = new_port;
                     srv.sin_port  = htons(new_port);
+                    if (lane_probing) lane_prober_set_port(&lp, new_port);
                 }
-                // Treat as lost packet since we expected a PONG
-                lost++;
-                if (JSON_LOGGING) {
-                    printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_control\",\"seq\":%d,\"lost\":%d}\n",
-                           time(NULL), seq, lost);
-                    fflush(stdout);
-                } else {
-                    printf("seq=%d rtt_ms=NA loss=%d window_swing_ms=unchanged (got CONTROL)\n",
-                           seq, lost);
-                }
-            } else {
-                // Normal PONG processing
-                clock_gettime(CLOCK_MONOTONIC, &t1);
-                rtt = (t1.tv_sec - t0.tv_sec)*1e3 +
-                      (t1.tv_nsec - t0.tv_nsec)/1e6;
-
-                // rolling window
-                if (rtt_count < WINDOW) {
-                    rtts[rtt_count++] = rtt;
-                } else {
-                    memmove(rtts, rtts+1, (WINDOW-1)*sizeof(double));
-                    rtts[WINDOW-1] = rtt;
+                if (ctl_seq) {
+                    int alen;
+                    if (h) {
+                        wire_control_t *ack = (wire_control_t *)sendbuf;
+                        *ack = *(const wire_control_t *)h;
+                        wire_hdr_init(&ack->h, WIRE_CONTROL_ACK, (uint32_t)my_pid, ctl_seq, t1);
+                        alen = sizeof(*ack);
+                    } else {
+                        alen = snprintf(sendbuf, BUFSZ, "CONTROL_ACK pid=%d seq=%u port=%d",
+                                        my_pid, ctl_seq, new_port);
+                    }
+                    if (sendto(sock, sendbuf, alen, 0,
+                               (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+                        perror("sendto CONTROL_ACK");   // the server resends
+                    } else if (ts_tx) {
+                        txid_seq[tx_count++ & 255] = 0;
+                    }
                 }
-                received++;
+                continue;
+            }
 
-                double mn = rtts[0], mx = rtts[0];
-                for (int i = 1; i < rtt_count; i++) {
-                    if (rtts[i] < mn) mn = rtts[i];
-                    if (rtts[i] > mx) mx = rtts[i];
-                }
-                double swing = mx - mn;
+            uint32_t seq;
+            if (!parse_pong(recvbuf, (size_t)n, use_binary, &seq)) continue;
 
+            double rtt = -1;
+            int reordered;
+            reply_kind_t kind = inflight_reply(&ps.probes, seq, t1, &rtt, &reordered);
+            if (kind != REPLY_OK) {
+                const char *what = kind == REPLY_LATE      ? "ping_late"
+                                 : kind == REPLY_DUPLICATE ? "ping_duplicate"
+                                                           : "ping_unknown";
                 if (JSON_LOGGING) {
-                    printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_success\",\"seq\":%d,\"rtt\":%.2f,\"lost\":%d,\"jitter\":%.2f,\"pid\":%d,\"port\":%d}\n",
-                           time(NULL), seq, rtt, lost, swing, my_pid, PORT);
-                    fflush(stdout);
+                    log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"%s\",\"seq\":%u,\"late\":%lu,\"duplicates\":%lu}\n",
+                           time(NULL), what, seq, (unsigned long)ps.probes.late,
+                           (unsigned long)ps.probes.duplicates);
                 } else {
-                    printf("seq=%d rtt_ms=%.1f loss=%d window_swing_ms=%.1f\n",
-                           seq, rtt, lost, swing);
+                    log_printf(LOG_CAT_PROBE, "seq=%u %s\n", seq, what + 5);
                 }
+                continue;
+            }
 
-                // send METRIC back to server over the same socket
-                char metric[128];
-                int  mlen = snprintf(metric, sizeof(metric),
-                    "METRIC pid=%d rtt=%.1f loss=%d jitter=%.1f",
-                    my_pid, rtt, (lost > 0 ? 1 : 0), swing);
-                if (sendto(sock, metric, mlen, 0,
-                           (struct sockaddr *)&srv, sizeof(srv)) < 0) {
-                    perror("sendto METRIC");
+            // With timestamps, rtt is taken between the kernel's send and
+            // receive stamps and split into time inside the server (its own
+            // rx/tx stamps) and time on the network.
+            double rtt_user = rtt, server_ms = -1, net_ms = -1;
+            int tx_kernel = 0;
+            const inflight_slot_t *slot = TIMESTAMPS ? inflight_find(&ps.probes, seq) : NULL;
+            if (slot && slot->tx_wall_ns && rx_wall > slot->tx_wall_ns) {
+                rtt       = (double)(rx_wall - slot->tx_wall_ns) / 1e6;
+                tx_kernel = slot->tx_kernel;
+                const wire_ping_ts_t *pong = (const wire_ping_ts_t *)recvbuf;
+                uint64_t srx = (size_t)n >= sizeof(*pong) ? le64toh(pong->srv_rx_ns) : 0;
+                uint64_t stx = (size_t)n >= sizeof(*pong) ? le64toh(pong->srv_tx_ns) : 0;
+                if (srx && stx >= srx) {
+                    server_ms = (double)(stx - srx) / 1e6;
+                    net_ms    = rtt > server_ms ? rtt - server_ms : 0.0;
                 }
             }
+
+            // rolling window
+            winstats_push(&rtt_win, rtt);
+            double swing = winstats_max(&rtt_win) - winstats_min(&rtt_win);
+            rate_ctl_reply(&rc, swing);
+            unsigned long lost = (unsigned long)ps.probes.lost;
+
+            char split[160] = "";
+            if (TIMESTAMPS && JSON_LOGGING) {
+                snprintf(split, sizeof(split),
+                         ",\"rtt_user\":%.3f,\"server_ms\":%.3f,\"net_rtt\":%.3f,\"tx_stamp\":\"%s\"",
+                         rtt_user, server_ms, net_ms, tx_kernel ? "kernel" : "user");
+            } else if (TIMESTAMPS) {
+                snprintf(split, sizeof(split), " server_ms=%.3f net_ms=%.3f%s",
+                         server_ms, net_ms, tx_kernel ? "" : " (user tx stamp)");
+            }
+            if (JSON_LOGGING) {
+                log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_success\",\"seq\":%u,\"rtt\":%.2f,\"lost\":%lu,\"jitter\":%.2f,\"rtt_mean\":%.2f,\"rtt_stddev\":%.2f,\"pid\":%d,\"port\":%d%s%s}\n",
+                       time(NULL), seq, rtt, lost, swing,
+                       winstats_mean(&rtt_win), winstats_stddev(&rtt_win), my_pid, PORT,
+                       reordered ? ",\"reordered\":true" : "", split);
+            } else {
+                log_printf(LOG_CAT_PROBE, "seq=%u rtt_ms=%.1f loss=%lu window_swing_ms=%.1f%s%s\n",
+                       seq, rtt, lost, swing, split, reordered ? " (reordered)" : "");
+            }
+
+            // send METRIC back to server over the same socket; loss is the
+            // number of probes that timed out since the previous METRIC
+            int mlen;
+            if (use_binary) {
+                wire_metric_t *m = (wire_metric_t *)sendbuf;
+                wire_hdr_init(&m->h, WIRE_METRIC, (uint32_t)my_pid, seq, t1);
+                m->rtt_us    = htole32((uint32_t)(rtt * 1000.0));
+                m->jitter_us = htole32((uint32_t)(swing * 1000.0));
+                m->loss      = htole32((uint32_t)ps.loss_since_metric);
+                m->reserved  = 0;
+                mlen = sizeof(*m);
+            } else {
+                mlen = snprintf(sendbuf, BUFSZ,
+                    "METRIC pid=%d rtt=%.1f loss=%d jitter=%.1f",
+                    my_pid, rtt, ps.loss_since_metric, swing);
+            }
+            if (sendto(sock, sendbuf, mlen, 0,
+                       (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+                perror("sendto METRIC");
+            } else if (ts_tx) {
+                txid_seq[tx_count++ & 255] = 0;
+            }
+            ps.loss_since_metric = 0;
         }
 
-        struct timespec sleep_ts = {
-            .tv_sec  = RATE_MS / 1000,
-            .tv_nsec = (RATE_MS % 1000) * 1000000
-        };
-        nanosleep(&sleep_ts, NULL);
+        // ——— Pacing ———
+        // a faster interval takes effect at once, a slower one from the
+        // tick already due
+        uint64_t want_ns = rate_ctl_interval(&rc, get_now_ns());
+        if (want_ns != armed_ns) {
+            struct itimerspec cur;
+            if (timerfd_gettime(tfd, &cur) < 0) cur.it_value = its.it_interval;
+            uint64_t left = (uint64_t)cur.it_value.tv_sec * 1000000000ull + (uint64_t)cur.it_value.tv_nsec;
+            uint64_t first = left && left < want_ns ? left : want_ns;
+            its.it_interval = (struct timespec){ .tv_sec  = (time_t)(want_ns / 1000000000ull),
+                                                 .tv_nsec = (long)(want_ns % 1000000000ull) };
+            its.it_value    = (struct timespec){ .tv_sec  = (time_t)(first / 1000000000ull),
+                                                 .tv_nsec = (long)(first % 1000000000ull) };
+            if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+                perror("timerfd_settime");
+            } else {
+                log_probe_rate(my_pid, armed_ns, want_ns, want_ns < rc.interval_ns);
+                armed_ns = want_ns;
+            }
+        }
     }
 
+    inflight_free(&ps.probes);
+    host_budget_close(&budget);
+    if (lane_probing) lane_prober_free(&lp);
+    free(rtt_store);
+    close(tfd);
     close(sock);
+    log_shutdown();
     return 0;
 }
@@ -0,0 +1,498 @@
+// multi.c
+// Multi-target prober (see multi.h).
+
+#define _GNU_SOURCE  // recvmmsg/sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common/log.h"
+#include "common/winstats.h"
+#include "common/wire.h"
+#include "inflight.h"
+#include "multi.h"
+#include "timer_wheel.h"
+
+#define MT_BATCH        64
+#define MT_MAX_SOCKETS  64
+#define MT_TXBUF        64      // largest datagram we send (REGISTER text)
+#define MT_RXBUF        256     // replies are small; longer ones are not ours
+#define MT_TICK_NS      1000000ull
+#define MT_WHEEL_SLOTS  4096
+#define MT_REG_RETRY_NS 1000000000ull
+
+enum { T_REGISTERING, T_UP };
+
+typedef struct {
+    tw_node_t   timer;            // next send, probe timeout or REGISTER retry
+    char        name[64];
+    struct sockaddr_in addr;      // current lane
+    uint16_t    door_port;
+    uint32_t    id;               // wire pid: process bits | target index
+    int         sock;
+    int         state;
+    int         reg_tries;
+    uint64_t    next_send_ns;
+    uint32_t    switches;
+    uint32_t    ctl_seq;          // newest CONTROL seq acted on
+    int         loss_since_metric;
+    inflight_t  probes;           // slots live in the shared arena
+    winstats_t  rtt_win;          // so does the window
+} target_t;
+
+typedef struct {
+    int fd;
+    unsigned count;
+    struct mmsghdr     msgs[MT_BATCH];
+    struct iovec       iov[MT_BATCH];
+    struct sockaddr_in to[MT_BATCH];
+    _Alignas(8) char   buf[MT_BATCH][MT_TXBUF];
+} mt_sock_t;
+
+typedef struct {
+    const multi_config_t *cfg;
+    target_t     *targets;
+    int           ntargets;
+    mt_sock_t    *socks;
+    int           nsocks;
+    timer_wheel_t wheel;
+    tw_node_t     report;         // periodic per-target summary
+    uint64_t      syscalls;       // sendmmsg + recvmmsg + poll
+} mt_state_t;
+
+// ——— Send batching ———
+// Everything a pass of the loop produces (PINGs, METRICs, REGISTERs) is
+// queued per socket and leaves in one sendmmsg().
+
+static void sock_flush(mt_state_t *st, mt_sock_t *s) {
+    unsigned done = 0;
+    while (done < s->count) {
+        int m = sendmmsg(s->fd, s->msgs + done, s->count - done, 0);
+        st->syscalls++;
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("sendmmsg");
+            break;   // what did not go out is lost like any dropped probe
+        }
+        done += (unsigned)m;
+    }
+    s->count = 0;
+}
+
+static void sock_queue(mt_state_t *st, target_t *t, const void *data, size_t len) {
+    mt_sock_t *s = &st->socks[t->sock];
+    if (s->count == MT_BATCH) sock_flush(st, s);
+    unsigned i = s->count++;
+    memcpy(s->buf[i], data, len);
+    s->to[i]  = t->addr;
+    s->iov[i] = (struct iovec){ .iov_base = s->buf[i], .iov_len = len };
+    s->msgs[i].msg_hdr = (struct msghdr){
+        .msg_name    = &s->to[i],
+        .msg_namelen = sizeof(s->to[i]),
+        .msg_iov     = &s->iov[i],
+        .msg_iovlen  = 1
+    };
+}
+
+// ——— Targets ———
+
+static int parse_target(target_t *t, const char *spec, const char *name) {
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host)) return -1;
+    memcpy(host, spec, (size_t)(colon - spec));
+    host[colon - spec] = '\0';
+    char *end;
+    long port = strtol(colon + 1, &end, 10);
+    if (*end || port <= 0 || port > 65535) return -1;
+    memset(&t->addr, 0, sizeof(t->addr));
+    t->addr.sin_family = AF_INET;
+    t->addr.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &t->addr.sin_addr) != 1) return -1;
+    t->door_port = (uint16_t)port;
+    snprintf(t->name, sizeof(t->name), "%s", name && *name ? name : spec);
+    return 0;
+}
+
+// Fill st->targets from the CLI list and the file. Returns the count or -1.
+static int load_targets(mt_state_t *st) {
+    const multi_config_t *cfg = st->cfg;
+    int cap = cfg->ntargets, n = 0;
+    FILE *f = NULL;
+    if (cfg->targets_file) {
+        f = fopen(cfg->targets_file, "r");
+        if (!f) {
+            perror(cfg->targets_file);
+            return -1;
+        }
+        char line[256];
+        while (fgets(line, sizeof(line), f)) cap++;
+        rewind(f);
+    }
+    if (cap > (int)MT_MAX_TARGETS) {
+        fprintf(stderr, "only the first %u targets are probed\n", MT_MAX_TARGETS);
+        cap = (int)MT_MAX_TARGETS;
+    }
+    st->targets = calloc((size_t)(cap ? cap : 1), sizeof(*st->targets));
+    if (!st->targets) {
+        if (f) fclose(f);
+        return -1;
+    }
+
+    for (int i = 0; i < cfg->ntargets && n < cap; i++) {
+        if (parse_target(&st->targets[n], cfg->targets[i], NULL) < 0)
+            fprintf(stderr, "ignoring bad target '%s'\n", cfg->targets[i]);
+        else
+            n++;
+    }
+    if (f) {
+        char line[256];
+        int lineno = 0;
+        while (fgets(line, sizeof(line), f) && n < cap) {
+            lineno++;
+            char *hash = strchr(line, '#');
+            if (hash) *hash = '\0';
+            char spec[128], name[64] = "";
+            int got = sscanf(line, "%127s %63s", spec, name);
+            if (got < 1) continue;
+            if (parse_target(&st->targets[n], spec, name) < 0)
+                fprintf(stderr, "%s:%d: ignoring bad target '%s'\n", cfg->targets_file, lineno, spec);
+            else
+                n++;
+        }
+        fclose(f);
+    }
+    return n;
+}
+
+static void log_target_lost(uint32_t seq, void *arg) {
+    target_t *t = arg;
+    t->loss_since_metric++;
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_timeout\",\"target\":\"%s\",\"pid\":%u,\"seq\":%u,\"lost\":%lu}\n",
+               time(NULL), t->name, t->id, seq, (unsigned long)t->probes.lost);
+    } else {
+        log_printf(LOG_CAT_PROBE, "[%s] seq=%u rtt_ms=NA loss=%lu window_swing_ms=unchanged\n",
+               t->name, seq, (unsigned long)t->probes.lost);
+    }
+}
+
+static void send_register(mt_state_t *st, target_t *t) {
+    char reg[MT_TXBUF];
+    int len = snprintf(reg, sizeof(reg), "REGISTER pid=%u proto=%d", t->id, WIRE_VERSION);
+    // registration always goes to the door, even after a lane switch
+    struct sockaddr_in lane = t->addr;
+    t->addr.sin_port = htons(t->door_port);
+    sock_queue(st, t, reg, (size_t)len);
+    t->addr = lane;
+    if (++t->reg_tries == 3) {
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"client\",\"event\":\"target_unreachable\",\"target\":\"%s\",\"pid\":%u}\n",
+                   time(NULL), t->name, t->id);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "CLIENT: [%s] no REGISTER ack yet, still retrying\n", t->name);
+        }
+    }
+}
+
+// The target's one timer covers its next send and its oldest probe's
+// timeout, whichever comes first.
+static void target_rearm(mt_state_t *st, target_t *t) {
+    uint64_t due = t->next_send_ns;
+    uint64_t deadline = inflight_next_deadline(&t->probes);
+    if (deadline && deadline < due) due = deadline;
+    tw_schedule(&st->wheel, &t->timer, due);
+}
+
+static void target_tick(mt_state_t *st, target_t *t, uint64_t now) {
+    const multi_config_t *cfg = st->cfg;
+    if (t->state == T_REGISTERING) {
+        send_register(st, t);
+        tw_schedule(&st->wheel, &t->timer, now + MT_REG_RETRY_NS);
+        return;
+    }
+    inflight_expire(&t->probes, now, log_target_lost, t);
+    if (now >= t->next_send_ns) {
+        // like the single-target pinger: a tick with the pipeline full is
+        // skipped, and missed ticks are not made up
+        if (t->probes.outstanding < (uint32_t)cfg->pipeline && !inflight_full(&t->probes)) {
+            wire_ping_t ping;
+            uint32_t seq = inflight_send(&t->probes, now);
+            wire_hdr_init(&ping.h, WIRE_PING, t->id, seq, now);
+            sock_queue(st, t, &ping, sizeof(ping));
+        }
+        t->next_send_ns += cfg->interval_ns;
+        if (t->next_send_ns <= now) t->next_send_ns = now + cfg->interval_ns;
+    }
+    target_rearm(st, t);
+}
+
+static void log_target_stats(mt_state_t *st) {
+    for (int i = 0; i < st->ntargets; i++) {
+        target_t *t = &st->targets[i];
+        const inflight_t *p = &t->probes;
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"target_stats\",\"target\":\"%s\",\"pid\":%u,\"up\":%s,\"port\":%d,\"switches\":%u,\"sent\":%lu,\"received\":%lu,\"lost\":%lu,\"late\":%lu,\"duplicates\":%lu,\"reordered\":%lu,\"rtt_mean\":%.2f,\"rtt_stddev\":%.2f,\"rtt_min\":%.2f,\"rtt_max\":%.2f}\n",
+                   time(NULL), t->name, t->id, t->state == T_UP ? "true" : "false",
+                   ntohs(t->addr.sin_port), t->switches,
+                   (unsigned long)p->sent, (unsigned long)p->received, (unsigned long)p->lost,
+                   (unsigned long)p->late, (unsigned long)p->duplicates, (unsigned long)p->reordered,
+                   winstats_mean(&t->rtt_win), winstats_stddev(&t->rtt_win),
+                   winstats_min(&t->rtt_win), winstats_max(&t->rtt_win));
+        } else {
+            log_printf(LOG_CAT_GENERAL, "CLIENT: [%s] port=%d sent=%lu recv=%lu lost=%lu rtt mean=%.1f min=%.1f max=%.1f ms\n",
+                   t->name, ntohs(t->addr.sin_port), (unsigned long)p->sent,
+                   (unsigned long)p->received, (unsigned long)p->lost,
+                   winstats_mean(&t->rtt_win), winstats_min(&t->rtt_win), winstats_max(&t->rtt_win));
+        }
+    }
+}
+
+static void on_timer(tw_node_t *n, void *arg) {
+    mt_state_t *st = arg;
+    uint64_t now = get_now_ns();
+    if (n == &st->report) {
+        log_target_stats(st);
+        tw_schedule(&st->wheel, &st->report, now + (uint64_t)st->cfg->report_s * 1000000000ull);
+        return;
+    }
+    target_tick(st, (target_t *)n, now);   // timer is the first member
+}
+
+// ——— Replies ———
+
+static void handle_pong(mt_state_t *st, target_t *t, uint32_t seq, uint64_t now) {
+    double rtt;
+    int reordered;
+    reply_kind_t kind = inflight_reply(&t->probes, seq, now, &rtt, &reordered);
+    if (kind != REPLY_OK) {
+        const char *what = kind == REPLY_LATE      ? "ping_late"
+                         : kind == REPLY_DUPLICATE ? "ping_duplicate"
+                                                   : "ping_unknown";
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"%s\",\"target\":\"%s\",\"pid\":%u,\"seq\":%u}\n",
+                   time(NULL), what, t->name, t->id, seq);
+        } else {
+            log_printf(LOG_CAT_PROBE, "[%s] seq=%u %s\n", t->name, seq, what + 5);
+        }
+        return;
+    }
+
+    winstats_push(&t->rtt_win, rtt);
+    double swing = winstats_max(&t->rtt_win) - winstats_min(&t->rtt_win);
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_PROBE, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"ping_success\",\"target\":\"%s\",\"seq\":%u,\"rtt\":%.2f,\"lost\":%lu,\"jitter\":%.2f,\"rtt_mean\":%.2f,\"rtt_stddev\":%.2f,\"pid\":%u,\"port\":%d%s}\n",
+               time(NULL), t->name, seq, rtt, (unsigned long)t->probes.lost, swing,
+               winstats_mean(&t->rtt_win), winstats_stddev(&t->rtt_win), t->id,
+               ntohs(t->addr.sin_port), reordered ? ",\"reordered\":true" : "");
+    } else {
+        log_printf(LOG_CAT_PROBE, "[%s] seq=%u rtt_ms=%.1f loss=%lu window_swing_ms=%.1f%s\n",
+               t->name, seq, rtt, (unsigned long)t->probes.lost, swing,
+               reordered ? " (reordered)" : "");
+    }
+
+    wire_metric_t m;
+    wire_hdr_init(&m.h, WIRE_METRIC, t->id, seq, now);
+    m.rtt_us    = htole32((uint32_t)(rtt * 1000.0));
+    m.jitter_us = htole32((uint32_t)(swing * 1000.0));
+    m.loss      = htole32((uint32_t)t->loss_since_metric);
+    m.reserved  = 0;
+    sock_queue(st, t, &m, sizeof(m));
+    t->loss_since_metric = 0;
+
+    // the answered probe may have been the one the timer was waiting on
+    target_rearm(st, t);
+}
+
+static void target_switch(target_t *t, int old_port, int new_port) {
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"lane_switch\",\"target\":\"%s\",\"pid\":%u,\"old_port\":%d,\"new_port\":%d}\n",
+               time(NULL), t->name, t->id, old_port, new_port);
+    } else {
+        log_printf(LOG_CAT_GENERAL, "CLIENT: [%s] switching from port %d to %d\n",
+               t->name, old_port, new_port);
+    }
+    t->addr.sin_port = htons((uint16_t)new_port);
+    t->switches++;
+}
+
+static void handle_reply(mt_state_t *st, const char *buf, size_t n, uint64_t now) {
+    const wire_hdr_t *h = wire_view(buf, n);
+    if (!h) return;
+    uint32_t pid = le32toh(h->pid);
+    uint32_t idx = pid & (MT_MAX_TARGETS - 1);
+    if (idx >= (uint32_t)st->ntargets || st->targets[idx].id != pid) return;
+    target_t *t = &st->targets[idx];
+
+    switch (h->type) {
+        case WIRE_REGISTER_ACK:
+            if (t->state == T_UP) break;
+            t->state        = T_UP;
+            t->next_send_ns = now;
+            if (JSON_LOGGING) {
+                log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"target_up\",\"target\":\"%s\",\"pid\":%u,\"port\":%d}\n",
+                       time(NULL), t->name, t->id, t->door_port);
+            } else {
+                log_printf(LOG_CAT_GENERAL, "CLIENT: [%s] registered as pid=%u\n", t->name, t->id);
+            }
+            target_tick(st, t, now);
+            break;
+        case WIRE_PONG:
+            if (t->state == T_UP) handle_pong(st, t, le32toh(h->seq), now);
+            break;
+        case WIRE_REREGISTER:
+            // the server lost track of this target (evicted as idle, or
+            // restarted): register again, retrying until it acks
+            if (t->state != T_UP) break;
+            t->state     = T_REGISTERING;
+            t->reg_tries = 0;
+            if (JSON_LOGGING) {
+                log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"reregistration\",\"target\":\"%s\",\"pid\":%u}\n",
+                       time(NULL), t->name, t->id);
+            } else {
+                log_printf(LOG_CAT_GENERAL, "CLIENT: [%s] server asked to register again\n", t->name);
+            }
+            target_tick(st, t, now);
+            break;
+        case WIRE_CONTROL: {
+            // each seq is acted on once; every copy is acknowledged
+            const wire_control_t *ctl = (const wire_control_t *)h;
+            uint32_t seq = le32toh(h->seq);
+            int new_port = le16toh(ctl->port);
+            int old_port = ntohs(t->addr.sin_port);
+            int fresh    = seq == 0 || (int32_t)(seq - t->ctl_seq) > 0;
+            if (fresh && seq) t->ctl_seq = seq;
+            if (fresh && new_port > 0 && new_port != old_port) target_switch(t, old_port, new_port);
+            if (seq) {
+                wire_control_t ack = *ctl;
+                wire_hdr_init(&ack.h, WIRE_CONTROL_ACK, t->id, seq, now);
+                sock_queue(st, t, &ack, sizeof(ack));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void drain_socket(mt_state_t *st, mt_sock_t *s) {
+    static _Alignas(8) char bufs[MT_BATCH][MT_RXBUF];
+    struct iovec   iov[MT_BATCH];
+    struct mmsghdr msgs[MT_BATCH];
+    for (;;) {
+        for (int j = 0; j < MT_BATCH; j++) {
+            iov[j] = (struct iovec){ .iov_base = bufs[j], .iov_len = MT_RXBUF };
+            msgs[j].msg_hdr = (struct msghdr){ .msg_iov = &iov[j], .msg_iovlen = 1 };
+        }
+        int got = recvmmsg(s->fd, msgs, MT_BATCH, MSG_DONTWAIT, NULL);
+        st->syscalls++;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("recvmmsg");
+            return;
+        }
+        uint64_t now = get_now_ns();
+        for (int j = 0; j < got; j++)
+            handle_reply(st, bufs[j], msgs[j].msg_len, now);
+        if (got < MT_BATCH) return;
+    }
+}
+
+// ——— Main loop ———
+
+int multi_main(const multi_config_t *cfg) {
+    mt_state_t st = { .cfg = cfg };
+    st.ntargets = load_targets(&st);
+    if (st.ntargets <= 0) {
+        fprintf(stderr, "error: no usable targets\n");
+        free(st.targets);
+        return 1;
+    }
+
+    st.nsocks = cfg->sockets < 1 ? 1 : cfg->sockets;
+    if (st.nsocks > MT_MAX_SOCKETS) st.nsocks = MT_MAX_SOCKETS;
+    if (st.nsocks > st.ntargets)    st.nsocks = st.ntargets;
+    st.socks = calloc((size_t)st.nsocks, sizeof(*st.socks));
+    if (!st.socks) {
+        perror("calloc");
+        return 1;
+    }
+    struct pollfd pfds[MT_MAX_SOCKETS];
+    for (int i = 0; i < st.nsocks; i++) {
+        st.socks[i].fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (st.socks[i].fd < 0) {
+            perror("socket");
+            return 1;
+        }
+        pfds[i] = (struct pollfd){ .fd = st.socks[i].fd, .events = POLLIN };
+    }
+
+    // One arena for every target's in-flight slots and RTT window, sized
+    // once from the probe rate, timeout and pipeline depth.
+    uint64_t timeout_ns = (uint64_t)cfg->timeout_ms * 1000000ull;
+    uint32_t want = (uint32_t)(timeout_ns / cfg->interval_ns) * 2 + (uint32_t)cfg->pipeline + 16;
+    size_t slot_bytes = (size_t)inflight_capacity(want) * sizeof(inflight_slot_t);
+    size_t win_bytes  = (winstats_storage_size((uint32_t)cfg->window) + 7) & ~(size_t)7;
+    size_t per_target = slot_bytes + win_bytes;
+    char *arena = malloc(per_target * (size_t)st.ntargets);
+    if (!arena) {
+        perror("malloc");
+        return 1;
+    }
+
+    uint32_t base = ((uint32_t)getpid() & 0x7ffffu) << MT_INDEX_BITS;
+    uint64_t now  = get_now_ns();
+    if (tw_init(&st.wheel, MT_WHEEL_SLOTS, MT_TICK_NS, now) < 0) {
+        perror("tw_init");
+        return 1;
+    }
+    for (int i = 0; i < st.ntargets; i++) {
+        target_t *t = &st.targets[i];
+        char *mem = arena + (size_t)i * per_target;
+        t->id    = base | (uint32_t)i;
+        t->sock  = i % st.nsocks;
+        t->state = T_REGISTERING;
+        inflight_init_with(&t->probes, want, timeout_ns, (inflight_slot_t *)mem);
+        winstats_init(&t->rtt_win, (uint32_t)cfg->window, mem + slot_bytes);
+        // spread the first REGISTERs (and so every later probe) over one interval
+        tw_schedule(&st.wheel, &t->timer, now + cfg->interval_ns * (uint64_t)i / (uint64_t)st.ntargets);
+    }
+    if (cfg->report_s > 0)
+        tw_schedule(&st.wheel, &st.report, now + (uint64_t)cfg->report_s * 1000000000ull);
+
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"client\",\"event\":\"multi_start\",\"targets\":%d,\"sockets\":%d,\"bytes_per_target\":%zu}\n",
+               time(NULL), st.ntargets, st.nsocks, sizeof(target_t) + per_target);
+    } else {
+        log_printf(LOG_CAT_GENERAL, "CLIENT: probing %d targets over %d sockets (%zu bytes per target)\n",
+               st.ntargets, st.nsocks, sizeof(target_t) + per_target);
+    }
+
+    while (!STOP) {
+        int n = poll(pfds, (nfds_t)st.nsocks, tw_timeout_ms(&st.wheel, get_now_ns()));
+        st.syscalls++;
+        if (n < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        tw_advance(&st.wheel, get_now_ns(), on_timer, &st);
+        for (int i = 0; i < st.nsocks && n > 0; i++)
+            if (pfds[i].revents & POLLIN) drain_socket(&st, &st.socks[i]);
+        for (int i = 0; i < st.nsocks; i++)
+            if (st.socks[i].count) sock_flush(&st, &st.socks[i]);
+    }
+
+    if (cfg->report_s > 0) log_target_stats(&st);
+    for (int i = 0; i < st.nsocks; i++) close(st.socks[i].fd);
+    tw_free(&st.wheel);
+    free(arena);
+    free(st.socks);
+    free(st.targets);
+    return 0;
+}
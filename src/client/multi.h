@@ -0,0 +1,42 @@
+// multi.h
+// Multi-target prober: one process probing many servers (or many lanes of
+// one server) at once. Targets share a few non-blocking sockets and one
+// poll() loop; each target's next send and oldest timeout are kept on a
+// timing wheel, and every target owns a fixed-size slice of one arena for
+// its in-flight table and RTT window, so memory is fixed at startup.
+//
+// Targets speak the binary protocol: the pid field identifies the target a
+// PONG, REGISTER_ACK or CONTROL belongs to, so replies arriving on a shared
+// socket are routed without a lookup table.
+
+#ifndef UDPMON_MULTI_H
+#define UDPMON_MULTI_H
+
+#include <signal.h>
+#include <stdint.h>
+
+// low bits of the wire pid carry the target index
+#define MT_INDEX_BITS   12
+#define MT_MAX_TARGETS  (1u << MT_INDEX_BITS)
+
+typedef struct {
+    const char **targets;      // "ADDR:PORT" from --target
+    int          ntargets;
+    const char  *targets_file; // one "ADDR:PORT [NAME]" per line, # comments
+    uint64_t     interval_ns;
+    int          timeout_ms;
+    int          window;
+    int          pipeline;
+    int          sockets;      // sockets shared by all targets
+    int          report_s;     // per-target summary period, 0 disables
+} multi_config_t;
+
+// Defined in main.c.
+extern int JSON_LOGGING;
+extern volatile sig_atomic_t STOP;
+uint64_t get_now_ns(void);
+
+// Runs until STOP is set. Returns the process exit code.
+int multi_main(const multi_config_t *cfg);
+
+#endif
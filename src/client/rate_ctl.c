@@ -0,0 +1,165 @@
+// rate_ctl.c
+// Adaptive PING interval and the host-wide PING budget (see rate_ctl.h).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rate_ctl.h"
+
+// Calm windows stretch the interval by half; a swing jump halves it and a
+// lost probe quarters it, so recovering resolution takes one or two
+// probes while giving it up takes several windows.
+#define BACKOFF   1.5
+#define RAMP_JUMP 2
+#define RAMP_LOSS 4
+
+static uint64_t clamp(const rate_ctl_t *r, uint64_t ns) {
+    return ns < r->min_ns ? r->min_ns : ns > r->max_ns ? r->max_ns : ns;
+}
+
+void rate_ctl_init(rate_ctl_t *r, uint64_t start_ns, uint64_t min_ns, uint64_t max_ns,
+                   uint32_t calm_needed, double swing_ms) {
+    memset(r, 0, sizeof(*r));
+    r->min_ns      = min_ns;
+    r->max_ns      = max_ns < min_ns ? min_ns : max_ns;
+    r->interval_ns = clamp(r, start_ns);
+    r->calm_needed = calm_needed ? calm_needed : 1;
+    r->swing_ms    = swing_ms;
+    r->swing_avg   = -1.0;
+}
+
+void rate_ctl_reply(rate_ctl_t *r, double swing_ms) {
+    if (r->swing_avg < 0) r->swing_avg = swing_ms;
+    // a jump is well above the usual swing; the 1 ms floor keeps a
+    // near-zero average on loopback from calling every wobble a jump
+    int jump = swing_ms > r->swing_ms || swing_ms > 2.0 * r->swing_avg + 1.0;
+    r->swing_avg += (swing_ms - r->swing_avg) / 16.0;
+    if (jump) {
+        r->calm = 0;
+        r->interval_ns = clamp(r, r->interval_ns / RAMP_JUMP);
+    } else if (++r->calm >= r->calm_needed) {
+        r->calm = 0;
+        r->interval_ns = clamp(r, (uint64_t)((double)r->interval_ns * BACKOFF));
+    }
+}
+
+void rate_ctl_loss(rate_ctl_t *r) {
+    r->calm = 0;
+    r->interval_ns = clamp(r, r->interval_ns / RAMP_LOSS);
+}
+
+void rate_ctl_hint(rate_ctl_t *r, uint64_t interval_ns, uint64_t ttl_ns, uint64_t now_ns) {
+    r->hint_ns       = interval_ns;
+    r->hint_until_ns = now_ns + ttl_ns;
+}
+
+uint64_t rate_ctl_interval(const rate_ctl_t *r, uint64_t now_ns) {
+    uint64_t ns = r->interval_ns;
+    if (r->hint_ns && now_ns < r->hint_until_ns && r->hint_ns < ns) ns = r->hint_ns;
+    return ns < r->min_ns ? r->min_ns : ns;
+}
+
+// ——— Host budget ———
+
+static void wait_1ms(void) {
+    struct timespec ms = { 0, 1000000 };
+    nanosleep(&ms, NULL);
+}
+
+// Open the object, or create it and set its rate to pps. Returns 0, -1
+// (errno), or 1 for an object left half built by a creator that died: it
+// never reached its full size or never got its magic.
+static int budget_map(host_budget_t *b, const char *name, uint64_t pps) {
+    int created = 1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(name, O_RDWR, 0);
+    }
+    if (fd < 0) return -1;
+    // shared with clients run by other users, whatever the umask
+    if (created && (fchmod(fd, 0666) < 0 || ftruncate(fd, sizeof(host_budget_shm_t)) < 0)) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = err;
+        return -1;
+    }
+    // the creator may still be sizing it; mapping it short would SIGBUS
+    for (int tries = 0; ; tries++) {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        if ((size_t)st.st_size >= sizeof(host_budget_shm_t)) break;
+        if (tries == 100) {
+            close(fd);
+            return 1;
+        }
+        wait_1ms();
+    }
+    void *base = mmap(NULL, sizeof(host_budget_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    b->shm = base;
+
+    if (created) {
+        b->shm->pps = pps;
+        atomic_store_explicit(&b->shm->tat, 0, memory_order_relaxed);
+        // magic last: a client that sees it sees the rate
+        atomic_thread_fence(memory_order_release);
+        b->shm->magic = HOST_BUDGET_MAGIC;
+        return 0;
+    }
+    // ... and filling it in
+    for (int tries = 0; tries < 100 && b->shm->magic != HOST_BUDGET_MAGIC; tries++) wait_1ms();
+    atomic_thread_fence(memory_order_acquire);
+    if (b->shm->magic != HOST_BUDGET_MAGIC || b->shm->pps == 0) {
+        host_budget_close(b);
+        return 1;
+    }
+    return 0;
+}
+
+int host_budget_open(host_budget_t *b, const char *name, uint64_t pps) {
+    memset(b, 0, sizeof(*b));
+    if (pps == 0) pps = 1;
+    int rc = budget_map(b, name, pps);
+    if (rc == 1) {
+        // nobody will finish it: remove it and create it afresh, once
+        shm_unlink(name);
+        rc = budget_map(b, name, pps);
+        if (rc == 1) errno = EPROTO;
+    }
+    if (rc != 0) return -1;
+    b->step_ns  = 1000000000ull / b->shm->pps;
+    if (b->step_ns == 0) b->step_ns = 1;
+    b->burst_ns = (uint64_t)HOST_BUDGET_BURST_MS * 1000000ull;
+    if (b->burst_ns < b->step_ns) b->burst_ns = b->step_ns;
+    return 0;
+}
+
+int host_budget_take(host_budget_t *b, uint64_t now_ns) {
+    uint64_t tat = atomic_load_explicit(&b->shm->tat, memory_order_relaxed);
+    for (;;) {
+        uint64_t from = tat > now_ns ? tat : now_ns;
+        // already a burst's worth ahead of real time
+        if (from - now_ns + b->step_ns > b->burst_ns) return 0;
+        if (atomic_compare_exchange_weak_explicit(&b->shm->tat, &tat, from + b->step_ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+            return 1;
+    }
+}
+
+void host_budget_close(host_budget_t *b) {
+    if (b->shm) munmap(b->shm, sizeof(host_budget_shm_t));
+    b->shm = NULL;
+}
@@ -0,0 +1,68 @@
+// rate_ctl.h
+// Probe pacing for the single-target client.
+//
+// rate_ctl_t adapts the PING interval (--adaptive): it backs off while the
+// RTT window stays calm, one step per window of calm replies, and drops
+// quickly when probes are lost or the window's swing jumps, always within
+// [min_ns, max_ns]. A rate hint from the server (wire.h RATE_HINT) caps the
+// interval until it expires, so a client whose lane decision is close to a
+// switch probes harder while it is.
+//
+// host_budget_t is a PING budget shared by every client on the host
+// (--host-budget) through a small shared-memory object. It is a GCRA
+// (virtual scheduling) bucket kept in one 64-bit word of CLOCK_MONOTONIC
+// time and advanced with compare-and-swap, so no client waits on another.
+
+#ifndef UDPMON_RATE_CTL_H
+#define UDPMON_RATE_CTL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t min_ns, max_ns;
+    uint64_t interval_ns;         // adapted interval, before any hint
+    uint32_t calm_needed;         // calm replies in a row before backing off
+    uint32_t calm;
+    double   swing_ms;            // a window swing above this is never calm
+    double   swing_avg;           // slow average of the swing, ms
+    uint64_t hint_ns;             // server hint: probe at least this often...
+    uint64_t hint_until_ns;       // ...until then (CLOCK_MONOTONIC)
+} rate_ctl_t;
+
+void     rate_ctl_init(rate_ctl_t *r, uint64_t start_ns, uint64_t min_ns, uint64_t max_ns,
+                       uint32_t calm_needed, double swing_ms);
+// A probe was answered; swing_ms is the RTT window's max - min with it.
+void     rate_ctl_reply(rate_ctl_t *r, double swing_ms);
+// A probe timed out.
+void     rate_ctl_loss(rate_ctl_t *r);
+void     rate_ctl_hint(rate_ctl_t *r, uint64_t interval_ns, uint64_t ttl_ns, uint64_t now_ns);
+// The interval to probe at now: the adapted one, capped by a live hint,
+// never below min_ns.
+uint64_t rate_ctl_interval(const rate_ctl_t *r, uint64_t now_ns);
+
+#define HOST_BUDGET_NAME    "/udp-monitor-budget"
+#define HOST_BUDGET_MAGIC   0x314744424e4f4d55ull   // "UMONBDG1"
+#define HOST_BUDGET_BURST_MS 100                    // tolerance: a tenth of a second's worth
+
+typedef struct {
+    uint64_t magic;
+    uint64_t pps;                 // set by whichever client created the object
+    _Atomic uint64_t tat;         // when the budget next has room, CLOCK_MONOTONIC ns
+} host_budget_shm_t;
+
+typedef struct {
+    host_budget_shm_t *shm;
+    uint64_t step_ns, burst_ns;
+} host_budget_t;
+
+// Map the host's budget, creating it at pps if no client has yet. An
+// existing budget keeps its rate (b->shm->pps); remove /dev/shm/NAME to
+// change it. One left half built by a client that died creating it is
+// removed and created again. Returns 0 or -1 (errno).
+int  host_budget_open(host_budget_t *b, const char *name, uint64_t pps);
+// 1 if one more PING fits the budget at now (and it is taken), else 0.
+int  host_budget_take(host_budget_t *b, uint64_t now_ns);
+void host_budget_close(host_budget_t *b);
+
+#endif
@@ -0,0 +1,119 @@
+// timer_wheel.c
+// Hashed timing wheel (see timer_wheel.h).
+
+#include <stdlib.h>
+
+#include "timer_wheel.h"
+
+static void set_bit(timer_wheel_t *tw, uint32_t s)   { tw->occupied[s >> 6] |=  (1ull << (s & 63)); }
+static void clear_bit(timer_wheel_t *tw, uint32_t s) { tw->occupied[s >> 6] &= ~(1ull << (s & 63)); }
+
+int tw_init(timer_wheel_t *tw, uint32_t nslots, uint64_t tick_ns, uint64_t now_ns) {
+    uint32_t n = 64;
+    while (n < nslots) n <<= 1;
+    tw->slots    = malloc((size_t)n * sizeof(*tw->slots));
+    tw->occupied = calloc(n / 64, sizeof(*tw->occupied));
+    if (!tw->slots || !tw->occupied) {
+        free(tw->slots);
+        free(tw->occupied);
+        return -1;
+    }
+    for (uint32_t i = 0; i < n; i++) tw->slots[i].next = tw->slots[i].prev = &tw->slots[i];
+    tw->mask      = n - 1;
+    tw->tick_ns   = tick_ns ? tick_ns : 1;
+    tw->origin_ns = now_ns;
+    tw->cur_tick  = 0;
+    tw->count     = 0;
+    return 0;
+}
+
+void tw_free(timer_wheel_t *tw) {
+    free(tw->slots);
+    free(tw->occupied);
+    tw->slots    = NULL;
+    tw->occupied = NULL;
+}
+
+static void unlink_node(timer_wheel_t *tw, tw_node_t *n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    // the sentinel pointing at itself means the slot is now empty
+    uint32_t s = (uint32_t)(n->due_tick & tw->mask);
+    if (tw->slots[s].next == &tw->slots[s]) clear_bit(tw, s);
+    n->next = n->prev = NULL;
+    tw->count--;
+}
+
+void tw_cancel(timer_wheel_t *tw, tw_node_t *n) {
+    if (n->next) unlink_node(tw, n);
+}
+
+void tw_schedule(timer_wheel_t *tw, tw_node_t *n, uint64_t due_ns) {
+    if (n->next) unlink_node(tw, n);
+    uint64_t tick = due_ns > tw->origin_ns
+                  ? (due_ns - tw->origin_ns + tw->tick_ns - 1) / tw->tick_ns : 0;
+    if (tick < tw->cur_tick) tick = tw->cur_tick;
+    n->due_tick = tick;
+    uint32_t s = (uint32_t)(tick & tw->mask);
+    tw_node_t *head = &tw->slots[s];
+    n->prev = head->prev;
+    n->next = head;
+    head->prev->next = n;
+    head->prev = n;
+    set_bit(tw, s);
+    tw->count++;
+}
+
+void tw_advance(timer_wheel_t *tw, uint64_t now_ns,
+                void (*fire)(tw_node_t *n, void *arg), void *arg) {
+    if (now_ns < tw->origin_ns) return;
+    uint64_t now_tick = (now_ns - tw->origin_ns) / tw->tick_ns;
+    // after a stall longer than a revolution, one pass over every slot is enough
+    uint64_t steps = now_tick - tw->cur_tick + 1;
+    if (steps > (uint64_t)tw->mask + 1) steps = (uint64_t)tw->mask + 1;
+    for (uint64_t k = 0; k < steps && tw->count; k++) {
+        uint32_t s = (uint32_t)((tw->cur_tick + k) & tw->mask);
+        if (!(tw->occupied[s >> 6] & (1ull << (s & 63)))) continue;
+        tw_node_t *head = &tw->slots[s];
+        // detach the due nodes first: fire() may schedule into this slot
+        tw_node_t due = { .next = &due, .prev = &due };
+        for (tw_node_t *n = head->next, *next; n != head; n = next) {
+            next = n->next;
+            if (n->due_tick > now_tick) continue;   // a later revolution
+            unlink_node(tw, n);
+            n->prev = due.prev;
+            n->next = &due;
+            due.prev->next = n;
+            due.prev = n;
+        }
+        while (due.next != &due) {
+            tw_node_t *n = due.next;
+            due.next = n->next;
+            n->next->prev = &due;
+            n->next = n->prev = NULL;
+            fire(n, arg);
+        }
+    }
+    tw->cur_tick = now_tick + 1;
+}
+
+int tw_timeout_ms(const timer_wheel_t *tw, uint64_t now_ns) {
+    if (!tw->count) return -1;
+    uint32_t nslots = tw->mask + 1;
+    uint32_t start = (uint32_t)(tw->cur_tick & tw->mask);
+    // find the first occupied slot at or after the current tick, wrapping once
+    for (uint32_t k = 0; k < nslots; ) {
+        uint32_t s = (start + k) & tw->mask;
+        uint64_t word = tw->occupied[s >> 6] >> (s & 63);
+        if (word) {
+            k += (uint32_t)__builtin_ctzll(word);
+            if (k >= nslots) break;
+            uint64_t due_ns = tw->origin_ns + (tw->cur_tick + k) * tw->tick_ns;
+            if (due_ns <= now_ns) return 0;
+            return (int)((due_ns - now_ns + 999999) / 1000000);
+        }
+        k += 64 - (s & 63);
+    }
+    // only far-future nodes: wake once per revolution to let them come round
+    return (int)((uint64_t)nslots * tw->tick_ns / 1000000);
+}
@@ -0,0 +1,52 @@
+// timer_wheel.h
+// Hashed timing wheel for the multi-target prober: O(1) schedule and
+// cancel, with the timer node embedded in its owner so the wheel itself
+// never allocates after init.
+//
+// Time is cut into ticks of tick_ns; a node due at tick T waits in slot
+// T & mask. Nodes more than one revolution ahead share a slot with nearer
+// ones and are simply skipped until their tick comes round. A bitmap of
+// non-empty slots lets the event loop sleep until the next occupied slot
+// instead of waking every tick.
+
+#ifndef UDPMON_TIMER_WHEEL_H
+#define UDPMON_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct tw_node {
+    struct tw_node *next, *prev;   // NULL while not scheduled
+    uint64_t due_tick;
+} tw_node_t;
+
+typedef struct {
+    tw_node_t *slots;        // circular list heads (sentinels)
+    uint64_t  *occupied;     // one bit per slot
+    uint32_t   mask;
+    uint64_t   tick_ns;
+    uint64_t   origin_ns;    // time of tick 0
+    uint64_t   cur_tick;     // every tick before this one has fired
+    size_t     count;
+} timer_wheel_t;
+
+// nslots is rounded up to a power of two. Returns 0, or -1 on allocation failure.
+int  tw_init(timer_wheel_t *tw, uint32_t nslots, uint64_t tick_ns, uint64_t now_ns);
+void tw_free(timer_wheel_t *tw);
+
+// (Re)schedule n at due_ns; a due time in the past fires on the next advance.
+void tw_schedule(timer_wheel_t *tw, tw_node_t *n, uint64_t due_ns);
+void tw_cancel(timer_wheel_t *tw, tw_node_t *n);
+
+static inline int tw_pending(const tw_node_t *n) { return n->next != NULL; }
+
+// Fire every node due at or before now_ns. Nodes are unlinked before fire()
+// runs, so a callback may reschedule its own node.
+void tw_advance(timer_wheel_t *tw, uint64_t now_ns,
+                void (*fire)(tw_node_t *n, void *arg), void *arg);
+
+// Milliseconds until the next occupied slot comes due (0 if already due),
+// or -1 when nothing is scheduled. Suitable as a poll() timeout.
+int  tw_timeout_ms(const timer_wheel_t *tw, uint64_t now_ns);
+
+#endif
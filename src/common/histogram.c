@@ -0,0 +1,111 @@
+// histogram.c
+// Log-bucketed latency histogram (see histogram.h).
+
+#include <string.h>
+
+#include "histogram.h"
+
+#define HALF (HIST_SUB_COUNT / 2)
+
+static inline uint32_t bucket_of(uint64_t v) {
+    if (v < HIST_SUB_COUNT) return (uint32_t)v;
+    int shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+    if (shift > HIST_MAX_SHIFT) return HIST_BUCKETS - 1;
+    return (uint32_t)shift * HALF + (uint32_t)(v >> shift);
+}
+
+// Largest value that lands in bucket b.
+static uint64_t bucket_top(uint32_t b) {
+    if (b < HIST_SUB_COUNT) return b;
+    uint32_t shift = b / HALF - 1;
+    uint64_t sub   = b % HALF + HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+void hist_reset(hist_t *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_record(hist_t *h, uint64_t value) {
+    h->counts[bucket_of(value)]++;
+    h->total++;
+    if (value > h->max) h->max = value;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src) {
+    for (uint32_t b = 0; b < HIST_BUCKETS; b++)
+        dst->counts[b] += src->counts[b];
+    dst->total += src->total;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+void hist_percentiles(const hist_t *const *hs, int nh,
+                      const double *pcts, uint64_t *out, int n) {
+    uint64_t total = 0, max = 0;
+    for (int k = 0; k < nh; k++) {
+        total += hs[k]->total;
+        if (hs[k]->max > max) max = hs[k]->max;
+    }
+    int i = 0;
+    if (total == 0) {
+        for (; i < n; i++) out[i] = 0;
+        return;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < HIST_BUCKETS && i < n; b++) {
+        for (int k = 0; k < nh; k++) seen += hs[k]->counts[b];
+        // rank of the sample the percentile falls on, 1-based
+        while (i < n) {
+            uint64_t rank = (uint64_t)(pcts[i] / 100.0 * (double)total + 0.5);
+            if (rank < 1) rank = 1;
+            if (seen < rank) break;
+            uint64_t top = bucket_top(b);
+            out[i++] = top < max ? top : max;
+        }
+    }
+    for (; i < n; i++) out[i] = max;
+}
+
+void hist_window_init(hist_window_t *w, uint64_t span_ns, uint64_t now_ns) {
+    hist_reset(&w->cur);
+    hist_reset(&w->prev);
+    w->span_ns  = span_ns;
+    w->start_ns = now_ns;
+}
+
+void hist_window_advance(hist_window_t *w, uint64_t now_ns) {
+    uint64_t age = now_ns - w->start_ns;
+    if (age < w->span_ns) return;
+    if (age < 2 * w->span_ns)
+        w->prev = w->cur;
+    else
+        hist_reset(&w->prev);   // silent for more than a span: all stale
+    hist_reset(&w->cur);
+    w->start_ns = now_ns;
+}
+
+void hist_window_record(hist_window_t *w, uint64_t value, uint64_t now_ns) {
+    hist_window_advance(w, now_ns);
+    hist_record(&w->cur, value);
+}
+
+uint64_t hist_window_count(const hist_window_t *w) {
+    return w->cur.total + w->prev.total;
+}
+
+void hist_window_percentiles(const hist_window_t *w, const double *pcts,
+                             uint64_t *out, int n) {
+    const hist_t *hs[2] = { &w->cur, &w->prev };
+    hist_percentiles(hs, 2, pcts, out, n);
+}
+
+void hist_window_merge_into(hist_t *dst, const hist_window_t *w) {
+    hist_merge(dst, &w->cur);
+    hist_merge(dst, &w->prev);
+}
+
+void hist_window_merge(hist_window_t *w, const hist_t *src, uint64_t now_ns) {
+    hist_window_advance(w, now_ns);
+    hist_merge(&w->cur, src);
+}
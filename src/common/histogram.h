@@ -0,0 +1,62 @@
+// histogram.h
+// Fixed-memory log-bucketed latency histogram (HDR-style).
+//
+// Values are unsigned integers (the server records microseconds). The first
+// HIST_SUB_COUNT values get one bucket each; above that every power of two is
+// split into HIST_SUB_COUNT/2 linear sub-buckets, so a bucket is never wider
+// than 1/16 of its value (about 6% worst-case relative error). Recording is
+// a couple of shifts and one increment; percentile queries walk the bucket
+// array once. Two histograms with the same layout merge by adding counts.
+//
+// hist_window_t turns a pair of histograms into a rolling time window: the
+// live half collects samples for span_ns, then becomes the previous half and
+// the live half starts over. Queries see both halves, i.e. between one and
+// two spans of history, and never an empty window right after a rollover.
+
+#ifndef UDPMON_HISTOGRAM_H
+#define UDPMON_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS   5
+#define HIST_SUB_COUNT  (1u << HIST_SUB_BITS)
+#define HIST_MAX_SHIFT  22                      // top bucket starts at 2^26
+#define HIST_BUCKETS    ((HIST_MAX_SHIFT + 1) * (HIST_SUB_COUNT / 2) + HIST_SUB_COUNT / 2)
+
+typedef struct {
+    uint64_t total;
+    uint64_t max;
+    uint32_t counts[HIST_BUCKETS];
+} hist_t;
+
+typedef struct {
+    hist_t   cur, prev;
+    uint64_t start_ns;   // when cur started collecting
+    uint64_t span_ns;
+} hist_window_t;
+
+void     hist_reset(hist_t *h);
+void     hist_record(hist_t *h, uint64_t value);
+void     hist_merge(hist_t *dst, const hist_t *src);
+
+// Fill out[i] with the pcts[i]-th percentile (0..100) of the samples in the
+// first nh histograms taken together; pcts must be ascending. Reported
+// values are the upper edge of the matching bucket (clamped to the largest
+// sample seen). Every out[i] is 0 when there are no samples.
+void     hist_percentiles(const hist_t *const *hs, int nh,
+                          const double *pcts, uint64_t *out, int n);
+
+void     hist_window_init(hist_window_t *w, uint64_t span_ns, uint64_t now_ns);
+// Roll the window forward to now_ns; record does this itself, call it
+// before querying a window that may not have seen samples lately.
+void     hist_window_advance(hist_window_t *w, uint64_t now_ns);
+void     hist_window_record(hist_window_t *w, uint64_t value, uint64_t now_ns);
+uint64_t hist_window_count(const hist_window_t *w);
+void     hist_window_percentiles(const hist_window_t *w, const double *pcts,
+                                 uint64_t *out, int n);
+// dst += both halves of w
+void     hist_window_merge_into(hist_t *dst, const hist_window_t *w);
+// Count src's samples as recorded at now_ns.
+void     hist_window_merge(hist_window_t *w, const hist_t *src, uint64_t now_ns);
+
+#endif
@@ -0,0 +1,292 @@
+// log.c
+// Per-thread ring buffers drained by one writer thread (see log.h).
+//
+// Each ring is a single-producer/single-consumer byte stream of complete
+// lines: the owning thread copies a whole line in and then publishes the
+// new head, the writer hands [tail, head) straight to writev() and then
+// publishes the new tail. No framing, no locks on either side.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "log.h"
+
+#define RING_SIZE    (1u << 18)   // 256 KiB of queued lines per thread
+#define LOG_LINE_MAX 1024
+#define MAX_IOV      128
+#define IDLE_SLEEP_NS    5000000L   // writer poll period when all rings are empty
+#define REPORT_EVERY_NS  1000000000ull
+
+typedef struct log_ring {
+    struct log_ring *next;
+    _Atomic uint64_t head;          // bytes ever produced
+    _Atomic uint64_t tail;          // bytes ever consumed
+    _Atomic uint64_t dropped;       // lines lost to a full ring
+    _Atomic uint64_t sampled_out;   // lines thinned by sampling/rate caps
+
+    // producer-only sampling state
+    uint64_t seen[LOG_CAT_COUNT];
+    time_t   window_sec[LOG_CAT_COUNT];
+    uint32_t window_count[LOG_CAT_COUNT];
+
+    char buf[RING_SIZE];
+} log_ring_t;
+
+static const char *cat_names[LOG_CAT_COUNT] = {
+    [LOG_CAT_GENERAL] = "general",
+    [LOG_CAT_METRICS] = "client_metrics",
+    [LOG_CAT_CHAOS]   = "chaos",
+    [LOG_CAT_ECHO]    = "echo",
+    [LOG_CAT_PROBE]   = "probe",
+};
+
+static unsigned sample_every[LOG_CAT_COUNT];
+static unsigned max_per_sec[LOG_CAT_COUNT];
+
+static _Atomic(log_ring_t *) rings;
+static __thread log_ring_t *tl_ring;
+
+static log_config_t cfg;
+static int          out_fd = STDOUT_FILENO;
+static pthread_t    writer;
+static _Atomic int  running;
+static uint64_t     reported_dropped, reported_sampled;
+
+// ——— Configuration ———
+
+static int set_cat_value(const char *spec, unsigned *table) {
+    const char *eq = strchr(spec, '=');
+    if (!eq) return -1;
+    size_t len = (size_t)(eq - spec);
+    for (int i = 0; i < LOG_CAT_COUNT; i++) {
+        if (strlen(cat_names[i]) == len && strncmp(spec, cat_names[i], len) == 0) {
+            table[i] = (unsigned)strtoul(eq + 1, NULL, 10);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int log_set_sample(const char *spec) { return set_cat_value(spec, sample_every); }
+int log_set_rate(const char *spec)   { return set_cat_value(spec, max_per_sec); }
+
+// ——— Producer side ———
+
+static log_ring_t *ring_create(void) {
+    log_ring_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    log_ring_t *old = atomic_load(&rings);
+    do {
+        r->next = old;
+    } while (!atomic_compare_exchange_weak(&rings, &old, r));
+    tl_ring = r;
+    return r;
+}
+
+static int admit(log_ring_t *r, int cat) {
+    unsigned every = sample_every[cat];
+    if (every > 1 && r->seen[cat]++ % every != 0) return 0;
+
+    unsigned cap = max_per_sec[cat];
+    if (cap) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        if (ts.tv_sec != r->window_sec[cat]) {
+            r->window_sec[cat]   = ts.tv_sec;
+            r->window_count[cat] = 0;
+        }
+        if (r->window_count[cat]++ >= cap) return 0;
+    }
+    return 1;
+}
+
+void log_printf(int cat, const char *fmt, ...) {
+    if (cat < 0 || cat >= LOG_CAT_COUNT) cat = LOG_CAT_GENERAL;
+
+    char line[LOG_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (n > (int)sizeof(line) - 2) n = (int)sizeof(line) - 2;   // truncated
+    if (n == 0 || line[n - 1] != '\n') line[n++] = '\n';
+
+    // before log_init() (or after shutdown) there is no writer: write through
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        ssize_t w = write(out_fd, line, (size_t)n);
+        (void)w;
+        return;
+    }
+
+    log_ring_t *r = tl_ring ? tl_ring : ring_create();
+    if (!r) return;
+    if (!admit(r, cat)) {
+        atomic_fetch_add_explicit(&r->sampled_out, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (RING_SIZE - (head - tail) < (uint64_t)n) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    size_t off   = (size_t)(head & (RING_SIZE - 1));
+    size_t first = (size_t)n < RING_SIZE - off ? (size_t)n : RING_SIZE - off;
+    memcpy(r->buf + off, line, first);
+    memcpy(r->buf, line + first, (size_t)n - first);
+    atomic_store_explicit(&r->head, head + (uint64_t)n, memory_order_release);
+}
+
+// ——— Writer side ———
+
+static void write_all(const struct iovec *iov, int iovcnt) {
+    struct iovec local[MAX_IOV];
+    memcpy(local, iov, (size_t)iovcnt * sizeof(*iov));
+    struct iovec *v = local;
+    while (iovcnt > 0) {
+        ssize_t w = writev(out_fd, v, iovcnt);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;   // nowhere to report it; the lines are discarded
+        }
+        while (iovcnt > 0 && (size_t)w >= v->iov_len) {
+            w -= (ssize_t)v->iov_len;
+            v++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= (size_t)w;
+        }
+    }
+}
+
+// Gather every ring's pending bytes into one writev(). Returns bytes written.
+static size_t drain_all(void) {
+    struct iovec iov[MAX_IOV];
+    log_ring_t  *owner[MAX_IOV / 2];
+    uint64_t     upto[MAX_IOV / 2];
+    int niov = 0, nrings = 0;
+    size_t total = 0;
+
+    for (log_ring_t *r = atomic_load(&rings); r && niov + 2 <= MAX_IOV; r = r->next) {
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        if (head == tail) continue;
+        size_t off = (size_t)(tail & (RING_SIZE - 1));
+        size_t len = (size_t)(head - tail);
+        size_t first = len < RING_SIZE - off ? len : RING_SIZE - off;
+        iov[niov++] = (struct iovec){ .iov_base = r->buf + off, .iov_len = first };
+        if (len > first)
+            iov[niov++] = (struct iovec){ .iov_base = r->buf, .iov_len = len - first };
+        owner[nrings] = r;
+        upto[nrings++] = head;
+        total += len;
+    }
+    if (niov == 0) return 0;
+
+    write_all(iov, niov);
+    for (int i = 0; i < nrings; i++)
+        atomic_store_explicit(&owner[i]->tail, upto[i], memory_order_release);
+    return total;
+}
+
+static void report_drops(void) {
+    uint64_t dropped = 0, sampled = 0;
+    for (log_ring_t *r = atomic_load(&rings); r; r = r->next) {
+        dropped += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        sampled += atomic_load_explicit(&r->sampled_out, memory_order_relaxed);
+    }
+    if (dropped == reported_dropped && sampled == reported_sampled) return;
+
+    char line[256];
+    int n;
+    if (cfg.json) {
+        n = snprintf(line, sizeof(line),
+                     "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"%s\",\"event\":\"log_dropped\",\"dropped\":%" PRIu64 ",\"sampled_out\":%" PRIu64 ",\"dropped_total\":%" PRIu64 "}\n",
+                     time(NULL), cfg.component, dropped - reported_dropped,
+                     sampled - reported_sampled, dropped);
+    } else {
+        n = snprintf(line, sizeof(line),
+                     "LOG: dropped %" PRIu64 " lines, sampled out %" PRIu64 " (total dropped %" PRIu64 ")\n",
+                     dropped - reported_dropped, sampled - reported_sampled, dropped);
+    }
+    reported_dropped = dropped;
+    reported_sampled = sampled;
+    struct iovec iov = { .iov_base = line, .iov_len = (size_t)n };
+    write_all(&iov, 1);
+}
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    uint64_t next_report = mono_ns() + REPORT_EVERY_NS;
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        if (drain_all() == 0) {
+            struct timespec ts = { .tv_sec = 0, .tv_nsec = IDLE_SLEEP_NS };
+            nanosleep(&ts, NULL);
+        }
+        uint64_t now = mono_ns();
+        if (now >= next_report) {
+            report_drops();
+            next_report = now + REPORT_EVERY_NS;
+        }
+    }
+    while (drain_all() > 0) {}
+    report_drops();
+    return NULL;
+}
+
+int log_init(const log_config_t *c) {
+    cfg = *c;
+    if (!cfg.component) cfg.component = "log";
+    if (cfg.path) {
+        int fd = open(cfg.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+        out_fd = fd;
+    }
+    // anything printed through stdio so far must land before queued lines
+    fflush(stdout);
+    atomic_store_explicit(&running, 1, memory_order_release);
+    int err = pthread_create(&writer, NULL, writer_main, NULL);
+    if (err) {
+        atomic_store(&running, 0);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void log_shutdown(void) {
+    if (!atomic_exchange(&running, 0)) return;
+    pthread_join(writer, NULL);
+    if (out_fd != STDOUT_FILENO) {
+        close(out_fd);
+        out_fd = STDOUT_FILENO;
+    }
+}
+
+uint64_t log_dropped_total(void) {
+    uint64_t dropped = 0;
+    for (log_ring_t *r = atomic_load(&rings); r; r = r->next)
+        dropped += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    return dropped;
+}
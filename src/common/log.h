@@ -0,0 +1,50 @@
+// log.h
+// Asynchronous structured-log pipeline shared by server and client.
+//
+// log_printf() formats one line into a per-thread ring buffer and returns;
+// it never blocks and never calls into stdio. A background writer thread
+// drains every ring in batches to stdout or a log file. When a ring is full
+// the line is dropped and counted; the writer periodically reports drop
+// counts as a log_dropped event instead of stalling the packet loop.
+//
+// High-frequency event classes can be thinned per category with 1-in-N
+// sampling and/or a per-thread lines-per-second cap.
+
+#ifndef UDPMON_LOG_H
+#define UDPMON_LOG_H
+
+#include <stdint.h>
+
+enum {
+    LOG_CAT_GENERAL = 0,   // startup, registration, lane switches: never thinned by default
+    LOG_CAT_METRICS,       // "client_metrics": one per METRIC packet
+    LOG_CAT_CHAOS,         // chaos drops and delays
+    LOG_CAT_ECHO,          // per-echo verbose lines
+    LOG_CAT_PROBE,         // client per-probe success/timeout lines
+    LOG_CAT_COUNT
+};
+
+typedef struct {
+    const char *path;      // NULL = stdout
+    int         json;      // format the pipeline's own reports as JSON
+    const char *component; // "server" / "client", used in those reports
+} log_config_t;
+
+// Start the writer thread. Returns 0, or -1 if the log file cannot be opened.
+int  log_init(const log_config_t *cfg);
+
+// Flush every ring and stop the writer. Safe to call more than once.
+void log_shutdown(void);
+
+// Parse "CATEGORY=N" for --log-sample (keep 1 line in N) or --log-rate
+// (at most N lines per second per thread). Returns 0, or -1 on a bad spec.
+int  log_set_sample(const char *spec);
+int  log_set_rate(const char *spec);
+
+// Queue one line (a trailing newline is added if missing).
+void log_printf(int cat, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Totals across all threads, for stats reporting.
+uint64_t log_dropped_total(void);
+
+#endif
@@ -0,0 +1,418 @@
+// metrics_file.c
+// Segment writer and reader for recorded METRICs (see metrics_file.h).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics_file.h"
+#include "tstamp.h"
+#include "varint.h"
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+// Largest a block can encode to: a 64-bit zigzag varint takes 10 bytes, a
+// 32-bit varint 5, the lane 1.
+#define MF_DATA_MAX  ALIGN8(sizeof(mf_block_t) + MF_COLS * sizeof(uint32_t) \
+                            + (size_t)MF_BLOCK_SAMPLES * (10 + 10 + 1 + 5 + 5 + 5))
+#define MF_INDEX_MAX (sizeof(mf_block_t) + sizeof(uint64_t) \
+                      + MF_INDEX_EVERY * sizeof(mf_index_entry_t))
+#define MF_FIRST_BLOCK ALIGN8(sizeof(mf_header_t))
+
+// ——— Writer ———
+
+static int segment_open(mf_writer_t *w) {
+    uint64_t now = tstamp_wall_ns();
+    snprintf(w->path, sizeof(w->path), "%s/w%02u-%" PRIu64 ".umr", w->dir, w->worker, now);
+    int fd = open(w->path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    // sparse until blocks land in it
+    if (ftruncate(fd, (off_t)w->seg_bytes) < 0) {
+        int err = errno;
+        close(fd);
+        unlink(w->path);
+        errno = err;
+        return -1;
+    }
+    void *base = mmap(NULL, w->seg_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        unlink(w->path);
+        errno = err;
+        return -1;
+    }
+    w->fd         = fd;
+    w->base       = base;
+    w->off        = MF_FIRST_BLOCK;
+    w->last_index = 0;
+    w->nindex     = 0;
+
+    mf_header_t *h = base;
+    h->version     = MF_VERSION;
+    h->header_size = sizeof(mf_header_t);
+    h->created_ns  = now;
+    h->server_pid  = (int32_t)getpid();
+    h->worker      = w->worker;
+    atomic_store_explicit(&h->end, (uint64_t)w->off, memory_order_relaxed);
+    // magic last: a reader that sees it sees a complete header
+    atomic_thread_fence(memory_order_release);
+    h->magic = MF_MAGIC;
+    w->segments++;
+    return 0;
+}
+
+// Index the data blocks written since the last index block.
+static void write_index(mf_writer_t *w) {
+    if (!w->nindex) return;
+    mf_block_t *b = (mf_block_t *)(w->base + w->off);
+    uint64_t *prev = (uint64_t *)(b + 1);
+    mf_index_entry_t *e = (mf_index_entry_t *)(prev + 1);
+    *b = (mf_block_t){
+        .magic    = MF_BLOCK_INDEX,
+        .len      = (uint32_t)(sizeof(*b) + sizeof(*prev) + w->nindex * sizeof(*e)),
+        .count    = w->nindex,
+        .first_ns = w->index[0].first_ns,
+        .last_ns  = w->index[0].last_ns
+    };
+    *prev = w->last_index;
+    for (uint32_t i = 0; i < w->nindex; i++) {
+        e[i] = w->index[i];
+        if (e[i].first_ns < b->first_ns) b->first_ns = e[i].first_ns;
+        if (e[i].last_ns  > b->last_ns)  b->last_ns  = e[i].last_ns;
+    }
+    w->last_index = w->off;
+    w->off       += b->len;
+    w->nindex     = 0;
+    atomic_store_explicit(&((mf_header_t *)w->base)->last_index, w->last_index,
+                          memory_order_release);
+}
+
+// Index what is left, unmap, and trim the preallocation.
+static void segment_close(mf_writer_t *w) {
+    if (!w->base) return;
+    mf_header_t *h = (mf_header_t *)w->base;
+    write_index(w);
+    atomic_store_explicit(&h->end, (uint64_t)w->off, memory_order_release);
+    munmap(w->base, w->seg_bytes);
+    if (ftruncate(w->fd, (off_t)w->off) < 0) w->errors++;
+    close(w->fd);
+    w->base = NULL;
+    w->fd   = -1;
+}
+
+int mf_writer_open(mf_writer_t *w, const char *dir, uint32_t worker, size_t seg_bytes) {
+    memset(w, 0, sizeof(*w));
+    w->fd     = -1;
+    w->worker = worker;
+    snprintf(w->dir, sizeof(w->dir), "%s", dir);
+    // room for at least a few full blocks and their index
+    size_t min = MF_FIRST_BLOCK + 4 * MF_DATA_MAX + MF_INDEX_MAX;
+    w->seg_bytes = ALIGN8(seg_bytes < min ? min : seg_bytes);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return -1;
+    return segment_open(w);
+}
+
+int mf_flush(mf_writer_t *w) {
+    if (!w->n) return 0;
+    // a full segment is closed and the next one opened; if that failed
+    // before, it is retried here
+    if (w->base && w->off + MF_DATA_MAX + MF_INDEX_MAX > w->seg_bytes) segment_close(w);
+    if (!w->base && segment_open(w) < 0) {
+        w->errors++;
+        w->n = 0;
+        return -1;
+    }
+
+    mf_block_t *b = (mf_block_t *)(w->base + w->off);
+    uint32_t *col_len = (uint32_t *)(b + 1);
+    uint8_t *p = (uint8_t *)(col_len + MF_COLS), *col;
+    const mf_sample_t *s = w->pending;
+    uint32_t n = w->n, lanes = 0;
+    uint64_t first = s[0].ts_ns, last = s[0].ts_ns;
+    for (uint32_t i = 1; i < n; i++) {
+        if (s[i].ts_ns < first) first = s[i].ts_ns;
+        if (s[i].ts_ns > last)  last  = s[i].ts_ns;
+    }
+
+    // the wall clock may step back, so timestamp deltas are signed too
+    col = p;
+    uint64_t prev_ts = first;
+    for (uint32_t i = 0; i < n; i++) {
+        p = put_varint(p, zigzag((int64_t)(s[i].ts_ns - prev_ts)));
+        prev_ts = s[i].ts_ns;
+    }
+    col_len[MF_COL_TS] = (uint32_t)(p - col);
+
+    col = p;
+    int64_t prev_pid = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        p = put_varint(p, zigzag((int64_t)s[i].pid - prev_pid));
+        prev_pid = s[i].pid;
+    }
+    col_len[MF_COL_PID] = (uint32_t)(p - col);
+
+    col = p;
+    for (uint32_t i = 0; i < n; i++) {
+        *p++ = (uint8_t)((s[i].lane & 0x7f) | (s[i].probe ? MF_PROBE : 0));
+        lanes |= 1u << (s[i].lane & 0x1f);
+    }
+    col_len[MF_COL_LANE] = (uint32_t)(p - col);
+
+    col = p;
+    for (uint32_t i = 0; i < n; i++) p = put_varint(p, s[i].rtt_us);
+    col_len[MF_COL_RTT] = (uint32_t)(p - col);
+    col = p;
+    for (uint32_t i = 0; i < n; i++) p = put_varint(p, s[i].loss);
+    col_len[MF_COL_LOSS] = (uint32_t)(p - col);
+    col = p;
+    for (uint32_t i = 0; i < n; i++) p = put_varint(p, s[i].jitter_us);
+    col_len[MF_COL_JITTER] = (uint32_t)(p - col);
+
+    size_t len = ALIGN8((size_t)(p - (uint8_t *)b));
+    memset(p, 0, len - (size_t)(p - (uint8_t *)b));
+    *b = (mf_block_t){
+        .magic = MF_BLOCK_DATA, .len = (uint32_t)len, .count = n, .lanes = lanes,
+        .first_ns = first, .last_ns = last
+    };
+    w->index[w->nindex++] = (mf_index_entry_t){
+        .offset = w->off, .first_ns = first, .last_ns = last, .count = n, .lanes = lanes
+    };
+    w->off += len;
+    w->blocks++;
+    w->n = 0;
+    if (w->nindex == MF_INDEX_EVERY) write_index(w);
+
+    mf_header_t *h = (mf_header_t *)w->base;
+    if (!h->first_ns || first < h->first_ns) h->first_ns = first;
+    if (last > atomic_load_explicit(&h->last_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->last_ns, last, memory_order_relaxed);
+    atomic_store_explicit(&h->samples,
+                          atomic_load_explicit(&h->samples, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+    atomic_store_explicit(&h->end, (uint64_t)w->off, memory_order_release);
+    return (int)n;
+}
+
+int mf_append(mf_writer_t *w, const mf_sample_t *s) {
+    w->pending[w->n++] = *s;
+    return w->n == MF_BLOCK_SAMPLES ? mf_flush(w) : 0;
+}
+
+int mf_writer_close(mf_writer_t *w) {
+    int rc = mf_flush(w);
+    segment_close(w);
+    return rc;
+}
+
+// ——— Reader ———
+
+int mf_open(mf_reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < MF_FIRST_BLOCK) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    r->base = base;
+    r->size = (size_t)st.st_size;
+    r->h    = base;
+    if (r->h->magic != MF_MAGIC || r->h->version != MF_VERSION
+        || r->h->header_size != sizeof(mf_header_t)) {
+        mf_close(r);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void mf_close(mf_reader_t *r) {
+    if (r->base) munmap((void *)r->base, r->size);
+    r->base = NULL;
+    r->h    = NULL;
+    r->size = 0;
+}
+
+typedef struct {
+    mf_index_entry_t *v;
+    size_t n, cap;
+} entry_list_t;
+
+static int push_entry(entry_list_t *l, const mf_index_entry_t *e) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        mf_index_entry_t *grown = realloc(l->v, cap * sizeof(*grown));
+        if (!grown) return -1;
+        l->v = grown;
+        l->cap = cap;
+    }
+    l->v[l->n++] = *e;
+    return 0;
+}
+
+// The block at off, if it lies wholly below end.
+static const mf_block_t *block_at(const mf_reader_t *r, uint64_t off, uint64_t end) {
+    if (off < MF_FIRST_BLOCK || off % 8 || off + sizeof(mf_block_t) > end) return NULL;
+    const mf_block_t *b = (const mf_block_t *)(r->base + off);
+    if (b->len < sizeof(*b) || b->len % 8 || off + b->len > end) return NULL;
+    return b;
+}
+
+// Every data block below end, oldest first: through the index chain as far
+// as it goes, then block by block.
+static int list_blocks(const mf_reader_t *r, uint64_t end, entry_list_t *out) {
+    uint64_t tail = MF_FIRST_BLOCK;
+    uint64_t li = atomic_load_explicit(&r->h->last_index, memory_order_acquire);
+    const mf_block_t *ib = li ? block_at(r, li, end) : NULL;
+    if (ib && ib->magic == MF_BLOCK_INDEX) {
+        tail = li + ib->len;
+        // the chain runs newest first; collect it backwards, then flip
+        while (ib) {
+            if (ib->magic != MF_BLOCK_INDEX
+                || ib->len != sizeof(*ib) + sizeof(uint64_t) + ib->count * sizeof(mf_index_entry_t))
+                return -1;
+            const uint64_t *prev = (const uint64_t *)(ib + 1);
+            const mf_index_entry_t *e = (const mf_index_entry_t *)(prev + 1);
+            for (uint32_t i = ib->count; i-- > 0; )
+                if (push_entry(out, &e[i]) < 0) return -1;
+            if (!*prev) break;
+            if (*prev >= li) return -1;
+            li = *prev;
+            ib = block_at(r, li, end);
+            if (!ib) return -1;
+        }
+        for (size_t i = 0, j = out->n; i < j / 2; i++) {
+            mf_index_entry_t t = out->v[i];
+            out->v[i] = out->v[j - 1 - i];
+            out->v[j - 1 - i] = t;
+        }
+    }
+    while (tail < end) {
+        const mf_block_t *b = block_at(r, tail, end);
+        if (!b) return -1;
+        if (b->magic == MF_BLOCK_DATA) {
+            mf_index_entry_t e = {
+                .offset = tail, .first_ns = b->first_ns, .last_ns = b->last_ns,
+                .count = b->count, .lanes = b->lanes
+            };
+            if (push_entry(out, &e) < 0) return -1;
+        } else if (b->magic != MF_BLOCK_INDEX) {
+            return -1;
+        }
+        tail += b->len;
+    }
+    return 0;
+}
+
+// Decode one data block's columns into s. Returns its sample count or -1.
+static int decode_block(const mf_block_t *b, mf_sample_t *s) {
+    if (b->magic != MF_BLOCK_DATA || b->count > MF_BLOCK_SAMPLES
+        || b->len < sizeof(*b) + MF_COLS * sizeof(uint32_t))
+        return -1;
+    const uint32_t *col_len = (const uint32_t *)(b + 1);
+    const uint8_t *p = (const uint8_t *)(col_len + MF_COLS);
+    const uint8_t *limit = (const uint8_t *)b + b->len;
+    const uint8_t *col[MF_COLS + 1];
+    col[0] = p;
+    for (int c = 0; c < MF_COLS; c++) {
+        if (col_len[c] > (size_t)(limit - col[c])) return -1;
+        col[c + 1] = col[c] + col_len[c];
+    }
+    uint32_t n = b->count;
+    if (col_len[MF_COL_LANE] != n) return -1;
+
+    uint64_t v, ts = b->first_ns;
+    int64_t pid = 0;
+    const uint8_t *q = col[MF_COL_TS];
+    for (uint32_t i = 0; i < n; i++) {
+        if (!(q = get_varint(q, col[MF_COL_TS + 1], &v))) return -1;
+        ts += (uint64_t)unzigzag(v);
+        s[i].ts_ns = ts;
+    }
+    q = col[MF_COL_PID];
+    for (uint32_t i = 0; i < n; i++) {
+        if (!(q = get_varint(q, col[MF_COL_PID + 1], &v))) return -1;
+        pid += unzigzag(v);
+        s[i].pid = (uint32_t)pid;
+    }
+    q = col[MF_COL_LANE];
+    for (uint32_t i = 0; i < n; i++) {
+        s[i].lane  = q[i] & 0x7f;
+        s[i].probe = (q[i] & MF_PROBE) != 0;
+    }
+    static const int rest[3] = { MF_COL_RTT, MF_COL_LOSS, MF_COL_JITTER };
+    for (int k = 0; k < 3; k++) {
+        q = col[rest[k]];
+        for (uint32_t i = 0; i < n; i++) {
+            if (!(q = get_varint(q, col[rest[k] + 1], &v))) return -1;
+            uint32_t x = (uint32_t)v;
+            if (k == 0)      s[i].rtt_us    = x;
+            else if (k == 1) s[i].loss      = x;
+            else             s[i].jitter_us = x;
+        }
+    }
+    return (int)n;
+}
+
+int mf_scan(const mf_reader_t *r, const mf_query_t *q, mf_visit_fn fn, void *arg,
+            mf_scan_stats_t *st) {
+    mf_scan_stats_t local = {0};
+    if (!st) st = &local;
+    uint64_t end = atomic_load_explicit(&r->h->end, memory_order_acquire);
+    if (end > r->size) end = r->size;   // grown since we mapped it: what we have
+
+    entry_list_t blocks = {0};
+    if (list_blocks(r, end, &blocks) < 0) {
+        free(blocks.v);
+        errno = EPROTO;
+        return -1;
+    }
+    uint64_t to = q->to_ns ? q->to_ns : UINT64_MAX;
+    mf_sample_t *s = malloc(MF_BLOCK_SAMPLES * sizeof(*s));
+    if (!s) {
+        free(blocks.v);
+        return -1;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < blocks.n && rc == 0; i++) {
+        const mf_index_entry_t *e = &blocks.v[i];
+        st->blocks++;
+        if (e->last_ns < q->from_ns || e->first_ns > to) continue;
+        if (q->lanes && !(e->lanes & q->lanes)) continue;
+        const mf_block_t *b = block_at(r, e->offset, end);
+        int n = b ? decode_block(b, s) : -1;
+        if (n < 0) {
+            errno = EPROTO;
+            rc = -1;
+            break;
+        }
+        st->blocks_read++;
+        for (int j = 0; j < n; j++) {
+            if (s[j].ts_ns < q->from_ns || s[j].ts_ns > to) continue;
+            if (s[j].probe && !q->probes) continue;
+            if (q->lanes && !(q->lanes & (1u << (s[j].lane & 0x1f)))) continue;
+            if (q->pid >= 0 && s[j].pid != (uint32_t)q->pid) continue;
+            st->samples++;
+            if (fn(&s[j], arg)) {
+                rc = 1;
+                break;
+            }
+        }
+    }
+    free(s);
+    free(blocks.v);
+    return rc < 0 ? -1 : 0;
+}
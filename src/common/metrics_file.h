@@ -0,0 +1,149 @@
+// metrics_file.h
+// On-disk recording of the METRICs the server sees (udp-monitor-server
+// --record DIR), read back by udp-monitor-query and udp-monitor-replay.
+//
+// Each worker appends to its own segment files, DIR/w<worker>-<ns>.umr,
+// mapped read-write and preallocated to a fixed size. A segment is an
+// mf_header_t followed by 8-byte aligned blocks:
+//
+//   data block   up to MF_BLOCK_SAMPLES samples, stored column by column:
+//                timestamps as zigzag varint deltas, pids as zigzag varint
+//                deltas, one lane byte each, then RTT, loss and jitter as
+//                varints (microseconds). A sample costs about a dozen bytes.
+//   index block  written after every MF_INDEX_EVERY data blocks and when the
+//                segment is closed: the offset, time range and lanes of each
+//                of those blocks, and the offset of the index block before
+//                it, so a query skips out-of-range blocks without touching
+//                their pages.
+//
+// The writer publishes a block by storing header.end (release) after the
+// block is complete, so a reader can follow a live segment: it loads end
+// (acquire) and only looks below it. A segment that was never closed (the
+// server was killed) keeps its preallocated size and has no final index;
+// the reader walks the blocks past the last index block one by one.
+// Everything is in host byte order, like the shared-memory export.
+
+#ifndef UDPMON_METRICS_FILE_H
+#define UDPMON_METRICS_FILE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MF_MAGIC          0x314345524e4f4d55ull   // "UMONREC1"
+#define MF_VERSION        1
+#define MF_BLOCK_DATA     0x41544144u             // "DATA"
+#define MF_BLOCK_INDEX    0x58444e49u             // "INDX"
+#define MF_BLOCK_SAMPLES  1024
+#define MF_INDEX_EVERY    16
+#define MF_PROBE          0x80                    // lane byte: a LANE_METRIC
+#define MF_DEFAULT_SEGMENT_MB 64
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t created_ns;             // CLOCK_REALTIME
+    int32_t  server_pid;
+    uint32_t worker;
+    _Atomic uint64_t end;            // bytes of complete blocks, from the start of the file
+    _Atomic uint64_t last_index;     // offset of the newest index block, 0 = none yet
+    _Atomic uint64_t samples;        // in complete blocks
+    uint64_t first_ns;               // earliest sample, 0 = none yet
+    _Atomic uint64_t last_ns;        // latest sample
+} mf_header_t;
+
+typedef struct {
+    uint32_t magic;                  // MF_BLOCK_DATA or MF_BLOCK_INDEX
+    uint32_t len;                    // whole block, this header included
+    uint32_t count;                  // samples, or index entries
+    uint32_t lanes;                  // data: bit per lane with a sample in the block
+    uint64_t first_ns, last_ns;      // data: its samples; index: the blocks it lists
+} mf_block_t;
+
+enum { MF_COL_TS, MF_COL_PID, MF_COL_LANE, MF_COL_RTT, MF_COL_LOSS, MF_COL_JITTER, MF_COLS };
+
+// A data block's header is followed by uint32_t col_len[MF_COLS], then the
+// columns back to back. An index block's by uint64_t prev (offset of the
+// previous index block, 0 = first), then count entries.
+typedef struct {
+    uint64_t offset;
+    uint64_t first_ns, last_ns;
+    uint32_t count, lanes;
+} mf_index_entry_t;
+
+typedef struct {
+    uint64_t ts_ns;                  // CLOCK_REALTIME arrival at the server
+    uint32_t pid;
+    uint8_t  lane;                   // METRIC: lane it arrived on; probe: lane probed
+    uint8_t  probe;                  // a LANE_METRIC report, not a METRIC
+    uint32_t rtt_us, loss, jitter_us;
+} mf_sample_t;
+
+// ——— Writer (one per worker thread) ———
+
+typedef struct {
+    char      dir[256];
+    char      path[320];             // current segment
+    uint32_t  worker;
+    size_t    seg_bytes;
+    int       fd;
+    uint8_t  *base;                  // current segment, NULL when none is open
+    size_t    off;                   // where the next block goes
+    uint64_t  last_index;
+    uint32_t  nindex;                // data blocks not yet in an index block
+    mf_index_entry_t index[MF_INDEX_EVERY];
+    uint32_t  n;                     // samples waiting for the next block
+    mf_sample_t pending[MF_BLOCK_SAMPLES];
+    uint64_t  segments, blocks, errors;
+} mf_writer_t;
+
+// Create dir if needed and open the first segment. Returns 0 or -1 (errno).
+int  mf_writer_open(mf_writer_t *w, const char *dir, uint32_t worker, size_t seg_bytes);
+// Buffer a sample; a full buffer is written out as a block. Returns the
+// samples that write stored (0 if there was none), or -1 (errno) if it
+// failed, in which case the block's MF_BLOCK_SAMPLES samples are lost.
+int  mf_append(mf_writer_t *w, const mf_sample_t *s);
+// Write the buffered samples out as a block now (a partial block is fine),
+// moving to a new segment when this one is full. Returns the samples
+// written, or -1 (errno) if they were lost.
+int  mf_flush(mf_writer_t *w);
+// Flush, write the final index block and trim the file to what was used.
+// Returns what the flush did.
+int  mf_writer_close(mf_writer_t *w);
+
+// ——— Reader ———
+
+typedef struct {
+    const uint8_t     *base;
+    size_t             size;
+    const mf_header_t *h;
+} mf_reader_t;
+
+typedef struct {
+    uint64_t from_ns, to_ns;         // inclusive; to_ns 0 = no upper bound
+    uint32_t lanes;                  // bit per lane, 0 = all
+    int64_t  pid;                    // < 0 = all
+    int      probes;                 // also visit LANE_METRIC samples
+} mf_query_t;
+
+typedef struct {
+    uint64_t blocks, blocks_read, samples;
+} mf_scan_stats_t;
+
+// Return nonzero to stop the scan.
+typedef int (*mf_visit_fn)(const mf_sample_t *s, void *arg);
+
+// Map a segment read-only and check its header. Returns 0, or -1 with errno
+// set (EPROTO for something that is not a segment of this version).
+int  mf_open(mf_reader_t *r, const char *path);
+void mf_close(mf_reader_t *r);
+
+// Visit the samples matching q in the order they were written. st (may be
+// NULL) counts the data blocks in the segment and those decoded. Returns
+// 0, or -1 with errno EPROTO if a block is damaged (samples before it have
+// been visited).
+int  mf_scan(const mf_reader_t *r, const mf_query_t *q, mf_visit_fn fn, void *arg,
+             mf_scan_stats_t *st);
+
+#endif
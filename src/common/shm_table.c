@@ -0,0 +1,99 @@
+// shm_table.c
+// Create and map the shared-memory state export (see shm_table.h).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_table.h"
+
+static size_t region_size(uint32_t nworkers, uint32_t slots) {
+    return sizeof(shm_header_t)
+         + (size_t)nworkers * sizeof(shm_worker_t)
+         + (size_t)nworkers * slots * sizeof(shm_client_t);
+}
+
+int shm_table_create(shm_table_t *t, const char *name, uint32_t nworkers,
+                     uint32_t slots, const uint32_t lane_ports[3], uint64_t start_ns) {
+    memset(t, 0, sizeof(*t));
+    snprintf(t->name, sizeof(t->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    t->size = region_size(nworkers, slots);
+
+    // a stale object from an earlier run may have another layout
+    shm_unlink(t->name);
+    int fd = shm_open(t->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return -1;
+    // pages stay unbacked until a worker first writes a record into them
+    if (ftruncate(fd, (off_t)t->size) < 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(t->name);
+        errno = err;
+        return -1;
+    }
+    void *base = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        shm_unlink(t->name);
+        errno = err;
+        return -1;
+    }
+    t->base = base;
+
+    shm_header_t *h = base;
+    h->version     = SHM_VERSION;
+    h->header_size = sizeof(shm_header_t);
+    h->worker_size = sizeof(shm_worker_t);
+    h->client_size = sizeof(shm_client_t);
+    h->nworkers    = nworkers;
+    h->slots       = slots;
+    h->server_pid  = (int32_t)getpid();
+    memcpy(h->lane_ports, lane_ports, sizeof(h->lane_ports));
+    h->start_ns    = start_ns;
+    for (uint32_t w = 0; w < nworkers; w++) shm_worker(t, w)->worker = w;
+    // magic last: a reader that sees it sees a complete header
+    atomic_thread_fence(memory_order_release);
+    h->magic = SHM_MAGIC;
+    return 0;
+}
+
+int shm_table_open(shm_table_t *t, const char *name) {
+    memset(t, 0, sizeof(*t));
+    snprintf(t->name, sizeof(t->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(t->name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_header_t)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    t->base = base;
+    t->size = (size_t)st.st_size;
+
+    const shm_header_t *h = base;
+    if (h->magic != SHM_MAGIC || h->version != SHM_VERSION
+        || h->header_size != sizeof(shm_header_t)
+        || h->worker_size != sizeof(shm_worker_t)
+        || h->client_size != sizeof(shm_client_t)
+        || t->size < region_size(h->nworkers, h->slots)) {
+        shm_table_close(t);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void shm_table_close(shm_table_t *t) {
+    if (t->base) munmap(t->base, t->size);
+    t->base = NULL;
+    t->size = 0;
+}
@@ -0,0 +1,126 @@
+// shm_table.h
+// Live server state exported through a POSIX shared-memory object
+// (/dev/shm/<name>), so dashboards and udp-monitor-top can poll it without
+// a single syscall on the server's side.
+//
+// Layout: one shm_header_t, then one shm_worker_t per worker, then each
+// worker's array of shm_client_t records indexed by the client's stable
+// slab index. Every worker section and every client record has exactly one
+// writer (its worker thread) and is guarded by its own seqlock: the writer
+// makes seq odd, updates the record, then makes it even again; a reader
+// copies the record and keeps the copy only if seq was even and unchanged
+// across the copy. Readers never block the writer and never take a lock.
+
+#ifndef UDPMON_SHM_TABLE_H
+#define UDPMON_SHM_TABLE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define SHM_MAGIC        0x314d48534e4f4d55ull   // "UMONSHM1"
+#define SHM_VERSION      1
+#define SHM_DEFAULT_NAME "/udp-monitor"
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size, worker_size, client_size;   // layout check for readers
+    uint32_t nworkers;
+    uint32_t slots;             // client records per worker
+    int32_t  server_pid;
+    uint32_t lane_ports[3];
+    uint64_t start_ns;          // CLOCK_MONOTONIC at startup
+} shm_header_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t worker;
+    uint32_t slots_used;        // records past this index were never written
+    uint32_t overflow;          // live clients whose index is beyond slots
+    uint64_t publish_ns;        // CLOCK_MONOTONIC of the last update
+    uint64_t clients, rx_packets, pings, metrics, registers, lane_switches;
+    uint64_t chaos_drops, chaos_delays, evictions, malformed;
+    hist_t   lane_rtt[3], lane_jitter[3];   // microseconds, last one to two windows
+} shm_worker_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t in_use;            // 0: slot free (client evicted or never seen)
+    int32_t  pid;
+    uint32_t index;
+    uint32_t ip;                // network byte order
+    uint16_t port;              // host byte order
+    uint8_t  lane;
+    uint8_t  proto;
+    int32_t  loss_streak, slow_streak, jitter_streak;
+    uint32_t switches;
+    uint64_t metrics, losses;
+    int64_t  cooldown_until_ms; // CLOCK_MONOTONIC ms; no switch before this
+    uint64_t last_seen_ns;      // CLOCK_MONOTONIC
+    uint64_t rtt_pcts[3];       // p50/p99/p99.9, microseconds
+    uint32_t samples;           // RTTs in the histogram window
+    uint32_t reserved;
+    double   last_rtt, rtt_mean, rtt_min, rtt_max, rfc_jitter;   // ms
+} shm_client_t;
+
+typedef struct {
+    void   *base;
+    size_t  size;
+    char    name[64];
+} shm_table_t;
+
+// Server side: create (or replace) the object sized for nworkers x slots
+// records, fill in the header and map it read-write. Returns 0 or -1 (errno).
+int  shm_table_create(shm_table_t *t, const char *name, uint32_t nworkers,
+                      uint32_t slots, const uint32_t lane_ports[3], uint64_t start_ns);
+// Reader side: map an existing object read-only and check its header.
+// Returns 0, or -1 with errno set (EPROTO for a layout mismatch).
+int  shm_table_open(shm_table_t *t, const char *name);
+void shm_table_close(shm_table_t *t);
+
+static inline const shm_header_t *shm_header(const shm_table_t *t) {
+    return t->base;
+}
+
+static inline shm_worker_t *shm_worker(const shm_table_t *t, uint32_t w) {
+    return (shm_worker_t *)((char *)t->base + sizeof(shm_header_t)) + w;
+}
+
+static inline shm_client_t *shm_client(const shm_table_t *t, uint32_t w, uint32_t slot) {
+    const shm_header_t *h = t->base;
+    shm_client_t *first = (shm_client_t *)shm_worker(t, h->nworkers);
+    return first + (size_t)w * h->slots + slot;
+}
+
+// ——— Seqlock ———
+
+static inline void shm_write_begin(_Atomic uint32_t *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void shm_write_end(_Atomic uint32_t *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Copy len bytes of a record that starts with its seq into dst. Returns 0 on
+// a consistent copy, -1 if the writer kept it busy for every attempt.
+static inline int shm_read(const void *rec, void *dst, size_t len) {
+    const _Atomic uint32_t *seq = rec;
+    for (int tries = 0; tries < 64; tries++) {
+        uint32_t s = atomic_load_explicit(seq, memory_order_acquire);
+        if (s & 1) continue;
+        memcpy(dst, rec, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == s) return 0;
+    }
+    return -1;
+}
+
+#endif
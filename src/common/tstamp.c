@@ -0,0 +1,80 @@
+// tstamp.c
+// Kernel RX/TX timestamp helpers (see tstamp.h).
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+#include "tstamp.h"
+
+static uint64_t ts_to_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+uint64_t tstamp_wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts_to_ns(&ts);
+}
+
+int tstamp_enable_rx(int fd) {
+    int one = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+}
+
+int tstamp_enable_tx(int fd) {
+    unsigned flags = SOF_TIMESTAMPING_TX_SOFTWARE
+                   | SOF_TIMESTAMPING_SOFTWARE
+                   | SOF_TIMESTAMPING_OPT_ID
+                   | SOF_TIMESTAMPING_OPT_TSONLY;   // stamp only, no payload copy
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+uint64_t tstamp_rx(struct msghdr *msg) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPNS) continue;
+        struct timespec ts;
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        return ts_to_ns(&ts);
+    }
+    return 0;
+}
+
+int tstamp_read_tx(int fd, uint32_t *id, uint64_t *ns) {
+    for (;;) {
+        char ctrl[TSTAMP_CMSG_SPACE];
+        struct msghdr msg = { .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        uint64_t stamp = 0;
+        int have_id = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                struct scm_timestamping tss;
+                memcpy(&tss, CMSG_DATA(c), sizeof(tss));
+                stamp = ts_to_ns(&tss.ts[0]);   // ts[0] is the software stamp
+            } else if ((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR)
+                       || (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)) {
+                struct sock_extended_err ee;
+                memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+                if (ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING
+                    && ee.ee_info == SCM_TSTAMP_SND) {
+                    *id     = ee.ee_data;
+                    have_id = 1;
+                }
+            }
+        }
+        // anything else on the error queue (ICMP errors) is skipped
+        if (stamp && have_id) {
+            *ns = stamp;
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+// tstamp.h
+// Kernel packet timestamps (SO_TIMESTAMPNS for receive, SO_TIMESTAMPING
+// software stamps for transmit). All values are CLOCK_REALTIME nanoseconds,
+// the clock the kernel stamps with, so they can be compared with
+// tstamp_wall_ns() as a fallback when the kernel gives none.
+
+#ifndef UDPMON_TSTAMP_H
+#define UDPMON_TSTAMP_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Room for every control message tstamp_rx() looks at.
+#define TSTAMP_CMSG_SPACE 128
+
+uint64_t tstamp_wall_ns(void);
+
+// Ask for a kernel receive timestamp on every datagram. Returns 0 or -1.
+int      tstamp_enable_rx(int fd);
+
+// Ask for a software transmit timestamp on every datagram sent, delivered
+// on the socket error queue tagged with a per-socket counter (0 for the
+// first datagram sent after this call). Returns 0 or -1.
+int      tstamp_enable_tx(int fd);
+
+// Kernel receive timestamp carried in msg's control data, or 0.
+uint64_t tstamp_rx(struct msghdr *msg);
+
+// Pop one transmit timestamp off fd's error queue. Returns 1 and fills
+// *id / *ns, or 0 when the queue is empty.
+int      tstamp_read_tx(int fd, uint32_t *id, uint64_t *ns);
+
+#endif
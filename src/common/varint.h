@@ -0,0 +1,43 @@
+// varint.h
+// LEB128 varints and zigzag signed mapping, shared by the recording format
+// (metrics_file.c) and relay summaries (server/relay.c).
+
+#ifndef UDPMON_VARINT_H
+#define UDPMON_VARINT_H
+
+#include <stdint.h>
+
+#define VARINT_MAX 10   // bytes a 64-bit value can take
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// NULL if the varint runs past end or is longer than 10 bytes.
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 70 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,87 @@
+// winstats.c
+// Monotonic-deque sliding min/max with running mean/variance (see winstats.h).
+
+#include <math.h>
+
+#include "winstats.h"
+
+size_t winstats_storage_size(uint32_t cap) {
+    return (size_t)cap * (sizeof(double) + 2 * sizeof(uint32_t));
+}
+
+void winstats_init(winstats_t *w, uint32_t cap, void *storage) {
+    w->cap  = cap;
+    w->vals = storage;
+    w->minq = (uint32_t *)(w->vals + cap);
+    w->maxq = w->minq + cap;
+    winstats_reset(w);
+}
+
+void winstats_reset(winstats_t *w) {
+    w->count = w->next = 0;
+    w->min_head = w->min_len = 0;
+    w->max_head = w->max_len = 0;
+    w->mean = w->m2 = 0.0;
+}
+
+static inline uint32_t ring_at(const winstats_t *w, uint32_t head, uint32_t i) {
+    uint32_t s = head + i;
+    return s >= w->cap ? s - w->cap : s;
+}
+
+// Drop the front slot if it is about to be overwritten, pop every entry
+// that the new sample beats, then append the new slot. want_min selects
+// the ordering.
+static void deque_push(winstats_t *w, uint32_t *q, uint32_t *head, uint32_t *len,
+                       uint32_t slot, double x, int want_min) {
+    if (*len && q[*head] == slot) {
+        *head = ring_at(w, *head, 1);
+        (*len)--;
+    }
+    while (*len) {
+        double back = w->vals[q[ring_at(w, *head, *len - 1)]];
+        if (want_min ? back < x : back > x) break;
+        (*len)--;
+    }
+    q[ring_at(w, *head, *len)] = slot;
+    (*len)++;
+}
+
+void winstats_push(winstats_t *w, double x) {
+    uint32_t slot = w->next;
+    // slot still holds the sample leaving the window (when full); the
+    // deques drop it before the new value is written over it
+    if (w->count == w->cap) {
+        double y = w->vals[slot];
+        double old_mean = w->mean;
+        w->mean += (x - y) / w->cap;
+        w->m2   += (x - y) * (x - w->mean + y - old_mean);
+        if (w->m2 < 0.0) w->m2 = 0.0;   // rounding can leave it slightly negative
+    } else {
+        w->count++;
+        double d = x - w->mean;
+        w->mean += d / w->count;
+        w->m2   += d * (x - w->mean);
+    }
+
+    deque_push(w, w->minq, &w->min_head, &w->min_len, slot, x, 1);
+    deque_push(w, w->maxq, &w->max_head, &w->max_len, slot, x, 0);
+    w->vals[slot] = x;
+    w->next = slot + 1 == w->cap ? 0 : slot + 1;
+}
+
+double winstats_min(const winstats_t *w) {
+    return w->min_len ? w->vals[w->minq[w->min_head]] : 0.0;
+}
+
+double winstats_max(const winstats_t *w) {
+    return w->max_len ? w->vals[w->maxq[w->max_head]] : 0.0;
+}
+
+double winstats_variance(const winstats_t *w) {
+    return w->count > 1 ? w->m2 / (w->count - 1) : 0.0;
+}
+
+double winstats_stddev(const winstats_t *w) {
+    return sqrt(winstats_variance(w));
+}
@@ -0,0 +1,48 @@
+// winstats.h
+// Sliding-window statistics over the last `cap` samples, O(1) per sample.
+//
+// Samples live in a ring. Minimum and maximum come from two monotonic
+// deques of ring slots: each new sample pops every worse candidate off the
+// back of the deque before it is appended, and the front drops out when its
+// slot is overwritten, so the front is always the extreme of the window and
+// every sample is pushed and popped at most once. Mean and variance are
+// maintained incrementally (Welford's update, extended to remove the sample
+// that leaves the window).
+//
+// The caller supplies the storage (winstats_storage_size() bytes) so the
+// server can carve windows for a whole slab of clients out of one block.
+
+#ifndef UDPMON_WINSTATS_H
+#define UDPMON_WINSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    double   *vals;          // ring of the last cap samples
+    uint32_t *minq, *maxq;   // deques of slots into vals, each a ring of cap
+    uint32_t cap, count;
+    uint32_t next;           // slot the next sample is written to
+    uint32_t min_head, min_len;
+    uint32_t max_head, max_len;
+    double   mean, m2;
+} winstats_t;
+
+size_t winstats_storage_size(uint32_t cap);
+
+// storage must be suitably aligned for double and winstats_storage_size(cap)
+// bytes long; cap must be at least 1.
+void   winstats_init(winstats_t *w, uint32_t cap, void *storage);
+void   winstats_reset(winstats_t *w);
+void   winstats_push(winstats_t *w, double x);
+
+static inline uint32_t winstats_count(const winstats_t *w) { return w->count; }
+static inline double   winstats_mean(const winstats_t *w)  { return w->mean; }
+
+// All of these return 0 for an empty window.
+double winstats_min(const winstats_t *w);
+double winstats_max(const winstats_t *w);
+double winstats_variance(const winstats_t *w);   // sample variance (n - 1)
+double winstats_stddev(const winstats_t *w);
+
+#endif
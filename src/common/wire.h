@@ -0,0 +1,214 @@
+// wire.h
+// Binary framing shared by udp-monitor-server and udp-monitor-client.
+//
+// Every binary datagram starts with a fixed 24-byte header. All fields are
+// little-endian and naturally aligned, so a received buffer that passes
+// wire_view() can be read in place through the structs below; only the
+// le*toh() on each field read is needed (a no-op on little-endian hosts).
+//
+// A client asks for binary mode with a text "REGISTER pid=N proto=1". A
+// server that understands it answers with a binary REGISTER_ACK; any other
+// answer (or none) means the client stays on the text protocol. Text
+// messages never start with WIRE_MAGIC, so both encodings can share a port.
+//
+// The REGISTER_ACK carries the server's lane ports. With them a client can
+// probe the lanes it is not on (LANE_PROBE, echoed unchanged by the server)
+// and report what it measured (LANE_METRIC), so lane switches go to the
+// lane that measures best. A 24-byte ack, from an older server, has no
+// lane table and the client does not probe.
+//
+// A CONTROL carries a sequence number in its header seq, counting up per
+// client. The client answers every CONTROL, repeats included, with a
+// CONTROL_ACK echoing that seq and the port, and acts on a seq only once;
+// the server resends until it is acknowledged and only then treats the
+// client as moved. A CONTROL with seq 0 is from an older server and is
+// not acknowledged.
+//
+// A RATE_HINT asks a client to PING at least every interval_us for the
+// next ttl_ms, because its lane decision is close to a switch. Hints are
+// not acknowledged or resent: one that is lost just expires, and clients
+// that do not adapt their rate ignore them.
+//
+// A REREGISTER answers a METRIC from a pid the server does not know (it
+// was evicted as idle, or the server restarted): the client should send
+// its REGISTER again. It is the bare header, pid the METRIC's; a text
+// client gets "REREGISTER pid=N".
+//
+// A SUMMARY travels from a relay server to the server above it (see
+// server/relay.h): the header's pid is the relay's id and its seq the
+// summary number, and the varint records after wire_summary_t are
+// body_len bytes long.
+
+#ifndef UDPMON_WIRE_H
+#define UDPMON_WIRE_H
+
+#include <endian.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WIRE_MAGIC   0x4d55   // "UM" on the wire
+#define WIRE_VERSION 1
+
+enum {
+    WIRE_REGISTER     = 1,
+    WIRE_REGISTER_ACK = 2,
+    WIRE_PING         = 3,
+    WIRE_PONG         = 4,
+    WIRE_METRIC       = 5,
+    WIRE_CONTROL      = 6,
+    WIRE_LANE_PROBE   = 7,
+    WIRE_LANE_METRIC  = 8,
+    WIRE_CONTROL_ACK  = 9,
+    WIRE_RATE_HINT    = 10,
+    WIRE_SUMMARY      = 11,
+    WIRE_REREGISTER   = 12,
+};
+
+#define WIRE_LANES 3
+
+typedef struct {
+    uint16_t magic;
+    uint8_t  version;
+    uint8_t  type;
+    uint32_t pid;
+    uint32_t seq;
+    uint32_t reserved;
+    uint64_t ts_ns;      // sender CLOCK_MONOTONIC time
+} wire_hdr_t;
+
+// PING and PONG share a layout: the server echoes the datagram with the
+// type rewritten in place.
+typedef struct {
+    wire_hdr_t h;
+} wire_ping_t;
+
+// A PING sent with room for this body asks for server timestamps: the
+// server fills in when it received the PING (kernel stamp if it has one)
+// and when it handed the PONG to the kernel, both CLOCK_REALTIME. Their
+// difference is the time spent inside the server, chaos delay included.
+// A shorter PING is echoed as is.
+typedef struct {
+    wire_hdr_t h;
+    uint64_t   srv_rx_ns;
+    uint64_t   srv_tx_ns;
+} wire_ping_ts_t;
+
+typedef struct {
+    wire_hdr_t h;
+    uint32_t   rtt_us;
+    uint32_t   jitter_us;
+    uint32_t   loss;
+    uint32_t   reserved;
+} wire_metric_t;
+
+// Also the layout of CONTROL_ACK, which echoes the CONTROL's seq, port and
+// lane.
+typedef struct {
+    wire_hdr_t h;
+    uint16_t   port;
+    uint16_t   lane;
+    uint32_t   reserved;
+} wire_control_t;
+
+typedef struct {
+    wire_hdr_t h;
+    uint16_t   lane_ports[WIRE_LANES];   // indexed by lane
+    uint16_t   reserved;
+} wire_register_ack_t;
+
+// Background probe of one lane, sent to that lane's port. seq counts per
+// lane; lane is only read back by the client.
+typedef struct {
+    wire_hdr_t h;
+    uint16_t   lane;
+    uint16_t   reserved;
+    uint32_t   reserved2;
+} wire_lane_probe_t;
+
+// What the client measured on a lane it is not on: RTT of the latest
+// answered LANE_PROBE, its change from the one before, and how many probes
+// of that lane were lost since the previous report.
+typedef struct {
+    wire_hdr_t h;
+    uint32_t   rtt_us;
+    uint32_t   jitter_us;
+    uint32_t   loss;
+    uint16_t   lane;
+    uint16_t   reserved;
+} wire_lane_metric_t;
+
+typedef struct {
+    wire_hdr_t h;
+    uint32_t   interval_us;
+    uint32_t   ttl_ms;
+} wire_rate_hint_t;
+
+typedef struct {
+    wire_hdr_t h;
+    uint16_t   part;       // datagram of the summary, from 0
+    uint8_t    last;       // 1 on its final datagram
+    uint8_t    source;     // relay worker that built it
+    uint32_t   body_len;
+} wire_summary_t;
+
+_Static_assert(sizeof(wire_hdr_t)          == 24, "wire header layout");
+_Static_assert(sizeof(wire_ping_ts_t)      == 40, "wire timestamped ping layout");
+_Static_assert(sizeof(wire_metric_t)       == 40, "wire metric layout");
+_Static_assert(sizeof(wire_control_t)      == 32, "wire control layout");
+_Static_assert(sizeof(wire_register_ack_t) == 32, "wire register ack layout");
+_Static_assert(sizeof(wire_lane_probe_t)   == 32, "wire lane probe layout");
+_Static_assert(sizeof(wire_lane_metric_t)  == 40, "wire lane metric layout");
+_Static_assert(sizeof(wire_rate_hint_t)    == 32, "wire rate hint layout");
+_Static_assert(sizeof(wire_summary_t)      == 32, "wire summary layout");
+
+static inline size_t wire_min_len(uint8_t type) {
+    switch (type) {
+        case WIRE_REGISTER:
+        case WIRE_REGISTER_ACK:
+        case WIRE_PING:
+        case WIRE_PONG:
+        case WIRE_REREGISTER:  return sizeof(wire_ping_t);
+        case WIRE_METRIC:      return sizeof(wire_metric_t);
+        case WIRE_CONTROL:
+        case WIRE_CONTROL_ACK: return sizeof(wire_control_t);
+        case WIRE_LANE_PROBE:  return sizeof(wire_lane_probe_t);
+        case WIRE_LANE_METRIC: return sizeof(wire_lane_metric_t);
+        case WIRE_RATE_HINT:   return sizeof(wire_rate_hint_t);
+        case WIRE_SUMMARY:     return sizeof(wire_summary_t);
+        default:               return 0;
+    }
+}
+
+// Validate buf as a binary datagram and return a view of its header, or
+// NULL if it is text, truncated, or from another protocol version. buf
+// must be at least 8-byte aligned.
+static inline const wire_hdr_t *wire_view(const void *buf, size_t len) {
+    if (len < sizeof(wire_hdr_t)) return NULL;
+    const wire_hdr_t *h = buf;
+    if (le16toh(h->magic) != WIRE_MAGIC || h->version != WIRE_VERSION) return NULL;
+    size_t need = wire_min_len(h->type);
+    if (need == 0 || len < need) return NULL;
+    return h;
+}
+
+// Cheap pre-check used to route a datagram to the binary or text parser.
+static inline int wire_is_binary(const void *buf, size_t len) {
+    uint16_t magic;
+    if (len < sizeof(magic)) return 0;
+    memcpy(&magic, buf, sizeof(magic));
+    return le16toh(magic) == WIRE_MAGIC;
+}
+
+static inline void wire_hdr_init(wire_hdr_t *h, uint8_t type, uint32_t pid,
+                                 uint32_t seq, uint64_t ts_ns) {
+    h->magic    = htole16(WIRE_MAGIC);
+    h->version  = WIRE_VERSION;
+    h->type     = type;
+    h->pid      = htole32(pid);
+    h->seq      = htole32(seq);
+    h->reserved = 0;
+    h->ts_ns    = htole64(ts_ns);
+}
+
+#endif
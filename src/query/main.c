@@ -0,0 +1,272 @@
+// udp-monitor-query
+// Reads the segment files written by udp-monitor-server --record DIR (see
+// common/metrics_file.h):
+//
+//   info     one line per segment: worker, samples, bytes, time span
+//   samples  the matching samples, one per line
+//   lanes    per-lane aggregates of the matching samples: RTT and jitter
+//            percentiles, lossy reports, loss
+//
+// --from/--to/--last, --pid and --lane narrow the samples; whole blocks
+// outside the time range or without the lane are skipped through the
+// segments' index blocks. Segments may still be being written. To replay a
+// recording through the lane engines, give the segments to
+// udp-monitor-replay.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "common/histogram.h"
+#include "common/metrics_file.h"
+
+static const char *LANE_NAMES[3] = { "green", "yellow", "red" };
+
+static uint64_t now_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Seconds since the epoch, fractions allowed.
+static int parse_time(const char *s, uint64_t *ns) {
+    char *end;
+    double t = strtod(s, &end);
+    if (end == s || *end || t < 0) return -1;
+    *ns = (uint64_t)(t * 1e9);
+    return 0;
+}
+
+static int parse_lane(const char *s) {
+    for (int l = 0; l < 3; l++)
+        if (strcmp(s, LANE_NAMES[l]) == 0) return l;
+    if (s[0] >= '0' && s[0] <= '2' && !s[1]) return s[0] - '0';
+    return -1;
+}
+
+// ——— samples ———
+
+typedef struct {
+    int      json;
+    uint64_t limit, shown;
+} dump_t;
+
+static int print_sample(const mf_sample_t *s, void *arg) {
+    dump_t *d = arg;
+    const char *lane = s->lane < 3 ? LANE_NAMES[s->lane] : "?";
+    if (d->json) {
+        printf("{\"ts_ns\":%" PRIu64 ",\"pid\":%u,\"lane\":%u,\"probe\":%s,\"rtt\":%.3f,\"loss\":%u,\"jitter\":%.3f}\n",
+               s->ts_ns, s->pid, s->lane, s->probe ? "true" : "false",
+               s->rtt_us / 1000.0, s->loss, s->jitter_us / 1000.0);
+    } else {
+        printf("%" PRIu64 ".%06" PRIu64 " %8u %-6s %-5s %9.3f %5u %9.3f\n",
+               s->ts_ns / UINT64_C(1000000000), (s->ts_ns % UINT64_C(1000000000)) / 1000, s->pid, lane,
+               s->probe ? "probe" : "-", s->rtt_us / 1000.0, s->loss, s->jitter_us / 1000.0);
+    }
+    return d->limit && ++d->shown >= d->limit;
+}
+
+// ——— lanes ———
+
+typedef struct {
+    uint64_t samples, probes, lossy, lost;
+    double   rtt_sum, jitter_sum;
+    hist_t   rtt, jitter;            // microseconds
+} lane_agg_t;
+
+static int aggregate(const mf_sample_t *s, void *arg) {
+    lane_agg_t *a = arg;
+    if (s->lane >= 3) return 0;
+    a += s->lane;
+    a->samples++;
+    if (s->probe) a->probes++;
+    if (s->loss) a->lossy++;
+    a->lost       += s->loss;
+    a->rtt_sum    += s->rtt_us;
+    a->jitter_sum += s->jitter_us;
+    hist_record(&a->rtt, s->rtt_us);
+    hist_record(&a->jitter, s->jitter_us);
+    return 0;
+}
+
+static void print_lanes(const lane_agg_t *a, int json) {
+    static const double pct[3] = { 50.0, 90.0, 99.0 };
+    if (!json)
+        printf("%-6s %9s %7s %7s %8s %9s %9s %9s %9s %9s %9s %9s\n", "lane", "samples", "probes",
+               "lossy%", "lost", "rtt_mean", "rtt_p50", "rtt_p90", "rtt_p99", "rtt_max",
+               "jit_mean", "jit_p99");
+    for (int l = 0; l < 3; l++) {
+        const lane_agg_t *x = &a[l];
+        const hist_t *rh = &x->rtt, *jh = &x->jitter;
+        uint64_t rp[3], jp[3];
+        hist_percentiles(&rh, 1, pct, rp, 3);
+        hist_percentiles(&jh, 1, pct, jp, 3);
+        double n = x->samples ? (double)x->samples : 1.0;
+        double lossy = 100.0 * (double)x->lossy / n;
+        if (json) {
+            printf("{\"lane\":\"%s\",\"samples\":%" PRIu64 ",\"probes\":%" PRIu64 ",\"lossy_pct\":%.2f,\"lost\":%" PRIu64 ",\"rtt\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},\"jitter\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f}}\n",
+                   LANE_NAMES[l], x->samples, x->probes, lossy, x->lost,
+                   x->rtt_sum / n / 1000.0, rp[0] / 1000.0, rp[1] / 1000.0, rp[2] / 1000.0,
+                   x->rtt.max / 1000.0, x->jitter_sum / n / 1000.0,
+                   jp[0] / 1000.0, jp[1] / 1000.0, jp[2] / 1000.0);
+        } else {
+            printf("%-6s %9" PRIu64 " %7" PRIu64 " %7.2f %8" PRIu64 " %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+                   LANE_NAMES[l], x->samples, x->probes, lossy, x->lost,
+                   x->rtt_sum / n / 1000.0, rp[0] / 1000.0, rp[1] / 1000.0, rp[2] / 1000.0,
+                   x->rtt.max / 1000.0, x->jitter_sum / n / 1000.0, jp[2] / 1000.0);
+        }
+    }
+}
+
+// ——— info ———
+
+static void print_info(const char *path, const mf_reader_t *r, int json) {
+    const mf_header_t *h = r->h;
+    uint64_t end     = atomic_load_explicit(&h->end, memory_order_acquire);
+    uint64_t samples = atomic_load_explicit(&h->samples, memory_order_relaxed);
+    uint64_t last    = atomic_load_explicit(&h->last_ns, memory_order_relaxed);
+    // a query that matches nothing still counts the blocks
+    mf_query_t none = { .from_ns = UINT64_MAX, .to_ns = UINT64_MAX, .pid = -1 };
+    mf_scan_stats_t st = {0};
+    int ok = mf_scan(r, &none, NULL, NULL, &st) == 0;
+    // a closed segment is trimmed to its last block
+    int open = r->size != end;
+    double span = h->first_ns && last > h->first_ns ? (double)(last - h->first_ns) / 1e9 : 0.0;
+    double per  = samples ? (double)(end - sizeof(*h)) / (double)samples : 0.0;
+    if (json) {
+        printf("{\"path\":\"%s\",\"worker\":%u,\"server_pid\":%d,\"created_ns\":%" PRIu64 ",\"samples\":%" PRIu64 ",\"blocks\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"bytes_per_sample\":%.2f,\"first_ns\":%" PRIu64 ",\"last_ns\":%" PRIu64 ",\"span_s\":%.3f,\"open\":%s,\"damaged\":%s}\n",
+               path, h->worker, h->server_pid, h->created_ns, samples, st.blocks, end, per,
+               h->first_ns, last, span, open ? "true" : "false", ok ? "false" : "true");
+    } else {
+        printf("%s: worker %u, pid %d, %" PRIu64 " samples in %" PRIu64 " blocks, %" PRIu64 " bytes (%.1f/sample), %.1f s from %" PRIu64 ".%03" PRIu64 "%s%s\n",
+               path, h->worker, h->server_pid, samples, st.blocks, end, per, span,
+               h->first_ns / UINT64_C(1000000000), (h->first_ns % UINT64_C(1000000000)) / 1000000,
+               open ? ", open" : "", ok ? "" : ", DAMAGED");
+    }
+}
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [--from SEC] [--to SEC] [--last SEC] [--pid PID] [--lane LANE]... "
+           "[--probes] [--limit N] [--json] info|samples|lanes SEGMENT...\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    mf_query_t q = { .pid = -1 };
+    double last_s = 0.0;
+    int json = 0;
+    uint64_t limit = 0;
+
+    static struct option long_opts[] = {
+        {"from",   required_argument, 0, 'f'},
+        {"to",     required_argument, 0, 't'},
+        {"last",   required_argument, 0, 'l'},
+        {"pid",    required_argument, 0, 'p'},
+        {"lane",   required_argument, 0, 'L'},
+        {"probes", no_argument,       0, 'P'},
+        {"limit",  required_argument, 0, 'n'},
+        {"json",   no_argument,       0, 'j'},
+        {"help",   no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:t:l:p:L:Pn:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+            case 't':
+                if (parse_time(optarg, opt == 'f' ? &q.from_ns : &q.to_ns) < 0) {
+                    fprintf(stderr, "bad time '%s' (seconds since the epoch)\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'l': last_s = atof(optarg); break;
+            case 'p': q.pid  = strtoll(optarg, NULL, 10); break;
+            case 'L': {
+                int l = parse_lane(optarg);
+                if (l < 0) {
+                    fprintf(stderr, "unknown lane '%s'\n", optarg);
+                    return 2;
+                }
+                q.lanes |= 1u << l;
+                break;
+            }
+            case 'P': q.probes = 1; break;
+            case 'n': limit = strtoull(optarg, NULL, 10); break;
+            case 'j': json = 1; break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return (opt=='h') ? 0 : 2;
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *cmd = argv[optind++];
+    int ninputs = argc - optind;
+    char **inputs = argv + optind;
+    if (strcmp(cmd, "info") && strcmp(cmd, "samples") && strcmp(cmd, "lanes")) {
+        fprintf(stderr, "unknown command '%s'\n", cmd);
+        return 2;
+    }
+
+    mf_reader_t *readers = calloc((size_t)ninputs, sizeof(*readers));
+    if (!readers) {
+        perror("calloc");
+        return 1;
+    }
+    int rc = 0;
+    uint64_t newest = 0;
+    for (int i = 0; i < ninputs; i++) {
+        if (mf_open(&readers[i], inputs[i]) < 0) {
+            fprintf(stderr, "%s: %s\n", inputs[i],
+                    errno == EPROTO ? "not a udp-monitor recording" : strerror(errno));
+            rc = 1;
+            continue;
+        }
+        uint64_t l = atomic_load_explicit(&readers[i].h->last_ns, memory_order_relaxed);
+        if (l > newest) newest = l;
+    }
+    // --last counts back from the newest sample in any of the segments
+    if (last_s > 0 && newest) {
+        uint64_t back = (uint64_t)(last_s * 1e9);
+        uint64_t from = newest > back ? newest - back : 0;
+        if (from > q.from_ns) q.from_ns = from;
+    }
+
+    lane_agg_t agg[3];
+    memset(agg, 0, sizeof(agg));
+    dump_t dump = { .json = json, .limit = limit };
+    mf_scan_stats_t st = {0};
+    uint64_t t0 = now_mono_ns();
+    for (int i = 0; i < ninputs; i++) {
+        if (!readers[i].base) continue;
+        if (strcmp(cmd, "info") == 0) {
+            print_info(inputs[i], &readers[i], json);
+            continue;
+        }
+        int samples = strcmp(cmd, "samples") == 0;
+        if (mf_scan(&readers[i], &q, samples ? print_sample : aggregate,
+                    samples ? (void *)&dump : (void *)agg, &st) < 0) {
+            fprintf(stderr, "%s: damaged block, stopped there\n", inputs[i]);
+            rc = 1;
+        }
+        if (samples && limit && dump.shown >= limit) break;
+    }
+    double ms = (double)(now_mono_ns() - t0) / 1e6;
+
+    if (strcmp(cmd, "lanes") == 0) print_lanes(agg, json);
+    if (strcmp(cmd, "info") != 0) {
+        // on stderr so it stays out of piped output
+        fprintf(stderr, "%" PRIu64 " samples matched, %" PRIu64 "/%" PRIu64 " blocks decoded, %.1f ms\n",
+                st.samples, st.blocks_read, st.blocks, ms);
+    }
+    for (int i = 0; i < ninputs; i++) mf_close(&readers[i]);
+    free(readers);
+    return rc;
+}
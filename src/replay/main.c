@@ -0,0 +1,338 @@
+// udp-monitor-replay
+// Feeds the client_metrics events of a recorded JSON server log, or the
+// segments written by udp-monitor-server --record, through the lane engines
+// (server/lane_policy.h) and compares how they would have behaved: how many
+// switches, how many of those were flaps, and how long each took to leave
+// green once a client's METRICs started going bad.
+//
+// Segments carry nanosecond arrival times and the LANE_METRIC reports of
+// background probes, which update the probed lane's estimate as they did
+// live; the JSON log only has one-second timestamps and no probes.
+//
+// Every engine sees the same METRICs in the same order. The recorded lane
+// is ignored; each engine starts every client on green and follows its own
+// decisions, cooldowns included, on the log's clock.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <netinet/in.h>
+
+#include "common/metrics_file.h"
+#include "server/lane_policy.h"
+
+// A burst is over once this many clean METRICs follow it.
+#define CLEAN_RUN 5
+
+static const char *LANE_NAMES[3] = { "green", "yellow", "red" };
+
+typedef struct {
+    uint64_t last_ns;        // replay time of the previous METRIC
+    uint64_t lane_since_ns;  // when the client entered its current lane
+    uint64_t onset_ns;       // first bad METRIC of the current burst on green, 0 = none
+    int      clean_run;      // clean METRICs since then
+} replay_client_t;
+
+typedef struct {
+    const lane_engine_t *engine;
+    uint64_t metrics, clients, switches, flaps;
+    uint64_t bursts, bursts_switched;
+    double   ttsw_sum_ms, ttsw_max_ms;
+    uint64_t lane_ns[3];
+} replay_result_t;
+
+typedef struct {
+    lane_policy_t policy;
+    uint32_t rtt_window;
+    uint64_t hist_window_ns;
+    uint64_t step_ns;        // spacing of METRICs logged within one second
+    uint64_t flap_ns;        // switching back sooner than this is a flap
+} replay_config_t;
+
+// Numeric value of "key": in a JSON log line (quoted or not).
+static int json_num(const char *line, const char *key, double *out) {
+    char pat[48];
+    int n = snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(line, pat);
+    if (!p) return -1;
+    p += n;
+    if (*p == '"') p++;
+    char *end;
+    *out = strtod(p, &end);
+    return end == p ? -1 : 0;
+}
+
+// One engine's pass over the input.
+typedef struct {
+    const replay_config_t *cfg;
+    replay_result_t       *r;
+    client_table_t         t;
+    replay_client_t       *rc;
+    size_t                 rc_cap;
+    struct sockaddr_in     addr;
+} replay_t;
+
+static int replay_init(replay_t *rp, const replay_config_t *cfg, replay_result_t *r) {
+    memset(rp, 0, sizeof(*rp));
+    rp->cfg = cfg;
+    rp->r   = r;
+    rp->addr.sin_family = AF_INET;
+    if (client_table_init(&rp->t, 0, cfg->rtt_window) < 0) {
+        perror("client_table_init");
+        return -1;
+    }
+    return 0;
+}
+
+// A METRIC from pid at now_ns. Times that do not move a client's clock
+// forward are spread step_ns apart.
+static void replay_metric(replay_t *rp, pid_t pid, double rtt, int loss, uint64_t now,
+                          uint64_t step_ns) {
+    const replay_config_t *cfg = rp->cfg;
+    replay_result_t *r = rp->r;
+    int created;
+    client_t *c = client_table_insert(&rp->t, pid, &rp->addr, &created);
+    if (!c) return;
+    if (c->index >= rp->rc_cap) {
+        size_t cap = rp->rc_cap ? rp->rc_cap * 2 : 256;
+        while (cap <= c->index) cap *= 2;
+        replay_client_t *grown = realloc(rp->rc, cap * sizeof(*rp->rc));
+        if (!grown) {
+            perror("realloc");
+            return;
+        }
+        memset(grown + rp->rc_cap, 0, (cap - rp->rc_cap) * sizeof(*rp->rc));
+        rp->rc = grown;
+        rp->rc_cap = cap;
+    }
+    replay_client_t *s = &rp->rc[c->index];
+
+    if (created) {
+        memset(s, 0, sizeof(*s));
+        c->current_lane  = LANE_GREEN;
+        hist_window_init(&c->rtt_hist, cfg->hist_window_ns, now);
+        s->lane_since_ns = now;
+        r->clients++;
+    } else if (now <= s->last_ns) {
+        now = s->last_ns + step_ns;
+    }
+    s->last_ns = now;
+    r->metrics++;
+
+    lane_verdict_t v;
+    lane_observe(&cfg->policy, c, rtt, loss, now, &v);
+
+    int bad = loss > 0 || rtt > cfg->policy.slow_ms;
+    if (c->current_lane == LANE_GREEN) {
+        if (bad && !s->onset_ns) {
+            s->onset_ns = now;
+            r->bursts++;
+        }
+        s->clean_run = bad ? 0 : s->clean_run + 1;
+        if (s->onset_ns && s->clean_run >= CLEAN_RUN) s->onset_ns = 0;   // ridden out
+    }
+
+    long now_ms = (long)(now / 1000000ull);
+    if (v.desired != c->current_lane && now_ms >= c->cooldown_until_ms) {
+        int from = c->current_lane;
+        if (c->switched_ns && v.desired == c->prev_lane && now - c->switched_ns < cfg->flap_ns)
+            r->flaps++;
+        if (from == LANE_GREEN && s->onset_ns) {
+            double ms = (double)(now - s->onset_ns) / 1e6;
+            r->ttsw_sum_ms += ms;
+            if (ms > r->ttsw_max_ms) r->ttsw_max_ms = ms;
+            r->bursts_switched++;
+            s->onset_ns = 0;
+        }
+        r->lane_ns[from] += now - s->lane_since_ns;
+        s->lane_since_ns  = now;
+        c->current_lane   = v.desired;
+        lane_switched(&cfg->policy, c, from, v.desired, now);
+        r->switches++;
+    }
+}
+
+// A LANE_METRIC: only the probed lane's estimate moves.
+static void replay_probe(replay_t *rp, pid_t pid, int lane, double rtt, int loss, uint64_t now) {
+    client_t *c = client_table_find(&rp->t, pid, &rp->addr);
+    if (!c || c->index >= rp->rc_cap) return;
+    replay_client_t *s = &rp->rc[c->index];
+    if (now <= s->last_ns) now = s->last_ns + 1;
+    s->last_ns = now;
+    lane_probe_observe(&rp->cfg->policy, c, lane, rtt, loss, now);
+}
+
+// Close out the time each client spent in its final lane.
+static void replay_finish(replay_t *rp) {
+    for (size_t i = 0; i < rp->t.cap; i++) {
+        client_t *c = rp->t.slots[i];
+        if (c && c->index < rp->rc_cap)
+            rp->r->lane_ns[c->current_lane] += rp->rc[c->index].last_ns - rp->rc[c->index].lane_since_ns;
+    }
+    free(rp->rc);
+    client_table_free(&rp->t);
+}
+
+static void replay_log(replay_t *rp, FILE *f) {
+    char line[4096];
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        if (!strstr(line, "\"event\":\"client_metrics\"")) continue;
+        double ts, pid, rtt, loss;
+        if (json_num(line, "timestamp", &ts) < 0 || json_num(line, "pid", &pid) < 0
+            || json_num(line, "rtt", &rtt) < 0 || json_num(line, "loss", &loss) < 0)
+            continue;
+        // the log has one-second timestamps: METRICs within a second are
+        // spread step_ns apart
+        replay_metric(rp, (pid_t)pid, rtt, (int)loss, (uint64_t)ts * 1000000000ull,
+                      rp->cfg->step_ns);
+    }
+}
+
+static int replay_sample(const mf_sample_t *s, void *arg) {
+    replay_t *rp = arg;
+    if (s->probe)
+        replay_probe(rp, (pid_t)s->pid, s->lane, s->rtt_us / 1000.0, (int)s->loss, s->ts_ns);
+    else
+        replay_metric(rp, (pid_t)s->pid, s->rtt_us / 1000.0, (int)s->loss, s->ts_ns, 1);
+    return 0;
+}
+
+static void print_result(const replay_result_t *r, int json) {
+    uint64_t total = r->lane_ns[0] + r->lane_ns[1] + r->lane_ns[2];
+    double share[3];
+    for (int l = 0; l < 3; l++) share[l] = total ? 100.0 * (double)r->lane_ns[l] / (double)total : 0.0;
+    double mean = r->bursts_switched ? r->ttsw_sum_ms / (double)r->bursts_switched : 0.0;
+    if (json) {
+        printf("{\"engine\":\"%s\",\"metrics\":%" PRIu64 ",\"clients\":%" PRIu64 ",\"switches\":%" PRIu64 ",\"flaps\":%" PRIu64 ",\"bursts\":%" PRIu64 ",\"bursts_switched\":%" PRIu64 ",\"time_to_switch_ms\":{\"mean\":%.1f,\"max\":%.1f},\"lane_time_pct\":{\"green\":%.1f,\"yellow\":%.1f,\"red\":%.1f}}\n",
+               r->engine->name, r->metrics, r->clients, r->switches, r->flaps,
+               r->bursts, r->bursts_switched, mean, r->ttsw_max_ms, share[0], share[1], share[2]);
+    } else {
+        printf("%-8s %8" PRIu64 " %7" PRIu64 " %8" PRIu64 " %6" PRIu64 " %7" PRIu64 "/%-7" PRIu64 " %9.1f %9.1f ",
+               r->engine->name, r->metrics, r->clients, r->switches, r->flaps,
+               r->bursts_switched, r->bursts, mean, r->ttsw_max_ms);
+        for (int l = 0; l < 3; l++) printf(" %s=%.0f%%", LANE_NAMES[l], share[l]);
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "logs/server-json.log";
+    int json = 0;
+    const lane_engine_t *engines[8];
+    int nengines = 0;
+    replay_config_t cfg = {
+        .rtt_window     = 10,
+        .hist_window_ns = 10000000000ull,
+        .step_ns        = 100000000ull,
+        .flap_ns        = 30000000000ull
+    };
+    lane_policy_defaults(&cfg.policy);
+
+    static struct option long_opts[] = {
+        {"engine",         required_argument, 0, 'e'},
+        {"json",           no_argument,       0, 'j'},
+        {"step-ms",        required_argument, 0, 1000},
+        {"flap-s",         required_argument, 0, 1001},
+        {"slow-ms",        required_argument, 0, 1002},
+        {"jitter-ms",      required_argument, 0, 1003},
+        {"ewma-alpha",     required_argument, 0, 1004},
+        {"hysteresis",     required_argument, 0, 1005},
+        {"cooldown-ms",    required_argument, 0, 1006},
+        {"rtt-window",     required_argument, 0, 1007},
+        {"hist-window-ms", required_argument, 0, 1008},
+        {"help",           no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "e:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'e': {
+                const lane_engine_t *e = lane_engine_find(optarg);
+                if (!e) {
+                    fprintf(stderr, "unknown engine '%s'\n", optarg);
+                    return 2;
+                }
+                if (nengines < (int)(sizeof(engines) / sizeof(engines[0]))) engines[nengines++] = e;
+                break;
+            }
+            case 'j':  json = 1; break;
+            case 1000: cfg.step_ns        = (uint64_t)strtoull(optarg, NULL, 10) * 1000000ull; break;
+            case 1001: cfg.flap_ns        = (uint64_t)strtoull(optarg, NULL, 10) * 1000000000ull; break;
+            case 1002: cfg.policy.slow_ms     = atof(optarg); break;
+            case 1003: cfg.policy.jitter_ms   = atof(optarg); break;
+            case 1004: cfg.policy.alpha       = atof(optarg); break;
+            case 1005: cfg.policy.hysteresis  = atof(optarg); break;
+            case 1006: cfg.policy.cooldown_ms = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 1007: cfg.rtt_window     = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 1008: cfg.hist_window_ns = (uint64_t)strtoull(optarg, NULL, 10) * 1000000ull; break;
+            case 'h':
+            default:
+                printf("Usage: %s [--engine NAME]... [--json] [--step-ms MS] [--flap-s S] "
+                       "[--slow-ms MS] [--jitter-ms MS] [--ewma-alpha A] [--hysteresis H] "
+                       "[--cooldown-ms MS] [--rtt-window N] [--hist-window-ms MS] "
+                       "[LOG | SEGMENT...]\n", argv[0]);
+                return (opt=='h') ? 0 : 2;
+        }
+    }
+    int nsegs = 0;
+    char **segs = argv + optind;
+    if (optind < argc) path = argv[optind];
+    if (cfg.rtt_window < 1) cfg.rtt_window = 1;
+    if (cfg.step_ns < 1) cfg.step_ns = 1;
+    if (cfg.hist_window_ns < 1000000ull) cfg.hist_window_ns = 1000000ull;
+    if (cfg.policy.cooldown_ms > cfg.policy.max_cooldown_ms) cfg.policy.max_cooldown_ms = cfg.policy.cooldown_ms;
+    if (nengines == 0)
+        for (int i = 0; LANE_ENGINES[i] && nengines < (int)(sizeof(engines) / sizeof(engines[0])); i++)
+            engines[nengines++] = LANE_ENGINES[i];
+
+    // segments if the first input is one, else a JSON log
+    mf_reader_t *readers = NULL;
+    FILE *f = NULL;
+    mf_reader_t first;
+    if (mf_open(&first, path) == 0) {
+        nsegs = argc - optind;
+        readers = calloc((size_t)nsegs, sizeof(*readers));
+        if (!readers) {
+            perror("calloc");
+            return 1;
+        }
+        readers[0] = first;
+        for (int i = 1; i < nsegs; i++) {
+            if (mf_open(&readers[i], segs[i]) < 0) {
+                fprintf(stderr, "%s: %s\n", segs[i],
+                        errno == EPROTO ? "not a udp-monitor recording" : strerror(errno));
+                return 1;
+            }
+        }
+    } else if (!(f = fopen(path, "r"))) {
+        perror(path);
+        return 1;
+    }
+    if (!json)
+        printf("%-8s %8s %7s %8s %6s %15s %9s %9s  lane time\n",
+               "engine", "metrics", "clients", "switches", "flaps", "bursts sw/all", "ttsw_ms", "max_ms");
+    for (int i = 0; i < nengines; i++) {
+        replay_config_t run = cfg;
+        run.policy.engine = engines[i];
+        replay_result_t r = { .engine = engines[i] };
+        replay_t rp;
+        if (replay_init(&rp, &run, &r) < 0) return 1;
+        if (f) replay_log(&rp, f);
+        // one worker's segments hold each of its clients' samples in order
+        mf_query_t all = { .pid = -1, .probes = 1 };
+        for (int s = 0; s < nsegs; s++)
+            if (mf_scan(&readers[s], &all, replay_sample, &rp, NULL) < 0)
+                fprintf(stderr, "%s: damaged block, replayed up to it\n", segs[s]);
+        replay_finish(&rp);
+        print_result(&r, json);
+    }
+    if (f) fclose(f);
+    for (int s = 0; s < nsegs; s++) mf_close(&readers[s]);
+    free(readers);
+    return 0;
+}
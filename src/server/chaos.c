@@ -0,0 +1,320 @@
+// chaos.c
+// Per-lane impairment profiles (see chaos.h).
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chaos.h"
+
+// ——— PRNG ———
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+void chaos_rng_seed(chaos_rng_t *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) r->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t chaos_rng_next(chaos_rng_t *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+double chaos_rng_unit(chaos_rng_t *r) {
+    return (double)(chaos_rng_next(r) >> 11) * 0x1.0p-53;
+}
+
+// ——— Decisions ———
+
+void chaos_defaults(chaos_config_t *c) {
+    memset(c, 0, sizeof(*c));
+    for (int l = 0; l < CHAOS_LANES; l++) {
+        c->lane[l].loss_model  = CHAOS_LOSS_BERNOULLI;
+        c->lane[l].loss        = 0.2;
+        c->lane[l].delay_model = CHAOS_DELAY_UNIFORM;
+        c->lane[l].delay_b     = 150.0;
+    }
+}
+
+void chaos_state_init(chaos_lane_state_t *s, const chaos_profile_t *p, uint64_t now_ns) {
+    s->bad       = 0;
+    s->tokens    = p->burst;
+    s->refill_ns = now_ns;
+}
+
+static int lost(const chaos_profile_t *p, chaos_lane_state_t *s, chaos_rng_t *r) {
+    switch (p->loss_model) {
+        case CHAOS_LOSS_BERNOULLI:
+            return chaos_rng_unit(r) < p->loss;
+        case CHAOS_LOSS_GILBERT:
+            // move between the states first, then drop with the new state's odds
+            if (chaos_rng_unit(r) < (s->bad ? p->ge_r : p->ge_p)) s->bad = !s->bad;
+            return chaos_rng_unit(r) < (s->bad ? p->ge_loss_bad : p->ge_loss_good);
+        default:
+            return 0;
+    }
+}
+
+static int rate_limited(const chaos_profile_t *p, chaos_lane_state_t *s, uint64_t now_ns) {
+    if (p->rate_pps <= 0.0) return 0;
+    if (now_ns > s->refill_ns) {
+        s->tokens += (double)(now_ns - s->refill_ns) / 1e9 * p->rate_pps;
+        if (s->tokens > p->burst) s->tokens = p->burst;
+        s->refill_ns = now_ns;
+    }
+    if (s->tokens < 1.0) return 1;
+    s->tokens -= 1.0;
+    return 0;
+}
+
+static double delay_ms(const chaos_profile_t *p, chaos_rng_t *r) {
+    double a = p->delay_a, b = p->delay_b, u, d;
+    switch (p->delay_model) {
+        case CHAOS_DELAY_FIXED:
+            return a;
+        case CHAOS_DELAY_UNIFORM:
+            return a + (b - a) * chaos_rng_unit(r);
+        case CHAOS_DELAY_NORMAL:
+            // Box-Muller; 1 - u keeps the log finite
+            u = 1.0 - chaos_rng_unit(r);
+            d = a + b * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * chaos_rng_unit(r));
+            return d > 0.0 ? d : 0.0;
+        case CHAOS_DELAY_EXPONENTIAL:
+            return a - b * log(1.0 - chaos_rng_unit(r));
+        case CHAOS_DELAY_PARETO:
+            // Lomax (Pareto II) with shape 2.5, scaled to mean b: heavy tail above a
+            return a + 1.5 * b * (pow(1.0 - chaos_rng_unit(r), -1.0 / 2.5) - 1.0);
+        default:
+            return 0.0;
+    }
+}
+
+void chaos_decide(const chaos_profile_t *p, chaos_lane_state_t *s, chaos_rng_t *r,
+                  uint64_t now_ns, chaos_verdict_t *v) {
+    *v = (chaos_verdict_t){ .drop = CHAOS_PASS };
+    if (lost(p, s, r)) {
+        v->drop = CHAOS_DROP_LOSS;
+        return;
+    }
+    if (rate_limited(p, s, now_ns)) {
+        v->drop = CHAOS_DROP_RATE;
+        return;
+    }
+    double ms = delay_ms(p, r);
+    if (p->reorder > 0.0 && chaos_rng_unit(r) < p->reorder) {
+        ms += p->reorder_ms;
+        v->reordered = 1;
+    }
+    v->delay_ns  = (uint64_t)(ms * 1e6);
+    v->duplicate = p->duplicate > 0.0 && chaos_rng_unit(r) < p->duplicate;
+}
+
+// ——— Config file ———
+
+// A probability: "0.2" or "20%".
+static int parse_prob(const char *s, double *out) {
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || errno) return -1;
+    if (*end == '%') {
+        v /= 100.0;
+        end++;
+    }
+    if (*end || v < 0.0 || v > 1.0) return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_num(const char *s, double *out) {
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || *end || errno || v < 0.0) return -1;
+    *out = v;
+    return 0;
+}
+
+// Split line into at most max whitespace-separated words, in place.
+static int split(char *line, char **words, int max) {
+    int n = 0;
+    char *save;
+    for (char *tok = strtok_r(line, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (n == max) return -1;
+        words[n++] = tok;
+    }
+    return n;
+}
+
+// Apply "key = value" to p. Returns NULL, or what was wrong.
+static const char *apply_key(chaos_profile_t *p, const char *key, char *value) {
+    char *w[6];
+    int n = split(value, w, 6);
+    if (n <= 0) return "missing or extra values";
+
+    if (strcmp(key, "loss") == 0) {
+        chaos_profile_t q = *p;
+        if (strcmp(w[0], "none") == 0 && n == 1) {
+            q.loss_model = CHAOS_LOSS_NONE;
+        } else if (strcmp(w[0], "bernoulli") == 0 && n == 2) {
+            q.loss_model = CHAOS_LOSS_BERNOULLI;
+            if (parse_prob(w[1], &q.loss) < 0) return "bad probability";
+        } else if (strcmp(w[0], "gilbert") == 0 && n >= 3 && n <= 5) {
+            q.loss_model   = CHAOS_LOSS_GILBERT;
+            q.ge_loss_good = 0.0;
+            q.ge_loss_bad  = 1.0;
+            if (parse_prob(w[1], &q.ge_p) < 0 || parse_prob(w[2], &q.ge_r) < 0
+                || (n > 3 && parse_prob(w[3], &q.ge_loss_good) < 0)
+                || (n > 4 && parse_prob(w[4], &q.ge_loss_bad) < 0))
+                return "bad probability";
+        } else {
+            return "expected none, bernoulli P or gilbert P_GB P_BG [LOSS_GOOD [LOSS_BAD]]";
+        }
+        *p = q;
+    } else if (strcmp(key, "delay") == 0) {
+        static const struct { const char *name; int model, args; } models[] = {
+            { "none",        CHAOS_DELAY_NONE,        0 },
+            { "fixed",       CHAOS_DELAY_FIXED,       1 },
+            { "uniform",     CHAOS_DELAY_UNIFORM,     2 },
+            { "normal",      CHAOS_DELAY_NORMAL,      2 },
+            { "exponential", CHAOS_DELAY_EXPONENTIAL, 2 },
+            { "pareto",      CHAOS_DELAY_PARETO,      2 },
+        };
+        size_t i = 0;
+        while (i < sizeof(models) / sizeof(models[0]) && strcmp(models[i].name, w[0]) != 0) i++;
+        if (i == sizeof(models) / sizeof(models[0])) return "unknown delay distribution";
+        if (n != models[i].args + 1) return "wrong number of delay parameters";
+        double a = 0.0, b = 0.0;
+        if ((n > 1 && parse_num(w[1], &a) < 0) || (n > 2 && parse_num(w[2], &b) < 0))
+            return "bad delay";
+        if (models[i].model == CHAOS_DELAY_UNIFORM && b < a) return "uniform max below min";
+        p->delay_model = models[i].model;
+        p->delay_a     = a;
+        p->delay_b     = b;
+    } else if (strcmp(key, "reorder") == 0) {
+        double prob, ms;
+        if (n != 2 || parse_prob(w[0], &prob) < 0 || parse_num(w[1], &ms) < 0)
+            return "expected P MS";
+        p->reorder    = prob;
+        p->reorder_ms = ms;
+    } else if (strcmp(key, "duplicate") == 0) {
+        double prob;
+        if (n != 1 || parse_prob(w[0], &prob) < 0) return "expected P";
+        p->duplicate = prob;
+    } else if (strcmp(key, "rate") == 0) {
+        double pps, burst;
+        if (n > 2 || parse_num(w[0], &pps) < 0) return "expected PPS [BURST]";
+        burst = pps / 10.0 < 1.0 ? 1.0 : pps / 10.0;
+        if (n == 2 && (parse_num(w[1], &burst) < 0 || burst < 1.0)) return "bad burst";
+        p->rate_pps = pps;
+        p->burst    = burst;
+    } else if (strcmp(key, "control") == 0) {
+        if (n != 1 || (strcmp(w[0], "on") != 0 && strcmp(w[0], "off") != 0))
+            return "expected on or off";
+        p->control = strcmp(w[0], "on") == 0;
+    } else {
+        return "unknown key";
+    }
+    return NULL;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) *--e = '\0';
+    return s;
+}
+
+int chaos_load(chaos_config_t *c, const char *path, char *err, size_t errlen) {
+    static const char *const sections[CHAOS_LANES] = { "green", "yellow", "red" };
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(err, errlen, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    chaos_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    int lane = -1;   // -1: [default], every lane
+    char line[512];
+    int lineno = 0;
+    const char *why = NULL;
+    while (!why && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *s = trim(line);
+        if (!*s) continue;
+
+        if (*s == '[') {
+            char *close = strchr(s, ']');
+            if (!close || close[1]) {
+                why = "bad section header";
+                break;
+            }
+            *close = '\0';
+            char *name = trim(s + 1);
+            lane = -2;
+            if (strcmp(name, "default") == 0) lane = -1;
+            for (int l = 0; l < CHAOS_LANES; l++)
+                if (strcmp(name, sections[l]) == 0) lane = l;
+            if (lane == -2) why = "unknown section (default, green, yellow or red)";
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            why = "expected key = value";
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(s), *value = trim(eq + 1);
+        for (int l = 0; l < CHAOS_LANES && !why; l++) {
+            if (lane >= 0 && l != lane) continue;
+            char copy[512];
+            snprintf(copy, sizeof(copy), "%s", value);   // split() writes into it
+            why = apply_key(&cfg.lane[l], key, copy);
+        }
+    }
+    fclose(f);
+    if (why) {
+        snprintf(err, errlen, "%s:%d: %s", path, lineno, why);
+        return -1;
+    }
+    *c = cfg;
+    return 0;
+}
+
+void chaos_describe(const chaos_profile_t *p, char *buf, size_t len) {
+    static const char *const delays[] = { "none", "fixed", "uniform", "normal", "exponential", "pareto" };
+    char loss[160];
+    if (p->loss_model == CHAOS_LOSS_BERNOULLI)
+        snprintf(loss, sizeof(loss), "{\"model\":\"bernoulli\",\"p\":%.4g}", p->loss);
+    else if (p->loss_model == CHAOS_LOSS_GILBERT)
+        snprintf(loss, sizeof(loss), "{\"model\":\"gilbert\",\"p_gb\":%.4g,\"p_bg\":%.4g,\"loss_good\":%.4g,\"loss_bad\":%.4g}",
+                 p->ge_p, p->ge_r, p->ge_loss_good, p->ge_loss_bad);
+    else
+        snprintf(loss, sizeof(loss), "{\"model\":\"none\"}");
+    snprintf(buf, len, "{\"loss\":%s,\"delay\":{\"model\":\"%s\",\"a_ms\":%.4g,\"b_ms\":%.4g},\"reorder\":%.4g,\"reorder_ms\":%.4g,\"duplicate\":%.4g,\"rate_pps\":%.4g,\"burst\":%.4g,\"control\":%s}",
+             loss, delays[p->delay_model], p->delay_a, p->delay_b, p->reorder, p->reorder_ms,
+             p->duplicate, p->rate_pps, p->burst, p->control ? "true" : "false");
+}
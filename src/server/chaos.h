@@ -0,0 +1,99 @@
+// chaos.h
+// Network impairment the server applies to its echoes, configured per lane.
+// Each lane has a profile: a loss model (Bernoulli, or Gilbert-Elliott for
+// bursts), a delay distribution, reordering, duplication and a rate limit.
+// Every worker draws from its own seeded PRNG and keeps its own loss state
+// and token buckets, so nothing is shared on the packet path. With one
+// worker and a fixed --seed, the same packets meet the same fate every run.
+//
+// Profiles are loaded from a small config file (chaos_load); without one
+// every lane gets the built-in profile (20% loss, 0-150 ms uniform delay).
+// No I/O besides reading the file, so it can be driven from benchmarks.
+
+#ifndef UDPMON_CHAOS_H
+#define UDPMON_CHAOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHAOS_LANES 3
+
+// xoshiro256**, seeded through splitmix64
+typedef struct {
+    uint64_t s[4];
+} chaos_rng_t;
+
+void     chaos_rng_seed(chaos_rng_t *r, uint64_t seed);
+uint64_t chaos_rng_next(chaos_rng_t *r);
+double   chaos_rng_unit(chaos_rng_t *r);   // uniform in [0, 1)
+
+enum { CHAOS_LOSS_NONE, CHAOS_LOSS_BERNOULLI, CHAOS_LOSS_GILBERT };
+enum {
+    CHAOS_DELAY_NONE, CHAOS_DELAY_FIXED, CHAOS_DELAY_UNIFORM,
+    CHAOS_DELAY_NORMAL, CHAOS_DELAY_EXPONENTIAL, CHAOS_DELAY_PARETO
+};
+
+typedef struct {
+    int    loss_model;
+    double loss;                  // bernoulli: drop probability
+    double ge_p, ge_r;            // gilbert: P(good -> bad), P(bad -> good) per packet
+    double ge_loss_good, ge_loss_bad;   // drop probability in each state
+
+    int    delay_model;
+    double delay_a, delay_b;      // ms. fixed: a; uniform: min, max; normal: mean, sd;
+                                  // exponential, pareto: base + a tail of mean b
+    double reorder, reorder_ms;   // probability an echo is held back reorder_ms longer
+    double duplicate;             // probability an echo is sent twice
+
+    double rate_pps, burst;       // token bucket; rate 0 = unlimited
+    int    control;               // loss and rate limit also apply to CONTROLs
+} chaos_profile_t;
+
+typedef struct {
+    chaos_profile_t lane[CHAOS_LANES];
+} chaos_config_t;
+
+// One worker's state for one lane.
+typedef struct {
+    int      bad;                 // gilbert: in the bad state
+    double   tokens;
+    uint64_t refill_ns;
+} chaos_lane_state_t;
+
+enum { CHAOS_PASS = 0, CHAOS_DROP_LOSS, CHAOS_DROP_RATE };
+
+typedef struct {
+    int      drop;                // CHAOS_PASS or why it was dropped
+    uint64_t delay_ns;            // reorder hold included
+    int      reordered;
+    int      duplicate;
+} chaos_verdict_t;
+
+// The built-in profile on every lane.
+void chaos_defaults(chaos_config_t *c);
+
+// Read profiles from path. The file has a [default] section, whose keys
+// apply to every lane, and [green], [yellow], [red] sections; later lines
+// win. Lanes start with no impairment. Keys:
+//   loss      = none | bernoulli P | gilbert P_GB P_BG [LOSS_GOOD [LOSS_BAD]]
+//   delay     = none | fixed MS | uniform MIN MAX | normal MEAN SD
+//             | exponential BASE MEAN | pareto BASE MEAN
+//   reorder   = P MS
+//   duplicate = P
+//   rate      = PPS [BURST]
+//   control   = on | off
+// Probabilities are fractions or percentages ("0.2", "20%"). On error
+// returns -1 with a message in err, and leaves c untouched.
+int  chaos_load(chaos_config_t *c, const char *path, char *err, size_t errlen);
+
+// Start a lane's state in the good loss state with a full token bucket.
+void chaos_state_init(chaos_lane_state_t *s, const chaos_profile_t *p, uint64_t now_ns);
+
+// What happens to the next echo on a lane.
+void chaos_decide(const chaos_profile_t *p, chaos_lane_state_t *s, chaos_rng_t *r,
+                  uint64_t now_ns, chaos_verdict_t *v);
+
+// One-line JSON object describing p, for the startup and reload logs.
+void chaos_describe(const chaos_profile_t *p, char *buf, size_t len);
+
+#endif
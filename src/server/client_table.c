@@ -0,0 +1,185 @@
+// client_table.c
+// Open-addressing client registry with a slab allocator (see client_table.h).
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "client_table.h"
+
+#define INITIAL_CAP 64
+
+static uint64_t key_hash(pid_t pid, const struct sockaddr_in *addr) {
+    uint64_t x = ((uint64_t)addr->sin_addr.s_addr << 32)
+               ^ ((uint64_t)addr->sin_port << 16)
+               ^ (uint64_t)(uint32_t)pid * 0x9e3779b97f4a7c15ull;
+    // splitmix64 finalizer
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27; x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static int key_eq(const client_t *c, pid_t pid, const struct sockaddr_in *addr) {
+    return c->pid == pid
+        && c->addr.sin_addr.s_addr == addr->sin_addr.s_addr
+        && c->addr.sin_port == addr->sin_port;
+}
+
+static size_t home_slot(const client_table_t *t, const client_t *c) {
+    return (size_t)key_hash(c->pid, &c->addr) & (t->cap - 1);
+}
+
+// ——— Slab allocator ———
+
+static client_t *slab_alloc(client_table_t *t) {
+    if (!t->free_list) {
+        size_t win_bytes = winstats_storage_size(t->window);
+        client_slab_t *s = malloc(sizeof(*s));
+        if (!s) return NULL;
+        s->win_store = malloc(win_bytes * CLIENT_SLAB_SIZE);
+        if (!s->win_store) {
+            free(s);
+            return NULL;
+        }
+        s->next  = t->slabs;
+        t->slabs = s;
+        uint32_t base = t->nslabs++ * CLIENT_SLAB_SIZE;
+        // thread the new items onto the free list, lowest index first
+        for (int i = CLIENT_SLAB_SIZE - 1; i >= 0; i--) {
+            s->items[i].index     = base + (uint32_t)i;
+            s->items[i].next_free = t->free_list;
+            t->free_list          = &s->items[i];
+            winstats_init(&s->items[i].rtt_win, t->window,
+                          s->win_store + (size_t)i * win_bytes);
+        }
+    }
+    client_t *c = t->free_list;
+    t->free_list = c->next_free;
+    uint32_t index = c->index;
+    winstats_t win = c->rtt_win;
+    memset(c, 0, sizeof(*c));
+    c->index   = index;
+    c->rtt_win = win;
+    winstats_reset(&c->rtt_win);
+    return c;
+}
+
+static void slab_release(client_table_t *t, client_t *c) {
+    c->next_free = t->free_list;
+    t->free_list = c;
+}
+
+// ——— Hash table ———
+
+static int grow(client_table_t *t) {
+    size_t ncap = t->cap ? t->cap * 2 : INITIAL_CAP;
+    client_t **ns = calloc(ncap, sizeof(*ns));
+    if (!ns) return -1;
+    client_t **old = t->slots;
+    size_t ocap = t->cap;
+    t->slots = ns;
+    t->cap   = ncap;
+    for (size_t i = 0; i < ocap; i++) {
+        if (!old[i]) continue;
+        size_t j = home_slot(t, old[i]);
+        while (t->slots[j]) j = (j + 1) & (ncap - 1);
+        t->slots[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+int client_table_init(client_table_t *t, size_t max_clients, uint32_t window) {
+    memset(t, 0, sizeof(*t));
+    t->max_clients = max_clients;
+    t->window      = window ? window : 1;
+    return grow(t);
+}
+
+void client_table_free(client_table_t *t) {
+    client_slab_t *s = t->slabs;
+    while (s) {
+        client_slab_t *next = s->next;
+        free(s->win_store);
+        free(s);
+        s = next;
+    }
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+client_t *client_table_find(client_table_t *t, pid_t pid, const struct sockaddr_in *addr) {
+    size_t mask = t->cap - 1;
+    for (size_t i = (size_t)key_hash(pid, addr) & mask; t->slots[i]; i = (i + 1) & mask) {
+        if (key_eq(t->slots[i], pid, addr)) return t->slots[i];
+    }
+    return NULL;
+}
+
+client_t *client_table_insert(client_table_t *t, pid_t pid,
+                              const struct sockaddr_in *addr, int *created) {
+    *created = 0;
+    client_t *c = client_table_find(t, pid, addr);
+    if (c) return c;
+
+    if (t->max_clients && t->count >= t->max_clients) return NULL;
+    // keep the load factor under 0.7 so probe chains stay short
+    if ((t->count + 1) * 10 > t->cap * 7 && grow(t) < 0) return NULL;
+
+    c = slab_alloc(t);
+    if (!c) return NULL;
+    c->pid  = pid;
+    c->addr = *addr;
+
+    size_t i = home_slot(t, c);
+    while (t->slots[i]) i = (i + 1) & (t->cap - 1);
+    t->slots[i] = c;
+    t->count++;
+    *created = 1;
+    return c;
+}
+
+// Backward-shift deletion: pull later members of the probe chain into the
+// hole so lookups never need tombstones.
+static void remove_at(client_table_t *t, size_t hole) {
+    size_t mask = t->cap - 1;
+    client_t *victim = t->slots[hole];
+    t->slots[hole] = NULL;
+    for (size_t j = (hole + 1) & mask; t->slots[j]; j = (j + 1) & mask) {
+        size_t home = home_slot(t, t->slots[j]);
+        // move j back only if its home is not in the cyclic range (hole, j]
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            t->slots[hole] = t->slots[j];
+            t->slots[j]    = NULL;
+            hole = j;
+        }
+    }
+    t->count--;
+    slab_release(t, victim);
+}
+
+void client_table_remove(client_table_t *t, client_t *c) {
+    size_t mask = t->cap - 1;
+    for (size_t i = home_slot(t, c); t->slots[i]; i = (i + 1) & mask) {
+        if (t->slots[i] == c) {
+            remove_at(t, i);
+            return;
+        }
+    }
+}
+
+size_t client_table_evict_idle(client_table_t *t, uint64_t cutoff_ns,
+                               void (*on_evict)(client_t *c, void *arg), void *arg) {
+    size_t evicted = 0;
+    for (size_t i = 0; i < t->cap; ) {
+        client_t *c = t->slots[i];
+        if (c && c->last_seen_ns < cutoff_ns) {
+            if (on_evict) on_evict(c, arg);
+            remove_at(t, i);
+            evicted++;
+            continue;   // a later entry may have shifted into slot i
+        }
+        i++;
+    }
+    return evicted;
+}
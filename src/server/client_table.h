@@ -0,0 +1,103 @@
+// client_table.h
+// Per-worker client registry: an open-addressing hash table (linear probing,
+// backward-shift deletion) keyed by (pid, source ip:port). client_t records
+// come from a slab allocator, so they never move once registered and each
+// one keeps a stable index for logging. Each slab also carries the storage
+// for its clients' RTT windows, so registering a client never mallocs.
+
+#ifndef UDPMON_CLIENT_TABLE_H
+#define UDPMON_CLIENT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "common/histogram.h"
+#include "common/winstats.h"
+
+// What lane_policy.h last knew about one lane of a client: from its METRICs
+// while on that lane, and from its background probe reports otherwise.
+typedef struct {
+    double   rtt, loss, jitter;  // EWMAs: ms, lost fraction of probes, ms
+    double   score, trend;       // degradation score and its smoothed per-METRIC change
+    uint64_t updated_ns;         // last METRIC folded in, 0 = never on this lane
+} lane_est_t;
+
+typedef struct client {
+    pid_t pid;
+    struct sockaddr_in addr;
+    int current_lane;
+    winstats_t rtt_win;      // last window RTT samples, ms
+    int loss_streak, slow_streak, jitter_streak;
+    long cooldown_until_ms;
+    lane_est_t lane_est[3];  // per lane: the client's lane quality matrix
+    uint32_t cooldown_ms;    // hold time given at the last switch
+    uint64_t switched_ns;    // time of the last switch, 0 = never
+    int      prev_lane;      // lane left at the last switch
+    int proto;               // WIRE_VERSION if the client negotiated binary framing
+
+    // The CONTROL in flight, if any. current_lane only changes once the
+    // client acknowledges ctl_seq (or its METRICs show up on another lane).
+    uint32_t ctl_seq;        // seq of the last CONTROL sent
+    int      ctl_pending;    // 1 while ctl_seq is unacknowledged
+    int      ctl_lane;       // lane it moves the client to
+    int      ctl_tries;      // transmissions of ctl_seq so far
+    int      ctl_measured;   // lane picked from measured lanes (for the log)
+    uint64_t hint_ns;        // when the last rate hint was sent, 0 = never
+
+    hist_window_t rtt_hist;  // reported RTTs in microseconds
+    double last_rtt;         // previous sample, for the jitter estimate
+    double rfc_jitter;       // RFC 3550 interarrival jitter over reported RTTs, ms
+    uint64_t rtt_pcts[3];    // p50/p99/p99.9 from the last METRIC, microseconds
+
+    uint64_t metrics, losses;   // METRICs received, and how many reported loss
+    uint32_t switches;          // CONTROLs acknowledged
+    uint64_t up_metrics, up_losses;   // metrics/losses/switches as of the last
+    uint32_t up_switches;             // relay summary (--upstream)
+    int      shm_dirty;         // changed since last exported (see shm_table.h)
+
+    uint32_t index;          // stable slab slot, reported as client_index
+    uint64_t last_seen_ns;   // CLOCK_MONOTONIC time of the last REGISTER/METRIC
+    struct client *next_free;
+} client_t;
+
+#define CLIENT_SLAB_SIZE 256
+
+typedef struct client_slab {
+    struct client_slab *next;
+    char *win_store;         // CLIENT_SLAB_SIZE RTT windows
+    client_t items[CLIENT_SLAB_SIZE];
+} client_slab_t;
+
+typedef struct {
+    client_t **slots;        // NULL marks an empty slot
+    size_t     cap;          // always a power of two
+    size_t     count;
+    size_t     max_clients;  // 0 = unlimited
+    uint32_t   window;       // RTT window length given to every client
+
+    client_slab_t *slabs;
+    uint32_t       nslabs;
+    client_t      *free_list;
+} client_table_t;
+
+int       client_table_init(client_table_t *t, size_t max_clients, uint32_t window);
+void      client_table_free(client_table_t *t);
+
+client_t *client_table_find(client_table_t *t, pid_t pid, const struct sockaddr_in *addr);
+
+// Return the existing entry for (pid, addr) with *created = 0, or a new
+// zeroed entry (empty RTT window) with pid/addr filled in and *created = 1. Returns NULL when
+// the table is full (max_clients) or out of memory.
+client_t *client_table_insert(client_table_t *t, pid_t pid,
+                              const struct sockaddr_in *addr, int *created);
+
+void      client_table_remove(client_table_t *t, client_t *c);
+
+// Remove every client whose last_seen_ns is older than cutoff_ns, calling
+// on_evict(c, arg) just before each one is released. Returns how many.
+size_t    client_table_evict_idle(client_table_t *t, uint64_t cutoff_ns,
+                                  void (*on_evict)(client_t *c, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,251 @@
+// lane_policy.c
+// Lane decision engines (see lane_policy.h).
+
+#include <math.h>
+#include <string.h>
+
+#include "lane_policy.h"
+
+void lane_policy_defaults(lane_policy_t *p) {
+    *p = (lane_policy_t){
+        .engine          = &LANE_ENGINE_EWMA,
+        .slow_pct        = 99.0,
+        .slow_ms         = 100.0,
+        .jitter_ms       = 20.0,
+        .min_samples     = 10,
+        .alpha           = 0.2,
+        .trend_alpha     = 0.3,
+        .horizon         = 3.0,
+        .loss_ref        = 0.25,
+        .hysteresis      = 0.5,
+        .cooldown_ms     = 5000,
+        .max_cooldown_ms = 60000,
+        .stale_ms        = 20000,
+        .fresh_ms        = 5000
+    };
+}
+
+const lane_engine_t *lane_engine_find(const char *name) {
+    for (int i = 0; LANE_ENGINES[i]; i++)
+        if (strcmp(LANE_ENGINES[i]->name, name) == 0) return LANE_ENGINES[i];
+    return NULL;
+}
+
+static void est_update(const lane_policy_t *p, lane_est_t *e, double rtt, int loss, uint64_t now_ns);
+static void pick_measured(const lane_policy_t *p, client_t *c, uint64_t now_ns, lane_verdict_t *v);
+
+void lane_observe(const lane_policy_t *p, client_t *c, double rtt, int loss,
+                  uint64_t now_ns, lane_verdict_t *v) {
+    if (rtt < 0) rtt = 0.0;
+
+    // RFC 3550 §6.4.1 estimator, J += (|D| - J) / 16, where D is the change
+    // in round-trip time between consecutive reports
+    if (winstats_count(&c->rtt_win) > 0) {
+        double d = rtt - c->last_rtt;
+        c->rfc_jitter += ((d < 0 ? -d : d) - c->rfc_jitter) / 16.0;
+    }
+    c->last_rtt = rtt;
+
+    // update rolling RTT window
+    winstats_push(&c->rtt_win, rtt);
+    hist_window_record(&c->rtt_hist, (uint64_t)(rtt * 1000.0), now_ns);
+
+    // p50, p99, p99.9 for the log line
+    static const double pct[3] = { 50.0, 99.0, 99.9 };
+    hist_window_percentiles(&c->rtt_hist, pct, v->pcts, 3);
+    v->score = v->predicted = 0.0;
+    v->measured = 0;
+    v->near     = 0;
+
+    est_update(p, &c->lane_est[c->current_lane], rtt, loss, now_ns);
+    const lane_engine_t *e = p->engine ? p->engine : &LANE_ENGINE_STREAK;
+    e->decide(p, c, rtt, loss, now_ns, v);
+    pick_measured(p, c, now_ns, v);
+    if (v->desired != c->current_lane) v->near = 1;
+}
+
+void lane_probe_observe(const lane_policy_t *p, client_t *c, int lane, double rtt, int loss,
+                        uint64_t now_ns) {
+    if (lane < 0 || lane > LANE_RED) return;
+    est_update(p, &c->lane_est[lane], rtt < 0 ? 0.0 : rtt, loss, now_ns);
+}
+
+void lane_switched(const lane_policy_t *p, client_t *c, int from, int to, uint64_t now_ns) {
+    const lane_engine_t *e = p->engine ? p->engine : &LANE_ENGINE_STREAK;
+    uint32_t hold = e->cooldown(p, c, from, to, now_ns);
+    c->cooldown_until_ms = (long)(now_ns / 1000000ull) + (long)hold;
+    c->prev_lane   = from;
+    c->switched_ns = now_ns;
+}
+
+// ——— streak ———
+
+static void streak_decide(const lane_policy_t *p, client_t *c, double rtt, int loss,
+                          uint64_t now_ns, lane_verdict_t *v) {
+    (void)now_ns;
+    uint64_t p_slow;
+    if (p->slow_pct == 99.0)
+        p_slow = v->pcts[1];
+    else
+        hist_window_percentiles(&c->rtt_hist, &p->slow_pct, &p_slow, 1);
+
+    c->loss_streak = (loss > 0 ? c->loss_streak + 1 : 0);
+    int slow, jittery;
+    if (hist_window_count(&c->rtt_hist) >= p->min_samples) {
+        double hi_ms  = p_slow / 1000.0;
+        double med_ms = v->pcts[0] / 1000.0;
+        slow    = hi_ms > p->slow_ms;
+        jittery = hi_ms - med_ms > p->jitter_ms;
+    } else {
+        // too few samples for percentiles: fall back to the raw window
+        slow    = rtt > p->slow_ms;
+        jittery = winstats_max(&c->rtt_win) - winstats_min(&c->rtt_win) > p->jitter_ms;
+    }
+    c->slow_streak   = (slow    ? c->slow_streak + 1   : 0);
+    c->jitter_streak = (jittery ? c->jitter_streak + 1 : 0);
+
+    v->triggers = (c->loss_streak >= 3)
+                + (c->slow_streak >= 3)
+                + (c->jitter_streak >= 3);
+    // one more bad METRIC would complete a streak
+    v->near     = c->loss_streak == 2 || c->slow_streak == 2 || c->jitter_streak == 2;
+    v->desired  = v->triggers >= 2 ? LANE_RED
+                : v->triggers == 1 ? LANE_YELLOW
+                                   : LANE_GREEN;
+}
+
+static uint32_t streak_cooldown(const lane_policy_t *p, client_t *c, int from, int to,
+                                uint64_t now_ns) {
+    (void)p; (void)c; (void)from; (void)to; (void)now_ns;
+    return 10000;
+}
+
+const lane_engine_t LANE_ENGINE_STREAK = { "streak", streak_decide, streak_cooldown };
+
+// ——— Lane estimates ———
+// Each score term rises from 0 at half its threshold to 1 at the threshold
+// and is capped at 1.5, so a score of 1 is roughly "one streak triggered"
+// and 2 "two triggered": the lane boundaries sit at 1 and 2.
+
+static double term(double x, double ref) {
+    double t = 2.0 * x / ref - 1.0;
+    return t < 0.0 ? 0.0 : t > 1.5 ? 1.5 : t;
+}
+
+static int fresh(const lane_policy_t *p, const lane_est_t *e, uint64_t now_ns) {
+    return e->updated_ns && now_ns - e->updated_ns <= (uint64_t)p->fresh_ms * 1000000ull;
+}
+
+// An estimate that is no longer fresh starts over from this RTT (an old one
+// only serves remembered()). Loss and jitter build up from zero, so one
+// lossy first report is not a lossy lane.
+static void est_update(const lane_policy_t *p, lane_est_t *e, double rtt, int loss, uint64_t now_ns) {
+    double lost = loss > 0 ? (double)loss / (double)(loss + 1) : 0.0;   // one reply per report
+    // jitter sample: distance from the lane's average RTT
+    double jit  = e->updated_ns ? fabs(rtt - e->rtt) : 0.0;
+    int    cont = fresh(p, e, now_ns);
+    if (!cont) {
+        *e = (lane_est_t){ .rtt = rtt, .loss = p->alpha * lost, .jitter = p->alpha * jit };
+    } else {
+        e->rtt    += p->alpha * (rtt  - e->rtt);
+        e->loss   += p->alpha * (lost - e->loss);
+        e->jitter += p->alpha * (jit  - e->jitter);
+    }
+    double score = term(e->rtt, p->slow_ms) + term(e->loss, p->loss_ref)
+                 + term(e->jitter, p->jitter_ms);
+    if (cont) e->trend += p->trend_alpha * ((score - e->score) - e->trend);
+    e->score      = score;
+    e->updated_ns = now_ns;
+}
+
+// Once another lane has a fresh measurement, a client that has to move
+// goes to the best measured lane, or stays put if none beats the current
+// one by the hysteresis; and a client off green goes back as soon as green
+// measures healthy.
+static void pick_measured(const lane_policy_t *p, client_t *c, uint64_t now_ns, lane_verdict_t *v) {
+    int cur = c->current_lane, best = -1;
+    for (int l = LANE_GREEN; l <= LANE_RED; l++) {
+        if (l == cur || !fresh(p, &c->lane_est[l], now_ns)) continue;
+        if (best < 0 || c->lane_est[l].score < c->lane_est[best].score) best = l;
+    }
+    if (best < 0) return;   // nothing measured: the engine's choice stands
+
+    const lane_est_t *green = &c->lane_est[LANE_GREEN];
+    if (cur != LANE_GREEN && fresh(p, green, now_ns) && green->score < 1.0 - p->hysteresis) {
+        v->desired = LANE_GREEN;
+    } else if (v->desired != cur) {
+        v->desired = c->lane_est[best].score + p->hysteresis < c->lane_est[cur].score ? best : cur;
+    } else {
+        return;
+    }
+    v->measured = 1;
+}
+
+// ——— ewma ———
+
+static int lane_for(double score) {
+    return score >= 2.0 ? LANE_RED : score >= 1.0 ? LANE_YELLOW : LANE_GREEN;
+}
+
+// A lane's score as of now: what it was when last measured, halving every
+// stale_ms since, so a lane that went bad is avoided for a while and then
+// forgiven.
+static double remembered(const lane_policy_t *p, const lane_est_t *e, uint64_t now_ns) {
+    if (!e->updated_ns) return 0.0;
+    double age_ms = (double)(now_ns - e->updated_ns) / 1e6;
+    return e->score * exp2(-age_ms / (double)(p->stale_ms ? p->stale_ms : 1));
+}
+
+static void ewma_decide(const lane_policy_t *p, client_t *c, double rtt, int loss,
+                        uint64_t now_ns, lane_verdict_t *v) {
+    (void)rtt; (void)loss;
+    int cur = c->current_lane;
+    const lane_est_t *e = &c->lane_est[cur];   // est_update() has folded this METRIC in
+    double score = e->score;
+
+    // only degradation is predicted; improvement has to be measured
+    double predicted = score + (e->trend > 0.0 ? e->trend * p->horizon : 0.0);
+    v->score     = score;
+    v->predicted = predicted;
+    v->triggers  = (term(e->rtt, p->slow_ms) >= 1.0) + (term(e->loss, p->loss_ref) >= 1.0)
+                 + (term(e->jitter, p->jitter_ms) >= 1.0);
+
+    int worse  = lane_for(predicted - p->hysteresis);
+    int better = lane_for(score + p->hysteresis);
+    // across a threshold but still inside the hysteresis band
+    v->near    = lane_for(predicted) > cur || lane_for(score) < cur;
+    if (worse > cur) {
+        v->desired = worse;
+    } else if (better < cur) {
+        // step down no further than the best lane that has not gone bad lately
+        int to = cur;
+        while (to > better && remembered(p, &c->lane_est[to - 1], now_ns) < (double)to - p->hysteresis)
+            to--;
+        v->desired = to;
+    } else {
+        v->desired = cur;
+    }
+}
+
+// Going straight back to the lane just left, within a few cooldowns of
+// leaving it, is a flap: the hold doubles. Otherwise it halves back toward
+// the base.
+static uint32_t ewma_cooldown(const lane_policy_t *p, client_t *c, int from, int to,
+                              uint64_t now_ns) {
+    (void)from;
+    uint32_t hold = c->cooldown_ms ? c->cooldown_ms : p->cooldown_ms;
+    int flap = c->switched_ns && to == c->prev_lane
+            && now_ns - c->switched_ns < (uint64_t)hold * 4 * 1000000ull;
+    if (flap) {
+        hold = hold * 2 > p->max_cooldown_ms ? p->max_cooldown_ms : hold * 2;
+    } else {
+        hold /= 2;
+        if (hold < p->cooldown_ms) hold = p->cooldown_ms;
+    }
+    c->cooldown_ms = hold;
+    return hold;
+}
+
+const lane_engine_t LANE_ENGINE_EWMA = { "ewma", ewma_decide, ewma_cooldown };
+
+const lane_engine_t *const LANE_ENGINES[] = { &LANE_ENGINE_EWMA, &LANE_ENGINE_STREAK, NULL };
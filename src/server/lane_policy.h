@@ -0,0 +1,106 @@
+// lane_policy.h
+// Per-client lane decision: folds each METRIC into the client's RTT window,
+// histogram and jitter estimate, then hands the client to a lane engine
+// that picks the lane it should be on and how long to hold it after a
+// switch. No I/O, so it can be driven from benchmarks and replays as well
+// as the server's packet path.
+//
+// Two engines are built in:
+//   streak  counts consecutive lossy/slow/jittery METRICs; three in a row
+//           is a trigger, one trigger means yellow, two or more red, and
+//           every switch is held for 10 s.
+//   ewma    keeps EWMAs of RTT, loss and jitter per client per lane and
+//           scores the current lane from them. It moves to a worse lane
+//           when the score projected along its trend crosses a boundary,
+//           back to a better one only when the measured score is clear of
+//           the boundary and that lane did not go bad recently, and holds
+//           each switch for a cooldown that doubles while the client flaps.
+//
+// Both engines work from the client's current lane alone. Clients that
+// probe their other lanes in the background report those lanes too
+// (lane_probe_observe); once any other lane has a fresh measurement, the
+// engine's choice is checked against the measured lanes: a client that has
+// to move goes to the lane that measures best, or stays if none is clearly
+// better, and a client off green goes back as soon as green measures healthy.
+
+#ifndef UDPMON_LANE_POLICY_H
+#define UDPMON_LANE_POLICY_H
+
+#include <stdint.h>
+
+#include "client_table.h"
+
+#define LANE_GREEN   0
+#define LANE_YELLOW  1
+#define LANE_RED     2
+
+typedef struct {
+    uint64_t pcts[3];    // windowed p50/p99/p99.9 RTT, microseconds
+    int      triggers;   // streak: streaks that reached 3; ewma: score terms at 1.0
+    int      desired;    // LANE_*
+    double   score;      // ewma: current lane's score (0 for streak)
+    double   predicted;  // ewma: score projected along its trend
+    int      measured;   // desired was picked from measured lanes, not by the engine
+    int      near;       // a switch is due or within reach: worth probing harder
+} lane_verdict_t;
+
+typedef struct lane_policy lane_policy_t;
+
+typedef struct {
+    const char *name;
+    // Pick v->desired (and fill the rest of v) for a client whose windows
+    // already include this METRIC.
+    void     (*decide)(const lane_policy_t *p, client_t *c, double rtt, int loss,
+                       uint64_t now_ns, lane_verdict_t *v);
+    // How long to stay put after switching from -> to, in ms.
+    uint32_t (*cooldown)(const lane_policy_t *p, client_t *c, int from, int to,
+                         uint64_t now_ns);
+} lane_engine_t;
+
+extern const lane_engine_t LANE_ENGINE_STREAK;
+extern const lane_engine_t LANE_ENGINE_EWMA;
+extern const lane_engine_t *const LANE_ENGINES[];   // NULL-terminated
+
+// The engine called name, or NULL.
+const lane_engine_t *lane_engine_find(const char *name);
+
+// A client is "slow" when the slow_pct-th percentile of its recent RTTs
+// exceeds slow_ms, and "jittery" when that percentile sits more than
+// jitter_ms above its median. Until min_samples RTTs are in the histogram
+// the latest sample and the min/max swing of the RTT window are used.
+// The ewma engine scores against slow_ms and jitter_ms as well.
+struct lane_policy {
+    const lane_engine_t *engine;   // NULL means streak
+    double   slow_pct;
+    double   slow_ms;
+    double   jitter_ms;
+    uint32_t min_samples;
+
+    // ewma engine
+    double   alpha;            // weight of a new METRIC in the EWMAs
+    double   trend_alpha;      // weight of the newest score change in the trend
+    double   horizon;          // METRICs ahead the trend is projected
+    double   loss_ref;         // lost fraction of probes that scores 1.0
+    double   hysteresis;       // margin past a lane boundary before moving
+    uint32_t cooldown_ms;      // hold time after a switch, when not flapping
+    uint32_t max_cooldown_ms;
+    uint32_t stale_ms;         // half-life of a left lane's score
+    uint32_t fresh_ms;         // a lane measurement this recent counts as current
+};
+
+// The server's defaults, engine included.
+void lane_policy_defaults(lane_policy_t *p);
+
+void lane_observe(const lane_policy_t *p, client_t *c, double rtt, int loss,
+                  uint64_t now_ns, lane_verdict_t *v);
+
+// Fold a background probe report for lane into the client's estimate of
+// that lane. The decision itself waits for the next METRIC.
+void lane_probe_observe(const lane_policy_t *p, client_t *c, int lane, double rtt, int loss,
+                        uint64_t now_ns);
+
+// Record a switch the caller has acted on and start its cooldown
+// (c->cooldown_until_ms, CLOCK_MONOTONIC ms).
+void lane_switched(const lane_policy_t *p, client_t *c, int from, int to, uint64_t now_ns);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // recvmmsg/sendmmsg
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,17 +6,58 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 #include <time.h>
 
+#include "common/histogram.h"
+#include "common/log.h"
+#include "common/metrics_file.h"
+#include "common/shm_table.h"
+#include "common/tstamp.h"
+#include "common/wire.h"
+#include "chaos.h"
+#include "client_table.h"
+#include "lane_policy.h"
+#include "parse.h"
+#include "profile.h"
+#include "relay.h"
+#include "timer_heap.h"
+#include "uring.h"
+
 // Add JSON logging flag
 int JSON_LOGGING = 0;
+int VERBOSE = 0;
 
-// ——— Lane definitions ———
-#define LANE_GREEN   0
-#define LANE_YELLOW  1
-#define LANE_RED     2
+volatile sig_atomic_t STOP = 0;
+
+void on_stop_signal(int sig) {
+    (void)sig;
+    STOP = 1;
+}
+
+// SIGHUP re-reads the --chaos file (see reload_chaos)
+volatile sig_atomic_t CHAOS_RELOAD = 0;
+
+void on_reload_signal(int sig) {
+    (void)sig;
+    CHAOS_RELOAD = 1;
+}
 
+// SIGUSR1 logs the profile and the sampled traces (see log_profile)
+volatile sig_atomic_t PROFILE_DUMP = 0;
+
+void on_profile_signal(int sig) {
+    (void)sig;
+    PROFILE_DUMP = 1;
+}
+
+// ——— Lane definitions ———
 // Map each lane to its UDP port
 int lane_ports[] = {
     [LANE_GREEN]  = 5000,
@@ -23,21 +65,88 @@ int lane_ports[] = {
     [LANE_RED]    = 7000
 };
 
-#define MAX_CLIENTS 16
+// Datagrams moved per recvmmsg()/sendmmsg() call
+#define BATCH 64
+#define BUFSZ 2048
 
-typedef struct {
-    pid_t pid;
-    struct sockaddr_in addr;
-    int current_lane;
-    double rtts[10];
-    int rtt_count;
-    int loss_streak, slow_streak, jitter_streak;
-    long cooldown_until_ms;
-    int history_idx;
-} client_t;
+#define MAX_WORKERS 64
+int NUM_WORKERS = 1;
+
+// Per-worker cap on registered clients, and how long a client may stay
+// silent before its entry is evicted (0 disables eviction).
+size_t MAX_CLIENTS     = 65536;
+int    IDLE_TIMEOUT_MS = 30000;
 
-client_t clients[MAX_CLIENTS];
-int client_count = 0;
+// Lane decision engine and thresholds (see lane_policy.h), filled with
+// lane_policy_defaults() before the command line is parsed. Percentiles
+// cover the last one to two HIST_WINDOW_MS spans; the fallback swing is
+// taken over the last RTT_WINDOW samples.
+lane_policy_t POLICY;
+// Chaos on PING and lane probe echoes, per lane (see chaos.h): the profiles
+// in --chaos FILE, re-read on SIGHUP, or the built-in 20% loss and 0-150 ms
+// delay on every lane. Workers copy CHAOS_CONFIG whenever CHAOS_GEN moves.
+// --seed makes each worker's draw sequence reproducible; --no-chaos echoes
+// everything at once.
+int              CHAOS      = 1;
+const char      *CHAOS_FILE = NULL;
+chaos_config_t   CHAOS_CONFIG;   // guarded by CHAOS_LOCK
+pthread_mutex_t  CHAOS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+_Atomic uint64_t CHAOS_GEN  = 1;
+// Kernel receive timestamps (SO_TIMESTAMPNS) on the lane sockets; without
+// them timestamped PINGs get the time recvmmsg() returned instead.
+int      TIMESTAMPS = 0;
+int      SEEDED = 0;
+uint64_t SEED;
+
+// Run the packet loop on io_uring (--io-uring); workers fall back to epoll
+// when the kernel cannot set it up.
+int      IO_URING = 0;
+
+int      HIST_WINDOW_MS = 10000;
+uint32_t RTT_WINDOW     = 10;
+
+// CONTROL retransmission (see send_control): the first resend waits
+// CONTROL_RTO_MS or twice the client's RTT, whichever is longer, and each
+// one after that twice as long, up to CONTROL_RTO_MAX_MS; after
+// CONTROL_RETRIES resends the switch is given up and left to the next METRIC.
+#define  CONTROL_RTO_MAX_MS 4000
+int      CONTROL_RTO_MS  = 200;
+int      CONTROL_RETRIES = 5;
+
+// Rate hints (see send_rate_hint): a client whose lane decision is close to
+// a switch is asked to PING at least every RATE_HINT_MS for the next
+// RATE_HINT_TTL_MS. RATE_HINT_MS 0 turns them off.
+int      RATE_HINT_MS     = 100;
+int      RATE_HINT_TTL_MS = 5000;
+
+// Recording of every METRIC and LANE_METRIC to segment files in RECORD_DIR
+// (--record DIR, see metrics_file.h). Each worker writes its own segments
+// and flushes its partial block every RECORD_FLUSH_MS; on shutdown the main
+// thread sets RECORD_STOP and waits for the workers to close them.
+const char *RECORD_DIR        = NULL;
+int         RECORD_SEGMENT_MB = MF_DEFAULT_SEGMENT_MB;
+int         RECORD_FLUSH_MS   = 1000;
+_Atomic int RECORD_STOP       = 0;
+
+// Relay mode (--upstream HOST:PORT, see relay.h): every SUMMARY_MS each
+// worker sends a summary of its shard, and of the relays reporting to it,
+// to the server above. RELAY_ID names this server there (default: its pid).
+#define  RELAY_BATCH 16   // summary datagrams per sendmmsg()
+struct sockaddr_in UPSTREAM;
+int      UPSTREAM_SET = 0;
+uint32_t RELAY_ID     = 0;
+int      SUMMARY_MS   = 1000;
+
+// Profiling builds (-DUDPMON_PROFILE, see profile.h) trace one packet in
+// every PROFILE_SAMPLE; 0 takes no traces. A SIGUSR1 dump logs each
+// worker's newest PROFILE_DUMP_TRACES.
+#define  PROFILE_DUMP_TRACES 32
+uint32_t PROFILE_SAMPLE = 1000;
+
+// Shared-memory state export (--shm NAME); SHM.base stays NULL without it.
+const char *SHM_NAME        = NULL;
+int         SHM_INTERVAL_MS = 100;
+shm_table_t SHM;
 
 long get_now_ms() {
     struct timespec ts;
@@ -48,37 +157,1676 @@ long get_now_ms() {
 void log_json(const char* level, const char* component, const char* event, const char* details) {
     if (JSON_LOGGING) {
         time_t now = time(NULL);
-        printf("{\"timestamp\":\"%ld\",\"level\":\"%s\",\"component\":\"%s\",\"event\":\"%s\",\"details\":%s}\n", 
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"%s\",\"component\":\"%s\",\"event\":\"%s\",\"details\":%s}\n", 
                now, level, component, event, details);
-        fflush(stdout);
     }
 }
 
-void log_lane_switch(int pid, int old_lane, int new_lane, int new_port) {
+// measured: the lane was picked from the client's lane probes, not by the engine.
+// attempts: CONTROL transmissions it took; via_metric: the client was seen on
+// the new lane before its ACK arrived.
+void log_lane_switch(int pid, int old_lane, int new_lane, int new_port, int measured,
+                     int attempts, int via_metric) {
     if (JSON_LOGGING) {
-        printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_switch\",\"pid\":%d,\"old_lane\":%d,\"new_lane\":%d,\"new_port\":%d}\n",
-               time(NULL), pid, old_lane, new_lane, new_port);
-        fflush(stdout);
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_switch\",\"pid\":%d,\"old_lane\":%d,\"new_lane\":%d,\"new_port\":%d,\"measured\":%s,\"attempts\":%d,\"acked\":%s}\n",
+               time(NULL), pid, old_lane, new_lane, new_port, measured ? "true" : "false",
+               attempts, via_metric ? "false" : "true");
     }
 }
 
-void log_client_metrics(int pid, double rtt, int loss, double jitter, int loss_streak, int slow_streak, int jitter_streak, int lane) {
+void log_control_failed(int pid, int lane, uint32_t seq, int attempts) {
     if (JSON_LOGGING) {
-        printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_metrics\",\"pid\":%d,\"rtt\":%.2f,\"loss\":%d,\"jitter\":%.2f,\"loss_streak\":%d,\"slow_streak\":%d,\"jitter_streak\":%d,\"current_lane\":%d}\n",
-               time(NULL), pid, rtt, loss, jitter, loss_streak, slow_streak, jitter_streak, lane);
-        fflush(stdout);
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"server\",\"event\":\"control_failed\",\"pid\":%d,\"new_lane\":%d,\"seq\":%u,\"attempts\":%d}\n",
+               time(NULL), pid, lane, seq, attempts);
+    } else if (VERBOSE) {
+        log_printf(LOG_CAT_GENERAL, "SERVER: pid=%d never acknowledged CONTROL seq=%u (lane%d) after %d tries\n",
+               pid, seq, lane, attempts);
     }
 }
 
+// pcts holds the client's windowed p50/p99/p99.9 RTT in microseconds.
+// score/predicted are the ewma engine's lane score, 0 under the streak engine.
+void log_client_metrics(int pid, double rtt, int loss, double jitter, int loss_streak, int slow_streak, int jitter_streak, int lane,
+                        const uint64_t pcts[3], double rfc_jitter, double score, double predicted) {
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_METRICS, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_metrics\",\"pid\":%d,\"rtt\":%.2f,\"loss\":%d,\"jitter\":%.2f,\"loss_streak\":%d,\"slow_streak\":%d,\"jitter_streak\":%d,\"current_lane\":%d,\"rtt_p50\":%.2f,\"rtt_p99\":%.2f,\"rtt_p999\":%.2f,\"rfc_jitter\":%.2f,\"lane_score\":%.2f,\"lane_predicted\":%.2f}\n",
+               time(NULL), pid, rtt, loss, jitter, loss_streak, slow_streak, jitter_streak, lane,
+               pcts[0] / 1000.0, pcts[1] / 1000.0, pcts[2] / 1000.0, rfc_jitter, score, predicted);
+    }
+}
 
+void log_echo(const struct sockaddr_in *peer, ssize_t n) {
+    if (!VERBOSE) return;
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &peer->sin_addr, ip, sizeof(ip));
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_ECHO, "{\"timestamp\":\"%ld\",\"level\":\"DEBUG\",\"component\":\"server\",\"event\":\"echo\",\"bytes\":%zd,\"client_ip\": \"%s\",\"client_port\":%d}\n",
+               time(NULL), n, ip, ntohs(peer->sin_port));
+    } else {
+        log_printf(LOG_CAT_ECHO, "echoed %zd bytes to %s:%d\n",
+               n, ip, ntohs(peer->sin_port));
+    }
+}
 
-int main(int argc, char *argv[]) {
-    int PORT = 5000;
-    int VERBOSE = 0;
-    const size_t BUFSZ = 2048;
+// ——— Delayed echoes ———
+// A chaos-delayed PING is copied here and parked in the timer heap instead of
+// sleeping, so the loop keeps serving every lane while the echo waits.
+typedef struct {
+    int fd;
+    struct sockaddr_in peer;
+    socklen_t peerlen;
+    int stamp_tx;            // data is a wire_ping_ts_t: fill srv_tx_ns on send
+    _Atomic uint64_t *sendto_calls;   // profile counter to bump, or NULL
+    size_t len;
+    char data[];
+} pending_echo_t;
+
+void fire_echo(void *arg) {
+    pending_echo_t *e = arg;
+    if (e->stamp_tx) {
+        uint64_t now = htole64(tstamp_wall_ns());
+        memcpy(e->data + offsetof(wire_ping_ts_t, srv_tx_ns), &now, sizeof(now));
+    }
+    ssize_t m = sendto(e->fd, e->data, e->len, 0,
+                       (struct sockaddr *)&e->peer, e->peerlen);
+    if (e->sendto_calls) prof_count(e->sendto_calls, 1);
+    if (m < 0) perror("sendto");
+    else       log_echo(&e->peer, (ssize_t)e->len);
+    free(e);
+}
+
+int schedule_echo(timer_heap_t *timers, int fd, const struct sockaddr_in *peer, socklen_t peerlen,
+                  const char *data, size_t len, uint64_t delay_ns, int stamp_tx,
+                  _Atomic uint64_t *sendto_calls) {
+    pending_echo_t *e = malloc(sizeof(*e) + len);
+    if (!e) return -1;
+    e->fd       = fd;
+    e->peer     = *peer;
+    e->peerlen  = peerlen;
+    e->stamp_tx = stamp_tx;
+    e->sendto_calls = sendto_calls;
+    e->len      = len;
+    memcpy(e->data, data, len);
+    if (timer_heap_push(timers, get_now_ns() + delay_ns, fire_echo, e) < 0) {
+        free(e);
+        return -1;
+    }
+    return 0;
+}
+
+// ——— Batched echo replies ———
+typedef struct {
+    int fd;
+    unsigned count;
+    unsigned calls;                // sendmmsg() calls the last flush took
+    struct mmsghdr msgs[BATCH];
+    struct iovec   iov[BATCH];
+    uint64_t      *stamp[BATCH];   // srv_tx_ns to fill just before sending, or NULL
+} tx_batch_t;
+
+// Returns 0, or -1 if the batch is full (see worker_tx_add).
+int tx_batch_add(tx_batch_t *tx, void *data, size_t len,
+                 const struct sockaddr_in *peer, socklen_t peerlen, uint64_t *stamp) {
+    if (tx->count == BATCH) return -1;
+    unsigned i = tx->count++;
+    tx->stamp[i] = stamp;
+    tx->iov[i] = (struct iovec){ .iov_base = data, .iov_len = len };
+    tx->msgs[i].msg_hdr = (struct msghdr){
+        .msg_name    = (void *)peer,
+        .msg_namelen = peerlen,
+        .msg_iov     = &tx->iov[i],
+        .msg_iovlen  = 1
+    };
+    return 0;
+}
+
+// Returns how many datagrams the socket refused; a refused one is skipped
+// so the rest still go out.
+unsigned tx_batch_flush(tx_batch_t *tx) {
+    uint64_t now = 0;
+    for (unsigned i = 0; i < tx->count; i++) {
+        if (!tx->stamp[i]) continue;
+        if (!now) now = htole64(tstamp_wall_ns());
+        *tx->stamp[i] = now;
+    }
+    unsigned done = 0, failed = 0;
+    tx->calls = 0;
+    while (done < tx->count) {
+        int m = sendmmsg(tx->fd, tx->msgs + done, tx->count - done, 0);
+        tx->calls++;
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            perror("sendmmsg");
+            done++;
+            failed++;
+            continue;
+        }
+        done += (unsigned)m;
+    }
+    tx->count = 0;
+    return failed;
+}
+
+// ——— Workers ———
+// Each worker owns one SO_REUSEPORT socket per lane and the shard of clients
+// the kernel steers to it, so nothing on the packet path is shared between
+// threads. Counters are written only by their worker and read (relaxed) by
+// the main thread when it merges stats.
+typedef struct {
+    _Atomic uint64_t rx_packets, rx_batches;
+    _Atomic uint64_t pings, tx_batches, chaos_drops, chaos_delays;
+    _Atomic uint64_t tx_dropped;     // echoes queued but never sent
+    _Atomic uint64_t chaos_rate_drops, chaos_reorders, chaos_dups;
+    _Atomic uint64_t metrics, registers, lane_switches;
+    _Atomic uint64_t lane_probes, lane_metrics;   // background probing of other lanes
+    _Atomic uint64_t control_sent, control_retransmits, control_acks, control_failures;
+    _Atomic uint64_t register_dups, register_rejects, evictions;
+    _Atomic uint64_t reregisters;    // REREGISTERs sent for METRICs from unknown clients
+    _Atomic uint64_t malformed;
+    _Atomic uint64_t uring_enters;   // io_uring_enter() calls (io_uring backend)
+    _Atomic uint64_t uring_sendmsgs; // sendmsg() calls outside the ring: duplicate echoes
+    _Atomic uint64_t recorded, record_errors;   // --record samples kept / lost
+    _Atomic uint64_t rate_hints;
+    _Atomic uint64_t summaries_sent, summary_datagrams, summary_bytes, summary_send_errors;
+    _Atomic uint64_t relay_datagrams, relay_summaries, relay_lost, relay_rejects;
+    _Atomic uint64_t clients;   // gauge: size of this worker's shard
+} worker_stats_t;
+
+#define STAT_INC(w, f) \
+    atomic_store_explicit(&(w)->stats.f, \
+        atomic_load_explicit(&(w)->stats.f, memory_order_relaxed) + 1, \
+        memory_order_relaxed)
+#define STAT_ADD(w, f, v) \
+    atomic_store_explicit(&(w)->stats.f, \
+        atomic_load_explicit(&(w)->stats.f, memory_order_relaxed) + (v), \
+        memory_order_relaxed)
+
+typedef struct {
+    int id;
+    int ep;
+    chaos_rng_t rng;                       // chaos draws, seeded per worker
+    uint64_t    chaos_gen;                 // CHAOS_GEN that chaos[] was copied at
+    chaos_profile_t    chaos[3];           // rate limits scaled to one worker's share
+    chaos_lane_state_t chaos_state[3];
+    int lane_fds[3];
+    client_table_t clients;
+    timer_heap_t timers;     // parked echoes, CONTROL resends and the idle sweep
+    tx_batch_t tx;
+    worker_stats_t stats;
+#ifdef UDPMON_PROFILE
+    prof_t prof;
+#endif
+    pthread_t thread;
+    mf_writer_t *rec;        // --record, NULL without it and once closed
+    _Atomic int  rec_closed;
+
+    // Per-lane RTT and client-jitter histograms (microseconds), fed by every
+    // METRIC. Once a second the worker copies them into lane_snap under
+    // snap_lock so the stats thread can merge all workers without touching
+    // the live ones.
+    hist_window_t   lane_rtt[3], lane_jitter[3];
+    pthread_mutex_t snap_lock;
+    hist_t          snap_rtt[3], snap_jitter[3];
+
+    // --upstream: what the shard saw since its last summary, with the
+    // summaries from relays below folded into the lane records. Datagrams
+    // queue in up_bufs and go out RELAY_BATCH at a time.
+    int            up_fd;                  // connected to UPSTREAM, -1 without it
+    uint32_t       up_seq;
+    relay_lane_t   up_lane[3];
+    client_t     **up_order;               // clients to report, sorted by pid
+    size_t         up_order_cap;
+    relay_enc_t    up_enc;
+    int            up_n;
+    struct mmsghdr up_msgs[RELAY_BATCH];
+    struct iovec   up_iov[RELAY_BATCH];
+    _Alignas(8) uint8_t up_bufs[RELAY_BATCH][RELAY_MTU];
+
+    relay_sources_t relays;                // relays sending summaries to this worker
+
+    // One receive slot per datagram in a batch. Each slot holds spare bytes
+    // so the text parsers always see a NUL-terminated message.
+    // Rows are padded to a multiple of 8 so binary headers can be viewed in place.
+    _Alignas(8) char   rx_bufs[BATCH][BUFSZ + 8];
+    char               rx_ctrl[BATCH][TSTAMP_CMSG_SPACE];
+    uint64_t           rx_stamp_ns;   // CLOCK_REALTIME arrival of the packet being handled
+    struct sockaddr_in rx_peers[BATCH];
+    struct iovec       rx_iov[BATCH];
+    struct mmsghdr     rx_msgs[BATCH];
+} worker_t;
+
+worker_t *workers[MAX_WORKERS];
+
+// Send the echoes queued on w->tx as one batch.
+void worker_tx_flush(worker_t *w) {
+    PROF_DEPTH(w, PROF_Q_TX_BATCH, w->tx.count);
+    PROF_T0(t);
+    unsigned failed = tx_batch_flush(&w->tx);
+    PROF_STAGE(w, PROF_SEND, t);
+    PROF_SYSCALLS(w, PROF_SYS_SENDMMSG, w->tx.calls);
+    STAT_INC(w, tx_batches);
+    if (failed) STAT_ADD(w, tx_dropped, failed);
+}
+
+// Queue an echo, sending the batch first if it is full: with duplicate
+// chaos a receive batch can produce twice as many echoes as it holds.
+void worker_tx_add(worker_t *w, void *data, size_t len,
+                   const struct sockaddr_in *peer, socklen_t peerlen, uint64_t *stamp) {
+    if (w->tx.count == BATCH) worker_tx_flush(w);
+    if (tx_batch_add(&w->tx, data, len, peer, peerlen, stamp) < 0) STAT_INC(w, tx_dropped);
+}
+
+// ——— Chaos ———
+// A lane's profile as this worker applies it. The copy is refreshed after a
+// reload; each worker sees about 1/NUM_WORKERS of a lane's traffic, so it
+// enforces that share of the lane's rate limit.
+const chaos_profile_t *worker_chaos(worker_t *w, int lane, uint64_t now_ns) {
+    uint64_t gen = atomic_load_explicit(&CHAOS_GEN, memory_order_acquire);
+    if (gen != w->chaos_gen) {
+        pthread_mutex_lock(&CHAOS_LOCK);
+        memcpy(w->chaos, CHAOS_CONFIG.lane, sizeof(w->chaos));
+        pthread_mutex_unlock(&CHAOS_LOCK);
+        for (int l = 0; l < 3; l++) {
+            chaos_profile_t *p = &w->chaos[l];
+            p->rate_pps /= NUM_WORKERS;
+            p->burst     = p->burst / NUM_WORKERS < 1.0 ? 1.0 : p->burst / NUM_WORKERS;
+            chaos_state_init(&w->chaos_state[l], p, now_ns);
+        }
+        w->chaos_gen = gen;
+    }
+    return &w->chaos[lane];
+}
+
+void log_chaos(const char *action, int lane, const char *what, const chaos_verdict_t *v) {
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_CHAOS, "{\"timestamp\":\"%ld\",\"level\":\"DEBUG\",\"component\":\"server\",\"event\":\"chaos\",\"action\":\"%s\",\"lane\":%d,\"packet\":\"%s\",\"reason\":\"%s\",\"delay_ms\":%.1f,\"reordered\":%s,\"duplicate\":%s}\n",
+               time(NULL), action, lane, what, v->drop == CHAOS_DROP_RATE ? "rate" : v->drop ? "loss" : "",
+               (double)v->delay_ns / 1e6, v->reordered ? "true" : "false", v->duplicate ? "true" : "false");
+    } else if (VERBOSE) {
+        if (v->drop)
+            log_printf(LOG_CAT_CHAOS, "SERVER: dropping %s on lane%d for chaos (%s)\n", what, lane,
+                       v->drop == CHAOS_DROP_RATE ? "rate limit" : "loss");
+        else
+            log_printf(LOG_CAT_CHAOS, "SERVER: delaying %s on lane%d %.1fms chaos%s%s\n", what, lane,
+                       (double)v->delay_ns / 1e6, v->reordered ? ", reordered" : "",
+                       v->duplicate ? ", duplicated" : "");
+    }
+}
+
+// ——— Outgoing control traffic ———
+// REGISTER_ACK leaves from the green socket. A CONTROL leaves from the
+// socket of the lane the client is on, the path its PONGs take. Either way
+// the encoding follows whatever the client negotiated at REGISTER time.
+//
+// A lane switch is one sequenced CONTROL at a time per client: it is resent
+// with backoff until the client acknowledges its seq, and the client's lane
+// only changes then (control_commit), or when its METRICs show it on
+// another lane. Clients acknowledge repeats too and act on each seq once,
+// so resends are harmless.
+
+void control_transmit(worker_t *w, client_t *c) {
+    int new_port = lane_ports[c->ctl_lane];
+    int fd = w->lane_fds[c->current_lane];
+    c->ctl_tries++;
+    STAT_INC(w, control_sent);
+
+    // profiles with control = on drop CONTROLs too; the resend timer recovers
+    if (CHAOS) {
+        uint64_t now_ns = get_now_ns();
+        const chaos_profile_t *p = worker_chaos(w, c->current_lane, now_ns);
+        chaos_verdict_t v;
+        if (p->control) {
+            PROF_T0(t);
+            chaos_decide(p, &w->chaos_state[c->current_lane], &w->rng, now_ns, &v);
+            PROF_STAGE(w, PROF_CHAOS, t);
+            if (v.drop) {
+                STAT_INC(w, chaos_drops);
+                if (v.drop == CHAOS_DROP_RATE) STAT_INC(w, chaos_rate_drops);
+                log_chaos("drop", c->current_lane, "control", &v);
+                return;
+            }
+        }
+    }
+
+    ssize_t m;
+    if (c->proto == WIRE_VERSION) {
+        wire_control_t ctl;
+        wire_hdr_init(&ctl.h, WIRE_CONTROL, (uint32_t)c->pid, c->ctl_seq, get_now_ns());
+        ctl.port     = htole16((uint16_t)new_port);
+        ctl.lane     = htole16((uint16_t)c->ctl_lane);
+        ctl.reserved = 0;
+        m = sendto(fd, &ctl, sizeof(ctl), 0, (struct sockaddr *)&c->addr, sizeof(c->addr));
+    } else {
+        char ctrl[64];
+        int clen = snprintf(ctrl, sizeof(ctrl),
+                            "CONTROL pid=%d port=%d seq=%u",
+                            c->pid, new_port, c->ctl_seq);
+        m = sendto(fd, ctrl, clen, 0, (struct sockaddr *)&c->addr, sizeof(c->addr));
+    }
+    PROF_SYSCALL(w, PROF_SYS_SENDTO);
+    if (m < 0) perror("sendto CONTROL");   // the resend timer covers it
+}
+
+// Wait before the next send of a CONTROL already sent tries times.
+uint64_t control_rto_ns(const client_t *c, int tries) {
+    uint64_t ms = (uint64_t)CONTROL_RTO_MS;
+    double rtt  = c->lane_est[c->current_lane].rtt;
+    if (2.0 * rtt > (double)ms)
+        ms = 2.0 * rtt < CONTROL_RTO_MAX_MS ? (uint64_t)(2.0 * rtt) : CONTROL_RTO_MAX_MS;
+    // doubling stops at the cap, so no number of tries can overflow it
+    for (int i = 1; i < tries && ms < CONTROL_RTO_MAX_MS; i++) ms <<= 1;
+    return (ms > CONTROL_RTO_MAX_MS ? CONTROL_RTO_MAX_MS : ms) * 1000000ull;
+}
+
+// The client is on lane now: make it its lane and start the cooldown.
+void lane_move(worker_t *w, client_t *c, int lane, uint64_t now_ns, int via_metric) {
+    int old_lane = c->current_lane;
+    c->current_lane = lane;
+    c->shm_dirty    = 1;
+    lane_switched(&POLICY, c, old_lane, lane, now_ns);
+    c->switches++;
+    STAT_INC(w, lane_switches);
+    if (w->up_fd >= 0) w->up_lane[lane].switches++;
+
+    log_lane_switch(c->pid, old_lane, lane, lane_ports[lane], c->ctl_measured,
+                    c->ctl_tries, via_metric);
+    if (VERBOSE && !JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "SERVER: pid=%d on lane%d(port=%d) after %d CONTROL(s)\n",
+               c->pid, lane, lane_ports[lane], c->ctl_tries);
+    }
+}
+
+// The client moved to ctl_lane.
+void control_commit(worker_t *w, client_t *c, uint64_t now_ns, int via_metric) {
+    c->ctl_pending = 0;
+    lane_move(w, c, c->ctl_lane, now_ns, via_metric);
+}
+
+// Resend timer of one CONTROL. It refers to the client by key, not by
+// pointer, since the client may be evicted before it fires.
+typedef struct {
+    worker_t          *w;
+    pid_t              pid;
+    struct sockaddr_in addr;
+    uint32_t           seq;
+} control_timer_t;
+
+void fire_control_resend(void *arg) {
+    control_timer_t *t = arg;
+    worker_t *w = t->w;
+    client_t *c = client_table_find(&w->clients, t->pid, &t->addr);
+    if (c && c->ctl_pending && c->ctl_seq == t->seq) {
+        if (c->ctl_tries > CONTROL_RETRIES) {
+            c->ctl_pending = 0;
+            STAT_INC(w, control_failures);
+            log_control_failed(c->pid, c->ctl_lane, c->ctl_seq, c->ctl_tries);
+        } else {
+            STAT_INC(w, control_retransmits);
+            control_transmit(w, c);
+            if (timer_heap_push(&w->timers, get_now_ns() + control_rto_ns(c, c->ctl_tries),
+                                fire_control_resend, t) == 0)
+                return;
+            c->ctl_pending = 0;
+        }
+    }
+    free(t);
+}
+
+// Start moving c to lane. Returns -1 if the resend timer cannot be set up,
+// in which case nothing is sent.
+int send_control(worker_t *w, client_t *c, int lane, int measured) {
+    control_timer_t *t = malloc(sizeof(*t));
+    if (!t) return -1;
+    uint32_t seq = c->ctl_seq + 1 ? c->ctl_seq + 1 : 1;   // 0 means unsequenced
+    *t = (control_timer_t){ .w = w, .pid = c->pid, .addr = c->addr, .seq = seq };
+    if (timer_heap_push(&w->timers, get_now_ns() + control_rto_ns(c, 1),
+                        fire_control_resend, t) < 0) {
+        free(t);
+        return -1;
+    }
+    c->ctl_seq      = seq;
+    c->ctl_pending  = 1;
+    c->ctl_lane     = lane;
+    c->ctl_tries    = 0;
+    c->ctl_measured = measured;
+    control_transmit(w, c);
+    return 0;
+}
+
+// Ask c to probe harder for a while. A live hint is only refreshed once half
+// its TTL has gone, so a client that stays near a switch gets a couple of
+// hints per TTL rather than one per METRIC.
+void send_rate_hint(worker_t *w, client_t *c, uint64_t now_ns) {
+    uint64_t ttl_ns = (uint64_t)RATE_HINT_TTL_MS * 1000000ull;
+    if (c->hint_ns && now_ns - c->hint_ns < ttl_ns / 2) return;
+    c->hint_ns = now_ns;
+
+    int fd = w->lane_fds[c->current_lane];
+    ssize_t m;
+    if (c->proto == WIRE_VERSION) {
+        wire_rate_hint_t h;
+        wire_hdr_init(&h.h, WIRE_RATE_HINT, (uint32_t)c->pid, 0, now_ns);
+        h.interval_us = htole32((uint32_t)RATE_HINT_MS * 1000u);
+        h.ttl_ms      = htole32((uint32_t)RATE_HINT_TTL_MS);
+        m = sendto(fd, &h, sizeof(h), 0, (struct sockaddr *)&c->addr, sizeof(c->addr));
+    } else {
+        char msg[80];
+        int len = snprintf(msg, sizeof(msg), "RATE pid=%d interval_us=%u ttl_ms=%u",
+                           c->pid, (unsigned)RATE_HINT_MS * 1000u, (unsigned)RATE_HINT_TTL_MS);
+        m = sendto(fd, msg, len, 0, (struct sockaddr *)&c->addr, sizeof(c->addr));
+    }
+    PROF_SYSCALL(w, PROF_SYS_SENDTO);
+    if (m >= 0) STAT_INC(w, rate_hints);   // a lost hint just expires
+}
+
+// The ack lists the lane ports so the client can probe the lanes it is not on.
+void send_register_ack(worker_t *w, client_t *c) {
+    wire_register_ack_t ack;
+    wire_hdr_init(&ack.h, WIRE_REGISTER_ACK, (uint32_t)c->pid, 0, get_now_ns());
+    for (int l = 0; l < WIRE_LANES; l++) ack.lane_ports[l] = htole16((uint16_t)lane_ports[l]);
+    ack.reserved = 0;
+    sendto(w->lane_fds[LANE_GREEN], &ack, sizeof(ack), 0,
+           (struct sockaddr *)&c->addr, sizeof(c->addr));
+    PROF_SYSCALL(w, PROF_SYS_SENDTO);
+}
+
+// Ask the sender of a METRIC we have no client for to REGISTER again, in
+// the encoding the METRIC came in, from the lane it came in on.
+void send_reregister(worker_t *w, int lane, const struct sockaddr_in *peer, pid_t pid,
+                     int binary) {
+    ssize_t m;
+    if (binary) {
+        wire_ping_t r;
+        wire_hdr_init(&r.h, WIRE_REREGISTER, (uint32_t)pid, 0, get_now_ns());
+        m = sendto(w->lane_fds[lane], &r, sizeof(r), 0, (const struct sockaddr *)peer, sizeof(*peer));
+    } else {
+        char msg[40];
+        int len = snprintf(msg, sizeof(msg), "REREGISTER pid=%d", pid);
+        m = sendto(w->lane_fds[lane], msg, len, 0, (const struct sockaddr *)peer, sizeof(*peer));
+    }
+    PROF_SYSCALL(w, PROF_SYS_SENDTO);
+    if (m >= 0) STAT_INC(w, reregisters);
+}
+
+// ——— Recording ———
+
+// Samples count once the block holding them is written (rc of them), or
+// as lost if that failed (the pending ones).
+static void record_count(worker_t *w, uint32_t pending, int rc) {
+    if (rc < 0) STAT_ADD(w, record_errors, pending);
+    else STAT_ADD(w, recorded, (uint64_t)rc);
+}
+
+void record_sample(worker_t *w, pid_t pid, int lane, int probe, double rtt, int loss,
+                   double jitter) {
+    mf_sample_t s = {
+        .ts_ns     = w->rx_stamp_ns,
+        .pid       = (uint32_t)pid,
+        .lane      = (uint8_t)lane,
+        .probe     = (uint8_t)probe,
+        .rtt_us    = rtt > 0 ? (uint32_t)(rtt * 1000.0) : 0,
+        .loss      = loss > 0 ? (uint32_t)loss : 0,
+        .jitter_us = jitter > 0 ? (uint32_t)(jitter * 1000.0) : 0
+    };
+    PROF_T0(t);
+    int rc = mf_append(w->rec, &s);
+    PROF_STAGE(w, PROF_RECORD, t);
+    if (rc) record_count(w, MF_BLOCK_SAMPLES, rc);
+}
+
+// Re-arms itself every RECORD_FLUSH_MS, so a reader following the segment
+// is never further behind than that. Closes the writer once RECORD_STOP is
+// set.
+void flush_recording(void *arg) {
+    worker_t *w = arg;
+    if (atomic_load_explicit(&RECORD_STOP, memory_order_acquire)) {
+        uint32_t pending = w->rec->n;
+        record_count(w, pending, mf_writer_close(w->rec));
+        free(w->rec);
+        w->rec = NULL;
+        atomic_store_explicit(&w->rec_closed, 1, memory_order_release);
+        return;
+    }
+    uint32_t pending = w->rec->n;
+    record_count(w, pending, mf_flush(w->rec));
+    timer_heap_push(&w->timers, get_now_ns() + (uint64_t)RECORD_FLUSH_MS * 1000000ull,
+                    flush_recording, w);
+}
+
+// ——— Message handlers ———
+// Shared by the text and binary decoders below.
+
+// lane is the lane the METRIC arrived on.
+void handle_metric(worker_t *w, int lane, const struct sockaddr_in *peer,
+                   pid_t pid, double rtt, int loss, double jitter, int binary) {
+    STAT_INC(w, metrics);
+
+    client_t *c = client_table_find(&w->clients, pid, peer);
+    if (!c) {
+        // unknown or evicted: the client must REGISTER again
+        send_reregister(w, lane, peer, pid, binary);
+        return;
+    }
+
+    if (rtt < 0) rtt = 0.0;
+
+    if (w->rec) record_sample(w, pid, lane, 0, rtt, loss, jitter);
+
+    uint64_t now_ns = get_now_ns();
+    c->last_seen_ns = now_ns;
+    // a client reporting from the lane it was told to move to has moved,
+    // even if its ACK was lost. One reporting from another lane is there
+    // too, say after a switch given up on whose ACKs were all lost, unless
+    // it is a METRIC sent just before the last switch, from the lane left.
+    if (c->ctl_pending && lane == c->ctl_lane) {
+        control_commit(w, c, now_ns, 1);
+    } else if (lane != c->current_lane
+               && !(lane == c->prev_lane && c->switched_ns
+                    && now_ns - c->switched_ns < (uint64_t)CONTROL_RTO_MAX_MS * 1000000ull)) {
+        lane_move(w, c, lane, now_ns, 1);
+    }
+    lane_verdict_t v;
+    PROF_T0(t);
+    lane_observe(&POLICY, c, rtt, loss, now_ns, &v);
+    PROF_STAGE(w, PROF_DECIDE, t);
+    int desired = v.desired;
+    memcpy(c->rtt_pcts, v.pcts, sizeof(c->rtt_pcts));
+    c->metrics++;
+    if (loss > 0) c->losses++;
+    c->shm_dirty = 1;
+
+    uint64_t rtt_us = (uint64_t)(rtt * 1000.0);
+    hist_window_record(&w->lane_rtt[c->current_lane], rtt_us, now_ns);
+    hist_window_record(&w->lane_jitter[c->current_lane],
+                       (uint64_t)(c->rfc_jitter * 1000.0), now_ns);
+    if (w->up_fd >= 0) {
+        relay_lane_t *u = &w->up_lane[c->current_lane];
+        u->metrics++;
+        if (loss > 0) u->losses++;
+        hist_record(&u->rtt, rtt_us);
+        hist_record(&u->jitter, (uint64_t)(c->rfc_jitter * 1000.0));
+    }
+
+    // 🔍 debug-print and structured logging
+    log_client_metrics(pid, rtt, loss, jitter, c->loss_streak, c->slow_streak, c->jitter_streak, c->current_lane,
+                       v.pcts, c->rfc_jitter, v.score, v.predicted);
+    
+    if (VERBOSE && !JSON_LOGGING) {
+        log_printf(LOG_CAT_METRICS, "DBG[%u]: pid=%d L/S/J=(%d/%d/%d) score=%.2f→%.2f → trg=%d want=%d\n",
+               c->index, pid,
+               c->loss_streak,
+               c->slow_streak,
+               c->jitter_streak,
+               v.score, v.predicted,
+               v.triggers,
+               desired);
+    }
+
+    // send CONTROL if it’s time to switch and none is still in flight
+    long now = get_now_ms();
+    if (desired != c->current_lane && !c->ctl_pending
+        && now >= c->cooldown_until_ms) {
+        if (send_control(w, c, desired, v.measured) < 0) {
+            perror("send_control");
+        } else if (VERBOSE && !JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "SERVER: told pid=%d → lane%d(port=%d) seq=%u\n",
+                   pid, desired, lane_ports[desired], c->ctl_seq);
+        }
+    }
+    // a switch in flight needs METRICs from the new lane soon
+    if (RATE_HINT_MS > 0 && (v.near || c->ctl_pending)) send_rate_hint(w, c, now_ns);
+}
+
+// Repeats of an ACK, and ACKs of a CONTROL already given up, change nothing.
+void handle_control_ack(worker_t *w, const struct sockaddr_in *peer, pid_t pid, uint32_t seq) {
+    STAT_INC(w, control_acks);
+    client_t *c = client_table_find(&w->clients, pid, peer);
+    if (!c) return;
+    c->last_seen_ns = get_now_ns();
+    if (c->ctl_pending && seq == c->ctl_seq) control_commit(w, c, c->last_seen_ns, 0);
+}
+
+// A client's report on a lane it probes in the background. It only updates
+// that lane's estimate; the next METRIC decides whether to move.
+void handle_lane_metric(worker_t *w, const struct sockaddr_in *peer,
+                        pid_t pid, int lane, double rtt, int loss, double jitter) {
+    STAT_INC(w, lane_metrics);
+    client_t *c = client_table_find(&w->clients, pid, peer);
+    if (!c) return;
+    if (w->rec) record_sample(w, pid, lane, 1, rtt, loss, jitter);
+
+    uint64_t now_ns = get_now_ns();
+    c->last_seen_ns = now_ns;
+    lane_probe_observe(&POLICY, c, lane, rtt, loss, now_ns);
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_METRICS, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_probe\",\"pid\":%d,\"lane\":%d,\"rtt\":%.2f,\"loss\":%d,\"lane_score\":%.2f,\"current_lane\":%d}\n",
+               time(NULL), pid, lane, rtt, loss, c->lane_est[lane].score, c->current_lane);
+    }
+}
+
+// proto is WIRE_VERSION when the client asked for binary framing, else 0.
+void handle_register(worker_t *w, const struct sockaddr_in *peer, pid_t pid, int proto) {
+    STAT_INC(w, registers);
+    int created;
+    client_t *c = client_table_insert(&w->clients, pid, peer, &created);
+    if (!c) {
+        STAT_INC(w, register_rejects);
+        if (VERBOSE && !JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "SERVER: client table full, ignoring pid=%d\n", pid);
+        }
+        return;
+    }
+    c->last_seen_ns = get_now_ns();
+    c->proto        = proto;
+    c->shm_dirty    = 1;
+    if (proto == WIRE_VERSION) send_register_ack(w, c);
+    if (!created) {
+        // duplicate REGISTER from a known client: keep its lane state
+        STAT_INC(w, register_dups);
+        return;
+    }
+    atomic_store_explicit(&w->stats.clients, (uint64_t)w->clients.count,
+                          memory_order_relaxed);
+    c->current_lane = LANE_GREEN;
+    hist_window_init(&c->rtt_hist, (uint64_t)HIST_WINDOW_MS * 1000000ull, c->last_seen_ns);
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_registered\",\"pid\":%d,\"client_index\":%u,\"worker\":%d}\n",
+               time(NULL), pid, c->index, w->id);
+    } else if (NUM_WORKERS > 1) {
+        log_printf(LOG_CAT_GENERAL, "SERVER: registered pid=%d as client[%u] on worker %d\n",
+               pid, c->index, w->id);
+    } else {
+        log_printf(LOG_CAT_GENERAL, "SERVER: registered pid=%d as client[%u]\n",
+               pid, c->index);
+    }
+}
+
+// want_ts: buf is a wire_ping_ts_t whose server timestamps are to be filled.
+void handle_ping(worker_t *w, int lane, char *buf, ssize_t n,
+                 const struct sockaddr_in *peer, socklen_t peerlen, int want_ts) {
+    STAT_INC(w, pings);
+    wire_ping_ts_t *ts = want_ts ? (wire_ping_ts_t *)buf : NULL;
+    if (ts) ts->srv_rx_ns = htole64(w->rx_stamp_ns);
+    chaos_verdict_t v = { .drop = CHAOS_PASS };
+    if (CHAOS) {
+        uint64_t now_ns = get_now_ns();
+        PROF_T0(t);
+        chaos_decide(worker_chaos(w, lane, now_ns), &w->chaos_state[lane], &w->rng, now_ns, &v);
+        PROF_STAGE(w, PROF_CHAOS, t);
+    }
+    if (v.drop) {
+        STAT_INC(w, chaos_drops);
+        if (v.drop == CHAOS_DROP_RATE) STAT_INC(w, chaos_rate_drops);
+        log_chaos("drop", lane, "echo", &v);
+        return;
+    }
+    if (v.reordered) STAT_INC(w, chaos_reorders);
+    if (v.duplicate) STAT_INC(w, chaos_dups);
+    int copies = v.duplicate ? 2 : 1;
+
+    if (v.delay_ns) {
+        STAT_INC(w, chaos_delays);
+        log_chaos("delay", lane, "echo", &v);
+        // park the echo; it is sent and logged when the timer fires
+        for (int i = 0; i < copies; i++)
+            if (schedule_echo(&w->timers, w->lane_fds[lane], peer, peerlen, buf, (size_t)n,
+                              v.delay_ns, want_ts, PROF_COUNTER(w, PROF_SYS_SENDTO)) < 0)
+                perror("schedule_echo");
+        return;
+    }
+    if (v.duplicate) log_chaos("duplicate", lane, "echo", &v);
+
+    // queued pointing at the receive slot; sent with the rest of the batch
+    for (int i = 0; i < copies; i++) {
+        worker_tx_add(w, buf, (size_t)n, peer, peerlen, ts ? &ts->srv_tx_ns : NULL);
+        log_echo(peer, n);
+    }
+}
+
+// ——— Packet dispatch ———
+// A datagram of a summary from a relay below. Lane counts and histograms
+// join this server's own (and go on up if it is a relay too); client
+// records are logged, not kept.
+typedef struct {
+    worker_t       *w;
+    relay_source_t *src;
+    uint64_t        now_ns;
+} summary_rx_t;
+
+void summary_lane(void *arg, int lane, const relay_lane_t *l) {
+    summary_rx_t *rx = arg;
+    relay_source_t *s = rx->src;
+    s->clients[lane] = l->clients;
+    s->metrics  += l->metrics;
+    s->losses   += l->losses;
+    s->switches += l->switches;
+    if (rx->w->up_fd >= 0) {
+        relay_lane_t *u = &rx->w->up_lane[lane];
+        u->metrics  += l->metrics;
+        u->losses   += l->losses;
+        u->switches += l->switches;
+    }
+}
+
+void summary_hist(void *arg, int lane, int jitter, const hist_t *h) {
+    summary_rx_t *rx = arg;
+    worker_t *w = rx->w;
+    hist_window_merge(jitter ? &w->lane_jitter[lane] : &w->lane_rtt[lane], h, rx->now_ns);
+    if (w->up_fd >= 0) hist_merge(jitter ? &w->up_lane[lane].jitter : &w->up_lane[lane].rtt, h);
+}
+
+void summary_client(void *arg, const relay_client_t *c) {
+    summary_rx_t *rx = arg;
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_METRICS, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"relay_client\",\"relay\":%u,\"source\":%u,\"pid\":%u,\"lane\":%u,\"metrics\":%u,\"losses\":%u,\"switches\":%u,\"rtt_p50_us\":%u,\"rtt_p99_us\":%u}\n",
+               time(NULL), rx->src->relay_id, rx->src->source, c->pid, c->lane, c->metrics,
+               c->losses, c->switches, c->p50_us, c->p99_us);
+    } else if (VERBOSE) {
+        log_printf(LOG_CAT_METRICS, "SERVER: relay %u/%u pid=%u lane%u metrics=%u losses=%u p50=%uus p99=%uus\n",
+               rx->src->relay_id, rx->src->source, c->pid, c->lane, c->metrics, c->losses,
+               c->p50_us, c->p99_us);
+    }
+}
+
+void handle_summary(worker_t *w, const struct sockaddr_in *peer, const char *buf, ssize_t n,
+                    uint32_t relay_id, uint32_t seq) {
+    static const relay_visitor_t visit = { summary_lane, summary_hist, summary_client };
+    const wire_summary_t *sum = (const wire_summary_t *)buf;
+    uint64_t now_ns = get_now_ns();
+    uint64_t idle_ns = (uint64_t)RELAY_IDLE_MS * 1000000ull;
+    STAT_INC(w, relay_datagrams);
+
+    relay_source_t *s = relay_source_get(&w->relays, relay_id, sum->source, peer,
+                                         now_ns > idle_ns ? now_ns - idle_ns : 0);
+    if (!s) {
+        STAT_INC(w, relay_rejects);
+        return;
+    }
+    int missing = relay_source_part(s, seq, le16toh(sum->part), sum->last, now_ns);
+    if (missing < 0) return;   // a copy, or from before the newest summary
+    STAT_ADD(w, relay_lost, (uint64_t)missing);
+
+    summary_rx_t rx = { .w = w, .src = s, .now_ns = now_ns };
+    if (relay_decode(buf, (size_t)n, &visit, &rx) < 0) STAT_INC(w, malformed);
+    if (!sum->last) return;
+
+    STAT_INC(w, relay_summaries);
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_METRICS, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"relay_summary\",\"relay\":%u,\"source\":%u,\"seq\":%u,\"parts\":%u,\"clients\":[%u,%u,%u],\"metrics\":%" PRIu64 ",\"losses\":%" PRIu64 ",\"switches\":%" PRIu64 ",\"summaries\":%" PRIu64 ",\"lost_parts\":%" PRIu64 "}\n",
+               time(NULL), s->relay_id, s->source, seq, le16toh(sum->part) + 1u,
+               s->clients[0], s->clients[1], s->clients[2], s->metrics, s->losses, s->switches,
+               s->summaries, s->lost_parts);
+    } else if (VERBOSE) {
+        log_printf(LOG_CAT_METRICS, "SERVER: relay %u/%u summary %u: clients=%u/%u/%u metrics=%" PRIu64 " lost_parts=%" PRIu64 "\n",
+               s->relay_id, s->source, seq, s->clients[0], s->clients[1], s->clients[2],
+               s->metrics, s->lost_parts);
+    }
+}
+
+// A STATS request is answered with every worker's profile merged into one
+// JSON object, or a note that this build has none. Only loopback peers get
+// an answer: the reply is a few hundred times the size of the request.
+void handle_stats(worker_t *w, int lane, const struct sockaddr_in *peer, socklen_t peerlen) {
+    if ((ntohl(peer->sin_addr.s_addr) >> 24) != 127) return;
+    char buf[4096];
+    size_t len = (size_t)snprintf(buf, sizeof(buf), "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"profile\",",
+                                  time(NULL));
+#ifdef UDPMON_PROFILE
+    prof_t *ps[MAX_WORKERS];
+    for (int i = 0; i < NUM_WORKERS; i++) ps[i] = &workers[i]->prof;
+    len += prof_format_all(buf + len, sizeof(buf) - len, ps, NUM_WORKERS);
+#else
+    len += (size_t)snprintf(buf + len, sizeof(buf) - len, "\"enabled\":false");
+#endif
+    if (len + 2 > sizeof(buf)) return;
+    buf[len++] = '}';
+    buf[len++] = '\n';
+    if (sendto(w->lane_fds[lane], buf, len, 0, (const struct sockaddr *)peer, peerlen) < 0)
+        perror("sendto STATS");
+    PROF_SYSCALL(w, PROF_SYS_SENDTO);
+}
+
+// buf is NUL-terminated and 8-byte aligned by the receive path. Undelayed
+// PING echoes are not sent here but queued on w->tx so the whole receive
+// batch is answered with one sendmmsg().
+void handle_packet(worker_t *w, int lane, char *buf, ssize_t n,
+                   const struct sockaddr_in *peer, socklen_t peerlen) {
+    msg_t m;
+    PROF_T0(t);
+    msg_kind_t kind = msg_parse(buf, (size_t)n, &m);
+    PROF_STAGE(w, PROF_PARSE, t);
+    PROF_MSG(w, kind);
+    switch (kind) {
+        case MSG_METRIC:
+            handle_metric(w, lane, peer, m.pid, m.rtt, m.loss, m.jitter, m.binary);
+            break;
+        case MSG_REGISTER:
+            handle_register(w, peer, m.pid, m.proto);
+            break;
+        case MSG_PING:
+            // binary echoes reuse the receive slot, so flip the type in place
+            if (m.binary) ((wire_hdr_t *)buf)->type = WIRE_PONG;
+            handle_ping(w, lane, buf, n, peer, peerlen,
+                        m.binary && (size_t)n >= sizeof(wire_ping_ts_t));
+            break;
+        case MSG_LANE_PROBE:
+            // echoed as is, through the same chaos as a PING on this lane
+            STAT_INC(w, lane_probes);
+            handle_ping(w, lane, buf, n, peer, peerlen, 0);
+            break;
+        case MSG_LANE_METRIC:
+            handle_lane_metric(w, peer, m.pid, m.lane, m.rtt, m.loss, m.jitter);
+            break;
+        case MSG_CONTROL_ACK:
+            handle_control_ack(w, peer, m.pid, m.seq);
+            break;
+        case MSG_SUMMARY:
+            handle_summary(w, peer, buf, n, (uint32_t)m.pid, m.seq);
+            break;
+        case MSG_STATS:
+            handle_stats(w, lane, peer, peerlen);
+            break;
+        default:
+            STAT_INC(w, malformed);
+            break;
+    }
+    PROF_STAGE(w, PROF_HANDLE, t);
+}
+
+// ——— Lane sockets ———
+// With several workers every lane port is a SO_REUSEPORT group holding one
+// socket per worker, in worker order. This classic BPF program picks the
+// group member from the source ip:port, so a client reaches the same worker
+// on every lane and its state never has to move between shards.
+int attach_shard_steering(int fd, int nworkers) {
+    struct sock_filter code[] = {
+        // X = IPv4 header length
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, (uint32_t)SKF_NET_OFF),
+        // A = UDP source port
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, (uint32_t)SKF_NET_OFF),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        // A = IPv4 source address ^ source port
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + 12),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)nworkers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+int open_lane_socket(int lane, int reuseport) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(lane_ports[lane]);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    if (TIMESTAMPS && tstamp_enable_rx(fd) < 0)
+        perror("setsockopt SO_TIMESTAMPNS");
+    return fd;
+}
+
+// ——— Shared-memory export ———
+// Every SHM_INTERVAL_MS each worker copies its counters, its lane histogram
+// snapshot and every client that changed since the last pass into its own
+// part of the shared table. Readers only ever look at the mapping, so
+// dashboards can poll it as often as they like.
+void shm_put_client(worker_t *w, const client_t *c) {
+    shm_client_t *r = shm_client(&SHM, (uint32_t)w->id, c->index);
+    shm_write_begin(&r->seq);
+    r->in_use            = 1;
+    r->pid               = c->pid;
+    r->index             = c->index;
+    r->ip                = c->addr.sin_addr.s_addr;
+    r->port              = ntohs(c->addr.sin_port);
+    r->lane              = (uint8_t)c->current_lane;
+    r->proto             = (uint8_t)c->proto;
+    r->loss_streak       = c->loss_streak;
+    r->slow_streak       = c->slow_streak;
+    r->jitter_streak     = c->jitter_streak;
+    r->switches          = c->switches;
+    r->metrics           = c->metrics;
+    r->losses            = c->losses;
+    r->cooldown_until_ms = c->cooldown_until_ms;
+    r->last_seen_ns      = c->last_seen_ns;
+    memcpy(r->rtt_pcts, c->rtt_pcts, sizeof(r->rtt_pcts));
+    r->samples           = (uint32_t)hist_window_count(&c->rtt_hist);
+    r->last_rtt          = c->last_rtt;
+    r->rtt_mean          = winstats_mean(&c->rtt_win);
+    r->rtt_min           = winstats_min(&c->rtt_win);
+    r->rtt_max           = winstats_max(&c->rtt_win);
+    r->rfc_jitter        = c->rfc_jitter;
+    shm_write_end(&r->seq);
+}
+
+void shm_clear_client(worker_t *w, const client_t *c) {
+    if (c->index >= shm_header(&SHM)->slots) return;
+    shm_client_t *r = shm_client(&SHM, (uint32_t)w->id, c->index);
+    shm_write_begin(&r->seq);
+    r->in_use = 0;
+    shm_write_end(&r->seq);
+}
+
+// Re-arms itself.
+void publish_shm(void *arg) {
+    worker_t *w = arg;
+    uint64_t now = get_now_ns();
+    uint32_t slots = shm_header(&SHM)->slots;
+    uint32_t overflow = 0;
+    for (size_t i = 0; i < w->clients.cap; i++) {
+        client_t *c = w->clients.slots[i];
+        if (!c) continue;
+        if (c->index >= slots) {
+            overflow++;
+            continue;
+        }
+        if (!c->shm_dirty) continue;
+        c->shm_dirty = 0;
+        shm_put_client(w, c);
+    }
+
+    uint32_t used = w->clients.nslabs * CLIENT_SLAB_SIZE;
+    shm_worker_t *s = shm_worker(&SHM, (uint32_t)w->id);
+    worker_stats_t *st = &w->stats;
+    shm_write_begin(&s->seq);
+    s->slots_used    = used < slots ? used : slots;
+    s->overflow      = overflow;
+    s->publish_ns    = now;
+    s->clients       = atomic_load_explicit(&st->clients,       memory_order_relaxed);
+    s->rx_packets    = atomic_load_explicit(&st->rx_packets,    memory_order_relaxed);
+    s->pings         = atomic_load_explicit(&st->pings,         memory_order_relaxed);
+    s->metrics       = atomic_load_explicit(&st->metrics,       memory_order_relaxed);
+    s->registers     = atomic_load_explicit(&st->registers,     memory_order_relaxed);
+    s->lane_switches = atomic_load_explicit(&st->lane_switches, memory_order_relaxed);
+    s->chaos_drops   = atomic_load_explicit(&st->chaos_drops,   memory_order_relaxed);
+    s->chaos_delays  = atomic_load_explicit(&st->chaos_delays,  memory_order_relaxed);
+    s->evictions     = atomic_load_explicit(&st->evictions,     memory_order_relaxed);
+    s->malformed     = atomic_load_explicit(&st->malformed,     memory_order_relaxed);
+    // the snapshots are only written by this thread, so no snap_lock here
+    memcpy(s->lane_rtt,    w->snap_rtt,    sizeof(s->lane_rtt));
+    memcpy(s->lane_jitter, w->snap_jitter, sizeof(s->lane_jitter));
+    shm_write_end(&s->seq);
+
+    timer_heap_push(&w->timers, now + (uint64_t)SHM_INTERVAL_MS * 1000000ull, publish_shm, w);
+}
+
+// ——— Idle eviction ———
+void log_eviction(client_t *c, void *arg) {
+    worker_t *w = arg;
+    STAT_INC(w, evictions);
+    if (SHM.base) shm_clear_client(w, c);
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_evicted\",\"pid\":%d,\"client_index\":%u,\"worker\":%d}\n",
+               time(NULL), c->pid, c->index, w->id);
+    } else {
+        log_printf(LOG_CAT_GENERAL, "SERVER: evicted idle pid=%d (client[%u])\n", c->pid, c->index);
+    }
+}
+
+// Re-arms itself; sweeps four times per idle period so an entry outlives
+// its deadline by at most a quarter of it.
+void sweep_idle(void *arg) {
+    worker_t *w = arg;
+    uint64_t now = get_now_ns();
+    uint64_t idle_ns = (uint64_t)IDLE_TIMEOUT_MS * 1000000ull;
+    if (now > idle_ns && client_table_evict_idle(&w->clients, now - idle_ns, log_eviction, w) > 0)
+        atomic_store_explicit(&w->stats.clients, (uint64_t)w->clients.count,
+                              memory_order_relaxed);
+    timer_heap_push(&w->timers, now + idle_ns / 4, sweep_idle, w);
+}
+
+// ——— Lane histogram snapshots ———
+// Re-arms itself once a second.
+void publish_lane_hist(void *arg) {
+    worker_t *w = arg;
+    uint64_t now = get_now_ns();
+    pthread_mutex_lock(&w->snap_lock);
+    for (int lane = 0; lane < 3; lane++) {
+        hist_window_advance(&w->lane_rtt[lane], now);
+        hist_window_advance(&w->lane_jitter[lane], now);
+        hist_reset(&w->snap_rtt[lane]);
+        hist_reset(&w->snap_jitter[lane]);
+        hist_window_merge_into(&w->snap_rtt[lane], &w->lane_rtt[lane]);
+        hist_window_merge_into(&w->snap_jitter[lane], &w->lane_jitter[lane]);
+    }
+    pthread_mutex_unlock(&w->snap_lock);
+    timer_heap_push(&w->timers, now + 1000000000ull, publish_lane_hist, w);
+}
+
+// ——— Relay summaries ———
+
+void up_flush(worker_t *w) {
+    int sent = 0;
+    while (sent < w->up_n) {
+        int k = sendmmsg(w->up_fd, w->up_msgs + sent, (unsigned)(w->up_n - sent), MSG_DONTWAIT);
+        PROF_SYSCALL(w, PROF_SYS_SENDMMSG);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            // the upstream is gone or the socket is full: the rest of this
+            // summary is lost, and the server above counts it missing
+            STAT_ADD(w, summary_send_errors, (uint64_t)(w->up_n - sent));
+            break;
+        }
+        for (int i = sent; i < sent + k; i++) STAT_ADD(w, summary_bytes, w->up_msgs[i].msg_len);
+        sent += k;
+    }
+    w->up_n = 0;
+}
+
+void up_queue(const void *dgram, size_t len, void *arg) {
+    worker_t *w = arg;
+    memcpy(w->up_bufs[w->up_n], dgram, len);
+    w->up_iov[w->up_n]  = (struct iovec){ .iov_base = w->up_bufs[w->up_n], .iov_len = len };
+    w->up_msgs[w->up_n] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &w->up_iov[w->up_n], .msg_iovlen = 1 } };
+    STAT_INC(w, summary_datagrams);
+    if (++w->up_n == RELAY_BATCH) up_flush(w);
+}
+
+int cmp_client_pid(const void *a, const void *b) {
+    pid_t x = (*(client_t *const *)a)->pid, y = (*(client_t *const *)b)->pid;
+    return (x > y) - (x < y);
+}
+
+// Re-arms itself every SUMMARY_MS. Clients are reported in pid order so
+// their pids delta-code small; one that sent no METRIC since the last
+// summary is left out.
+void send_summary(void *arg) {
+    worker_t *w = arg;
+    uint64_t now = get_now_ns();
+    uint64_t idle_ns = (uint64_t)IDLE_TIMEOUT_MS * 1000000ull;
+
+    if (w->up_order_cap < w->clients.count) {
+        client_t **grown = realloc(w->up_order, w->clients.count * sizeof(*grown));
+        if (grown) {
+            w->up_order     = grown;
+            w->up_order_cap = w->clients.count;
+        }
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < w->clients.cap; i++) {
+        client_t *c = w->clients.slots[i];
+        if (!c) continue;
+        w->up_lane[c->current_lane].clients++;
+        if (c->metrics != c->up_metrics && n < w->up_order_cap) w->up_order[n++] = c;
+    }
+    // clients behind the relays below, as of their latest summaries
+    for (int i = 0; i < RELAY_MAX_SOURCES; i++) {
+        const relay_source_t *s = &w->relays.s[i];
+        if (!s->in_use || (IDLE_TIMEOUT_MS > 0 && now - s->last_seen_ns > idle_ns)) continue;
+        for (int lane = 0; lane < 3; lane++) w->up_lane[lane].clients += s->clients[lane];
+    }
+    if (n > 1) qsort(w->up_order, n, sizeof(*w->up_order), cmp_client_pid);
+
+    relay_enc_begin(&w->up_enc, ++w->up_seq, tstamp_wall_ns());
+    for (int lane = 0; lane < 3; lane++) relay_enc_lane(&w->up_enc, lane, &w->up_lane[lane]);
+    for (size_t i = 0; i < n; i++) {
+        client_t *c = w->up_order[i];
+        relay_client_t r = {
+            .pid      = (uint32_t)c->pid,
+            .lane     = (uint8_t)c->current_lane,
+            .metrics  = (uint32_t)(c->metrics - c->up_metrics),
+            .losses   = (uint32_t)(c->losses - c->up_losses),
+            .switches = c->switches - c->up_switches,
+            .p50_us   = (uint32_t)c->rtt_pcts[0],
+            .p99_us   = (uint32_t)c->rtt_pcts[1]
+        };
+        relay_enc_client(&w->up_enc, &r);
+        c->up_metrics  = c->metrics;
+        c->up_losses   = c->losses;
+        c->up_switches = c->switches;
+    }
+    relay_enc_end(&w->up_enc);
+    up_flush(w);
+    STAT_INC(w, summaries_sent);
+
+    for (int lane = 0; lane < 3; lane++) {
+        relay_lane_t *u = &w->up_lane[lane];
+        u->clients = 0;
+        u->metrics = u->losses = u->switches = 0;
+        hist_reset(&u->rtt);
+        hist_reset(&u->jitter);
+    }
+    timer_heap_push(&w->timers, now + (uint64_t)SUMMARY_MS * 1000000ull, send_summary, w);
+}
+
+// ——— io_uring worker loop ———
+// Each lane socket has one multishot RECVMSG outstanding that draws buffers
+// from a provided-buffer ring, so the kernel keeps delivering datagrams
+// without a new request per packet. An undelayed echo is sent with SENDMSG
+// straight out of the buffer it arrived in (the PING is rewritten in place
+// into the PONG); the buffer goes back to the ring when the send completes.
+// One io_uring_enter() both submits the batch's sends and waits for the next
+// completions.
+#define UR_ENTRIES  1024
+#define UR_NBUFS    512    // power of two
+#define UR_NAME_LEN sizeof(struct sockaddr_in)
+// recvmsg_out header, peer address, control data, then the datagram plus
+// room for the NUL the text parsers expect; every part keeps 8-byte alignment
+#define UR_BUF_SIZE (sizeof(struct io_uring_recvmsg_out) + UR_NAME_LEN + TSTAMP_CMSG_SPACE + BUFSZ + 8)
+
+enum { UR_OP_RECV = 1, UR_OP_SEND = 2 };
+#define UR_DATA(op, lane, bid) (((uint64_t)(op) << 32) | ((uint64_t)(lane) << 16) | (bid))
+#define UR_OP(d)   ((unsigned)((d) >> 32))
+#define UR_LANE(d) ((int)(((d) >> 16) & 0xffff))
+#define UR_BID(d)  ((uint16_t)((d) & 0xffff))
+
+typedef struct {
+    uring_t      ring;
+    uring_bufs_t bufs;
+    struct msghdr rx_tmpl;            // name/control sizes for multishot RECVMSG
+    unsigned      rearm;              // lanes whose multishot receive ended
+    // one send per buffer at most, so its msghdr lives with the buffer id
+    struct {
+        struct msghdr mh;
+        struct iovec  iov;
+    } tx[UR_NBUFS];
+    uint64_t *stamps[UR_ENTRIES];     // srv_tx_ns of sends not yet submitted
+    unsigned  nstamps;
+} ur_worker_t;
+
+// Stamp timestamped PONGs as late as possible, right before submission.
+static void ur_stamp(ur_worker_t *u) {
+    if (!u->nstamps) return;
+    uint64_t now = htole64(tstamp_wall_ns());
+    for (unsigned i = 0; i < u->nstamps; i++) *u->stamps[i] = now;
+    u->nstamps = 0;
+}
+
+static struct io_uring_sqe *ur_sqe(ur_worker_t *u) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&u->ring);
+    if (!sqe) {
+        // submission queue full: push out what we have and retry
+        ur_stamp(u);
+        uring_submit(&u->ring);
+        sqe = uring_get_sqe(&u->ring);
+    }
+    return sqe;
+}
 
-    srand((unsigned)time(NULL));
+static void ur_arm_recv(ur_worker_t *u, worker_t *w, int lane) {
+    struct io_uring_sqe *sqe = ur_sqe(u);
+    if (!sqe) return;   // retried on the next pass
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = w->lane_fds[lane];
+    sqe->addr      = (uint64_t)(uintptr_t)&u->rx_tmpl;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = u->bufs.bgid;
+    sqe->user_data = UR_DATA(UR_OP_RECV, lane, 0);
+    u->rearm &= ~(1u << lane);
+}
+
+// One received datagram in buffer bid. Reuses handle_packet(); an echo it
+// queues on w->tx becomes a SENDMSG from the same buffer.
+static void ur_handle_rx(ur_worker_t *u, worker_t *w, int lane, uint16_t bid, uint64_t batch_wall) {
+    char *base = uring_buf(&u->bufs, bid);
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)base;
+    char *name    = base + sizeof(*out);
+    char *control = name + UR_NAME_LEN;
+    char *payload = control + u->rx_tmpl.msg_controllen;
+    if ((out->flags & MSG_TRUNC) || out->payloadlen > BUFSZ || out->namelen > UR_NAME_LEN) {
+        STAT_INC(w, malformed);
+        uring_bufs_recycle(&u->bufs, bid);
+        return;
+    }
+    ssize_t n = out->payloadlen;
+    payload[n] = '\0';
 
+    struct msghdr cm = { .msg_control = control, .msg_controllen = out->controllen };
+    w->rx_stamp_ns = TIMESTAMPS && out->controllen ? tstamp_rx(&cm) : 0;
+    if (!w->rx_stamp_ns) w->rx_stamp_ns = batch_wall;
+
+    w->tx.fd    = w->lane_fds[lane];
+    w->tx.count = 0;
+    handle_packet(w, lane, payload, n, (const struct sockaddr_in *)name, out->namelen);
+    if (w->tx.count == 0) {
+        uring_bufs_recycle(&u->bufs, bid);
+        return;
+    }
+
+    // copies beyond the first (a chaos duplicate) go out right away; the
+    // buffer can carry only one SENDMSG
+    for (unsigned i = 1; i < w->tx.count; i++) {
+        if (w->tx.stamp[i]) *w->tx.stamp[i] = htole64(tstamp_wall_ns());
+        PROF_T0(t);
+        ssize_t m = sendmsg(w->lane_fds[lane], &w->tx.msgs[i].msg_hdr, 0);
+        PROF_STAGE(w, PROF_SEND, t);
+        PROF_SYSCALL(w, PROF_SYS_SENDTO);
+        STAT_INC(w, uring_sendmsgs);
+        if (m < 0) {
+            perror("sendmsg");
+            STAT_INC(w, tx_dropped);
+        }
+    }
+
+    struct io_uring_sqe *sqe = ur_sqe(u);
+    if (!sqe) {
+        // the ring is full: the echo is lost like one sendmmsg() refused
+        STAT_INC(w, tx_dropped);
+        w->tx.count = 0;
+        uring_bufs_recycle(&u->bufs, bid);
+        return;
+    }
+    u->tx[bid].iov        = w->tx.iov[0];
+    u->tx[bid].mh         = w->tx.msgs[0].msg_hdr;
+    u->tx[bid].mh.msg_iov = &u->tx[bid].iov;
+    if (w->tx.stamp[0]) u->stamps[u->nstamps++] = w->tx.stamp[0];
+    w->tx.count = 0;
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = w->lane_fds[lane];
+    sqe->addr      = (uint64_t)(uintptr_t)&u->tx[bid].mh;
+    sqe->len       = 1;
+    sqe->user_data = UR_DATA(UR_OP_SEND, lane, bid);
+}
+
+// Runs the worker until the process exits. Returns -1 (errno set) only if
+// io_uring could not be set up, before any packet was touched.
+int worker_loop_uring(worker_t *w) {
+    ur_worker_t *u = calloc(1, sizeof(*u));
+    if (!u) return -1;
+    if (uring_init(&u->ring, UR_ENTRIES) < 0) {
+        free(u);
+        return -1;
+    }
+    if (uring_bufs_init(&u->ring, &u->bufs, 0, UR_NBUFS, (uint32_t)UR_BUF_SIZE) < 0) {
+        int err = errno;
+        uring_free(&u->ring);
+        free(u);
+        errno = err;
+        return -1;
+    }
+    u->rx_tmpl.msg_namelen    = UR_NAME_LEN;
+    u->rx_tmpl.msg_controllen = TIMESTAMPS ? TSTAMP_CMSG_SPACE : 0;
+    for (int lane = 0; lane < 3; lane++) ur_arm_recv(u, w, lane);
+
+    for (;;) {
+        ur_stamp(u);
+        PROF_T0(t);
+        int rc = uring_submit_wait(&u->ring, timer_heap_timeout_ms(&w->timers, get_now_ns()));
+        STAT_INC(w, uring_enters);
+        PROF_SYSCALL(w, PROF_SYS_URING_ENTER);
+        PROF_STAGE(w, PROF_WAIT, t);
+        if (rc < 0 && rc != -ETIME && rc != -EINTR && rc != -EBUSY) {
+            errno = -rc;
+            perror("io_uring_enter");
+        }
+
+        PROF_DEPTH(w, PROF_Q_TIMERS, w->timers.len);
+        timer_heap_run_due(&w->timers, get_now_ns());
+        PROF_STAGE(w, PROF_TIMERS, t);
+
+        uint64_t batch_wall = tstamp_wall_ns();
+        uint64_t got = 0;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&u->ring))) {
+            uint64_t data  = cqe->user_data;
+            int      res   = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(&u->ring);
+
+            if (UR_OP(data) == UR_OP_SEND) {
+                if (res < 0) {
+                    errno = -res;
+                    perror("io_uring sendmsg");
+                    STAT_INC(w, tx_dropped);
+                }
+                uring_bufs_recycle(&u->bufs, UR_BID(data));
+                continue;
+            }
+            int lane = UR_LANE(data);
+            // the kernel ends a multishot receive on errors and when it runs
+            // out of buffers; re-armed below, after this pass recycled some
+            if (!(flags & IORING_CQE_F_MORE)) u->rearm |= 1u << lane;
+            if (res < 0) {
+                if (res != -ENOBUFS) {
+                    errno = -res;
+                    perror("io_uring recvmsg");
+                }
+                continue;
+            }
+            if (!(flags & IORING_CQE_F_BUFFER)) continue;
+            PROF_TRACE_BEGIN(w, lane, (int)got, batch_wall);
+            got++;
+            ur_handle_rx(u, w, lane, (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT), batch_wall);
+        }
+        if (got) {
+            STAT_ADD(w, rx_packets, got);
+            PROF_DEPTH(w, PROF_Q_RX_BATCH, got);
+        }
+        // the pass's echoes go out with the next io_uring_enter()
+        PROF_TRACE_CLOSE(w);
+        for (int lane = 0; lane < 3; lane++)
+            if (u->rearm & (1u << lane)) ur_arm_recv(u, w, lane);
+    }
+    return 0;
+}
+
+// ——— Worker loop ———
+void *worker_main(void *arg) {
+    worker_t *w = arg;
+
+    publish_lane_hist(w);
+    if (SHM.base) publish_shm(w);
+    if (w->rec)
+        timer_heap_push(&w->timers, get_now_ns() + (uint64_t)RECORD_FLUSH_MS * 1000000ull,
+                        flush_recording, w);
+
+    if (IDLE_TIMEOUT_MS > 0)
+        timer_heap_push(&w->timers, get_now_ns() + (uint64_t)IDLE_TIMEOUT_MS * 250000ull,
+                        sweep_idle, w);
+    if (w->up_fd >= 0)
+        timer_heap_push(&w->timers, get_now_ns() + (uint64_t)SUMMARY_MS * 1000000ull,
+                        send_summary, w);
+
+    if (IO_URING && worker_loop_uring(w) < 0) {
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"server\",\"event\":\"io_uring_unavailable\",\"worker\":%d,\"error\":\"%s\"}\n",
+                   time(NULL), w->id, strerror(errno));
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: worker %d: io_uring unavailable (%s), using epoll\n",
+                   w->id, strerror(errno));
+        }
+    }
+
+    for (;;) {
+        // ─── 0) wait for any lane, or the earliest parked echo ────────────
+        struct epoll_event events[3];
+        int wait_ms = timer_heap_timeout_ms(&w->timers, get_now_ns());
+        PROF_T0(t);
+        int nev = epoll_wait(w->ep, events, 3, wait_ms);
+        PROF_SYSCALL(w, PROF_SYS_EPOLL_WAIT);
+        PROF_STAGE(w, PROF_WAIT, t);
+        if (nev < 0) {
+            if (errno != EINTR) perror("epoll_wait");
+            continue;
+        }
+
+        PROF_DEPTH(w, PROF_Q_TIMERS, w->timers.len);
+        timer_heap_run_due(&w->timers, get_now_ns());
+        PROF_STAGE(w, PROF_TIMERS, t);
+
+        // Drain ready lanes round-robin, one batch per lane per pass, so a
+        // flooded lane cannot starve the others.
+        int pending[3] = {0};
+        int npending = 0;
+        for (int i = 0; i < nev; i++) {
+            if (!pending[events[i].data.u32]) npending++;
+            pending[events[i].data.u32] = 1;
+        }
+
+        while (npending > 0) {
+            for (int lane = 0; lane < 3; lane++) {
+                if (!pending[lane]) continue;
+
+                for (int j = 0; j < BATCH; j++) {
+                    w->rx_iov[j] = (struct iovec){ .iov_base = w->rx_bufs[j], .iov_len = BUFSZ };
+                    w->rx_msgs[j].msg_hdr = (struct msghdr){
+                        .msg_name       = &w->rx_peers[j],
+                        .msg_namelen    = sizeof(w->rx_peers[j]),
+                        .msg_iov        = &w->rx_iov[j],
+                        .msg_iovlen     = 1,
+                        .msg_control    = TIMESTAMPS ? w->rx_ctrl[j] : NULL,
+                        .msg_controllen = TIMESTAMPS ? sizeof(w->rx_ctrl[j]) : 0
+                    };
+                }
+                PROF_T0(tr);
+                int got = recvmmsg(w->lane_fds[lane], w->rx_msgs, BATCH, MSG_DONTWAIT, NULL);
+                PROF_SYSCALL(w, PROF_SYS_RECVMMSG);
+                PROF_STAGE(w, PROF_RECV, tr);
+                if (got < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) perror("recvmmsg");
+                    pending[lane] = 0;
+                    npending--;
+                    continue;
+                }
+                // a short batch means the socket is empty
+                if (got < BATCH) {
+                    pending[lane] = 0;
+                    npending--;
+                }
+                STAT_INC(w, rx_batches);
+                STAT_ADD(w, rx_packets, (uint64_t)got);
+                PROF_DEPTH(w, PROF_Q_RX_BATCH, (uint64_t)got);
+
+                w->tx.fd = w->lane_fds[lane];
+                uint64_t batch_wall = tstamp_wall_ns();
+                for (int j = 0; j < got; j++) {
+                    ssize_t n = w->rx_msgs[j].msg_len;
+                    w->rx_bufs[j][n] = '\0';
+                    w->rx_stamp_ns = TIMESTAMPS ? tstamp_rx(&w->rx_msgs[j].msg_hdr) : 0;
+                    if (!w->rx_stamp_ns) w->rx_stamp_ns = batch_wall;
+                    PROF_TRACE_BEGIN(w, lane, j, w->rx_stamp_ns);
+                    handle_packet(w, lane, w->rx_bufs[j], n, &w->rx_peers[j],
+                                  w->rx_msgs[j].msg_hdr.msg_namelen);
+                }
+                if (w->tx.count > 0) worker_tx_flush(w);
+                PROF_TRACE_CLOSE(w);
+            }
+        }
+    }
+    return NULL;
+}
+
+// ——— Stats merge ———
+// Runs on the main thread; workers are never paused. Lane histograms come
+// from each worker's last published snapshot.
+void log_lane_percentiles(void) {
+    static hist_t rtt[3], jit[3];
+    for (int lane = 0; lane < 3; lane++) {
+        hist_reset(&rtt[lane]);
+        hist_reset(&jit[lane]);
+    }
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        worker_t *w = workers[i];
+        pthread_mutex_lock(&w->snap_lock);
+        for (int lane = 0; lane < 3; lane++) {
+            hist_merge(&rtt[lane], &w->snap_rtt[lane]);
+            hist_merge(&jit[lane], &w->snap_jitter[lane]);
+        }
+        pthread_mutex_unlock(&w->snap_lock);
+    }
+
+    static const double pct[3] = { 50.0, 99.0, 99.9 };
+    for (int lane = 0; lane < 3; lane++) {
+        if (rtt[lane].total == 0) continue;
+        const hist_t *hr = &rtt[lane], *hj = &jit[lane];
+        uint64_t p[3], j[3];
+        hist_percentiles(&hr, 1, pct, p, 3);
+        hist_percentiles(&hj, 1, pct, j, 3);
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_latency\",\"lane\":%d,\"samples\":%" PRIu64 ",\"rtt_p50\":%.2f,\"rtt_p99\":%.2f,\"rtt_p999\":%.2f,\"jitter_p50\":%.2f,\"jitter_p99\":%.2f}\n",
+                   time(NULL), lane, hr->total, p[0] / 1000.0, p[1] / 1000.0, p[2] / 1000.0,
+                   j[0] / 1000.0, j[1] / 1000.0);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: lane%d n=%" PRIu64 " rtt p50=%.2f p99=%.2f p99.9=%.2f ms jitter p50=%.2f ms\n",
+                   lane, hr->total, p[0] / 1000.0, p[1] / 1000.0, p[2] / 1000.0, j[0] / 1000.0);
+        }
+    }
+}
+
+void log_merged_stats(void) {
+    uint64_t rx = 0, batches = 0, pings = 0, tx_batches = 0, tx_dropped = 0, drops = 0,
+             delays = 0, metrics = 0, registers = 0, switches = 0, clients = 0,
+             dups = 0, rejects = 0, evictions = 0, reregs = 0, malformed = 0, enters = 0, sendmsgs = 0,
+             lprobes = 0, lmetrics = 0, csent = 0, cresent = 0, cacks = 0, cfailed = 0,
+             rate_drops = 0, reorders = 0, copies = 0, recorded = 0, rec_errors = 0,
+             hints = 0, sum_sent = 0, sum_dgrams = 0, sum_bytes = 0, sum_errors = 0,
+             relay_dgrams = 0, relay_sums = 0, relay_lost = 0, relay_rejects = 0;
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        worker_stats_t *st = &workers[i]->stats;
+        rx         += atomic_load_explicit(&st->rx_packets,    memory_order_relaxed);
+        batches    += atomic_load_explicit(&st->rx_batches,    memory_order_relaxed);
+        pings      += atomic_load_explicit(&st->pings,         memory_order_relaxed);
+        tx_batches += atomic_load_explicit(&st->tx_batches,    memory_order_relaxed);
+        tx_dropped += atomic_load_explicit(&st->tx_dropped,    memory_order_relaxed);
+        drops      += atomic_load_explicit(&st->chaos_drops,   memory_order_relaxed);
+        delays     += atomic_load_explicit(&st->chaos_delays,  memory_order_relaxed);
+        rate_drops += atomic_load_explicit(&st->chaos_rate_drops, memory_order_relaxed);
+        reorders   += atomic_load_explicit(&st->chaos_reorders,   memory_order_relaxed);
+        copies     += atomic_load_explicit(&st->chaos_dups,       memory_order_relaxed);
+        metrics    += atomic_load_explicit(&st->metrics,       memory_order_relaxed);
+        registers  += atomic_load_explicit(&st->registers,     memory_order_relaxed);
+        switches   += atomic_load_explicit(&st->lane_switches, memory_order_relaxed);
+        clients    += atomic_load_explicit(&st->clients,       memory_order_relaxed);
+        dups       += atomic_load_explicit(&st->register_dups,    memory_order_relaxed);
+        rejects    += atomic_load_explicit(&st->register_rejects, memory_order_relaxed);
+        evictions  += atomic_load_explicit(&st->evictions,        memory_order_relaxed);
+        reregs     += atomic_load_explicit(&st->reregisters,      memory_order_relaxed);
+        malformed  += atomic_load_explicit(&st->malformed,        memory_order_relaxed);
+        enters     += atomic_load_explicit(&st->uring_enters,     memory_order_relaxed);
+        sendmsgs   += atomic_load_explicit(&st->uring_sendmsgs,   memory_order_relaxed);
+        lprobes    += atomic_load_explicit(&st->lane_probes,      memory_order_relaxed);
+        lmetrics   += atomic_load_explicit(&st->lane_metrics,     memory_order_relaxed);
+        csent      += atomic_load_explicit(&st->control_sent,        memory_order_relaxed);
+        cresent    += atomic_load_explicit(&st->control_retransmits, memory_order_relaxed);
+        cacks      += atomic_load_explicit(&st->control_acks,        memory_order_relaxed);
+        cfailed    += atomic_load_explicit(&st->control_failures,    memory_order_relaxed);
+        recorded   += atomic_load_explicit(&st->recorded,      memory_order_relaxed);
+        rec_errors += atomic_load_explicit(&st->record_errors, memory_order_relaxed);
+        hints      += atomic_load_explicit(&st->rate_hints,    memory_order_relaxed);
+        sum_sent   += atomic_load_explicit(&st->summaries_sent,      memory_order_relaxed);
+        sum_dgrams += atomic_load_explicit(&st->summary_datagrams,   memory_order_relaxed);
+        sum_bytes  += atomic_load_explicit(&st->summary_bytes,       memory_order_relaxed);
+        sum_errors += atomic_load_explicit(&st->summary_send_errors, memory_order_relaxed);
+        relay_dgrams  += atomic_load_explicit(&st->relay_datagrams, memory_order_relaxed);
+        relay_sums    += atomic_load_explicit(&st->relay_summaries, memory_order_relaxed);
+        relay_lost    += atomic_load_explicit(&st->relay_lost,      memory_order_relaxed);
+        relay_rejects += atomic_load_explicit(&st->relay_rejects,   memory_order_relaxed);
+    }
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"stats\",\"workers\":%d,\"clients\":%" PRIu64 ",\"rx_packets\":%" PRIu64 ",\"rx_batches\":%" PRIu64 ",\"tx_batches\":%" PRIu64 ",\"tx_dropped\":%" PRIu64 ",\"pings\":%" PRIu64 ",\"chaos_drops\":%" PRIu64 ",\"chaos_delays\":%" PRIu64 ",\"chaos_rate_drops\":%" PRIu64 ",\"chaos_reorders\":%" PRIu64 ",\"chaos_dups\":%" PRIu64 ",\"metrics\":%" PRIu64 ",\"registers\":%" PRIu64 ",\"lane_switches\":%" PRIu64 ",\"register_dups\":%" PRIu64 ",\"register_rejects\":%" PRIu64 ",\"evictions\":%" PRIu64 ",\"reregisters\":%" PRIu64 ",\"malformed\":%" PRIu64 ",\"uring_enters\":%" PRIu64 ",\"uring_sendmsgs\":%" PRIu64 ",\"lane_probes\":%" PRIu64 ",\"lane_metrics\":%" PRIu64 ",\"control_sent\":%" PRIu64 ",\"control_retransmits\":%" PRIu64 ",\"control_acks\":%" PRIu64 ",\"control_failures\":%" PRIu64 ",\"recorded\":%" PRIu64 ",\"record_errors\":%" PRIu64 ",\"rate_hints\":%" PRIu64 ",\"summaries_sent\":%" PRIu64 ",\"summary_datagrams\":%" PRIu64 ",\"summary_bytes\":%" PRIu64 ",\"summary_send_errors\":%" PRIu64 ",\"relay_datagrams\":%" PRIu64 ",\"relay_summaries\":%" PRIu64 ",\"relay_lost\":%" PRIu64 ",\"relay_rejects\":%" PRIu64 ",\"log_dropped\":%" PRIu64 "}\n",
+               time(NULL), NUM_WORKERS, clients, rx, batches, tx_batches, tx_dropped,
+               pings, drops, delays, rate_drops, reorders, copies, metrics, registers, switches,
+               dups, rejects, evictions, reregs, malformed, enters, sendmsgs, lprobes, lmetrics,
+               csent, cresent, cacks, cfailed, recorded, rec_errors, hints,
+               sum_sent, sum_dgrams, sum_bytes, sum_errors,
+               relay_dgrams, relay_sums, relay_lost, relay_rejects, log_dropped_total());
+    } else {
+        log_printf(LOG_CAT_GENERAL, "SERVER: stats workers=%d clients=%" PRIu64 " rx=%" PRIu64 " pings=%" PRIu64 " metrics=%" PRIu64 " switches=%" PRIu64 "\n",
+               NUM_WORKERS, clients, rx, pings, metrics, switches);
+    }
+    log_lane_percentiles();
+}
+
+// SIGUSR1: the merged profile as a profile, a profile_queues and one
+// profile_stage event per stage, then each worker's newest traces as trace
+// events, oldest first. JSON whatever --json says; main thread only.
+void log_profile(void) {
+#ifdef UDPMON_PROFILE
+    static prof_trace_t traces[PROFILE_DUMP_TRACES];
+    prof_t *ps[MAX_WORKERS];
+    char body[1024];
+    for (int i = 0; i < NUM_WORKERS; i++) ps[i] = &workers[i]->prof;
+
+    prof_format_counters(body, sizeof(body), ps, NUM_WORKERS);
+    log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"profile\",%s}\n",
+               time(NULL), body);
+    prof_format_queues(body, sizeof(body), ps, NUM_WORKERS);
+    log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"profile_queues\",%s}\n",
+               time(NULL), body);
+    for (int s = 0; s < PROF_STAGES; s++) {
+        prof_format_stage(body, sizeof(body), ps, NUM_WORKERS, s);
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"profile_stage\",\"stage\":\"%s\",%s}\n",
+                   time(NULL), prof_stage_name(s), body);
+    }
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        int n = prof_traces(ps[i], traces, PROFILE_DUMP_TRACES);
+        for (int k = 0; k < n; k++) {
+            prof_format_trace(body, sizeof(body), &traces[k]);
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"trace\",\"worker\":%d,%s}\n",
+                       time(NULL), i, body);
+        }
+    }
+#else
+    if (JSON_LOGGING) {
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"server\",\"event\":\"profile_unavailable\"}\n",
+                   time(NULL));
+    } else {
+        log_printf(LOG_CAT_GENERAL, "SERVER: built without -DUDPMON_PROFILE, no profile to dump\n");
+    }
+#endif
+}
+
+// One line per lane with the chaos profile in force. Main thread only, like
+// every write to CHAOS_CONFIG.
+void log_chaos_profiles(const char *event) {
+    const char *source = CHAOS_FILE ? CHAOS_FILE : "built-in";
+    for (int l = 0; l < 3; l++) {
+        char desc[512];
+        chaos_describe(&CHAOS_CONFIG.lane[l], desc, sizeof(desc));
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"%s\",\"lane\":%d,\"port\":%d,\"source\":\"%s\",\"profile\":%s}\n",
+                   time(NULL), event, l, lane_ports[l], source, desc);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: chaos lane%d(port=%d) from %s: %s\n",
+                   l, lane_ports[l], source, desc);
+        }
+    }
+}
+
+// SIGHUP: swap in the profiles from the --chaos file. A file that does not
+// load leaves the running profiles alone.
+void reload_chaos(void) {
+    chaos_config_t cfg;
+    char err[256];
+    if (!CHAOS_FILE)
+        snprintf(err, sizeof(err), "no --chaos file to reload");
+    if (!CHAOS_FILE || chaos_load(&cfg, CHAOS_FILE, err, sizeof(err)) < 0) {
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"WARN\",\"component\":\"server\",\"event\":\"chaos_reload_failed\",\"error\":\"%s\"}\n",
+                   time(NULL), err);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: chaos reload failed: %s\n", err);
+        }
+        return;
+    }
+    pthread_mutex_lock(&CHAOS_LOCK);
+    CHAOS_CONFIG = cfg;
+    pthread_mutex_unlock(&CHAOS_LOCK);
+    atomic_fetch_add_explicit(&CHAOS_GEN, 1, memory_order_release);
+    log_chaos_profiles("chaos_reload");
+}
+
+// "a.b.c.d:port" into addr. Returns 0 or -1.
+int parse_host_port(const char *s, struct sockaddr_in *addr) {
+    char host[64];
+    const char *colon = strrchr(s, ':');
+    if (!colon || (size_t)(colon - s) >= sizeof(host)) return -1;
+    memcpy(host, s, (size_t)(colon - s));
+    host[colon - s] = '\0';
+    int port = atoi(colon + 1);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port   = htons((uint16_t)port);
+    return port > 0 && port < 65536 && inet_pton(AF_INET, host, &addr->sin_addr) == 1 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int PORT = 5000;
+    int STATS_INTERVAL = 10;
+    int num_clients = 3;   // children spawned on the Green lane
+    log_config_t log_cfg = { .component = "server" };
+    lane_policy_defaults(&POLICY);
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--door") == 0 && i+1 < argc) {
@@ -90,19 +1838,195 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "--json") == 0) {
             JSON_LOGGING = 1;
         }
+        else if (strcmp(argv[i], "--workers") == 0 && i+1 < argc) {
+            NUM_WORKERS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i+1 < argc) {
+            RECORD_DIR = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record-segment-mb") == 0 && i+1 < argc) {
+            RECORD_SEGMENT_MB = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record-flush-ms") == 0 && i+1 < argc) {
+            RECORD_FLUSH_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stats-interval") == 0 && i+1 < argc) {
+            STATS_INTERVAL = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-clients") == 0 && i+1 < argc) {
+            MAX_CLIENTS = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--idle-timeout-ms") == 0 && i+1 < argc) {
+            IDLE_TIMEOUT_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--timestamps") == 0) {
+            TIMESTAMPS = 1;
+        }
+        else if (strcmp(argv[i], "--io-uring") == 0) {
+            IO_URING = 1;
+        }
+        else if (strcmp(argv[i], "--no-chaos") == 0) {
+            CHAOS = 0;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            SEED   = (uint64_t)strtoull(argv[++i], NULL, 10);
+            SEEDED = 1;
+        }
+        else if (strcmp(argv[i], "--chaos") == 0 && i+1 < argc) {
+            CHAOS_FILE = argv[++i];
+        }
+        else if (strcmp(argv[i], "--clients") == 0 && i+1 < argc) {
+            num_clients = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rtt-window") == 0 && i+1 < argc) {
+            RTT_WINDOW = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--hist-window-ms") == 0 && i+1 < argc) {
+            HIST_WINDOW_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--slow-pct") == 0 && i+1 < argc) {
+            POLICY.slow_pct = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--slow-ms") == 0 && i+1 < argc) {
+            POLICY.slow_ms = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--jitter-ms") == 0 && i+1 < argc) {
+            POLICY.jitter_ms = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--lane-engine") == 0 && i+1 < argc) {
+            const lane_engine_t *e = lane_engine_find(argv[++i]);
+            if (e)
+                POLICY.engine = e;
+            else
+                fprintf(stderr, "ignoring unknown --lane-engine '%s'\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--ewma-alpha") == 0 && i+1 < argc) {
+            POLICY.alpha = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hysteresis") == 0 && i+1 < argc) {
+            POLICY.hysteresis = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cooldown-ms") == 0 && i+1 < argc) {
+            POLICY.cooldown_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--control-rto-ms") == 0 && i+1 < argc) {
+            CONTROL_RTO_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--control-retries") == 0 && i+1 < argc) {
+            CONTROL_RETRIES = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rate-hint-ms") == 0 && i+1 < argc) {
+            RATE_HINT_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rate-hint-ttl-ms") == 0 && i+1 < argc) {
+            RATE_HINT_TTL_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--upstream") == 0 && i+1 < argc) {
+            if (parse_host_port(argv[++i], &UPSTREAM) < 0) {
+                fprintf(stderr, "--upstream: expected IPv4:PORT, got '%s'\n", argv[i]);
+                return 2;
+            }
+            UPSTREAM_SET = 1;
+        }
+        else if (strcmp(argv[i], "--relay-id") == 0 && i+1 < argc) {
+            RELAY_ID = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--summary-ms") == 0 && i+1 < argc) {
+            SUMMARY_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--profile-sample") == 0 && i+1 < argc) {
+            PROFILE_SAMPLE = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (!PROF_ENABLED)
+                fprintf(stderr, "--profile-sample: built without -DUDPMON_PROFILE, ignored\n");
+        }
+        else if (strcmp(argv[i], "--shm") == 0 && i+1 < argc) {
+            SHM_NAME = argv[++i];
+        }
+        else if (strcmp(argv[i], "--shm-interval-ms") == 0 && i+1 < argc) {
+            SHM_INTERVAL_MS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--log-file") == 0 && i+1 < argc) {
+            log_cfg.path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--log-sample") == 0 && i+1 < argc) {
+            if (log_set_sample(argv[++i]) < 0)
+                fprintf(stderr, "ignoring bad --log-sample '%s'\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--log-rate") == 0 && i+1 < argc) {
+            if (log_set_rate(argv[++i]) < 0)
+                fprintf(stderr, "ignoring bad --log-rate '%s'\n", argv[i]);
+        }
+    }
+    if (NUM_WORKERS < 1) NUM_WORKERS = 1;
+    if (NUM_WORKERS > MAX_WORKERS) NUM_WORKERS = MAX_WORKERS;
+    if (HIST_WINDOW_MS < 1) HIST_WINDOW_MS = 1;
+    if (RTT_WINDOW < 1) RTT_WINDOW = 1;
+    if (SHM_INTERVAL_MS < 1) SHM_INTERVAL_MS = 1;
+    if (POLICY.slow_pct < 0.0 || POLICY.slow_pct > 100.0) POLICY.slow_pct = 99.0;
+    if (POLICY.alpha <= 0.0 || POLICY.alpha > 1.0) POLICY.alpha = 0.2;
+    if (POLICY.hysteresis < 0.0) POLICY.hysteresis = 0.0;
+    if (POLICY.cooldown_ms > POLICY.max_cooldown_ms) POLICY.max_cooldown_ms = POLICY.cooldown_ms;
+    if (CONTROL_RTO_MS < 1) CONTROL_RTO_MS = 1;
+    if (CONTROL_RTO_MS > CONTROL_RTO_MAX_MS) CONTROL_RTO_MS = CONTROL_RTO_MAX_MS;
+    if (CONTROL_RETRIES < 0) CONTROL_RETRIES = 0;
+    if (CONTROL_RETRIES > 10) CONTROL_RETRIES = 10;   // up to ~40 s of resends already
+    if (RATE_HINT_MS < 0) RATE_HINT_MS = 0;
+    if (RATE_HINT_TTL_MS < 1) RATE_HINT_TTL_MS = 1;
+    if (RECORD_SEGMENT_MB < 1) RECORD_SEGMENT_MB = 1;
+    if (RECORD_FLUSH_MS < 1) RECORD_FLUSH_MS = 1;
+    if (SUMMARY_MS < 10) SUMMARY_MS = 10;
+    if (!RELAY_ID) RELAY_ID = (uint32_t)getpid();
+    // the door is the green lane; yellow and red sit 1000 and 2000 above it
+    lane_ports[LANE_GREEN]  = PORT;
+    lane_ports[LANE_YELLOW] = PORT + 1000;
+    lane_ports[LANE_RED]    = PORT + 2000;
+
+    // unseeded runs still log the seed they drew, so they can be repeated
+    if (!SEEDED) SEED = ((uint64_t)time(NULL) << 32) ^ get_now_ns() ^ (uint64_t)getpid();
+    chaos_defaults(&CHAOS_CONFIG);
+    if (CHAOS_FILE) {
+        char err[256];
+        if (chaos_load(&CHAOS_CONFIG, CHAOS_FILE, err, sizeof(err)) < 0) {
+            fprintf(stderr, "--chaos: %s\n", err);
+            return 1;
+        }
     }
+
+    log_cfg.json = JSON_LOGGING;
+    if (log_init(&log_cfg) < 0) {
+        perror("log_init");
+        return 1;
+    }
+    // flush queued log lines on the way out
+    signal(SIGINT,  on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    signal(SIGHUP,  on_reload_signal);
+    signal(SIGUSR1, on_profile_signal);
+
     if (JSON_LOGGING) {
-        printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"startup\",\"port\":%d,\"verbose\":%s}\n",
-               time(NULL), PORT, VERBOSE ? "true" : "false");
-        fflush(stdout);
+        log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"startup\",\"port\":%d,\"verbose\":%s,\"workers\":%d,\"lane_engine\":\"%s\",\"chaos\":\"%s\",\"seed\":%" PRIu64 ",\"profile\":%s}\n",
+               time(NULL), PORT, VERBOSE ? "true" : "false", NUM_WORKERS, POLICY.engine->name,
+               !CHAOS ? "off" : CHAOS_FILE ? CHAOS_FILE : "built-in", SEED,
+               PROF_ENABLED ? "true" : "false");
     } else {
-        printf("SERVER: listening on port %d%s\n",
-               PORT, VERBOSE ? " (verbose)" : "");
+        log_printf(LOG_CAT_GENERAL, "SERVER: listening on port %d%s, seed %" PRIu64 "\n",
+               PORT, VERBOSE ? " (verbose)" : "", SEED);
+    }
+    if (CHAOS) log_chaos_profiles("chaos_profile");
+    if (UPSTREAM_SET) {
+        char up[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &UPSTREAM.sin_addr, up, sizeof(up));
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"relay\",\"upstream\":\"%s:%d\",\"relay_id\":%u,\"summary_ms\":%d}\n",
+                   time(NULL), up, ntohs(UPSTREAM.sin_port), RELAY_ID, SUMMARY_MS);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: relay %u, summaries to %s:%d every %d ms\n",
+                   RELAY_ID, up, ntohs(UPSTREAM.sin_port), SUMMARY_MS);
+        }
     }
 
 
     // ——— Spawn clients on the Green lane ———
-    int num_clients = 3;  
     for (int i = 0; i < num_clients; i++) {
         pid_t pid = fork();
         if (pid == 0) {
@@ -121,225 +2045,154 @@ int main(int argc, char *argv[]) {
     }
 
 
-    // Create sockets for all three lanes
-    int lane_fds[3];
-    for (int i = 0; i < 3; i++) {
-        lane_fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
-        if (lane_fds[i] < 0) {
-            perror("socket");
+    // Create sockets for all three lanes, one set per worker
+    for (int wi = 0; wi < NUM_WORKERS; wi++) {
+        worker_t *w = calloc(1, sizeof(*w));
+        if (!w) {
+            perror("calloc");
             return 1;
         }
-
-        struct sockaddr_in addr;
-        memset(&addr, 0, sizeof(addr));
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        addr.sin_port = htons(lane_ports[i]);
-
-        if (bind(lane_fds[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-            perror("bind");
-            close(lane_fds[i]);
+        w->id        = wi;
+        chaos_rng_seed(&w->rng, SEED + (uint64_t)wi * 0x9e3779b97f4a7c15ull);
+        w->ep        = epoll_create1(0);
+        if (w->ep < 0) {
+            perror("epoll_create1");
             return 1;
         }
-        if (JSON_LOGGING) {
-            printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_ready\",\"port\":%d,\"lane\":%d}\n",
-                   time(NULL), lane_ports[i], i);
-            fflush(stdout);
-        } else {
-            printf("SERVER: listening on port %d (lane %d)\n", lane_ports[i], i);
+        if (client_table_init(&w->clients, MAX_CLIENTS, RTT_WINDOW) < 0) {
+            perror("client_table_init");
+            return 1;
         }
-    }
-
-    // lane_fds[LANE_GREEN] is used for sending control messages
-
-    char buf[2048];
-
-    srand((unsigned)time(NULL));
-
-    for (;;) {
-        // ─── 0) recv from any lane ─────────────────────────────────────────
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        int max_fd = 0;
-        for (int i = 0; i < 3; i++) {
-            FD_SET(lane_fds[i], &read_fds);
-            if (lane_fds[i] > max_fd) max_fd = lane_fds[i];
+        pthread_mutex_init(&w->snap_lock, NULL);
+        for (int lane = 0; lane < 3; lane++) {
+            hist_window_init(&w->lane_rtt[lane], (uint64_t)HIST_WINDOW_MS * 1000000ull, get_now_ns());
+            hist_window_init(&w->lane_jitter[lane], (uint64_t)HIST_WINDOW_MS * 1000000ull, get_now_ns());
         }
+        for (int i = 0; i < 3; i++) {
+            w->lane_fds[i] = open_lane_socket(i, NUM_WORKERS > 1);
+            if (w->lane_fds[i] < 0) return 1;
 
-        int activity = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        if (activity < 0) { perror("select"); continue; }
+            if (wi == 0 && NUM_WORKERS > 1
+                && attach_shard_steering(w->lane_fds[i], NUM_WORKERS) < 0) {
+                // without steering the kernel hashes the full 4-tuple, so a
+                // client may land on a different shard after a lane switch
+                perror("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+            }
 
-        // Check which socket has data
-        int active_fd = -1;
-        for (int i = 0; i < 3; i++) {
-            if (FD_ISSET(lane_fds[i], &read_fds)) {
-                active_fd = lane_fds[i];
-                break;
+            // edge-triggered: every wakeup is drained to EAGAIN
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.u32 = (uint32_t)i };
+            if (epoll_ctl(w->ep, EPOLL_CTL_ADD, w->lane_fds[i], &ev) < 0) {
+                perror("epoll_ctl");
+                return 1;
+            }
+            if (wi > 0) continue;
+            if (JSON_LOGGING) {
+                log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"lane_ready\",\"port\":%d,\"lane\":%d}\n",
+                       time(NULL), lane_ports[i], i);
+            } else {
+                log_printf(LOG_CAT_GENERAL, "SERVER: listening on port %d (lane %d)\n", lane_ports[i], i);
             }
         }
-        if (active_fd == -1) continue;
-
-        struct sockaddr_in peer;
-        socklen_t peerlen = sizeof(peer);
-        ssize_t n = recvfrom(active_fd, buf, BUFSZ, 0,
-                             (struct sockaddr *)&peer, &peerlen);
-        if (n < 0) { perror("recvfrom"); continue; }
-
-        // ─── 1) METRIC handling (must be first!) ─────────────
-        if (strncmp(buf, "METRIC", 6) == 0) {
-            int pid, loss;
-            double rtt, jitter;
-            sscanf(buf,
-                   "METRIC pid=%d rtt=%lf loss=%d jitter=%lf",
-                   &pid, &rtt, &loss, &jitter);
-
-            for (int i = 0; i < client_count; i++) {
-                client_t *c = &clients[i];
-                if (c->pid != pid) continue;
-
-                // update rolling RTT window
-                c->rtts[c->history_idx] = (rtt < 0 ? 0.0 : rtt);
-                if (c->rtt_count < 10) c->rtt_count++;
-                c->history_idx = (c->history_idx + 1) % 10;
-
-                // streaks
-                c->loss_streak = (loss > 0 ? c->loss_streak + 1 : 0);
-                c->slow_streak = (rtt > 100.0 ? c->slow_streak + 1 : 0);
-                // compute swing
-                double mn = c->rtts[0], mx = c->rtts[0];
-                for (int j = 1; j < c->rtt_count; j++) {
-                    if (c->rtts[j] < mn) mn = c->rtts[j];
-                    if (c->rtts[j] > mx) mx = c->rtts[j];
-                }
-                double swing = mx - mn;
-                c->jitter_streak = (swing > 20.0 ? c->jitter_streak + 1 : 0);
-
-                // decide new lane
-                int triggers = (c->loss_streak >= 3)
-                             + (c->slow_streak >= 3)
-                             + (c->jitter_streak >= 3);
-                int desired = triggers >= 2 ? LANE_RED
-                              : triggers == 1 ? LANE_YELLOW
-                                              : LANE_GREEN;
-
-                // 🔍 debug-print and structured logging
-                log_client_metrics(pid, rtt, loss, jitter, c->loss_streak, c->slow_streak, c->jitter_streak, c->current_lane);
-                
-                if (VERBOSE && !JSON_LOGGING) {
-                    printf("DBG[%d]: pid=%d L/S/J=(%d/%d/%d) → trg=%d want=%d\n",
-                           i, pid,
-                           c->loss_streak,
-                           c->slow_streak,
-                           c->jitter_streak,
-                           triggers,
-                           desired);
-                    fflush(stdout);
-                }
-
-                // send CONTROL if it’s time to switch
-                long now = get_now_ms();
-                if (desired != c->current_lane
-                    && now >= c->cooldown_until_ms) {
-                    int new_port = lane_ports[desired];
-                    char ctrl[64];
-                    int clen = snprintf(ctrl, sizeof(ctrl),
-                                        "CONTROL pid=%d port=%d",
-                                        pid, new_port);
-                    sendto(lane_fds[LANE_GREEN], ctrl, clen, 0,
-                           (struct sockaddr *)&c->addr,
-                           sizeof(c->addr));
-                    
-                    int old_lane = c->current_lane;
-                    c->current_lane      = desired;
-                    c->cooldown_until_ms = now + 10000;
-                    
-                    log_lane_switch(pid, old_lane, desired, new_port);
-                    
-                    if (VERBOSE && !JSON_LOGGING) {
-                        printf("SERVER: told pid=%d → lane%d(port=%d)\n",
-                               pid, desired, new_port);
-                        fflush(stdout);
-                    }
-                }
-                break;
+        w->up_fd = -1;
+        if (UPSTREAM_SET) {
+            w->up_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (w->up_fd < 0 || connect(w->up_fd, (struct sockaddr *)&UPSTREAM, sizeof(UPSTREAM)) < 0) {
+                perror("--upstream");
+                return 1;
             }
-            continue;  // done with this packet
-        }
-
-        // ─── 2) REGISTER handling ─────────────────────────────
-        if (strncmp(buf, "REGISTER", 8) == 0) {
-            int pid = atoi(strchr(buf, '=') + 1);
-            if (client_count < MAX_CLIENTS) {
-                client_t *c = &clients[client_count++];
-                *c = (client_t){
-                    .pid              = pid,
-                    .addr             = peer,
-                    .current_lane     = LANE_GREEN,
-                    .rtt_count        = 0,
-                    .history_idx      = 0,
-                    .loss_streak      = 0,
-                    .slow_streak      = 0,
-                    .jitter_streak    = 0,
-                    .cooldown_until_ms= 0
-                };
-                if (JSON_LOGGING) {
-                    printf("{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"client_registered\",\"pid\":%d,\"client_index\":%d}\n",
-                           time(NULL), pid, client_count-1);
-                    fflush(stdout);
-                } else {
-                    printf("SERVER: registered pid=%d as client[%d]\n",
-                           pid, client_count-1);
-                }
-                fflush(stdout);
+            relay_enc_init(&w->up_enc, RELAY_ID, (uint8_t)wi, up_queue, w);
+        }
+        if (RECORD_DIR) {
+            w->rec = malloc(sizeof(*w->rec));
+            if (!w->rec || mf_writer_open(w->rec, RECORD_DIR, (uint32_t)wi,
+                                          (size_t)RECORD_SEGMENT_MB << 20) < 0) {
+                perror(RECORD_DIR);
+                return 1;
+            }
+            if (wi == 0 && JSON_LOGGING) {
+                log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"recording\",\"dir\":\"%s\",\"segment_mb\":%d,\"flush_ms\":%d}\n",
+                       time(NULL), RECORD_DIR, RECORD_SEGMENT_MB, RECORD_FLUSH_MS);
+            } else if (wi == 0) {
+                log_printf(LOG_CAT_GENERAL, "SERVER: recording METRICs to %s\n", RECORD_DIR);
             }
-            continue;
         }
+#ifdef UDPMON_PROFILE
+        prof_init(&w->prof, w->lane_fds, PROFILE_SAMPLE);
+#endif
+        workers[wi] = w;
+    }
 
-        // ─── 3) Chaos injection (only for PINGs) ─────────────
+    if (SHM_NAME) {
+        // one record per slab slot a worker can hand out
+        size_t slots = MAX_CLIENTS ? MAX_CLIENTS : 65536;
+        slots = (slots + CLIENT_SLAB_SIZE - 1) / CLIENT_SLAB_SIZE * CLIENT_SLAB_SIZE;
+        uint32_t ports[3] = { (uint32_t)lane_ports[0], (uint32_t)lane_ports[1], (uint32_t)lane_ports[2] };
+        if (shm_table_create(&SHM, SHM_NAME, (uint32_t)NUM_WORKERS, (uint32_t)slots,
+                             ports, get_now_ns()) < 0) {
+            perror("shm_table_create");
+            return 1;
+        }
+        if (JSON_LOGGING) {
+            log_printf(LOG_CAT_GENERAL, "{\"timestamp\":\"%ld\",\"level\":\"INFO\",\"component\":\"server\",\"event\":\"shm_export\",\"name\":\"%s\",\"bytes\":%zu,\"interval_ms\":%d}\n",
+                   time(NULL), SHM.name, SHM.size, SHM_INTERVAL_MS);
+        } else {
+            log_printf(LOG_CAT_GENERAL, "SERVER: exporting state to /dev/shm%s every %d ms\n",
+                   SHM.name, SHM_INTERVAL_MS);
+        }
+    }
 
-        if ( strncmp(buf, "PING", 4 ) == 0 )
-        {
-            if (rand() % 100 < 20) {
-                if (JSON_LOGGING) {
-                    printf("{\"timestamp\":\"%ld\",\"level\":\"DEBUG\",\"component\":\"server\",\"event\":\"chaos\",\"action\":\"drop\"}\n", time(NULL));
-                    fflush(stdout);
-                } else if (VERBOSE) {
-                    printf("SERVER: dropping for chaos\n"); 
-                    fflush(stdout);
-                }
-                continue;
+    // workers inherit a mask with the stop, reload and dump signals blocked,
+    // so SIGINT/SIGTERM/SIGHUP/SIGUSR1 always interrupt the main thread's
+    // sleep below
+    sigset_t stop_set, old_set;
+    sigemptyset(&stop_set);
+    sigaddset(&stop_set, SIGINT);
+    sigaddset(&stop_set, SIGTERM);
+    sigaddset(&stop_set, SIGHUP);
+    sigaddset(&stop_set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &stop_set, &old_set);
+    for (int wi = 0; wi < NUM_WORKERS; wi++) {
+        int err = pthread_create(&workers[wi]->thread, NULL, worker_main, workers[wi]);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            return 1;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+    // The main thread only merges and reports stats, reloads chaos profiles
+    // and dumps the profile from here on.
+    unsigned period = STATS_INTERVAL > 0 ? (unsigned)STATS_INTERVAL : 10;
+    while (!STOP) {
+        unsigned left = period;
+        while (left > 0 && !STOP) {
+            left = sleep(left);
+            if (CHAOS_RELOAD) {
+                CHAOS_RELOAD = 0;
+                reload_chaos();
             }
-            int chaos_ms = rand() % 150;
-            if (chaos_ms) {
-                if (JSON_LOGGING) {
-                    printf("{\"timestamp\":\"%ld\",\"level\":\"DEBUG\",\"component\":\"server\",\"event\":\"chaos\",\"action\":\"delay\",\"delay_ms\":%d}\n", time(NULL), chaos_ms);
-                    fflush(stdout);
-                } else if (VERBOSE) {
-                    printf("SERVER: delaying %dms chaos\n", chaos_ms); 
-                    fflush(stdout);
-                }
-                usleep(chaos_ms * 1000);
+            if (PROFILE_DUMP) {
+                PROFILE_DUMP = 0;
+                log_profile();
             }
-
-            // ─── 4) Echo the PING ─────────────────────────────────
-            ssize_t m = sendto(active_fd, buf, (size_t)n, 0,
-                            (struct sockaddr *)&peer, peerlen);
-            if (m < 0) { perror("sendto"); continue; }
         }
-        // ─── 4) Verbose echo log ─────────────────────────────
-        if (VERBOSE) {
-            char ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
-            if (JSON_LOGGING) {
-                printf("{\"timestamp\":\"%ld\",\"level\":\"DEBUG\",\"component\":\"server\",\"event\":\"echo\",\"bytes\":%zd,\"client_ip\": \"%s\",\"client_port\":%d}\n",
-                       time(NULL), n, ip, ntohs(peer.sin_port));
-                fflush(stdout);
-            } else {
-                printf("echoed %zd bytes to %s:%d\n",
-                       n, ip, ntohs(peer.sin_port));
-                fflush(stdout);
+        if (STOP) break;
+        if (STATS_INTERVAL > 0 && (VERBOSE || JSON_LOGGING || NUM_WORKERS > 1))
+            log_merged_stats();
+    }
+    // each worker closes its segment at its next flush
+    if (RECORD_DIR) {
+        atomic_store_explicit(&RECORD_STOP, 1, memory_order_release);
+        for (int wi = 0; wi < NUM_WORKERS; wi++) {
+            for (int waited = 0; waited < RECORD_FLUSH_MS + 1000; waited += 10) {
+                if (atomic_load_explicit(&workers[wi]->rec_closed, memory_order_acquire)) break;
+                usleep(10000);
             }
         }
     }
-
+    // workers may still be writing, so only the name goes away
+    if (SHM.base) shm_unlink(SHM.name);
+    log_shutdown();
+    return 0;
 }
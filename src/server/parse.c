@@ -0,0 +1,96 @@
+// parse.c
+// Text and binary message decoding (see parse.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/wire.h"
+#include "parse.h"
+
+static msg_kind_t parse_binary(const char *buf, size_t n, msg_t *m) {
+    const wire_hdr_t *h = wire_view(buf, n);
+    if (!h) return MSG_MALFORMED;
+    m->binary = 1;
+    m->pid    = (pid_t)le32toh(h->pid);
+
+    switch (h->type) {
+        case WIRE_METRIC: {
+            const wire_metric_t *w = (const wire_metric_t *)h;
+            m->rtt    = le32toh(w->rtt_us) / 1000.0;
+            m->loss   = (int)le32toh(w->loss);
+            m->jitter = le32toh(w->jitter_us) / 1000.0;
+            return MSG_METRIC;
+        }
+        case WIRE_REGISTER:
+            m->proto = WIRE_VERSION;
+            return MSG_REGISTER;
+        case WIRE_PING:
+            return MSG_PING;
+        case WIRE_LANE_PROBE:
+            return MSG_LANE_PROBE;
+        case WIRE_LANE_METRIC: {
+            const wire_lane_metric_t *w = (const wire_lane_metric_t *)h;
+            m->rtt    = le32toh(w->rtt_us) / 1000.0;
+            m->loss   = (int)le32toh(w->loss);
+            m->jitter = le32toh(w->jitter_us) / 1000.0;
+            m->lane   = le16toh(w->lane);
+            return m->lane < WIRE_LANES ? MSG_LANE_METRIC : MSG_MALFORMED;
+        }
+        case WIRE_CONTROL_ACK:
+            m->seq = le32toh(h->seq);
+            return MSG_CONTROL_ACK;
+        case WIRE_SUMMARY:
+            m->seq = le32toh(h->seq);
+            return MSG_SUMMARY;
+        default:
+            return MSG_MALFORMED;
+    }
+}
+
+static msg_kind_t parse_text(const char *buf, msg_t *m) {
+    // ─── 1) METRIC (must be first!) ──────────────────────
+    if (strncmp(buf, "METRIC", 6) == 0) {
+        int pid;
+        if (sscanf(buf,
+                   "METRIC pid=%d rtt=%lf loss=%d jitter=%lf",
+                   &pid, &m->rtt, &m->loss, &m->jitter) != 4)
+            return MSG_MALFORMED;
+        m->pid = pid;
+        return MSG_METRIC;
+    }
+
+    // ─── 2) REGISTER ─────────────────────────────────────
+    if (strncmp(buf, "REGISTER", 8) == 0) {
+        const char *eq = strchr(buf, '=');
+        if (!eq) return MSG_MALFORMED;
+        const char *proto = strstr(buf, "proto=");
+        m->pid   = atoi(eq + 1);
+        m->proto = proto ? atoi(proto + 6) : 0;
+        return MSG_REGISTER;
+    }
+
+    // ─── 3) PING ─────────────────────────────────────────
+    if (strncmp(buf, "PING", 4) == 0) return MSG_PING;
+
+    // ─── 4) CONTROL_ACK ──────────────────────────────────
+    if (strncmp(buf, "CONTROL_ACK", 11) == 0) {
+        int pid;
+        unsigned seq;
+        if (sscanf(buf, "CONTROL_ACK pid=%d seq=%u", &pid, &seq) != 2)
+            return MSG_MALFORMED;
+        m->pid = pid;
+        m->seq = seq;
+        return MSG_CONTROL_ACK;
+    }
+
+    // ─── 5) STATS ────────────────────────────────────────
+    if (strncmp(buf, "STATS", 5) == 0) return MSG_STATS;
+    return MSG_MALFORMED;
+}
+
+msg_kind_t msg_parse(const char *buf, size_t n, msg_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->kind = wire_is_binary(buf, n) ? parse_binary(buf, n, m) : parse_text(buf, m);
+    return m->kind;
+}
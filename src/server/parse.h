@@ -0,0 +1,40 @@
+// parse.h
+// Decoding of incoming datagrams, text or binary, into one message struct.
+// Kept apart from the handlers so the parsers can be benchmarked alone.
+
+#ifndef UDPMON_PARSE_H
+#define UDPMON_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef enum {
+    MSG_MALFORMED = 0,
+    MSG_METRIC,
+    MSG_REGISTER,
+    MSG_PING,
+    MSG_LANE_PROBE,     // binary only
+    MSG_LANE_METRIC,    // binary only
+    MSG_CONTROL_ACK,
+    MSG_SUMMARY,        // binary only, from a relay (relay.h)
+    MSG_STATS           // text only: a request for the server's profile (profile.h)
+} msg_kind_t;
+
+typedef struct {
+    msg_kind_t kind;
+    int    binary;      // arrived in wire.h framing
+    pid_t  pid;         // METRIC, REGISTER; binary PING; SUMMARY: relay id
+    int    proto;       // REGISTER: WIRE_VERSION if binary framing was asked for
+    double rtt;         // METRIC and LANE_METRIC, ms
+    double jitter;      // METRIC and LANE_METRIC, ms
+    int    loss;        // METRIC and LANE_METRIC
+    int    lane;        // LANE_METRIC
+    uint32_t seq;       // CONTROL_ACK: seq of the CONTROL acknowledged; SUMMARY: summary number
+} msg_t;
+
+// buf must be NUL-terminated (text) and 8-byte aligned (binary), as the
+// server's receive slots are. Returns m->kind.
+msg_kind_t msg_parse(const char *buf, size_t n, msg_t *m);
+
+#endif
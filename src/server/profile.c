@@ -0,0 +1,247 @@
+// profile.c
+// Stage timers, counters and the sampled trace ring (see profile.h).
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+
+#include "common/shm_table.h"
+#include "profile.h"
+
+static const char *const STAGE_NAMES[PROF_STAGES] = {
+    "wait", "timers", "recv", "parse", "handle", "decide", "chaos", "record", "send"
+};
+static const char *const SYSCALL_NAMES[PROF_SYSCALLS] = {
+    "epoll_wait", "recvmmsg", "sendmmsg", "sendto", "io_uring_enter"
+};
+static const char *const QUEUE_NAMES[PROF_QUEUES] = {
+    "rx_batch", "tx_batch", "timers"
+};
+static const char *const KIND_NAMES[PROF_MSG_KINDS] = {
+    "malformed", "metric", "register", "ping", "lane_probe", "lane_metric",
+    "control_ack", "summary", "stats"
+};
+
+const char *prof_kind_name(int kind) {
+    return kind >= 0 && kind < PROF_MSG_KINDS ? KIND_NAMES[kind] : "?";
+}
+
+const char *prof_stage_name(int s) {
+    return s >= 0 && s < PROF_STAGES ? STAGE_NAMES[s] : "?";
+}
+
+void prof_init(prof_t *p, const int lane_fds[3], uint32_t sample_every) {
+    memset(p, 0, sizeof(*p));
+    memcpy(p->lane_fds, lane_fds, sizeof(p->lane_fds));
+    p->sample_every = sample_every;
+    p->countdown    = sample_every;
+}
+
+uint64_t prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ——— Recording ———
+
+uint64_t prof_stage(prof_t *p, prof_stage_id_t s, uint64_t t0) {
+    uint64_t now = prof_now(), d = now - t0;
+    prof_stage_t *st = &p->stage[s];
+    prof_count(&st->count, 1);
+    prof_count(&st->ns, d);
+    if (d > atomic_load_explicit(&st->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&st->max_ns, d, memory_order_relaxed);
+    int b = d ? 64 - __builtin_clzll(d) : 0;
+    prof_count(&st->buckets[b < PROF_BUCKETS ? b : PROF_BUCKETS - 1], 1);
+
+    // a batch arrives when the wait for it, or its recvmmsg(), returns
+    if (s == PROF_WAIT || s == PROF_RECV) p->batch_ns = now;
+    if (s == PROF_RECV) p->recv_ns = (uint32_t)d;
+    // the traced packet's own stages, then only its batch's send
+    if (p->tracing) {
+        p->open->ns[s] += (uint32_t)d;
+        if (s == PROF_HANDLE) p->tracing = 0;
+    } else if (p->open && s == PROF_SEND) {
+        p->open->ns[s] += (uint32_t)d;
+    }
+    return now;
+}
+
+void prof_depth(prof_t *p, prof_queue_id_t q, uint64_t n) {
+    prof_queue_t *pq = &p->queue[q];
+    prof_count(&pq->samples, 1);
+    prof_count(&pq->sum, n);
+    if (n > atomic_load_explicit(&pq->max, memory_order_relaxed))
+        atomic_store_explicit(&pq->max, n, memory_order_relaxed);
+}
+
+void prof_trace_begin(prof_t *p, int lane, int i, uint64_t ts_ns) {
+    if (!p->sample_every || p->open || --p->countdown) return;
+    p->countdown = p->sample_every;
+
+    uint64_t n = atomic_load_explicit(&p->traces, memory_order_relaxed);
+    prof_trace_t *t = &p->ring[n % PROF_TRACE_SLOTS];
+    shm_write_begin(&t->seq);
+    t->lane      = (uint8_t)lane;
+    t->kind      = MSG_MALFORMED;
+    t->batch     = (uint16_t)i;
+    t->ts_ns     = ts_ns;
+    t->queued_ns = (uint32_t)(prof_now() - p->batch_ns);
+    t->total_ns  = 0;
+    memset(t->ns, 0, sizeof(t->ns));
+    t->ns[PROF_RECV] = p->recv_ns;
+    p->open    = t;
+    p->tracing = 1;
+}
+
+void prof_trace_close(prof_t *p) {
+    if (!p->open) return;
+    p->open->total_ns = (uint32_t)(prof_now() - p->batch_ns);
+    shm_write_end(&p->open->seq);
+    atomic_store_explicit(&p->traces,
+                          atomic_load_explicit(&p->traces, memory_order_relaxed) + 1,
+                          memory_order_release);
+    p->open    = NULL;
+    p->tracing = 0;
+}
+
+// ——— Reporting ———
+
+static uint64_t load(const _Atomic uint64_t *v) {
+    return atomic_load_explicit(v, memory_order_relaxed);
+}
+
+// Append to buf like snprintf, keeping *len the length wanted so far.
+static void put(char *buf, size_t cap, size_t *len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int k = vsnprintf(*len < cap ? buf + *len : NULL, *len < cap ? cap - *len : 0, fmt, ap);
+    va_end(ap);
+    if (k > 0) *len += (size_t)k;
+}
+
+// Upper bound of the bucket holding the q-quantile, never above max.
+static uint64_t bucket_pct(const uint64_t *buckets, uint64_t count, uint64_t max, double q) {
+    uint64_t want = (uint64_t)((double)count * q + 0.5), seen = 0;
+    if (!want) want = 1;
+    for (int b = 0; b < PROF_BUCKETS - 1; b++) {
+        seen += buckets[b];
+        if (seen >= want) return (1ull << b) < max ? (1ull << b) : max;
+    }
+    return max;
+}
+
+size_t prof_format_counters(char *buf, size_t cap, prof_t *const *ps, int n) {
+    size_t len = 0;
+    if (cap) buf[0] = '\0';
+    uint64_t traces = 0;
+    for (int i = 0; i < n; i++) traces += atomic_load_explicit(&ps[i]->traces, memory_order_acquire);
+    put(buf, cap, &len, "\"workers\":%d,\"traces\":%" PRIu64 ",\"syscalls\":{", n, traces);
+    for (int s = 0; s < PROF_SYSCALLS; s++) {
+        uint64_t v = 0;
+        for (int i = 0; i < n; i++) v += load(&ps[i]->syscalls[s]);
+        put(buf, cap, &len, "%s\"%s\":%" PRIu64, s ? "," : "", SYSCALL_NAMES[s], v);
+    }
+    put(buf, cap, &len, "},\"packets\":{");
+    for (int k = 0; k < PROF_MSG_KINDS; k++) {
+        uint64_t v = 0;
+        for (int i = 0; i < n; i++) v += load(&ps[i]->msgs[k]);
+        put(buf, cap, &len, "%s\"%s\":%" PRIu64, k ? "," : "", KIND_NAMES[k], v);
+    }
+    put(buf, cap, &len, "}");
+    return len;
+}
+
+size_t prof_format_queues(char *buf, size_t cap, prof_t *const *ps, int n) {
+    size_t len = 0;
+    if (cap) buf[0] = '\0';
+    put(buf, cap, &len, "\"queues\":{");
+    for (int q = 0; q < PROF_QUEUES; q++) {
+        uint64_t samples = 0, sum = 0, max = 0;
+        for (int i = 0; i < n; i++) {
+            const prof_queue_t *pq = &ps[i]->queue[q];
+            samples += load(&pq->samples);
+            sum     += load(&pq->sum);
+            if (load(&pq->max) > max) max = load(&pq->max);
+        }
+        put(buf, cap, &len, "%s\"%s\":{\"samples\":%" PRIu64 ",\"avg\":%.2f,\"max\":%" PRIu64 "}",
+            q ? "," : "", QUEUE_NAMES[q], samples,
+            samples ? (double)sum / (double)samples : 0.0, max);
+    }
+
+    // what the kernel holds for each lane right now, and what it dropped
+    // for want of receive buffer since the sockets opened
+    put(buf, cap, &len, "},\"sockets\":[");
+    for (int lane = 0; lane < 3; lane++) {
+        uint64_t queued = 0, drops = 0, rcvbuf = 0;
+        for (int i = 0; i < n; i++) {
+            uint32_t mem[SK_MEMINFO_VARS];
+            socklen_t ml = sizeof(mem);
+            if (getsockopt(ps[i]->lane_fds[lane], SOL_SOCKET, SO_MEMINFO, mem, &ml) < 0) continue;
+            queued += mem[SK_MEMINFO_RMEM_ALLOC];
+            drops  += mem[SK_MEMINFO_DROPS];
+            rcvbuf += mem[SK_MEMINFO_RCVBUF];
+        }
+        put(buf, cap, &len, "%s{\"lane\":%d,\"queued_bytes\":%" PRIu64 ",\"rcvbuf\":%" PRIu64 ",\"drops\":%" PRIu64 "}",
+            lane ? "," : "", lane, queued, rcvbuf, drops);
+    }
+    put(buf, cap, &len, "]");
+    return len;
+}
+
+size_t prof_format_stage(char *buf, size_t cap, prof_t *const *ps, int n, int s) {
+    size_t len = 0;
+    if (cap) buf[0] = '\0';
+    uint64_t count = 0, ns = 0, max = 0, buckets[PROF_BUCKETS] = {0};
+    for (int i = 0; i < n; i++) {
+        const prof_stage_t *st = &ps[i]->stage[s];
+        count += load(&st->count);
+        ns    += load(&st->ns);
+        if (load(&st->max_ns) > max) max = load(&st->max_ns);
+        for (int b = 0; b < PROF_BUCKETS; b++) buckets[b] += load(&st->buckets[b]);
+    }
+    put(buf, cap, &len, "\"count\":%" PRIu64 ",\"ns\":%" PRIu64 ",\"avg_ns\":%" PRIu64 ",\"p50_ns\":%" PRIu64 ",\"p99_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64,
+        count, ns, count ? ns / count : 0,
+        count ? bucket_pct(buckets, count, max, 0.50) : 0,
+        count ? bucket_pct(buckets, count, max, 0.99) : 0, max);
+    return len;
+}
+
+size_t prof_format_all(char *buf, size_t cap, prof_t *const *ps, int n) {
+    size_t len = prof_format_counters(buf, cap, ps, n);
+    put(buf, cap, &len, ",");
+    len += prof_format_queues(len < cap ? buf + len : NULL, len < cap ? cap - len : 0, ps, n);
+    put(buf, cap, &len, ",\"stages\":{");
+    for (int s = 0; s < PROF_STAGES; s++) {
+        put(buf, cap, &len, "%s\"%s\":{", s ? "," : "", STAGE_NAMES[s]);
+        len += prof_format_stage(len < cap ? buf + len : NULL, len < cap ? cap - len : 0, ps, n, s);
+        put(buf, cap, &len, "}");
+    }
+    put(buf, cap, &len, "}");
+    return len;
+}
+
+int prof_traces(const prof_t *p, prof_trace_t *out, int max) {
+    uint64_t end = atomic_load_explicit(&p->traces, memory_order_acquire);
+    uint64_t begin = end > PROF_TRACE_SLOTS ? end - PROF_TRACE_SLOTS : 0;
+    if (end - begin > (uint64_t)max) begin = end - (uint64_t)max;
+    int k = 0;
+    for (uint64_t i = begin; i < end; i++)
+        if (shm_read(&p->ring[i % PROF_TRACE_SLOTS], &out[k], sizeof(out[k])) == 0) k++;
+    return k;
+}
+
+size_t prof_format_trace(char *buf, size_t cap, const prof_trace_t *t) {
+    size_t len = 0;
+    if (cap) buf[0] = '\0';
+    put(buf, cap, &len, "\"ts_ns\":%" PRIu64 ",\"lane\":%u,\"kind\":\"%s\",\"batch\":%u,\"queued_ns\":%u,\"total_ns\":%u",
+        t->ts_ns, t->lane, prof_kind_name(t->kind), t->batch, t->queued_ns, t->total_ns);
+    for (int s = PROF_RECV; s < PROF_STAGES; s++)
+        put(buf, cap, &len, ",\"%s_ns\":%u", STAGE_NAMES[s], t->ns[s]);
+    return len;
+}
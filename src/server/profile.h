@@ -0,0 +1,169 @@
+// profile.h
+// Self-profiling of the server's packet loop, compiled in with
+// -DUDPMON_PROFILE. Without it every PROF_* macro below expands to nothing
+// and worker_t carries no prof_t, so a normal build pays nothing.
+//
+// Each worker times the stages of its loop on CLOCK_MONOTONIC (a vDSO read,
+// no syscall): per stage the count, the total and the longest, and a
+// power-of-two histogram of the nanoseconds each pass took. It also counts
+// its syscalls, the datagrams of each message kind, and how full its
+// receive and send batches and its timer heap run. Like worker_stats_t,
+// everything is a relaxed atomic written only by its worker, so the main
+// thread and the STATS handler on another worker read it live.
+//
+// One packet in every sample_every also gets a trace: what each stage took
+// for that packet, how long it waited behind the rest of its batch, and the
+// whole time from recvmmsg() returning to its reply batch being sent. Traces
+// go to a ring of PROF_TRACE_SLOTS per worker whose slots are seqlocked like
+// the shm export's records, so a reader copies them while the worker keeps
+// overwriting the oldest.
+
+#ifndef UDPMON_PROFILE_H
+#define UDPMON_PROFILE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parse.h"
+
+typedef enum {
+    PROF_WAIT = 0,     // blocked in epoll_wait() / io_uring_enter()
+    PROF_TIMERS,       // due timers: parked echoes, CONTROL resends, flushes, summaries
+    PROF_RECV,         // recvmmsg() (the io_uring backend has no such stage)
+    PROF_PARSE,        // msg_parse()
+    PROF_HANDLE,       // the message's handler, the three below included
+    PROF_DECIDE,       // lane_observe()
+    PROF_CHAOS,        // chaos_decide()
+    PROF_RECORD,       // appending a sample to the --record segment
+    PROF_SEND,         // sendmmsg() of a reply batch
+    PROF_STAGES
+} prof_stage_id_t;
+
+typedef enum {
+    PROF_SYS_EPOLL_WAIT = 0,
+    PROF_SYS_RECVMMSG,
+    PROF_SYS_SENDMMSG,
+    PROF_SYS_SENDTO,         // sendto()/sendmsg() of a single datagram
+    PROF_SYS_URING_ENTER,
+    PROF_SYSCALLS
+} prof_syscall_id_t;
+
+typedef enum {
+    PROF_Q_RX_BATCH = 0,     // datagrams per recvmmsg() / completion pass
+    PROF_Q_TX_BATCH,         // replies per sendmmsg()
+    PROF_Q_TIMERS,           // timer heap length at each wakeup
+    PROF_QUEUES
+} prof_queue_id_t;
+
+#define PROF_BUCKETS      32     // bucket b: [2^(b-1), 2^b) ns; the last one open-ended
+#define PROF_TRACE_SLOTS  256    // per worker
+#define PROF_MSG_KINDS    (MSG_STATS + 1)
+
+typedef struct {
+    _Atomic uint64_t count, ns, max_ns;
+    _Atomic uint64_t buckets[PROF_BUCKETS];
+} prof_stage_t;
+
+typedef struct {
+    _Atomic uint64_t samples, sum, max;
+} prof_queue_t;
+
+typedef struct {
+    _Atomic uint32_t seq;          // odd while the worker writes the slot
+    uint8_t  lane, kind;           // kind: msg_kind_t
+    uint16_t batch;                // the packet's place in its receive batch
+    uint64_t ts_ns;                // CLOCK_REALTIME arrival
+    uint32_t queued_ns;            // from the batch's arrival to this packet's turn
+    uint32_t total_ns;             // from the batch's arrival to its replies sent
+    uint32_t ns[PROF_STAGES];      // per stage; recv and send are the batch's
+} prof_trace_t;
+
+typedef struct {
+    prof_stage_t     stage[PROF_STAGES];
+    _Atomic uint64_t syscalls[PROF_SYSCALLS];
+    _Atomic uint64_t msgs[PROF_MSG_KINDS];
+    prof_queue_t     queue[PROF_QUEUES];
+    int              lane_fds[3];  // for prof_format_queues()
+
+    // worker-only state
+    uint64_t      batch_ns;        // when the current batch arrived
+    uint32_t      recv_ns;         // what its recvmmsg() took
+    uint32_t      sample_every, countdown;
+    prof_trace_t *open;            // trace being filled, NULL if none
+    int           tracing;         // open's packet is being handled
+
+    _Atomic uint64_t traces;       // traces completed; the newest is traces - 1
+    prof_trace_t     ring[PROF_TRACE_SLOTS];
+} prof_t;
+
+// sample_every 0 takes no traces.
+void     prof_init(prof_t *p, const int lane_fds[3], uint32_t sample_every);
+uint64_t prof_now(void);
+// Account stage s as having run from t0 until now. Returns now.
+uint64_t prof_stage(prof_t *p, prof_stage_id_t s, uint64_t t0);
+void     prof_depth(prof_t *p, prof_queue_id_t q, uint64_t n);
+// Start a trace for the packet at batch position i if it is due for one.
+void     prof_trace_begin(prof_t *p, int lane, int i, uint64_t ts_ns);
+// Finish the open trace, if any, once its batch's replies are out.
+void     prof_trace_close(prof_t *p);
+
+static inline void prof_count(_Atomic uint64_t *c, uint64_t n) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static inline void prof_msg(prof_t *p, msg_kind_t kind) {
+    prof_count(&p->msgs[kind], 1);
+    if (p->tracing) p->open->kind = (uint8_t)kind;
+}
+
+// Reports merge n workers. Each writes the members of a JSON object (no
+// braces) and returns the length it wanted, like snprintf.
+// Syscalls and datagrams per message kind.
+size_t prof_format_counters(char *buf, size_t cap, prof_t *const *ps, int n);
+// Batch and timer heap fill, and the lane sockets' receive queues and drops.
+size_t prof_format_queues(char *buf, size_t cap, prof_t *const *ps, int n);
+// Stage s: count, total, average, p50/p99 (bucket bounds) and max.
+size_t prof_format_stage(char *buf, size_t cap, prof_t *const *ps, int n, int s);
+// All three, the stages as a "stages" object keyed by name.
+size_t prof_format_all(char *buf, size_t cap, prof_t *const *ps, int n);
+// Copy up to max of p's traces, oldest first, skipping any being written.
+// Returns how many were copied.
+int    prof_traces(const prof_t *p, prof_trace_t *out, int max);
+// One trace as the members of a JSON object.
+size_t prof_format_trace(char *buf, size_t cap, const prof_trace_t *t);
+
+const char *prof_kind_name(int kind);
+const char *prof_stage_name(int s);
+
+// ——— Hooks ———
+// t is a uint64_t the caller declares with PROF_T0; PROF_STAGE moves it to
+// now, so back-to-back stages share one clock read. PROF_COUNTER is a
+// syscall counter to bump later, from code that has no worker at hand, or
+// NULL.
+#ifdef UDPMON_PROFILE
+#define PROF_ENABLED              1
+#define PROF_T0(t)                uint64_t t = prof_now()
+#define PROF_STAGE(w, s, t)       ((t) = prof_stage(&(w)->prof, (s), (t)))
+#define PROF_SYSCALL(w, s)        prof_count(&(w)->prof.syscalls[s], 1)
+#define PROF_SYSCALLS(w, s, n)    prof_count(&(w)->prof.syscalls[s], (n))
+#define PROF_MSG(w, kind)         prof_msg(&(w)->prof, (kind))
+#define PROF_DEPTH(w, q, n)       prof_depth(&(w)->prof, (q), (n))
+#define PROF_TRACE_BEGIN(w, lane, i, ts) prof_trace_begin(&(w)->prof, (lane), (i), (ts))
+#define PROF_TRACE_CLOSE(w)       prof_trace_close(&(w)->prof)
+#define PROF_COUNTER(w, s)        (&(w)->prof.syscalls[s])
+#else
+#define PROF_ENABLED              0
+#define PROF_T0(t)                ((void)0)
+#define PROF_STAGE(w, s, t)       ((void)0)
+#define PROF_SYSCALL(w, s)        ((void)0)
+#define PROF_SYSCALLS(w, s, n)    ((void)(n))
+#define PROF_MSG(w, kind)         ((void)0)
+#define PROF_DEPTH(w, q, n)       ((void)0)
+#define PROF_TRACE_BEGIN(w, lane, i, ts) ((void)0)
+#define PROF_TRACE_CLOSE(w)       ((void)0)
+#define PROF_COUNTER(w, s)        NULL
+#endif
+
+#endif
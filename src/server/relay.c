@@ -0,0 +1,243 @@
+// relay.c
+// Relay summary encoding and decoding, and the source table (see relay.h).
+
+#include <errno.h>
+#include <string.h>
+
+#include "common/varint.h"
+#include "relay.h"
+
+enum { REC_LANE = 1, REC_HIST = 2, REC_CLIENT = 3 };
+
+// Most a record can take: a tag, a lane and five 64-bit or 32-bit varints
+// for lanes and clients; a histogram's header is a tag, lane, max and
+// count, and each bucket a gap and a count.
+#define REC_MAX       (1 + 1 + 5 * VARINT_MAX)
+#define HIST_HDR_MAX  (1 + 1 + VARINT_MAX + 5)
+#define HIST_PAIR_MAX (5 + 5)
+
+// ——— Encoding ———
+
+static void part_begin(relay_enc_t *e) {
+    e->len      = sizeof(wire_summary_t);
+    e->prev_pid = 0;
+}
+
+static void part_send(relay_enc_t *e, int last) {
+    wire_summary_t *s = (wire_summary_t *)e->buf;
+    wire_hdr_init(&s->h, WIRE_SUMMARY, e->relay_id, e->seq, e->ts_ns);
+    s->part     = htole16(e->part);
+    s->last     = (uint8_t)last;
+    s->source   = e->source;
+    s->body_len = htole32((uint32_t)(e->len - sizeof(*s)));
+    e->send(e->buf, e->len, e->arg);
+    e->part++;
+    part_begin(e);
+}
+
+// Make room for need more bytes, sending what is there if it is too full.
+static void reserve(relay_enc_t *e, size_t need) {
+    if (e->len + need > RELAY_MTU) part_send(e, 0);
+}
+
+void relay_enc_init(relay_enc_t *e, uint32_t relay_id, uint8_t source,
+                    relay_send_fn send, void *arg) {
+    memset(e, 0, sizeof(*e));
+    e->relay_id = relay_id;
+    e->source   = source;
+    e->send     = send;
+    e->arg      = arg;
+}
+
+void relay_enc_begin(relay_enc_t *e, uint32_t seq, uint64_t ts_ns) {
+    e->seq   = seq;
+    e->ts_ns = ts_ns;
+    e->part  = 0;
+    part_begin(e);
+}
+
+static int varint_len(uint64_t v) {
+    int n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// As many of h's nonzero buckets as fit in each datagram, from bucket b on.
+static void enc_hist(relay_enc_t *e, int lane, int jitter, const hist_t *h) {
+    uint32_t b = 0;
+    while (b < HIST_BUCKETS) {
+        while (b < HIST_BUCKETS && !h->counts[b]) b++;
+        if (b == HIST_BUCKETS) break;
+        reserve(e, HIST_HDR_MAX + HIST_PAIR_MAX);
+
+        uint8_t pairs[RELAY_MTU];
+        size_t  room = RELAY_MTU - e->len - HIST_HDR_MAX, used = 0;
+        uint32_t n = 0, prev = 0;
+        for (; b < HIST_BUCKETS; b++) {
+            uint32_t count = h->counts[b];
+            if (!count) continue;
+            if (used + (size_t)varint_len(b - prev) + (size_t)varint_len(count) > room) break;
+            used = (size_t)(put_varint(put_varint(pairs + used, b - prev), count) - pairs);
+            prev = b;
+            n++;
+        }
+        uint8_t *p = e->buf + e->len;
+        *p++ = REC_HIST;
+        *p++ = (uint8_t)(lane << 1 | jitter);
+        p = put_varint(p, h->max);
+        p = put_varint(p, n);
+        memcpy(p, pairs, used);
+        e->len = (size_t)(p + used - e->buf);
+    }
+}
+
+void relay_enc_lane(relay_enc_t *e, int lane, const relay_lane_t *l) {
+    reserve(e, REC_MAX);
+    uint8_t *p = e->buf + e->len;
+    *p++ = REC_LANE;
+    *p++ = (uint8_t)lane;
+    p = put_varint(p, l->clients);
+    p = put_varint(p, l->metrics);
+    p = put_varint(p, l->losses);
+    p = put_varint(p, l->switches);
+    e->len = (size_t)(p - e->buf);
+    enc_hist(e, lane, 0, &l->rtt);
+    enc_hist(e, lane, 1, &l->jitter);
+}
+
+void relay_enc_client(relay_enc_t *e, const relay_client_t *c) {
+    reserve(e, REC_MAX);
+    uint8_t *p = e->buf + e->len;
+    *p++ = REC_CLIENT;
+    p = put_varint(p, zigzag((int64_t)c->pid - (int64_t)e->prev_pid));
+    *p++ = c->lane;
+    p = put_varint(p, c->metrics);
+    p = put_varint(p, c->losses);
+    p = put_varint(p, c->switches);
+    p = put_varint(p, c->p50_us);
+    p = put_varint(p, c->p99_us);
+    e->len      = (size_t)(p - e->buf);
+    e->prev_pid = c->pid;
+}
+
+uint16_t relay_enc_end(relay_enc_t *e) {
+    part_send(e, 1);
+    return e->part;
+}
+
+// ——— Decoding ———
+
+int relay_decode(const void *dgram, size_t n, const relay_visitor_t *v, void *arg) {
+    const wire_summary_t *s = dgram;
+    if (n < sizeof(*s) || n - sizeof(*s) < le32toh(s->body_len)) goto bad;
+    const uint8_t *p   = (const uint8_t *)dgram + sizeof(*s);
+    const uint8_t *end = p + le32toh(s->body_len);
+    uint32_t prev_pid  = 0;
+
+    while (p < end) {
+        uint8_t tag = *p++;
+        uint64_t x[6];
+        if (tag == REC_LANE) {
+            if (p >= end || *p >= WIRE_LANES) goto bad;
+            int lane = *p++;
+            for (int i = 0; i < 4; i++)
+                if (!(p = get_varint(p, end, &x[i]))) goto bad;
+            relay_lane_t l;
+            memset(&l, 0, sizeof(l));
+            l.clients  = (uint32_t)x[0];
+            l.metrics  = x[1];
+            l.losses   = x[2];
+            l.switches = x[3];
+            if (v->lane) v->lane(arg, lane, &l);
+        } else if (tag == REC_HIST) {
+            if (p >= end || (*p >> 1) >= WIRE_LANES) goto bad;
+            int lane = *p >> 1, jitter = *p & 1;
+            p++;
+            if (!(p = get_varint(p, end, &x[0])) || !(p = get_varint(p, end, &x[1]))) goto bad;
+            hist_t h;
+            hist_reset(&h);
+            h.max = x[0];
+            uint64_t b = 0;
+            for (uint64_t i = 0; i < x[1]; i++) {
+                if (!(p = get_varint(p, end, &x[2])) || !(p = get_varint(p, end, &x[3]))) goto bad;
+                b += x[2];
+                if (b >= HIST_BUCKETS) goto bad;
+                h.counts[b] += (uint32_t)x[3];
+                h.total     += x[3];
+            }
+            if (v->hist) v->hist(arg, lane, jitter, &h);
+        } else if (tag == REC_CLIENT) {
+            if (!(p = get_varint(p, end, &x[0])) || p >= end) goto bad;
+            relay_client_t c;
+            c.pid  = (uint32_t)((int64_t)prev_pid + unzigzag(x[0]));
+            c.lane = *p++;
+            if (c.lane >= WIRE_LANES) goto bad;
+            for (int i = 1; i < 6; i++)
+                if (!(p = get_varint(p, end, &x[i]))) goto bad;
+            c.metrics  = (uint32_t)x[1];
+            c.losses   = (uint32_t)x[2];
+            c.switches = (uint32_t)x[3];
+            c.p50_us   = (uint32_t)x[4];
+            c.p99_us   = (uint32_t)x[5];
+            prev_pid = c.pid;
+            if (v->client) v->client(arg, &c);
+        } else {
+            goto bad;
+        }
+    }
+    return 0;
+bad:
+    errno = EPROTO;
+    return -1;
+}
+
+// ——— Sources ———
+
+relay_source_t *relay_source_get(relay_sources_t *t, uint32_t relay_id, uint8_t source,
+                                 const struct sockaddr_in *addr, uint64_t idle_cutoff_ns) {
+    relay_source_t *spare = NULL;
+    for (int i = 0; i < RELAY_MAX_SOURCES; i++) {
+        relay_source_t *s = &t->s[i];
+        if (s->in_use && s->relay_id == relay_id && s->source == source) {
+            s->addr = *addr;   // a restarted relay may come from a new port
+            return s;
+        }
+        if (!spare && (!s->in_use || s->last_seen_ns < idle_cutoff_ns)) spare = s;
+    }
+    if (!spare) return NULL;
+    memset(spare, 0, sizeof(*spare));
+    spare->in_use   = 1;
+    spare->relay_id = relay_id;
+    spare->source   = source;
+    spare->addr     = *addr;
+    return spare;
+}
+
+int relay_source_part(relay_source_t *s, uint32_t seq, uint16_t part, int last,
+                      uint64_t now_ns) {
+    uint32_t missing = 0;
+    if (!s->started) {
+        missing = part;
+    } else if (seq == s->seq) {
+        if (s->complete || part < s->next_part) return -1;
+        missing = (uint32_t)(part - s->next_part);
+    } else if ((int32_t)(seq - s->seq) > 0) {
+        if (!s->complete) missing++;                   // the tail of the one before
+        missing += seq - s->seq - 1 + part;            // whole summaries, then parts of this one
+    } else if (seq == 1) {
+        missing = part;                                // the relay restarted
+    } else {
+        return -1;
+    }
+    s->started      = 1;
+    s->seq          = seq;
+    s->complete     = last;
+    s->next_part    = (uint16_t)(part + 1);
+    s->last_seen_ns = now_ns;
+    s->lost_parts  += missing;
+    if (last) s->summaries++;
+    return (int)missing;
+}
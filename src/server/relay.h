@@ -0,0 +1,122 @@
+// relay.h
+// Summaries a relay server (udp-monitor-server --upstream) sends to the
+// server above it, and how that server keeps track of its relays.
+//
+// A relay serves its own clients as usual. Every --summary-ms each of its
+// workers sums up what happened in its shard since the last summary: per
+// lane the METRICs, those reporting loss and the switches, the clients on it and
+// histograms of the reported RTTs and jitters; per client that reported
+// since, its lane, the same counts and its latest percentiles. The summary
+// goes up as WIRE_SUMMARY datagrams of at most RELAY_MTU bytes. Lane
+// records lead, then the clients in pid order. Every number is a varint,
+// pids are delta coded within a datagram, and a histogram lists only its
+// nonzero buckets as (gap, count) pairs, split over datagrams if need be.
+// No record spans two datagrams, so each decodes on its own and a lost one
+// only takes its own records with it.
+//
+// The encoder holds one datagram; full ones are handed to a callback, so a
+// summary of any size is sent with fixed memory.
+
+#ifndef UDPMON_RELAY_H
+#define UDPMON_RELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "common/histogram.h"
+#include "common/wire.h"
+
+#define RELAY_MTU          1400
+#define RELAY_MAX_SOURCES  64     // relay workers one server worker tracks
+#define RELAY_IDLE_MS      30000  // a relay silent this long gives up its slot
+
+typedef struct {
+    uint32_t clients;                  // on the lane when the summary was built
+    uint64_t metrics, losses, switches;  // since the previous summary (losses: METRICs reporting loss)
+    hist_t   rtt, jitter;              // microseconds, since the previous summary
+} relay_lane_t;
+
+typedef struct {
+    uint32_t pid;
+    uint8_t  lane;
+    uint32_t metrics, losses, switches;  // since the previous summary
+    uint32_t p50_us, p99_us;
+} relay_client_t;
+
+// ——— Encoding ———
+
+typedef void (*relay_send_fn)(const void *dgram, size_t len, void *arg);
+
+typedef struct {
+    _Alignas(8) uint8_t buf[RELAY_MTU];
+    size_t        len;
+    uint32_t      relay_id, seq;
+    uint8_t       source;
+    uint16_t      part;
+    uint32_t      prev_pid;
+    uint64_t      ts_ns;
+    relay_send_fn send;
+    void         *arg;
+} relay_enc_t;
+
+void relay_enc_init(relay_enc_t *e, uint32_t relay_id, uint8_t source,
+                    relay_send_fn send, void *arg);
+// Start summary seq, stamped ts_ns.
+void relay_enc_begin(relay_enc_t *e, uint32_t seq, uint64_t ts_ns);
+void relay_enc_lane(relay_enc_t *e, int lane, const relay_lane_t *l);
+void relay_enc_client(relay_enc_t *e, const relay_client_t *c);
+// Send the last datagram, marked last. Returns the summary's datagram count.
+uint16_t relay_enc_end(relay_enc_t *e);
+
+// ——— Decoding ———
+
+typedef struct {
+    // a lane record; l's histograms are empty, they arrive through hist()
+    void (*lane)(void *arg, int lane, const relay_lane_t *l);
+    // part of a lane's RTT (jitter = 0) or jitter histogram
+    void (*hist)(void *arg, int lane, int jitter, const hist_t *h);
+    void (*client)(void *arg, const relay_client_t *c);
+} relay_visitor_t;
+
+// Decode one WIRE_SUMMARY datagram, calling v's functions (any may be NULL)
+// for its records in order. Returns 0, or -1 with errno EPROTO if it is
+// damaged; records before the damage have been visited.
+int relay_decode(const void *dgram, size_t n, const relay_visitor_t *v, void *arg);
+
+// ——— Sources ———
+// A server worker's view of the relay workers sending to it, in a fixed
+// table; a relay silent for RELAY_IDLE_MS gives up its slot, whether or not
+// clients are evicted (a restarted relay usually comes back under a new id).
+
+typedef struct {
+    uint32_t relay_id;
+    uint8_t  source;
+    int      in_use;
+    struct sockaddr_in addr;
+    int      started;                  // seq holds a summary seen
+    int      complete;                 // its last datagram has arrived
+    uint32_t seq;                      // newest summary seen
+    uint16_t next_part;                // its part expected next
+    uint64_t last_seen_ns;
+    uint64_t summaries, lost_parts;
+    uint64_t metrics, losses, switches;  // totals over all summaries
+    uint32_t clients[WIRE_LANES];      // as of the newest summary
+} relay_source_t;
+
+typedef struct {
+    relay_source_t s[RELAY_MAX_SOURCES];
+} relay_sources_t;
+
+// The entry for (relay_id, source), taking a free slot or one idle since
+// before idle_cutoff_ns if it is new. NULL when the table is full.
+relay_source_t *relay_source_get(relay_sources_t *t, uint32_t relay_id, uint8_t source,
+                                 const struct sockaddr_in *addr, uint64_t idle_cutoff_ns);
+// Account for datagram (seq, part) from s. Returns how many datagrams went
+// missing before it (added to s->lost_parts too), where a summary whose
+// last datagram never came counts as one, or -1 for a datagram already
+// seen or older than the newest summary, which should be dropped.
+int relay_source_part(relay_source_t *s, uint32_t seq, uint16_t part, int last,
+                      uint64_t now_ns);
+
+#endif
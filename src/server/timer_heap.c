@@ -0,0 +1,87 @@
+// timer_heap.c
+// Min-heap of pending timers (see timer_heap.h).
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "timer_heap.h"
+
+uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int ent_before(const timer_ent_t *a, const timer_ent_t *b) {
+    if (a->due_ns != b->due_ns) return a->due_ns < b->due_ns;
+    return a->order < b->order;
+}
+
+static void sift_up(timer_heap_t *h, size_t i) {
+    timer_ent_t e = h->ents[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!ent_before(&e, &h->ents[parent])) break;
+        h->ents[i] = h->ents[parent];
+        i = parent;
+    }
+    h->ents[i] = e;
+}
+
+static void sift_down(timer_heap_t *h, size_t i) {
+    timer_ent_t e = h->ents[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->len) break;
+        if (child + 1 < h->len && ent_before(&h->ents[child + 1], &h->ents[child]))
+            child++;
+        if (!ent_before(&h->ents[child], &e)) break;
+        h->ents[i] = h->ents[child];
+        i = child;
+    }
+    h->ents[i] = e;
+}
+
+int timer_heap_push(timer_heap_t *h, uint64_t due_ns, timer_fn fn, void *arg) {
+    if (h->len == h->cap) {
+        size_t ncap = h->cap ? h->cap * 2 : 64;
+        timer_ent_t *n = realloc(h->ents, ncap * sizeof(*n));
+        if (!n) return -1;
+        h->ents = n;
+        h->cap  = ncap;
+    }
+    h->ents[h->len] = (timer_ent_t){
+        .due_ns = due_ns,
+        .order  = h->next_order++,
+        .fn     = fn,
+        .arg    = arg
+    };
+    sift_up(h, h->len++);
+    return 0;
+}
+
+size_t timer_heap_run_due(timer_heap_t *h, uint64_t now_ns) {
+    size_t fired = 0;
+    while (h->len > 0 && h->ents[0].due_ns <= now_ns) {
+        timer_ent_t e = h->ents[0];
+        h->ents[0] = h->ents[--h->len];
+        if (h->len > 0) sift_down(h, 0);
+        // pop before firing so the callback may schedule new timers
+        e.fn(e.arg);
+        fired++;
+    }
+    return fired;
+}
+
+int timer_heap_timeout_ms(const timer_heap_t *h, uint64_t now_ns) {
+    if (h->len == 0) return -1;
+    uint64_t due = h->ents[0].due_ns;
+    if (due <= now_ns) return 0;
+    uint64_t ms = (due - now_ns + 999999) / 1000000;
+    return ms > 0x7fffffff ? 0x7fffffff : (int)ms;
+}
+
+void timer_heap_free(timer_heap_t *h) {
+    free(h->ents);
+    *h = (timer_heap_t){0};
+}
@@ -0,0 +1,42 @@
+// timer_heap.h
+// Binary min-heap of one-shot timers keyed on a CLOCK_MONOTONIC deadline.
+// The event loop asks for the time until the earliest deadline, waits at most
+// that long for packets, then fires everything that has come due.
+
+#ifndef UDPMON_TIMER_HEAP_H
+#define UDPMON_TIMER_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*timer_fn)(void *arg);
+
+typedef struct {
+    uint64_t due_ns;
+    uint64_t order;     // insertion counter: equal deadlines fire FIFO
+    timer_fn fn;
+    void    *arg;
+} timer_ent_t;
+
+typedef struct {
+    timer_ent_t *ents;
+    size_t       len, cap;
+    uint64_t     next_order;
+} timer_heap_t;
+
+uint64_t get_now_ns(void);
+
+// Schedule fn(arg) at due_ns. Returns 0, or -1 if the heap cannot grow.
+int    timer_heap_push(timer_heap_t *h, uint64_t due_ns, timer_fn fn, void *arg);
+
+// Fire every timer with due_ns <= now_ns. Returns how many fired.
+size_t timer_heap_run_due(timer_heap_t *h, uint64_t now_ns);
+
+// Milliseconds until the earliest deadline (rounded up), 0 if one is already
+// due, or -1 if the heap is empty (wait forever).
+int    timer_heap_timeout_ms(const timer_heap_t *h, uint64_t now_ns);
+
+// Drop all pending timers without firing them.
+void   timer_heap_free(timer_heap_t *h);
+
+#endif
@@ -0,0 +1,185 @@
+// uring.c
+// io_uring setup and submission on raw syscalls (see uring.h).
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+                     unsigned flags, const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, const void *arg, unsigned nargs) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+static int map_rings(uring_t *r, const struct io_uring_params *p) {
+    r->sq_len   = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    r->cq_len   = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    int single  = (p->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cq_len > r->sq_len) r->sq_len = r->cq_len;
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) return -1;
+    r->cq_ptr = single ? r->sq_ptr
+              : mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) return -1;
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) return -1;
+
+    char *sq = r->sq_ptr, *cq = r->cq_ptr;
+    r->sq_head    = (unsigned *)(sq + p->sq_off.head);
+    r->sq_tail    = (unsigned *)(sq + p->sq_off.tail);
+    r->sq_mask    = (unsigned *)(sq + p->sq_off.ring_mask);
+    r->sq_array   = (unsigned *)(sq + p->sq_off.array);
+    r->cq_head    = (unsigned *)(cq + p->cq_off.head);
+    r->cq_tail    = (unsigned *)(cq + p->cq_off.tail);
+    r->cq_mask    = (unsigned *)(cq + p->cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    r->sq_entries = p->sq_entries;
+    r->cq_entries = p->cq_entries;
+    r->sq_local_tail = *r->sq_tail;
+    // SQEs are used in ring order, so the indirection array is the identity
+    for (unsigned i = 0; i < r->sq_entries; i++) r->sq_array[i] = i;
+    return 0;
+}
+
+int uring_init(uring_t *r, unsigned entries) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    // Multishot receives can post many completions per submission, so the
+    // CQ gets extra room. Newer flags cut task-work interrupts on a ring that
+    // only its own thread ever touches; older kernels reject them, so retry
+    // with fewer.
+    static const unsigned flag_sets[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN,
+        IORING_SETUP_CQSIZE,
+    };
+    struct io_uring_params p;
+    int fd = -1;
+    for (size_t i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]) && fd < 0; i++) {
+        memset(&p, 0, sizeof(p));
+        p.flags      = flag_sets[i];
+        p.cq_entries = entries * 4;
+        fd = sys_setup(entries, &p);
+        if (fd < 0 && errno != EINVAL) return -1;
+    }
+    if (fd < 0) return -1;
+    r->fd = fd;
+
+    if (map_rings(r, &p) < 0) {
+        int err = errno;
+        uring_free(r);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void uring_free(uring_t *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED) munmap(r->sq_ptr, r->sq_len);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sq_local_tail - head >= r->sq_entries) return NULL;
+    struct io_uring_sqe *sqe = &r->sqes[r->sq_local_tail & *r->sq_mask];
+    r->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Publish prepared SQEs; returns how many the kernel has not consumed yet.
+static unsigned publish(uring_t *r) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    return r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_submit(uring_t *r) {
+    unsigned n = publish(r);
+    if (n == 0) return 0;
+    int ret = sys_enter(r->fd, n, 0, 0, NULL, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+int uring_submit_wait(uring_t *r, int timeout_ms) {
+    unsigned n = publish(r);
+    int ret;
+    if (timeout_ms < 0) {
+        ret = sys_enter(r->fd, n, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    } else {
+        struct __kernel_timespec ts = {
+            .tv_sec  = timeout_ms / 1000,
+            .tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL
+        };
+        struct io_uring_getevents_arg arg = { .ts = (uint64_t)(uintptr_t)&ts };
+        ret = sys_enter(r->fd, n, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                        &arg, sizeof(arg));
+    }
+    return ret < 0 ? -errno : ret;
+}
+
+int uring_bufs_init(uring_t *r, uring_bufs_t *b, uint16_t bgid, uint16_t count, uint32_t size) {
+    memset(b, 0, sizeof(*b));
+    long page = sysconf(_SC_PAGESIZE);
+    b->br_len = ((size_t)count * sizeof(struct io_uring_buf) + (size_t)page - 1)
+              / (size_t)page * (size_t)page;
+    b->br = mmap(NULL, b->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->br == MAP_FAILED) {
+        b->br = NULL;
+        return -1;
+    }
+    b->mem = malloc((size_t)count * size);
+    if (!b->mem) {
+        uring_bufs_free(r, b);
+        return -1;
+    }
+    struct io_uring_buf_reg reg = {
+        .ring_addr    = (uint64_t)(uintptr_t)b->br,
+        .ring_entries = count,
+        .bgid         = bgid
+    };
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int err = errno;
+        uring_bufs_free(r, b);
+        errno = err;
+        return -1;
+    }
+    b->size  = size;
+    b->count = count;
+    b->mask  = (uint16_t)(count - 1);
+    b->bgid  = bgid;
+    for (uint16_t i = 0; i < count; i++) uring_bufs_recycle(b, i);
+    return 0;
+}
+
+void uring_bufs_free(uring_t *r, uring_bufs_t *b) {
+    if (b->count) {
+        struct io_uring_buf_reg reg = { .bgid = b->bgid };
+        sys_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (b->br) munmap(b->br, b->br_len);
+    free(b->mem);
+    memset(b, 0, sizeof(*b));
+}
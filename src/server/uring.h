@@ -0,0 +1,77 @@
+// uring.h
+// Minimal io_uring plumbing on raw syscalls (no liburing): ring setup and
+// mapping, SQE/CQE access, and a provided-buffer ring the kernel picks
+// receive buffers from. Only what the server's packet loop needs; the
+// opcodes themselves are prepared by the caller.
+
+#ifndef UDPMON_URING_H
+#define UDPMON_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries, cq_entries;
+    unsigned sq_local_tail;      // SQEs handed out, published on submit
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void    *sq_ptr, *cq_ptr;
+    size_t   sq_len, cq_len, sqes_len;
+} uring_t;
+
+typedef struct {
+    struct io_uring_buf_ring *br;
+    size_t   br_len;
+    char    *mem;                // count buffers of size bytes each
+    uint32_t size;
+    uint16_t count, mask, bgid;
+    uint16_t tail;
+} uring_bufs_t;
+
+// Returns 0, or -1 with errno set when io_uring is unavailable.
+int  uring_init(uring_t *r, unsigned entries);
+void uring_free(uring_t *r);
+
+// A zeroed SQE, or NULL when the submission queue is full (submit first).
+struct io_uring_sqe *uring_get_sqe(uring_t *r);
+
+// Submit everything prepared so far without waiting.
+int  uring_submit(uring_t *r);
+// Submit and wait for at least one completion, at most timeout_ms (-1: no
+// limit). Returns the number submitted or -errno (-ETIME on timeout).
+int  uring_submit_wait(uring_t *r, int timeout_ms);
+
+static inline struct io_uring_cqe *uring_peek_cqe(uring_t *r) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &r->cqes[head & *r->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring_t *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// Register count (a power of two) buffers of size bytes as buffer group
+// bgid and hand them all to the kernel.
+int  uring_bufs_init(uring_t *r, uring_bufs_t *b, uint16_t bgid, uint16_t count, uint32_t size);
+void uring_bufs_free(uring_t *r, uring_bufs_t *b);
+
+static inline char *uring_buf(const uring_bufs_t *b, uint16_t bid) {
+    return b->mem + (size_t)bid * b->size;
+}
+
+// Give buffer bid back to the kernel.
+static inline void uring_bufs_recycle(uring_bufs_t *b, uint16_t bid) {
+    struct io_uring_buf *e = &b->br->bufs[b->tail & b->mask];
+    e->addr = (uint64_t)(uintptr_t)uring_buf(b, bid);
+    e->len  = b->size;
+    e->bid  = bid;
+    b->tail++;
+    __atomic_store_n(&b->br->tail, b->tail, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,298 @@
+// udp-monitor-top
+// Live view of a running server's lanes and clients, read straight from the
+// shared-memory export (udp-monitor-server --shm NAME). The server is never
+// contacted: every refresh is a handful of seqlocked copies out of the
+// mapping, so this can poll as fast as a dashboard wants.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <arpa/inet.h>
+
+#include "common/histogram.h"
+#include "common/shm_table.h"
+
+static const char *LANE_NAMES[3] = { "green", "yellow", "red" };
+
+volatile sig_atomic_t STOP = 0;
+
+void on_stop_signal(int sig) {
+    (void)sig;
+    STOP = 1;
+}
+
+uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef enum { SORT_P99, SORT_LOSS, SORT_LANE, SORT_SWITCHES, SORT_PID } sort_key_t;
+
+typedef struct {
+    shm_client_t rec;
+    uint32_t     worker;
+} row_t;
+
+static sort_key_t SORT = SORT_P99;
+
+static double loss_pct(const shm_client_t *c) {
+    return c->metrics ? 100.0 * (double)c->losses / (double)c->metrics : 0.0;
+}
+
+// worst first, ties broken by pid so the order is stable between refreshes
+int cmp_rows(const void *a, const void *b) {
+    const shm_client_t *x = &((const row_t *)a)->rec, *y = &((const row_t *)b)->rec;
+    double dx = 0, dy = 0;
+    switch (SORT) {
+        case SORT_P99:      dx = (double)x->rtt_pcts[1]; dy = (double)y->rtt_pcts[1]; break;
+        case SORT_LOSS:     dx = loss_pct(x);            dy = loss_pct(y);            break;
+        case SORT_LANE:     dx = x->lane;                dy = y->lane;                break;
+        case SORT_SWITCHES: dx = x->switches;            dy = y->switches;            break;
+        case SORT_PID:      break;
+    }
+    if (dx != dy) return dx < dy ? 1 : -1;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+// ——— Snapshot ———
+// Consistent per record, not across records: each worker publishes on its
+// own clock, and a record that stays busy for every retry is skipped.
+typedef struct {
+    shm_header_t hdr;
+    uint32_t     nworkers;
+    uint64_t     clients, rx_packets, pings, metrics, lane_switches, chaos_drops;
+    uint64_t     oldest_publish_ns;
+    uint32_t     overflow;
+    hist_t       lane_rtt[3], lane_jitter[3];
+    uint32_t     lane_clients[3];
+    row_t       *rows;
+    size_t       nrows, cap;
+} snapshot_t;
+
+static shm_worker_t wbuf;   // ~19 KB of lane histograms, kept off the stack
+
+int take_snapshot(const shm_table_t *t, snapshot_t *s) {
+    s->hdr = *shm_header(t);
+    s->nworkers = s->hdr.nworkers;
+    s->clients = s->rx_packets = s->pings = s->metrics = s->lane_switches = s->chaos_drops = 0;
+    s->oldest_publish_ns = UINT64_MAX;
+    s->overflow = 0;
+    s->nrows = 0;
+    for (int lane = 0; lane < 3; lane++) {
+        hist_reset(&s->lane_rtt[lane]);
+        hist_reset(&s->lane_jitter[lane]);
+        s->lane_clients[lane] = 0;
+    }
+
+    for (uint32_t w = 0; w < s->nworkers; w++) {
+        if (shm_read(shm_worker(t, w), &wbuf, sizeof(wbuf)) < 0) continue;
+        s->clients       += wbuf.clients;
+        s->rx_packets    += wbuf.rx_packets;
+        s->pings         += wbuf.pings;
+        s->metrics       += wbuf.metrics;
+        s->lane_switches += wbuf.lane_switches;
+        s->chaos_drops   += wbuf.chaos_drops;
+        s->overflow      += wbuf.overflow;
+        if (wbuf.publish_ns && wbuf.publish_ns < s->oldest_publish_ns)
+            s->oldest_publish_ns = wbuf.publish_ns;
+        for (int lane = 0; lane < 3; lane++) {
+            hist_merge(&s->lane_rtt[lane], &wbuf.lane_rtt[lane]);
+            hist_merge(&s->lane_jitter[lane], &wbuf.lane_jitter[lane]);
+        }
+
+        uint32_t used = wbuf.slots_used < s->hdr.slots ? wbuf.slots_used : s->hdr.slots;
+        for (uint32_t i = 0; i < used; i++) {
+            if (s->nrows == s->cap) {
+                size_t ncap = s->cap ? s->cap * 2 : 256;
+                row_t *nr = realloc(s->rows, ncap * sizeof(*nr));
+                if (!nr) return -1;
+                s->rows = nr;
+                s->cap  = ncap;
+            }
+            row_t *r = &s->rows[s->nrows];
+            if (shm_read(shm_client(t, w, i), &r->rec, sizeof(r->rec)) < 0) continue;
+            if (!r->rec.in_use) continue;
+            r->worker = w;
+            if (r->rec.lane < 3) s->lane_clients[r->rec.lane]++;
+            s->nrows++;
+        }
+    }
+    qsort(s->rows, s->nrows, sizeof(*s->rows), cmp_rows);
+    return 0;
+}
+
+// ——— Output ———
+
+static void lane_pcts(const hist_t *h, uint64_t out[2]) {
+    static const double pct[2] = { 50.0, 99.0 };
+    hist_percentiles(&h, 1, pct, out, 2);
+}
+
+void print_text(const snapshot_t *s, size_t limit, int clear) {
+    uint64_t now_ns = get_now_ns();
+    int64_t  now_ms = (int64_t)(now_ns / 1000000ull);
+    if (clear) fputs("\033[H\033[2J", stdout);
+
+    double age = s->oldest_publish_ns != UINT64_MAX && now_ns > s->oldest_publish_ns
+               ? (double)(now_ns - s->oldest_publish_ns) / 1e9 : 0.0;
+    printf("udp-monitor-top  server pid %d  up %.0fs  workers %u  clients %" PRIu64
+           "  rx %" PRIu64 "  metrics %" PRIu64 "  switches %" PRIu64 "  (data %.1fs old)\n",
+           s->hdr.server_pid, (double)(now_ns - s->hdr.start_ns) / 1e9, s->nworkers,
+           s->clients, s->rx_packets, s->metrics, s->lane_switches, age);
+    if (s->overflow)
+        printf("  %u clients beyond the export's %u slots per worker are not shown\n",
+               s->overflow, s->hdr.slots);
+
+    printf("\n%-7s %6s %8s %10s %10s %10s %10s\n",
+           "LANE", "PORT", "CLIENTS", "RTT_P50", "RTT_P99", "JIT_P50", "JIT_P99");
+    for (int lane = 0; lane < 3; lane++) {
+        uint64_t r[2], j[2];
+        lane_pcts(&s->lane_rtt[lane], r);
+        lane_pcts(&s->lane_jitter[lane], j);
+        printf("%-7s %6u %8u %10.2f %10.2f %10.2f %10.2f\n",
+               LANE_NAMES[lane], s->hdr.lane_ports[lane], s->lane_clients[lane],
+               r[0] / 1000.0, r[1] / 1000.0, j[0] / 1000.0, j[1] / 1000.0);
+    }
+
+    printf("\n%-8s %3s %-21s %-6s %-8s %9s %9s %9s %8s %7s %6s %4s %6s %6s\n",
+           "PID", "WRK", "ADDR", "LANE", "L/S/J", "P50", "P99", "P99.9",
+           "JITTER", "SAMPLES", "LOSS%", "SW", "COOL", "SEEN");
+    size_t n = limit && limit < s->nrows ? limit : s->nrows;
+    for (size_t i = 0; i < n; i++) {
+        const shm_client_t *c = &s->rows[i].rec;
+        char addr[32], ip[INET_ADDRSTRLEN], lss[16];
+        struct in_addr a = { .s_addr = c->ip };
+        inet_ntop(AF_INET, &a, ip, sizeof(ip));
+        snprintf(addr, sizeof(addr), "%s:%u", ip, c->port);
+        snprintf(lss, sizeof(lss), "%d/%d/%d", c->loss_streak, c->slow_streak, c->jitter_streak);
+        double cool = c->cooldown_until_ms > now_ms ? (double)(c->cooldown_until_ms - now_ms) / 1000.0 : 0.0;
+        double seen = now_ns > c->last_seen_ns ? (double)(now_ns - c->last_seen_ns) / 1e9 : 0.0;
+        printf("%-8d %3u %-21s %-6s %-8s %9.2f %9.2f %9.2f %8.2f %7u %6.1f %4u %6.1f %6.1f\n",
+               c->pid, s->rows[i].worker, addr, c->lane < 3 ? LANE_NAMES[c->lane] : "?", lss,
+               c->rtt_pcts[0] / 1000.0, c->rtt_pcts[1] / 1000.0, c->rtt_pcts[2] / 1000.0,
+               c->rfc_jitter, c->samples, loss_pct(c), c->switches, cool, seen);
+    }
+    if (n < s->nrows) printf("... %zu more\n", s->nrows - n);
+    fflush(stdout);
+}
+
+void print_json(const snapshot_t *s, size_t limit) {
+    uint64_t now_ns = get_now_ns();
+    int64_t  now_ms = (int64_t)(now_ns / 1000000ull);
+    printf("{\"timestamp\":\"%ld\",\"component\":\"top\",\"event\":\"snapshot\",\"server_pid\":%d,\"workers\":%u,\"clients\":%" PRIu64 ",\"rx_packets\":%" PRIu64 ",\"metrics\":%" PRIu64 ",\"lane_switches\":%" PRIu64 ",\"overflow\":%u,\"lanes\":[",
+           time(NULL), s->hdr.server_pid, s->nworkers, s->clients, s->rx_packets,
+           s->metrics, s->lane_switches, s->overflow);
+    for (int lane = 0; lane < 3; lane++) {
+        uint64_t r[2], j[2];
+        lane_pcts(&s->lane_rtt[lane], r);
+        lane_pcts(&s->lane_jitter[lane], j);
+        printf("%s{\"lane\":%d,\"port\":%u,\"clients\":%u,\"rtt_p50\":%.2f,\"rtt_p99\":%.2f,\"jitter_p50\":%.2f,\"jitter_p99\":%.2f}",
+               lane ? "," : "", lane, s->hdr.lane_ports[lane], s->lane_clients[lane],
+               r[0] / 1000.0, r[1] / 1000.0, j[0] / 1000.0, j[1] / 1000.0);
+    }
+    fputs("],\"client_list\":[", stdout);
+    size_t n = limit && limit < s->nrows ? limit : s->nrows;
+    for (size_t i = 0; i < n; i++) {
+        const shm_client_t *c = &s->rows[i].rec;
+        char ip[INET_ADDRSTRLEN];
+        struct in_addr a = { .s_addr = c->ip };
+        inet_ntop(AF_INET, &a, ip, sizeof(ip));
+        long cool_ms = c->cooldown_until_ms > now_ms ? (long)(c->cooldown_until_ms - now_ms) : 0;
+        printf("%s{\"pid\":%d,\"worker\":%u,\"client_index\":%u,\"addr\":\"%s:%u\",\"current_lane\":%u,\"loss_streak\":%d,\"slow_streak\":%d,\"jitter_streak\":%d,\"rtt_p50\":%.2f,\"rtt_p99\":%.2f,\"rtt_p999\":%.2f,\"rtt_mean\":%.2f,\"rtt_min\":%.2f,\"rtt_max\":%.2f,\"last_rtt\":%.2f,\"rfc_jitter\":%.2f,\"samples\":%u,\"metrics\":%" PRIu64 ",\"losses\":%" PRIu64 ",\"switches\":%u,\"cooldown_ms\":%ld,\"idle_ms\":%" PRIu64 "}",
+               i ? "," : "", c->pid, s->rows[i].worker, c->index, ip, c->port, c->lane,
+               c->loss_streak, c->slow_streak, c->jitter_streak,
+               c->rtt_pcts[0] / 1000.0, c->rtt_pcts[1] / 1000.0, c->rtt_pcts[2] / 1000.0,
+               c->rtt_mean, c->rtt_min, c->rtt_max, c->last_rtt, c->rfc_jitter, c->samples,
+               c->metrics, c->losses, c->switches, cool_ms,
+               now_ns > c->last_seen_ns ? (now_ns - c->last_seen_ns) / 1000000u : 0);
+    }
+    fputs("]}\n", stdout);
+    fflush(stdout);
+}
+
+// The server is gone (or was restarted with a fresh object) when its pid no
+// longer answers signal 0.
+static int server_alive(const shm_table_t *t) {
+    return kill(shm_header(t)->server_pid, 0) == 0 || errno == EPERM;
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = SHM_DEFAULT_NAME;
+    int interval_ms = 1000;
+    int once = 0, json = 0;
+    size_t limit = 20;
+
+    static struct option long_opts[] = {
+        {"shm",         required_argument, 0, 's'},
+        {"interval-ms", required_argument, 0, 'i'},
+        {"limit",       required_argument, 0, 'n'},
+        {"sort",        required_argument, 0, 'o'},
+        {"once",        no_argument,       0, '1'},
+        {"json",        no_argument,       0, 'j'},
+        {"help",        no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:i:n:o:1jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 's': name        = optarg; break;
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'n': limit       = (size_t)strtoul(optarg, NULL, 10); break;
+            case '1': once        = 1; break;
+            case 'j': json        = 1; break;
+            case 'o':
+                if      (strcmp(optarg, "p99") == 0)      SORT = SORT_P99;
+                else if (strcmp(optarg, "loss") == 0)     SORT = SORT_LOSS;
+                else if (strcmp(optarg, "lane") == 0)     SORT = SORT_LANE;
+                else if (strcmp(optarg, "switches") == 0) SORT = SORT_SWITCHES;
+                else if (strcmp(optarg, "pid") == 0)      SORT = SORT_PID;
+                else fprintf(stderr, "ignoring bad --sort '%s'\n", optarg);
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s [--shm NAME] [--interval-ms MS] [--limit N] "
+                       "[--sort p99|loss|lane|switches|pid] [--once] [--json]\n", argv[0]);
+                return (opt=='h') ? 0 : 2;
+        }
+    }
+    if (interval_ms < 1) interval_ms = 1;
+
+    signal(SIGINT,  on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+
+    shm_table_t t = {0};
+    snapshot_t  s = {0};
+    int warned = 0;
+    while (!STOP) {
+        if (t.base && !server_alive(&t)) shm_table_close(&t);
+        if (!t.base && shm_table_open(&t, name) < 0) {
+            if (once) {
+                fprintf(stderr, "udp-monitor-top: cannot open /dev/shm%s%s: %s\n",
+                        name[0] == '/' ? "" : "/", name, strerror(errno));
+                return 1;
+            }
+            if (!warned++) fprintf(stderr, "udp-monitor-top: waiting for a server exporting %s\n", name);
+        } else if (t.base) {
+            warned = 0;
+            if (take_snapshot(&t, &s) < 0) {
+                perror("take_snapshot");
+                return 1;
+            }
+            if (json) print_json(&s, limit);
+            else      print_text(&s, limit, !once);
+            if (once) break;
+        }
+        struct timespec d = { .tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000L };
+        nanosleep(&d, NULL);
+    }
+    shm_table_close(&t);
+    free(s.rows);
+    return 0;
+}